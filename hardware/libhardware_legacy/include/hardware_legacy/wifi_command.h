@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WIFI_COMMAND_H
+#define _WIFI_COMMAND_H
+
+#include <stddef.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/*
+ * wifi_command() runs on a pool of supplicant connections: a command is
+ * only queued behind another one once all of them are busy.  Each command
+ * is timed into a per-command latency histogram.
+ */
+
+/*
+ * Like wifi_command(), but the NUL-terminated reply goes into a pooled
+ * buffer of up to 16383 bytes instead of one the caller sizes.  A longer
+ * reply is cut short.  Hand the buffer back with wifi_release_reply(); on
+ * failure *reply is NULL.
+ */
+int wifi_command_pooled(const char *command, char **reply, size_t *reply_len);
+
+/* Return a reply from wifi_command_pooled().  NULL is ignored. */
+void wifi_release_reply(char *reply);
+
+/*
+ * Format the command latency histograms into buf, one line per command:
+ * "<name> count=<n> timeouts=<n> <1ms:<n> <2ms:<n> ... >=1024ms:<n>".
+ * Returns the length that would have been written, like snprintf().
+ */
+int wifi_get_command_stats(char *buf, size_t buflen);
+
+#if __cplusplus
+};  // extern "C"
+#endif
+
+#endif  // _WIFI_COMMAND_H
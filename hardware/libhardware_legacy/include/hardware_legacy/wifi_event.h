@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WIFI_EVENT_H
+#define _WIFI_EVENT_H
+
+#include <stddef.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+/* Supplicant events the framework acts on; everything else is OTHER. */
+enum wifi_event_type {
+    WIFI_EVENT_OTHER = 0,
+    WIFI_EVENT_CONNECTED,
+    WIFI_EVENT_DISCONNECTED,
+    WIFI_EVENT_STATE_CHANGE,
+    WIFI_EVENT_SCAN_STARTED,
+    WIFI_EVENT_SCAN_RESULTS,
+    WIFI_EVENT_BSS_ADDED,
+    WIFI_EVENT_BSS_REMOVED,
+    WIFI_EVENT_TERMINATING,
+    WIFI_EVENT_DRIVER_STATE,
+    WIFI_EVENT_LINK_SPEED,
+    WIFI_EVENT_ASSOC_REJECT,
+    WIFI_EVENT_SSID_TEMP_DISABLED,
+    WIFI_EVENT_SSID_REENABLED,
+    WIFI_EVENT_EAP,             /* any CTRL-EVENT-EAP-* */
+    WIFI_EVENT_REQUEST,         /* any CTRL-EVENT-REQ-* (identity, password...) */
+    WIFI_EVENT_IGNORE,
+    WIFI_EVENT_WPS,             /* any WPS-* */
+    WIFI_EVENT_P2P,             /* any P2P-* */
+    WIFI_EVENT_AP_STA_CONNECTED,
+    WIFI_EVENT_AP_STA_DISCONNECTED,
+};
+
+/*
+ * One event, parsed in place.  Every pointer refers into the receive
+ * buffer, which must outlive the event; spans are not NUL-terminated
+ * except for text, which runs to the end of the event.
+ *
+ *     IFNAME=<iface> <level><name> <payload>
+ */
+struct wifi_event {
+    enum wifi_event_type type;
+    int level;                  /* message level, -1 if absent */
+    const char *iface;          /* NULL if the event carries no IFNAME= */
+    size_t iface_len;
+    const char *name;           /* e.g. "CTRL-EVENT-BSS-ADDED" */
+    size_t name_len;
+    const char *payload;        /* everything after the name */
+    size_t payload_len;
+    const char *text;           /* name and payload: what wifi_wait_for_event()
+                                   returns, less its IFNAME=<iface> prefix */
+    size_t text_len;
+};
+
+/*
+ * Parse len bytes of a raw supplicant event.  Returns 0, or -1 if the event
+ * is malformed (an IFNAME= prefix without an event behind it).  A malformed
+ * event is still filled in, as the WIFI_EVENT_IGNORE event that
+ * wifi_wait_for_event() returns in its place; its spans point at a static
+ * "CTRL-EVENT-IGNORE " string instead of the buffer.
+ */
+int wifi_parse_event(const char *buf, size_t len, struct wifi_event *event);
+
+/*
+ * Block for the next event, then also take every further event already
+ * queued on the monitor socket without blocking again, up to max_events.
+ * The raw events are stored back to back in buf.  A closed connection or
+ * receive error ends the batch with a synthesized WIFI_EVENT_TERMINATING,
+ * as wifi_wait_for_event() does.  Returns the number of events filled in.
+ */
+int wifi_wait_for_events(char *buf, size_t buflen, struct wifi_event *events,
+                         int max_events);
+
+#if __cplusplus
+};  // extern "C"
+#endif
+
+#endif  // _WIFI_EVENT_H
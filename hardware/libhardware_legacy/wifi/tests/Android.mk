@@ -0,0 +1,67 @@
+# Copyright 2014 The Android Open Source Project
+#
+# Tests for wifi.c.  Each one builds wifi.c itself, to reach its statics,
+# against wifi_test_env.c: a fake property area, init and supplicant in
+# place of the real ones, so no wpa_supplicant, driver or access point is
+# involved.  They are built for the target, where libwpa_client's header
+# is installed, and run from adb shell.  The libhardware_legacy makefile
+# does not descend this far, so build them with mmm.
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := wifi_enable_timing_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	wifi_enable_timing_test.c \
+	wifi_test_env.c
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := wifi_command_latency_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	wifi_command_latency_test.c \
+	wifi_test_env.c
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := wifi_event_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	wifi_event_bench.c \
+	wifi_test_env.c
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
+# Builds wifi.c's USES_TI_MAC80211 code against the libnl headers, with a
+# fake nl80211 in place of libnl itself.
+include $(CLEAR_VARS)
+LOCAL_MODULE := wifi_phy_cache_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	wifi_phy_cache_test.c \
+	wifi_test_env.c
+LOCAL_C_INCLUDES := external/libnl-headers
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := wifi_insmod_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	wifi_insmod_test.c \
+	wifi_test_env.c
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := wifi_config_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	wifi_config_test.c \
+	wifi_test_env.c
+LOCAL_SHARED_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * wifi_command_latency_test: send commands to a fake supplicant that takes
+ * SLOW_MS over every SCAN, and check that:
+ *
+ *   - a PING sent while a SCAN is in flight does not wait for it, but gets
+ *     a connection of its own
+ *   - wifi_command_pooled() NUL-terminates the reply, cuts a long one at
+ *     16383 bytes and hands a released buffer out again
+ *   - wifi_get_command_stats() counts each command, "IFNAME=wlan0 PING"
+ *     under PING, and timeouts, and sizes its output like snprintf()
+ */
+
+#include <stdio.h>
+
+#include "wifi_test_env.h"
+#include "../wifi.c"
+
+#define SLOW_MS         200
+#define PINGS           20
+#define MAX_PING_MS     (SLOW_MS / 4)
+
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+static int supplicant(const char *cmd, char *reply, size_t *reply_len)
+{
+    const char *answer = "OK\n";
+    size_t len;
+
+    if (strcmp(cmd, "SCAN") == 0) {
+        usleep(SLOW_MS * 1000);
+    } else if (strcmp(cmd, "STATUS") == 0) {
+        return -2;
+    } else if (strcmp(cmd, "BSS RANGE=ALL") == 0) {
+        /* much more than fits */
+        len = *reply_len;
+        memset(reply, 'b', len);
+        return 0;
+    } else if (strstr(cmd, "PING") != NULL) {
+        answer = "PONG\n";
+    }
+    len = strlen(answer);
+    if (len > *reply_len)
+        len = *reply_len;
+    memcpy(reply, answer, len);
+    *reply_len = len;
+    return 0;
+}
+
+static void *scan_thread(void *arg)
+{
+    char reply[64];
+    size_t len = sizeof(reply) - 1;
+
+    if (wifi_command("SCAN", reply, &len) != 0)
+        fail("SCAN");
+    return NULL;
+}
+
+/* the stats line for name, or NULL */
+static const char *stats_line(const char *stats, const char *name)
+{
+    size_t len = strlen(name);
+    const char *line, *next;
+
+    for (line = stats; *line; line = next) {
+        if (strncmp(line, name, len) == 0 && line[len] == ' ')
+            return line;
+        next = strchr(line, '\n');
+        next = next ? next + 1 : line + strlen(line);
+    }
+    return NULL;
+}
+
+static void test_concurrency(void)
+{
+    pthread_t thread;
+    double start, ms, max_ms = 0, total_ms = 0;
+    char reply[64];
+    size_t len;
+    int i;
+
+    pthread_create(&thread, NULL, scan_thread, NULL);
+    usleep(SLOW_MS * 1000 / 10);
+    for (i = 0; i < PINGS; i++) {
+        len = sizeof(reply) - 1;
+        start = fake_now_ms();
+        if (wifi_command(i % 2 ? "IFNAME=wlan0 PING" : "PING", reply, &len) ||
+                strcmp(reply, "PONG\n") != 0)
+            fail("PING");
+        ms = fake_now_ms() - start;
+        total_ms += ms;
+        if (ms > max_ms)
+            max_ms = ms;
+    }
+    pthread_join(thread, NULL);
+
+    printf("PING during SCAN:   %.3f ms average, %.3f ms max\n",
+           total_ms / PINGS, max_ms);
+    printf("connections opened: %d\n", fake_supplicant_opened());
+    if (max_ms > MAX_PING_MS)
+        fail("PING waited for SCAN");
+    /* command, monitor and the one opened for the PINGs */
+    if (fake_supplicant_opened() != 3)
+        fail("connections opened");
+}
+
+static void test_pooled(void)
+{
+    char *reply, *first;
+    size_t len;
+
+    if (wifi_command_pooled("PING", &reply, &len) != 0 || reply == NULL ||
+            len != 5 || strcmp(reply, "PONG\n") != 0)
+        fail("pooled PING");
+    first = reply;
+    wifi_release_reply(reply);
+
+    if (wifi_command_pooled("BSS RANGE=ALL", &reply, &len) != 0 ||
+            reply == NULL || len != REPLY_BUF_SIZE - 1 || reply[len] != '\0')
+        fail("long reply not cut at REPLY_BUF_SIZE - 1");
+    if (reply != first)
+        fail("released reply not reused");
+    wifi_release_reply(reply);
+
+    if (wifi_command_pooled("STATUS", &reply, &len) != -2 || reply != NULL)
+        fail("timed out pooled command");
+    wifi_release_reply(NULL);
+}
+
+static void test_stats(void)
+{
+    char stats[4096];
+    const char *line;
+    int len;
+
+    len = wifi_get_command_stats(stats, sizeof(stats));
+    printf("%s", stats);
+    if (len <= 0 || (size_t) len >= sizeof(stats) || len != (int) strlen(stats))
+        fail("stats length");
+
+    line = stats_line(stats, "PING");
+    if (line == NULL || strncmp(line, "PING count=21 timeouts=0 ", 25) != 0)
+        fail("PING stats");
+    line = stats_line(stats, "SCAN");
+    if (line == NULL || strncmp(line, "SCAN count=1 timeouts=0 ", 24) != 0 ||
+            strstr(line, " <256ms:1 ") == NULL)
+        fail("SCAN stats");
+    line = stats_line(stats, "STATUS");
+    if (line == NULL || strncmp(line, "STATUS count=1 timeouts=1 ", 26) != 0)
+        fail("STATUS stats");
+    if (stats_line(stats, "IFNAME=wlan0") != NULL)
+        fail("IFNAME= prefix kept");
+
+    if (wifi_get_command_stats(stats, 10) != len || strlen(stats) != 9)
+        fail("stats into a short buffer");
+}
+
+int main(int argc, char **argv)
+{
+    exit_sockets[0] = exit_sockets[1] = -1;
+    strcpy(supplicant_prop_name, SUPP_PROP_NAME);
+    property_set(SUPP_PROP_NAME, "running");
+    fake_supplicant_start(supplicant);
+    if (wifi_connect_on_socket_path("fake") != 0) {
+        printf("FAIL: cannot connect\n");
+        return 1;
+    }
+
+    test_concurrency();
+    test_pooled();
+    test_stats();
+
+    wifi_close_sockets();
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * wifi_config_test: run update_ctrl_interface() over made-up supplicant
+ * configs and check that:
+ *
+ *   - a config with a directory ctrl_interface is used as it is
+ *   - a config without ctrl_interface, or an empty one, is reported as
+ *     unusable, so that it is replaced with the template
+ *   - a config that cannot be mapped is kept, not reported as unusable
+ *   - a socket name ctrl_interface is rewritten in place, keeping the
+ *     networks, when run as root; otherwise it is left alone
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "wifi_test_env.h"
+#include "../wifi.c"
+
+#ifdef HAVE_ANDROID_OS
+#define TEST_CONFIG     "/data/local/tmp/wifi_config_test.conf"
+#else
+#define TEST_CONFIG     "/tmp/wifi_config_test.conf"
+#endif
+
+#define NETWORK         "network={\n\tssid=\"HomeNet\"\n\tpsk=\"secret\"\n}\n"
+
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+static void write_file(const char *text)
+{
+    FILE *f = fopen(TEST_CONFIG, "w");
+
+    if (f == NULL || fputs(text, f) < 0) {
+        printf("FAIL: cannot write %s\n", TEST_CONFIG);
+        exit(1);
+    }
+    fclose(f);
+}
+
+static int file_is(const char *text)
+{
+    static char buf[4096];
+    int fd = open(TEST_CONFIG, O_RDONLY);
+    ssize_t n;
+
+    if (fd < 0)
+        return 0;
+    n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n < 0)
+        return 0;
+    buf[n] = '\0';
+    return strcmp(buf, text) == 0;
+}
+
+static void check(const char *config, int want, const char *after,
+                  const char *what)
+{
+    write_file(config);
+    if (update_ctrl_interface(TEST_CONFIG) != want || !file_is(after))
+        fail(what);
+}
+
+int main(int argc, char **argv)
+{
+    static const char dir[] = "ctrl_interface=DIR=/data/misc/wifi/sockets\n"
+                              NETWORK;
+    static const char name[] = "ctrl_interface=wlan0\n" NETWORK;
+    char rewritten[256];
+
+    check(dir, 0, dir, "directory ctrl_interface");
+    check(NETWORK, -1, NETWORK, "config without ctrl_interface");
+    check("", -1, "", "empty config");
+
+    snprintf(rewritten, sizeof(rewritten), "ctrl_interface=%s\n" NETWORK,
+             CONTROL_IFACE_PATH);
+    check(name, 0, geteuid() == 0 ? rewritten : name, "socket ctrl_interface");
+
+    /* a directory opens, but does not map */
+    unlink(TEST_CONFIG);
+    mkdir(TEST_CONFIG, 0700);
+    if (update_ctrl_interface(TEST_CONFIG) != 0)
+        fail("unmappable config reported as unusable");
+    rmdir(TEST_CONFIG);
+
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * wifi_enable_timing_test: time the property waits on the way to a
+ * connection, against a fake init that answers ctl.start and ctl.stop
+ * after a varying delay, and check that:
+ *
+ *   - wifi_load_driver() returns as soon as the firmware loader sets
+ *     wlan.driver.status to "ok"
+ *   - wifi_stop_supplicant() returns as soon as init.svc.wpa_supplicant
+ *     reads "stopped"
+ *   - a supplicant that is already stopped is not waited for
+ *
+ * "late" is the time from the property changing to the call returning.
+ * Sleep-polling every 100 ms made it 50 ms on average, 100 ms at worst.
+ * The rest of enable-to-connected, the supplicant scanning and
+ * associating, needs a device and an access point.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+
+#ifdef HAVE_ANDROID_OS
+#define WIFI_DRIVER_MODULE_PATH "/data/local/tmp/wifi_enable_timing_test.ko"
+#else
+#define WIFI_DRIVER_MODULE_PATH "/tmp/wifi_enable_timing_test.ko"
+#endif
+#define WIFI_DRIVER_MODULE_NAME "wifi_enable_timing_test"
+#define WIFI_FIRMWARE_LOADER    "wlan_loader"
+
+#include "wifi_test_env.h"
+#include "../wifi.c"
+
+#define ROUNDS          20
+#define MAX_LATE_MS     20.0
+
+struct timing {
+    const char *what;
+    double total_late;
+    double max_late;
+    int count;
+};
+
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+static void account(struct timing *t, double returned)
+{
+    double late = returned - fake_init_last_set_ms();
+
+    t->total_late += late;
+    if (late > t->max_late)
+        t->max_late = late;
+    t->count++;
+}
+
+static void report(const struct timing *t)
+{
+    printf("%-24s late %.2f ms average, %.2f ms max\n", t->what,
+           t->total_late / t->count, t->max_late);
+    if (t->max_late > MAX_LATE_MS)
+        fail(t->what);
+}
+
+int main(int argc, char **argv)
+{
+    struct timing load = { "wifi_load_driver", 0, 0, 0 };
+    struct timing stop = { "wifi_stop_supplicant", 0, 0, 0 };
+    double start;
+    int fd, i;
+
+    fd = open(WIFI_DRIVER_MODULE_PATH, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    if (fd < 0 || write(fd, "\177ELF", 4) != 4) {
+        printf("FAIL: cannot create %s\n", WIFI_DRIVER_MODULE_PATH);
+        return 1;
+    }
+    close(fd);
+
+    for (i = 0; i < ROUNDS; i++) {
+        int delay_ms = (i * 37) % 100;
+
+        fake_properties_reset();
+        fake_init_on("start", WIFI_FIRMWARE_LOADER, DRIVER_PROP_NAME, "ok",
+                     delay_ms);
+        if (wifi_load_driver() != 0)
+            fail("wifi_load_driver");
+        account(&load, fake_now_ms());
+
+        fake_properties_reset();
+        property_set(SUPP_PROP_NAME, "running");
+        fake_init_on("stop", SUPPLICANT_NAME, SUPP_PROP_NAME, "stopped",
+                     delay_ms);
+        if (wifi_stop_supplicant(0) != 0)
+            fail("wifi_stop_supplicant");
+        account(&stop, fake_now_ms());
+    }
+    report(&load);
+    report(&stop);
+
+    /* init is never asked, so nothing would ever wake a waiter */
+    fake_properties_reset();
+    property_set(SUPP_PROP_NAME, "stopped");
+    start = fake_now_ms();
+    if (wifi_stop_supplicant(0) != 0 || fake_now_ms() - start > MAX_LATE_MS)
+        fail("stopping a stopped supplicant waited");
+
+    unlink(WIFI_DRIVER_MODULE_PATH);
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * wifi_event_bench: replay a recorded supplicant event log, over and over,
+ * through the monitor connection of a fake supplicant and time
+ *
+ *   - wifi_parse_event() alone, over the log in memory
+ *   - wifi_wait_for_event(), one receive and one copy per event
+ *   - wifi_wait_for_events(), everything queued in one call
+ *
+ * and check that both receive paths return the same text for every event
+ * of the log.
+ * The default log is a scan and a connection on wlan0; to replay another,
+ * one raw event per line as the monitor socket delivers them:
+ *
+ *   adb shell wifi_event_bench /data/local/tmp/events.log
+ */
+
+#include <stdio.h>
+
+#include "wifi_test_env.h"
+#include "../wifi.c"
+
+#define REPLAYS         2000
+#define PARSE_REPLAYS   100000
+#define BATCH           64
+#define BATCH_BUF       (BATCH * 256)
+#define MAX_EVENTS      1024
+
+static const char *recorded[MAX_EVENTS] = {
+    "IFNAME=wlan0 <3>CTRL-EVENT-SCAN-STARTED ",
+    "IFNAME=wlan0 <3>CTRL-EVENT-BSS-ADDED 0 00:1a:2b:3c:4d:01",
+    "IFNAME=wlan0 <3>CTRL-EVENT-BSS-ADDED 1 00:1a:2b:3c:4d:02",
+    "IFNAME=wlan0 <3>CTRL-EVENT-BSS-ADDED 2 00:1a:2b:3c:4d:03",
+    "IFNAME=wlan0 <3>CTRL-EVENT-BSS-ADDED 3 00:1a:2b:3c:4d:04",
+    "IFNAME=wlan0 <3>CTRL-EVENT-BSS-ADDED 4 a0:b1:c2:d3:e4:f5",
+    "IFNAME=wlan0 <3>CTRL-EVENT-SCAN-RESULTS ",
+    "IFNAME=wlan0 <3>CTRL-EVENT-STATE-CHANGE id=0 state=5 BSSID=00:1a:2b:3c:4d:01 SSID=HomeNet",
+    "IFNAME=wlan0 <3>CTRL-EVENT-STATE-CHANGE id=0 state=6 BSSID=00:1a:2b:3c:4d:01 SSID=HomeNet",
+    "IFNAME=wlan0 <3>CTRL-EVENT-STATE-CHANGE id=0 state=7 BSSID=00:1a:2b:3c:4d:01 SSID=HomeNet",
+    "IFNAME=wlan0 <3>CTRL-EVENT-STATE-CHANGE id=0 state=8 BSSID=00:1a:2b:3c:4d:01 SSID=HomeNet",
+    "IFNAME=wlan0 <3>WPA: Key negotiation completed with 00:1a:2b:3c:4d:01 [PTK=CCMP GTK=CCMP]",
+    "IFNAME=wlan0 <3>CTRL-EVENT-CONNECTED - Connection to 00:1a:2b:3c:4d:01 completed (auth) [id=0 id_str=]",
+    "IFNAME=wlan0 <3>CTRL-EVENT-STATE-CHANGE id=0 state=9 BSSID=00:1a:2b:3c:4d:01 SSID=HomeNet",
+    "IFNAME=wlan0 <3>CTRL-EVENT-LINK-SPEED 65",
+    "IFNAME=wlan0 <3>CTRL-EVENT-BSS-REMOVED 4 a0:b1:c2:d3:e4:f5",
+    "IFNAME=p2p0 <3>P2P-DEVICE-FOUND 02:1a:11:f0:00:01 p2p_dev_addr=02:1a:11:f0:00:01 pri_dev_type=10-0050F204-5 name='TV' config_methods=0x188 dev_capab=0x25 group_capab=0x0",
+    "IFNAME=wlan0 <3>CTRL-EVENT-DRIVER-STATE STARTED",
+    NULL,
+};
+static int recorded_count;
+
+static char *received[MAX_EVENTS];
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+static void load_log(const char *fn)
+{
+    static char line[1024];
+    FILE *f = fopen(fn, "r");
+    size_t len;
+
+    if (f == NULL) {
+        printf("cannot read %s\n", fn);
+        exit(2);
+    }
+    recorded_count = 0;
+    while (recorded_count < MAX_EVENTS && fgets(line, sizeof(line), f)) {
+        len = strlen(line);
+        if (len > 0 && line[len - 1] == '\n')
+            line[--len] = '\0';
+        if (len > 0)
+            recorded[recorded_count++] = strdup(line);
+    }
+    fclose(f);
+}
+
+static int no_commands(const char *cmd, char *reply, size_t *reply_len)
+{
+    return -1;
+}
+
+static void *replay_thread(void *arg)
+{
+    int i, j;
+
+    for (i = 0; i < REPLAYS; i++) {
+        for (j = 0; j < recorded_count; j++)
+            fake_supplicant_event(recorded[j]);
+    }
+    return NULL;
+}
+
+static void report(const char *what, int events, double ms)
+{
+    printf("%-22s %8.0f events/s, %6.3f us/event\n", what,
+           events * 1000.0 / ms, ms * 1000.0 / events);
+}
+
+static void bench_parse(void)
+{
+    static char copies[MAX_EVENTS][1024];
+    static size_t lens[MAX_EVENTS];
+    struct wifi_event event;
+    unsigned int sum = 0;
+    double start;
+    int i, j;
+
+    for (j = 0; j < recorded_count; j++) {
+        lens[j] = strlen(recorded[j]);
+        memcpy(copies[j], recorded[j], lens[j] + 1);
+    }
+    start = fake_now_ms();
+    for (i = 0; i < PARSE_REPLAYS; i++) {
+        for (j = 0; j < recorded_count; j++) {
+            wifi_parse_event(copies[j], lens[j], &event);
+            sum += event.type + event.name_len;
+        }
+    }
+    report("wifi_parse_event", PARSE_REPLAYS * recorded_count,
+           fake_now_ms() - start);
+    if (sum == 0)
+        fail("nothing parsed");
+}
+
+static void bench_wait_for_event(void)
+{
+    pthread_t thread;
+    char buf[1024];
+    double start;
+    int i, j, len;
+
+    pthread_create(&thread, NULL, replay_thread, NULL);
+    start = fake_now_ms();
+    for (i = 0; i < REPLAYS; i++) {
+        for (j = 0; j < recorded_count; j++) {
+            len = wifi_wait_for_event(buf, sizeof(buf));
+            if (i == 0)
+                received[j] = strndup(buf, len);
+        }
+    }
+    report("wifi_wait_for_event", REPLAYS * recorded_count,
+           fake_now_ms() - start);
+    pthread_join(thread, NULL);
+}
+
+/* whether event is what wifi_wait_for_event() returned as text */
+static int same_event(const struct wifi_event *event, const char *text)
+{
+    char buf[1024];
+
+    if (event->iface != NULL)
+        snprintf(buf, sizeof(buf), "IFNAME=%.*s %.*s", (int) event->iface_len,
+                 event->iface, (int) event->text_len, event->text);
+    else
+        snprintf(buf, sizeof(buf), "%.*s", (int) event->text_len, event->text);
+    return strcmp(buf, text) == 0;
+}
+
+static void bench_wait_for_events(void)
+{
+    static char buf[BATCH_BUF];
+    struct wifi_event events[BATCH];
+    pthread_t thread;
+    int total = REPLAYS * recorded_count;
+    int got = 0, calls = 0, n, i;
+    double start;
+
+    pthread_create(&thread, NULL, replay_thread, NULL);
+    start = fake_now_ms();
+    while (got < total) {
+        n = wifi_wait_for_events(buf, sizeof(buf), events, BATCH);
+        calls++;
+        for (i = 0; i < n; i++, got++) {
+            const char *want = received[got % recorded_count];
+
+            if (events[i].type == WIFI_EVENT_TERMINATING &&
+                    strncmp(want, "CTRL-EVENT-TERMINATING", 22) != 0) {
+                fail("connection lost");
+                got = total;
+                break;
+            }
+            if (got < recorded_count && !same_event(&events[i], want)) {
+                printf("  got \"%.*s\"\n  not \"%s\"\n",
+                       (int) events[i].text_len, events[i].text, want);
+                fail("wifi_wait_for_events and wifi_wait_for_event differ");
+            }
+        }
+    }
+    report("wifi_wait_for_events", total, fake_now_ms() - start);
+    printf("events per call:       %.1f\n", (double) total / calls);
+    pthread_join(thread, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        load_log(argv[1]);
+    else
+        while (recorded[recorded_count] != NULL)
+            recorded_count++;
+    if (recorded_count == 0) {
+        printf("no events\n");
+        return 2;
+    }
+
+    exit_sockets[0] = exit_sockets[1] = -1;
+    strcpy(supplicant_prop_name, SUPP_PROP_NAME);
+    property_set(SUPP_PROP_NAME, "running");
+    fake_supplicant_start(no_commands);
+    if (wifi_connect_on_socket_path("fake") != 0) {
+        printf("FAIL: cannot connect\n");
+        return 1;
+    }
+
+    printf("%d events, replayed %d times\n", recorded_count, REPLAYS);
+    bench_parse();
+    bench_wait_for_event();
+    bench_wait_for_events();
+
+    wifi_close_sockets();
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * wifi_insmod_test: load a made-up module file through insmod() against
+ * fake module syscalls, and check that:
+ *
+ *   - finit_module gets the module's file and the arguments, and nothing
+ *     falls back to init_module
+ *   - a kernel without finit_module (ENOSYS) gets the whole image, byte
+ *     for byte, through init_module
+ *   - any other finit_module error, and an init_module error, is returned
+ *     with its errno and without another try
+ *   - a missing file loads nothing
+ *   - no file descriptor is left open
+ *
+ * Built against headers without __NR_finit_module, insmod() only has the
+ * init_module path, and that is all that is checked.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "wifi_test_env.h"
+#include "../wifi.c"
+
+#ifdef HAVE_ANDROID_OS
+#define TEST_MODULE     "/data/local/tmp/wifi_insmod_test.ko"
+#else
+#define TEST_MODULE     "/tmp/wifi_insmod_test.ko"
+#endif
+#define TEST_ARGS       "firmware_path=/system/etc/firmware/fw.bin debug=0"
+#define MODULE_SIZE     3000
+
+static unsigned char module_image[MODULE_SIZE];
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+/* the lowest free descriptor, which insmod() must leave unchanged */
+static int next_fd(void)
+{
+    int fd = dup(0);
+
+    close(fd);
+    return fd;
+}
+
+static int load(int finit_errno, int init_errno, const char *fn)
+{
+    int fd = next_fd();
+    int ret;
+
+    fake_modules_reset(finit_errno, init_errno);
+    errno = 0;
+    ret = insmod(fn, TEST_ARGS);
+    if (next_fd() != fd)
+        fail("descriptor leaked");
+    return ret;
+}
+
+static int image_loaded(void)
+{
+    return fake_module_loads.init_calls == 1 &&
+            fake_module_loads.image_len == MODULE_SIZE &&
+            memcmp(fake_module_loads.image, module_image, MODULE_SIZE) == 0 &&
+            strcmp(fake_module_loads.args, TEST_ARGS) == 0;
+}
+
+int main(int argc, char **argv)
+{
+    int fd, i;
+
+    for (i = 0; i < MODULE_SIZE; i++)
+        module_image[i] = i * 7 + (i >> 8);
+    fd = open(TEST_MODULE, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    if (fd < 0 || write(fd, module_image, MODULE_SIZE) != MODULE_SIZE) {
+        printf("FAIL: cannot create %s\n", TEST_MODULE);
+        return 1;
+    }
+    close(fd);
+
+#ifdef __NR_finit_module
+    if (load(0, 0, TEST_MODULE) != 0 ||
+            fake_module_loads.finit_calls != 1 ||
+            fake_module_loads.finit_size != MODULE_SIZE ||
+            strcmp(fake_module_loads.args, TEST_ARGS) != 0)
+        fail("finit_module");
+    if (fake_module_loads.init_calls != 0)
+        fail("init_module after finit_module succeeded");
+
+    if (load(ENOSYS, 0, TEST_MODULE) != 0 ||
+            fake_module_loads.finit_calls != 1 || !image_loaded())
+        fail("init_module fallback without finit_module");
+
+    if (load(EEXIST, 0, TEST_MODULE) != -1 || errno != EEXIST)
+        fail("finit_module error");
+    if (fake_module_loads.init_calls != 0)
+        fail("init_module after finit_module failed");
+#else
+    printf("no finit_module, checking init_module only\n");
+    if (load(0, 0, TEST_MODULE) != 0 || !image_loaded())
+        fail("init_module");
+#endif
+
+    if (load(ENOSYS, EINVAL, TEST_MODULE) != -1 || errno != EINVAL ||
+            !image_loaded())
+        fail("init_module error");
+
+    if (load(0, 0, TEST_MODULE ".missing") != -1 || errno != ENOENT ||
+            fake_module_loads.finit_calls != 0 ||
+            fake_module_loads.init_calls != 0)
+        fail("missing module");
+
+    unlink(TEST_MODULE);
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
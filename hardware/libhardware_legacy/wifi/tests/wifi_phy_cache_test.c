@@ -0,0 +1,414 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * wifi_phy_cache_test: add the P2P interface over and over against a fake
+ * nl80211 and a fake /sys/class/ieee80211 whose only phy changes index
+ * behind wifi.c's back, and check that the phy index in the request:
+ *
+ *   - is looked up once and then cached
+ *   - is looked up again after a NEW_WIPHY or DEL_WIPHY notification, but
+ *     not after another one
+ *   - is looked up again after the notification socket fails to receive
+ *   - is looked up again after the kernel refuses the interface
+ *   - is looked up every time when there is no notification socket
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <netlink/genl/genl.h>
+#include <netlink/genl/family.h>
+#include <netlink/genl/ctrl.h>
+#include <netlink/msg.h>
+#include <netlink/attr.h>
+#include <nl80211.h>
+
+/*
+ * The libnl headers are included first, so that wifi.c's libnl calls, not
+ * their declarations, go to the fake kernel below.
+ */
+#define nl_socket_alloc             fake_socket_alloc
+#define nl_socket_free              fake_socket_free
+#define nl_socket_add_membership    fake_socket_add_membership
+#define nl_socket_disable_seq_check fake_socket_disable_seq_check
+#define nl_socket_set_nonblocking   fake_socket_set_nonblocking
+#define nl_socket_modify_cb         fake_socket_modify_cb
+#define nl_socket_get_fd            fake_socket_get_fd
+#define genl_connect                fake_genl_connect
+#define genl_ctrl_resolve_grp       fake_genl_ctrl_resolve_grp
+#define genl_ctrl_alloc_cache       fake_genl_ctrl_alloc_cache
+#define genl_ctrl_search_by_name    fake_genl_ctrl_search_by_name
+#define genl_family_put             fake_genl_family_put
+#define genl_family_get_id          fake_genl_family_get_id
+#define nl_cache_free               fake_cache_free
+#define nlmsg_alloc                 fake_nlmsg_alloc
+#define nlmsg_free                  fake_nlmsg_free
+#define nlmsg_hdr                   fake_nlmsg_hdr
+#define nlmsg_data                  fake_nlmsg_data
+#define genlmsg_put                 fake_genlmsg_put
+#define nla_put                     fake_nla_put
+#define nl_cb_alloc                 fake_cb_alloc
+#define nl_cb_put                   fake_cb_put
+#define nl_cb_err                   fake_cb_err
+#define nl_cb_set                   fake_cb_set
+#define nl_send_auto_complete       fake_send_auto_complete
+#define nl_recvmsgs                 fake_recvmsgs
+#define nl_recvmsgs_default         fake_recvmsgs_default
+
+/* a notification byte that makes the receive fail instead */
+#define RECV_ERROR      0xff
+
+struct fake_sock {
+    int fds[2];                 /* [0] is the socket, [1] the kernel's end */
+    nl_recvmsg_msg_cb_t valid;
+    void *valid_arg;
+};
+
+struct fake_cb {
+    nl_recvmsg_err_cb_t err;
+    void *err_arg;
+    nl_recvmsg_msg_cb_t ack;
+    void *ack_arg;
+};
+
+struct fake_msg {
+    struct nlmsghdr hdr;
+    struct genlmsghdr gnl;
+    int cmd;
+    int wiphy;
+};
+
+static struct fake_sock *event_sock;
+static int has_config_group = 1;
+static int kernel_error;
+static int requested_cmd;
+static int requested_phy;
+static int family;
+static int cache;
+
+static struct nl_sock *fake_socket_alloc(void)
+{
+    struct fake_sock *s = calloc(1, sizeof(*s));
+
+    socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, s->fds);
+    return (struct nl_sock *) s;
+}
+
+static void fake_socket_free(struct nl_sock *sock)
+{
+    struct fake_sock *s = (struct fake_sock *) sock;
+
+    if (s == NULL)
+        return;
+    if (s == event_sock)
+        event_sock = NULL;
+    close(s->fds[0]);
+    close(s->fds[1]);
+    free(s);
+}
+
+static int fake_socket_add_membership(struct nl_sock *sock, int group)
+{
+    event_sock = (struct fake_sock *) sock;
+    return 0;
+}
+
+static void fake_socket_disable_seq_check(struct nl_sock *sock)
+{
+}
+
+static int fake_socket_set_nonblocking(struct nl_sock *sock)
+{
+    return 0;
+}
+
+static int fake_socket_modify_cb(struct nl_sock *sock, enum nl_cb_type type,
+                                 enum nl_cb_kind kind, nl_recvmsg_msg_cb_t func,
+                                 void *arg)
+{
+    struct fake_sock *s = (struct fake_sock *) sock;
+
+    if (type == NL_CB_VALID) {
+        s->valid = func;
+        s->valid_arg = arg;
+    }
+    return 0;
+}
+
+static int fake_socket_get_fd(struct nl_sock *sock)
+{
+    return ((struct fake_sock *) sock)->fds[0];
+}
+
+static int fake_genl_connect(struct nl_sock *sock)
+{
+    return 0;
+}
+
+static int fake_genl_ctrl_resolve_grp(struct nl_sock *sock, const char *name,
+                                      const char *group)
+{
+    return has_config_group ? 5 : -ENOENT;
+}
+
+static int fake_genl_ctrl_alloc_cache(struct nl_sock *sock,
+                                      struct nl_cache **result)
+{
+    *result = (struct nl_cache *) &cache;
+    return 0;
+}
+
+static struct genl_family *fake_genl_ctrl_search_by_name(struct nl_cache *c,
+                                                         const char *name)
+{
+    return (struct genl_family *) &family;
+}
+
+static void fake_genl_family_put(struct genl_family *f)
+{
+}
+
+static int fake_genl_family_get_id(struct genl_family *f)
+{
+    return 28;
+}
+
+static void fake_cache_free(struct nl_cache *c)
+{
+}
+
+static struct nl_msg *fake_nlmsg_alloc(void)
+{
+    struct fake_msg *m = calloc(1, sizeof(*m));
+
+    m->wiphy = -1;
+    return (struct nl_msg *) m;
+}
+
+static void fake_nlmsg_free(struct nl_msg *msg)
+{
+    free(msg);
+}
+
+static struct nlmsghdr *fake_nlmsg_hdr(struct nl_msg *msg)
+{
+    return &((struct fake_msg *) msg)->hdr;
+}
+
+static void *fake_nlmsg_data(const struct nlmsghdr *hdr)
+{
+    return &((struct fake_msg *) hdr)->gnl;
+}
+
+static void *fake_genlmsg_put(struct nl_msg *msg, uint32_t port, uint32_t seq,
+                              int family_id, int hdrlen, int flags,
+                              uint8_t cmd, uint8_t version)
+{
+    struct fake_msg *m = (struct fake_msg *) msg;
+
+    m->cmd = cmd;
+    return &m->gnl;
+}
+
+static int fake_nla_put(struct nl_msg *msg, int type, int len, const void *data)
+{
+    if (type == NL80211_ATTR_WIPHY)
+        ((struct fake_msg *) msg)->wiphy = *(const uint32_t *) data;
+    return 0;
+}
+
+static struct nl_cb *fake_cb_alloc(enum nl_cb_kind kind)
+{
+    return calloc(1, sizeof(struct fake_cb));
+}
+
+static void fake_cb_put(struct nl_cb *cb)
+{
+    free(cb);
+}
+
+static int fake_cb_err(struct nl_cb *cb, enum nl_cb_kind kind,
+                       nl_recvmsg_err_cb_t func, void *arg)
+{
+    struct fake_cb *c = (struct fake_cb *) cb;
+
+    c->err = func;
+    c->err_arg = arg;
+    return 0;
+}
+
+static int fake_cb_set(struct nl_cb *cb, enum nl_cb_type type,
+                       enum nl_cb_kind kind, nl_recvmsg_msg_cb_t func,
+                       void *arg)
+{
+    struct fake_cb *c = (struct fake_cb *) cb;
+
+    if (type == NL_CB_ACK) {
+        c->ack = func;
+        c->ack_arg = arg;
+    }
+    return 0;
+}
+
+static int fake_send_auto_complete(struct nl_sock *sock, struct nl_msg *msg)
+{
+    struct fake_msg *m = (struct fake_msg *) msg;
+
+    requested_cmd = m->cmd;
+    requested_phy = m->wiphy;
+    return 0;
+}
+
+/* the kernel's answer to the last request */
+static int fake_recvmsgs(struct nl_sock *sock, struct nl_cb *cb)
+{
+    struct fake_cb *c = (struct fake_cb *) cb;
+    struct nlmsgerr err;
+
+    if (kernel_error) {
+        memset(&err, 0, sizeof(err));
+        err.error = kernel_error;
+        c->err(NULL, &err, c->err_arg);
+    } else {
+        c->ack(NULL, c->ack_arg);
+    }
+    return 0;
+}
+
+static int fake_recvmsgs_default(struct nl_sock *sock)
+{
+    struct fake_sock *s = (struct fake_sock *) sock;
+    struct fake_msg m;
+    unsigned char cmd;
+
+    if (recv(s->fds[0], &cmd, 1, 0) != 1)
+        return 0;
+    if (cmd == RECV_ERROR)
+        return -NLE_NOMEM;
+    memset(&m, 0, sizeof(m));
+    m.gnl.cmd = cmd;
+    s->valid((struct nl_msg *) &m, s->valid_arg);
+    return 0;
+}
+
+#ifdef HAVE_ANDROID_OS
+#define WIFI_PHY_SYSFS_DIR      "/data/local/tmp/wifi_phy_cache_test"
+#else
+#define WIFI_PHY_SYSFS_DIR      "/tmp/wifi_phy_cache_test"
+#endif
+#define USES_TI_MAC80211
+
+#include "wifi_test_env.h"
+#include "../wifi.c"
+
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+static void notify(unsigned char cmd)
+{
+    if (event_sock == NULL || send(event_sock->fds[1], &cmd, 1, 0) != 1)
+        fail("cannot notify");
+}
+
+static void set_phy_index(int index)
+{
+    char fn[PATH_MAX];
+    FILE *f;
+
+    snprintf(fn, sizeof(fn), "%s/phy0/index", WIFI_PHY_SYSFS_DIR);
+    f = fopen(fn, "w");
+    if (f == NULL || fprintf(f, "%d\n", index) < 0) {
+        printf("FAIL: cannot write %s\n", fn);
+        exit(1);
+    }
+    fclose(f);
+}
+
+/* add the P2P interface, expecting the request to name phy index want */
+static void expect_phy(int want, const char *what)
+{
+    requested_phy = -1;
+    if (add_remove_p2p_interface(1) != 0 ||
+            requested_cmd != NL80211_CMD_NEW_INTERFACE ||
+            requested_phy != want) {
+        printf("  phy %d, not %d\n", requested_phy, want);
+        fail(what);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char fn[PATH_MAX];
+
+    mkdir(WIFI_PHY_SYSFS_DIR, 0700);
+    snprintf(fn, sizeof(fn), "%s/phy0", WIFI_PHY_SYSFS_DIR);
+    mkdir(fn, 0700);
+
+    set_phy_index(0);
+    expect_phy(0, "first lookup");
+    set_phy_index(7);
+    expect_phy(0, "phy looked up again without a notification");
+
+    notify(NL80211_CMD_NEW_WIPHY);
+    expect_phy(7, "NEW_WIPHY ignored");
+    set_phy_index(3);
+    notify(NL80211_CMD_DEL_WIPHY);
+    expect_phy(3, "DEL_WIPHY ignored");
+    set_phy_index(4);
+    notify(NL80211_CMD_NEW_INTERFACE);
+    expect_phy(3, "cache dropped for another notification");
+
+    notify(RECV_ERROR);
+    expect_phy(4, "cache kept after a receive error");
+
+    /* refused: the netlink context is rebuilt and the phy looked up again */
+    kernel_error = -ENODEV;
+    if (add_remove_p2p_interface(1) == 0)
+        fail("refused interface added");
+    kernel_error = 0;
+    set_phy_index(6);
+    expect_phy(6, "cache kept after the kernel refused the interface");
+
+    /* without notifications nothing can be cached */
+    deinit_nl();
+    has_config_group = 0;
+    set_phy_index(1);
+    expect_phy(1, "no notifications, first lookup");
+    set_phy_index(2);
+    expect_phy(2, "phy cached without notifications");
+
+    deinit_nl();
+    snprintf(fn, sizeof(fn), "%s/phy0/index", WIFI_PHY_SYSFS_DIR);
+    unlink(fn);
+    snprintf(fn, sizeof(fn), "%s/phy0", WIFI_PHY_SYSFS_DIR);
+    rmdir(fn);
+    rmdir(WIFI_PHY_SYSFS_DIR);
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
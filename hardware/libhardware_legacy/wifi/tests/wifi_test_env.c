@@ -0,0 +1,485 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <cutils/properties.h>
+#include <cutils/property_wait.h>
+#include <libwpa_client/wpa_ctrl.h>
+
+#include "wifi_test_env.h"
+
+#define MAX_PROPS       64
+#define MAX_RULES       8
+
+struct fake_prop {
+    char name[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+    unsigned int serial;
+};
+
+struct init_rule {
+    char ctl[16];
+    char service[PROPERTY_VALUE_MAX];
+    char prop[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+    int delay_ms;
+};
+
+static pthread_mutex_t prop_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t prop_cond = PTHREAD_COND_INITIALIZER;
+static struct fake_prop props[MAX_PROPS];
+static int prop_count;
+static unsigned int next_serial;
+static struct init_rule rules[MAX_RULES];
+static int rule_count;
+static int rules_pending;
+static double last_set_ms;
+
+double fake_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static struct fake_prop *find_prop(const char *name)
+{
+    int i;
+
+    for (i = 0; i < prop_count; i++) {
+        if (strcmp(props[i].name, name) == 0)
+            return &props[i];
+    }
+    return NULL;
+}
+
+static void set_locked(const char *name, const char *value)
+{
+    struct fake_prop *p = find_prop(name);
+
+    if (p == NULL) {
+        if (prop_count == MAX_PROPS)
+            abort();
+        p = &props[prop_count++];
+        strncpy(p->name, name, sizeof(p->name) - 1);
+    }
+    strncpy(p->value, value, sizeof(p->value) - 1);
+    p->value[sizeof(p->value) - 1] = '\0';
+    p->serial = next_serial++;
+    pthread_cond_broadcast(&prop_cond);
+}
+
+void fake_properties_reset(void)
+{
+    fake_init_settle();
+    pthread_mutex_lock(&prop_lock);
+    memset(props, 0, sizeof(props));
+    prop_count = 0;
+    rule_count = 0;
+    pthread_mutex_unlock(&prop_lock);
+}
+
+void fake_init_on(const char *ctl, const char *service, const char *prop,
+                  const char *value, int delay_ms)
+{
+    struct init_rule *r;
+    int i;
+
+    pthread_mutex_lock(&prop_lock);
+    for (i = 0; i < rule_count; i++) {
+        if (strcmp(rules[i].ctl, ctl) == 0 &&
+                strcmp(rules[i].service, service) == 0)
+            break;
+    }
+    if (i == rule_count) {
+        if (rule_count == MAX_RULES)
+            abort();
+        rule_count++;
+    }
+    r = &rules[i];
+    memset(r, 0, sizeof(*r));
+    strncpy(r->ctl, ctl, sizeof(r->ctl) - 1);
+    strncpy(r->service, service, sizeof(r->service) - 1);
+    strncpy(r->prop, prop, sizeof(r->prop) - 1);
+    strncpy(r->value, value, sizeof(r->value) - 1);
+    r->delay_ms = delay_ms;
+    pthread_mutex_unlock(&prop_lock);
+}
+
+double fake_init_last_set_ms(void)
+{
+    double ms;
+
+    pthread_mutex_lock(&prop_lock);
+    ms = last_set_ms;
+    pthread_mutex_unlock(&prop_lock);
+    return ms;
+}
+
+void fake_init_settle(void)
+{
+    pthread_mutex_lock(&prop_lock);
+    while (rules_pending > 0)
+        pthread_cond_wait(&prop_cond, &prop_lock);
+    pthread_mutex_unlock(&prop_lock);
+}
+
+static void *run_rule(void *arg)
+{
+    struct init_rule *r = arg;
+
+    usleep(r->delay_ms * 1000);
+    pthread_mutex_lock(&prop_lock);
+    last_set_ms = fake_now_ms();
+    set_locked(r->prop, r->value);
+    rules_pending--;
+    pthread_cond_broadcast(&prop_cond);
+    pthread_mutex_unlock(&prop_lock);
+    free(r);
+    return NULL;
+}
+
+/* init's side of property_set("ctl.start", ...), called locked */
+static void control_message(const char *ctl, const char *service)
+{
+    pthread_attr_t attr;
+    pthread_t thread;
+    struct init_rule *r;
+    int i;
+
+    for (i = 0; i < rule_count; i++) {
+        if (strcmp(rules[i].ctl, ctl) == 0 &&
+                strcmp(rules[i].service, service) == 0)
+            break;
+    }
+    if (i == rule_count)
+        return;
+
+    r = malloc(sizeof(*r));
+    *r = rules[i];
+    rules_pending++;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&thread, &attr, run_rule, r);
+    pthread_attr_destroy(&attr);
+}
+
+int property_get(const char *key, char *value, const char *default_value)
+{
+    struct fake_prop *p;
+    int len = 0;
+
+    pthread_mutex_lock(&prop_lock);
+    p = find_prop(key);
+    if (p != NULL) {
+        strcpy(value, p->value);
+        len = strlen(value);
+    } else if (default_value != NULL) {
+        strncpy(value, default_value, PROPERTY_VALUE_MAX - 1);
+        value[PROPERTY_VALUE_MAX - 1] = '\0';
+        len = strlen(value);
+    } else {
+        value[0] = '\0';
+    }
+    pthread_mutex_unlock(&prop_lock);
+    return len;
+}
+
+int property_set(const char *key, const char *value)
+{
+    pthread_mutex_lock(&prop_lock);
+    if (strncmp(key, "ctl.", 4) == 0)
+        control_message(key + 4, value);
+    else
+        set_locked(key, value);
+    pthread_mutex_unlock(&prop_lock);
+    return 0;
+}
+
+unsigned int property_get_serial(const char *name)
+{
+    struct fake_prop *p;
+    unsigned int serial;
+
+    pthread_mutex_lock(&prop_lock);
+    p = find_prop(name);
+    serial = p ? p->serial : PROPERTY_SERIAL_NONE;
+    pthread_mutex_unlock(&prop_lock);
+    return serial;
+}
+
+int property_wait(const char *name, unsigned int old_serial, int timeout_ms,
+                  unsigned int *new_serial)
+{
+    struct timespec deadline;
+    struct fake_prop *p;
+    int ret = 0;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&prop_lock);
+    while ((p = find_prop(name)) == NULL || p->serial == old_serial) {
+        if (timeout_ms >= 0 &&
+                pthread_cond_timedwait(&prop_cond, &prop_lock, &deadline)) {
+            ret = -1;
+            break;
+        } else if (timeout_ms < 0) {
+            pthread_cond_wait(&prop_cond, &prop_lock);
+        }
+    }
+    if (ret == 0 && new_serial != NULL)
+        *new_serial = p->serial;
+    pthread_mutex_unlock(&prop_lock);
+    if (ret)
+        errno = ETIMEDOUT;
+    return ret;
+}
+
+struct fake_module_loads fake_module_loads;
+static int finit_error;
+static int init_error;
+
+void fake_modules_reset(int finit_errno, int init_errno)
+{
+    memset(&fake_module_loads, 0, sizeof(fake_module_loads));
+    finit_error = finit_errno;
+    init_error = init_errno;
+}
+
+long fake_syscall(long number, ...)
+{
+#ifdef __NR_finit_module
+    struct stat st;
+    const char *args;
+    va_list ap;
+    int fd;
+
+    if (number == __NR_finit_module) {
+        va_start(ap, number);
+        fd = va_arg(ap, int);
+        args = va_arg(ap, const char *);
+        va_end(ap);
+
+        fake_module_loads.finit_calls++;
+        fake_module_loads.finit_size = fstat(fd, &st) == 0 ? st.st_size : -1;
+        strncpy(fake_module_loads.args, args, sizeof(fake_module_loads.args) - 1);
+        if (finit_error) {
+            errno = finit_error;
+            return -1;
+        }
+        return 0;
+    }
+#endif
+    errno = ENOSYS;
+    return -1;
+}
+
+int init_module(void *image, unsigned long len, const char *args)
+{
+    size_t n = len < sizeof(fake_module_loads.image) ?
+            len : sizeof(fake_module_loads.image);
+
+    fake_module_loads.init_calls++;
+    memcpy(fake_module_loads.image, image, n);
+    fake_module_loads.image_len = len;
+    strncpy(fake_module_loads.args, args, sizeof(fake_module_loads.args) - 1);
+    if (init_error) {
+        errno = init_error;
+        return -1;
+    }
+    return 0;
+}
+
+int delete_module(const char *name, unsigned int flags)
+{
+    return 0;
+}
+
+/* libnetutils */
+int do_dhcp(const char *iface)
+{
+    return 0;
+}
+
+int ifc_init(void)
+{
+    return 0;
+}
+
+void ifc_close(void)
+{
+}
+
+char *dhcp_lasterror(void)
+{
+    return "";
+}
+
+void get_dhcp_info(int *ipaddr, int *gateway, int *mask, int *dns1,
+                   int *dns2, int *server, int *lease)
+{
+}
+
+/* libwpa_client */
+#define MAX_CONNECTIONS 8
+
+/* fds[0] is the client end, fds[1] the supplicant's */
+struct wpa_ctrl {
+    int fds[2];
+    int attached;
+};
+
+static pthread_mutex_t supplicant_lock = PTHREAD_MUTEX_INITIALIZER;
+static fake_supplicant_handler supplicant_handler;
+static int supplicant_opened;
+static struct wpa_ctrl *connections[MAX_CONNECTIONS];
+
+void fake_supplicant_start(fake_supplicant_handler handler)
+{
+    pthread_mutex_lock(&supplicant_lock);
+    supplicant_handler = handler;
+    supplicant_opened = 0;
+    pthread_mutex_unlock(&supplicant_lock);
+}
+
+int fake_supplicant_opened(void)
+{
+    int opened;
+
+    pthread_mutex_lock(&supplicant_lock);
+    opened = supplicant_opened;
+    pthread_mutex_unlock(&supplicant_lock);
+    return opened;
+}
+
+void fake_supplicant_event(const char *event)
+{
+    int i;
+
+    pthread_mutex_lock(&supplicant_lock);
+    for (i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i] != NULL && connections[i]->attached)
+            send(connections[i]->fds[1], event, strlen(event), 0);
+    }
+    pthread_mutex_unlock(&supplicant_lock);
+}
+
+struct wpa_ctrl *wpa_ctrl_open(const char *path)
+{
+    struct wpa_ctrl *ctrl = NULL;
+    int i;
+
+    pthread_mutex_lock(&supplicant_lock);
+    for (i = 0; supplicant_handler != NULL && i < MAX_CONNECTIONS; i++) {
+        if (connections[i] != NULL)
+            continue;
+        ctrl = calloc(1, sizeof(*ctrl));
+        if (socketpair(AF_UNIX, SOCK_DGRAM, 0, ctrl->fds) < 0) {
+            free(ctrl);
+            ctrl = NULL;
+            break;
+        }
+        connections[i] = ctrl;
+        supplicant_opened++;
+        break;
+    }
+    pthread_mutex_unlock(&supplicant_lock);
+    if (ctrl == NULL)
+        errno = ECONNREFUSED;
+    return ctrl;
+}
+
+void wpa_ctrl_close(struct wpa_ctrl *ctrl)
+{
+    int i;
+
+    pthread_mutex_lock(&supplicant_lock);
+    for (i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i] == ctrl)
+            connections[i] = NULL;
+    }
+    pthread_mutex_unlock(&supplicant_lock);
+    close(ctrl->fds[0]);
+    close(ctrl->fds[1]);
+    free(ctrl);
+}
+
+int wpa_ctrl_request(struct wpa_ctrl *ctrl, const char *cmd, size_t cmd_len,
+                     char *reply, size_t *reply_len,
+                     void (*msg_cb)(char *msg, size_t len))
+{
+    fake_supplicant_handler handler;
+    char command[256];
+
+    if (ctrl->attached || cmd_len >= sizeof(command))
+        return -1;
+    memcpy(command, cmd, cmd_len);
+    command[cmd_len] = '\0';
+    pthread_mutex_lock(&supplicant_lock);
+    handler = supplicant_handler;
+    pthread_mutex_unlock(&supplicant_lock);
+    return handler(command, reply, reply_len);
+}
+
+int wpa_ctrl_attach(struct wpa_ctrl *ctrl)
+{
+    ctrl->attached = 1;
+    return 0;
+}
+
+int wpa_ctrl_recv(struct wpa_ctrl *ctrl, char *reply, size_t *reply_len)
+{
+    ssize_t n = TEMP_FAILURE_RETRY(recv(ctrl->fds[0], reply, *reply_len, 0));
+
+    if (n < 0)
+        return -1;
+    *reply_len = n;
+    return 0;
+}
+
+int wpa_ctrl_pending(struct wpa_ctrl *ctrl)
+{
+    struct pollfd pfd = { ctrl->fds[0], POLLIN, 0 };
+
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+int wpa_ctrl_get_fd(struct wpa_ctrl *ctrl)
+{
+    return ctrl->fds[0];
+}
+
+void wpa_ctrl_cleanup(void)
+{
+}
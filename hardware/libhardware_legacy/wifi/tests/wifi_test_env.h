@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _WIFI_TEST_ENV_H
+#define _WIFI_TEST_ENV_H
+
+#include <stddef.h>
+
+/*
+ * What wifi.c talks to, faked for the host tests: the property area with
+ * its serials, init answering ctl.start and ctl.stop, wpa_supplicant, the
+ * module syscalls and libnetutils.  Include this before ../wifi.c.
+ */
+
+#ifndef WIFI_ENTROPY_FILE
+#define WIFI_ENTROPY_FILE       "/data/misc/wifi/entropy.bin"
+#endif
+
+/* insmod() calls finit_module through syscall() */
+#define syscall fake_syscall
+long fake_syscall(long number, ...);
+
+/* What the module syscalls were given since fake_modules_reset(). */
+struct fake_module_loads {
+    int finit_calls;
+    long long finit_size;       /* of the file behind finit_module's fd */
+    int init_calls;
+    unsigned char image[4096];  /* the start of init_module's image */
+    unsigned long image_len;
+    char args[256];             /* of the last call */
+};
+
+extern struct fake_module_loads fake_module_loads;
+
+/*
+ * Clear fake_module_loads.  finit_module and init_module then fail with
+ * finit_errno or init_errno, or succeed if that is 0.
+ */
+void fake_modules_reset(int finit_errno, int init_errno);
+
+/* CLOCK_MONOTONIC in ms */
+double fake_now_ms(void);
+
+/* Forget every property and init rule. */
+void fake_properties_reset(void);
+
+/*
+ * Have init answer "ctl.<ctl> <service>" by setting prop to value after
+ * delay_ms, from a thread of its own.  A later rule for the same ctl and
+ * service replaces the earlier one.
+ */
+void fake_init_on(const char *ctl, const char *service, const char *prop,
+                  const char *value, int delay_ms);
+
+/* When init last set a property for a rule, in fake_now_ms() time. */
+double fake_init_last_set_ms(void);
+
+/* Block until no rule is still waiting to set its property. */
+void fake_init_settle(void);
+
+/*
+ * Answers a supplicant command the way wpa_ctrl_request() does: fills at
+ * most *reply_len bytes of reply, sets *reply_len and returns 0, or -2 for
+ * a timeout.  Called on the caller's thread, so a slow handler holds only
+ * the connection it was called on.
+ */
+typedef int (*fake_supplicant_handler)(const char *cmd, char *reply,
+                                       size_t *reply_len);
+
+/* Let wpa_ctrl_open() succeed; commands go to handler. */
+void fake_supplicant_start(fake_supplicant_handler handler);
+
+/* Connections opened since fake_supplicant_start(), including closed ones. */
+int fake_supplicant_opened(void);
+
+/*
+ * Queue a raw event, e.g. "IFNAME=wlan0 <3>CTRL-EVENT-SCAN-STARTED ", on
+ * every attached connection.  Blocks while a connection's queue is full.
+ */
+void fake_supplicant_event(const char *event);
+
+#endif  /* _WIFI_TEST_ENV_H */
@@ -19,9 +19,14 @@
 #include <errno.h>
 #include <string.h>
 #include <dirent.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <poll.h>
+#include <pthread.h>
+#include <time.h>
 
 #ifdef USES_TI_MAC80211
 #include <dirent.h>
@@ -35,6 +40,8 @@
 #endif
 
 #include "hardware_legacy/wifi.h"
+#include "hardware_legacy/wifi_command.h"
+#include "hardware_legacy/wifi_event.h"
 #include "libwpa_client/wpa_ctrl.h"
 
 #define LOG_TAG "WifiHW"
@@ -42,6 +49,7 @@
 #include "cutils/memory.h"
 #include "cutils/misc.h"
 #include "cutils/properties.h"
+#include "cutils/property_wait.h"
 #include "private/android_filesystem_config.h"
 #ifdef HAVE_LIBC_SYSTEM_PROPERTIES
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
@@ -51,6 +59,47 @@
 static struct wpa_ctrl *ctrl_conn;
 static struct wpa_ctrl *monitor_conn;
 
+/*
+ * Command connections.  wpa_supplicant answers each control socket in
+ * order, so concurrent callers get a connection each instead of queueing
+ * behind a slow request; ctrl_conn is the first one and the rest are opened
+ * on demand, up to CTRL_POOL_MAX.
+ */
+#define CTRL_POOL_MAX           4
+static pthread_mutex_t ctrl_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ctrl_cond = PTHREAD_COND_INITIALIZER;
+static struct wpa_ctrl *ctrl_pool[CTRL_POOL_MAX];
+static int ctrl_busy[CTRL_POOL_MAX];
+static int ctrl_count;
+static int ctrl_opening;        /* connections being opened outside the lock */
+static unsigned int ctrl_generation;    /* bumped by ctrl_close_all() */
+static char ctrl_path[PATH_MAX];
+
+/* reply buffers handed out by wifi_command_pooled(), guarded by ctrl_lock */
+#define REPLY_BUF_SIZE          16384
+#define REPLY_POOL_MAX          4
+static char *reply_pool[REPLY_POOL_MAX];
+static int reply_pool_count;
+
+/*
+ * Per-command latency histogram: bucket i counts replies that took less
+ * than 2^i ms, the last bucket everything slower.  Commands beyond the
+ * first MAX_TRACKED_COMMANDS share the extra "*" entry at the end.
+ */
+#define LATENCY_BUCKETS         12
+#define MAX_TRACKED_COMMANDS    24
+struct command_stats {
+    char name[24];
+    unsigned int count;
+    unsigned int timeouts;
+    unsigned int buckets[LATENCY_BUCKETS];
+};
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct command_stats command_stats[MAX_TRACKED_COMMANDS + 1] = {
+    [MAX_TRACKED_COMMANDS] = { .name = "*" },
+};
+static int command_stats_count;
+
 /* socket pair used to exit from a blocking read */
 static int exit_sockets[2];
 
@@ -71,9 +120,14 @@ static char primary_iface[PROPERTY_VALUE_MAX];
 
 #ifdef USES_TI_MAC80211
 #define P2P_INTERFACE			"p2p0"
+/* kept from the first P2P interface change until an error */
 struct nl_sock *nl_soc;
 struct nl_cache *nl_cache;
 struct genl_family *nl80211;
+/* member of the nl80211 "config" group, which announces phys coming and going */
+static struct nl_sock *nl_event_soc;
+/* index of the only phy, valid while no NEW/DEL_WIPHY has been seen */
+static int cached_phy = -1;
 #endif
 
 #ifndef WIFI_DRIVER_MODULE_ARG
@@ -112,6 +166,9 @@ static const char EXT_MODULE_PATH[] = WIFI_EXT_MODULE_PATH;
 #ifndef WIFI_DRIVER_FW_PATH_PARAM
 #define WIFI_DRIVER_FW_PATH_PARAM	"/sys/module/wlan/parameters/fwpath"
 #endif
+#ifndef WIFI_PHY_SYSFS_DIR
+#define WIFI_PHY_SYSFS_DIR		"/sys/class/ieee80211"
+#endif
 
 static const char IFACE_DIR[]           = "/data/system/wpa_supplicant";
 #ifdef WIFI_DRIVER_MODULE_PATH
@@ -177,19 +234,101 @@ char* get_samsung_wifi_type()
 }
 #endif
 
+/*
+ * Follows a property without polling: the first call to prop_waiter_next()
+ * returns the current value, every further call blocks on the property's
+ * futex until init or a client changes it.  Both fail once timeout_ms has
+ * passed since prop_waiter_init().
+ */
+struct prop_waiter {
+    const char *name;
+    struct timespec deadline;   /* CLOCK_MONOTONIC */
+    int started;
+    unsigned int initial;       /* serial at prop_waiter_init() */
+    unsigned int serial;        /* serial of the last returned value */
+};
+
+static void prop_waiter_init(struct prop_waiter *w, const char *name,
+                             int timeout_ms)
+{
+    clock_gettime(CLOCK_MONOTONIC, &w->deadline);
+    w->deadline.tv_sec += timeout_ms / 1000;
+    w->deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (w->deadline.tv_nsec >= 1000000000) {
+        w->deadline.tv_sec++;
+        w->deadline.tv_nsec -= 1000000000;
+    }
+    w->name = name;
+    w->started = 0;
+    w->initial = w->serial = property_get_serial(name);
+}
+
+/* Time left until the deadline in ms, 0 once it has passed. */
+static int prop_waiter_remaining(const struct prop_waiter *w)
+{
+    struct timespec now;
+    long long left;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    left = (w->deadline.tv_sec - now.tv_sec) * 1000LL +
+           (w->deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+    return left > 0 ? left : 0;
+}
+
+static int prop_waiter_next(struct prop_waiter *w, char *value)
+{
+    int left = prop_waiter_remaining(w);
+
+    /* the first call only waits for the property to exist */
+    if (property_wait(w->name, w->started ? w->serial : PROPERTY_SERIAL_NONE,
+                      left, &w->serial))
+        return -1;
+    w->started = 1;
+    if (!property_get(w->name, value, NULL))
+        value[0] = '\0';
+    return 0;
+}
+
+/* Whether the property has been written since prop_waiter_init(). */
+static int prop_waiter_changed(const struct prop_waiter *w)
+{
+    return w->serial != w->initial;
+}
+
 static int insmod(const char *filename, const char *args)
 {
+    struct stat st;
     void *module;
-    unsigned int size;
-    int ret;
+    int fd, ret, saved_errno;
 
-    module = load_file(filename, &size);
-    if (!module)
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
         return -1;
 
-    ret = init_module(module, size, args);
+#ifdef __NR_finit_module
+    ret = syscall(__NR_finit_module, fd, args, 0);
+    if (ret == 0 || errno != ENOSYS) {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return ret;
+    }
+#endif
+
+    /* kernels before 3.8 only take an image */
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    module = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (module == MAP_FAILED)
+        return -1;
 
-    free(module);
+    ret = init_module(module, st.st_size, args);
+    saved_errno = errno;
+    munmap(module, st.st_size);
+    errno = saved_errno;
 
     return ret;
 }
@@ -276,7 +415,7 @@ int wifi_load_driver()
 {
 #ifdef WIFI_DRIVER_MODULE_PATH
     char driver_status[PROPERTY_VALUE_MAX];
-    int count = 100; /* wait at most 20 seconds for completion */
+    struct prop_waiter waiter;
     char module_arg2[256];
 #ifdef SAMSUNG_WIFI
     char* type = get_samsung_wifi_type();
@@ -316,17 +455,15 @@ int wifi_load_driver()
     else {
         property_set("ctl.start", FIRMWARE_LOADER);
     }
-    sched_yield();
-    while (count-- > 0) {
-        if (property_get(DRIVER_PROP_NAME, driver_status, NULL)) {
-            if (strcmp(driver_status, "ok") == 0)
-                return 0;
-            else if (strcmp(driver_status, "failed") == 0) {
-                wifi_unload_driver();
-                return -1;
-            }
+    /* wait at most 20 seconds for completion */
+    prop_waiter_init(&waiter, DRIVER_PROP_NAME, 20000);
+    while (prop_waiter_next(&waiter, driver_status) == 0) {
+        if (strcmp(driver_status, "ok") == 0)
+            return 0;
+        else if (strcmp(driver_status, "failed") == 0) {
+            wifi_unload_driver();
+            return -1;
         }
-        usleep(200000);
     }
     property_set(DRIVER_PROP_NAME, "timeout");
     wifi_unload_driver();
@@ -408,92 +545,196 @@ int ensure_entropy_file_exists()
     return 0;
 }
 
-int update_ctrl_interface(const char *config_file) {
-
-    int srcfd, destfd;
-    int nread;
-    char ifc[PROPERTY_VALUE_MAX];
-    char *pbuf;
-    char *sptr;
+/*
+ * The config files are mapped rather than copied: on the usual start nothing
+ * needs to change and the file is only read through the page cache.
+ */
+static void *map_config(const char *path, size_t *len)
+{
     struct stat sb;
-    int ret;
-
-    if (stat(config_file, &sb) != 0)
-        return -1;
+    void *map;
+    int fd;
 
-    pbuf = malloc(sb.st_size + PROPERTY_VALUE_MAX);
-    if (!pbuf)
-        return 0;
-    srcfd = TEMP_FAILURE_RETRY(open(config_file, O_RDONLY));
-    if (srcfd < 0) {
-        ALOGE("Cannot open \"%s\": %s", config_file, strerror(errno));
-        free(pbuf);
-        return 0;
+    fd = TEMP_FAILURE_RETRY(open(path, O_RDONLY));
+    if (fd < 0) {
+        ALOGE("Cannot open \"%s\": %s", path, strerror(errno));
+        return NULL;
     }
-    nread = TEMP_FAILURE_RETRY(read(srcfd, pbuf, sb.st_size));
-    close(srcfd);
-    if (nread < 0) {
-        ALOGE("Cannot read \"%s\": %s", config_file, strerror(errno));
-        free(pbuf);
-        return 0;
+    if (fstat(fd, &sb) < 0) {
+        ALOGE("Cannot stat \"%s\": %s", path, strerror(errno));
+        close(fd);
+        return NULL;
     }
+    *len = sb.st_size;
+    /* an empty file maps to an empty, but valid, image */
+    map = *len ? mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0) : (void *) "";
+    close(fd);
+    if (map == MAP_FAILED) {
+        ALOGE("Cannot map \"%s\": %s", path, strerror(errno));
+        return NULL;
+    }
+    return map;
+}
+
+static void unmap_config(void *map, size_t len)
+{
+    if (len)
+        munmap(map, len);
+}
 
+static void get_ctrl_interface(const char *config_file, char *ifc)
+{
     if (!strcmp(config_file, SUPP_CONFIG_FILE)) {
         property_get("wifi.interface", ifc, WIFI_TEST_INTERFACE);
     } else {
         strcpy(ifc, CONTROL_IFACE_PATH);
     }
-    /* Assume file is invalid to begin with */
-    ret = -1;
-    /*
-     * if there is a "ctrl_interface=<value>" entry, re-write it ONLY if it is
-     * NOT a directory.  The non-directory value option is an Android add-on
-     * that allows the control interface to be exchanged through an environment
-     * variable (initialized by the "init" program when it starts a service
-     * with a "socket" option).
-     *
-     * The <value> is deemed to be a directory if the "DIR=" form is used or
-     * the value begins with "/".
-     */
-    if ((sptr = strstr(pbuf, "ctrl_interface="))) {
+}
+
+/*
+ * Look at the "ctrl_interface=<value>" entry of a config image.  It is
+ * replaced ONLY if it is NOT a directory.  The non-directory value option is
+ * an Android add-on that allows the control interface to be exchanged through
+ * an environment variable (initialized by the "init" program when it starts a
+ * service with a "socket" option).
+ *
+ * The <value> is deemed to be a directory if the "DIR=" form is used or the
+ * value begins with "/".
+ *
+ * Returns -1 if there is no entry at all, 0 if the image can be used as is,
+ * and 1 if the value in [*start, *end) has to be replaced with ifc.
+ */
+static int check_ctrl_interface(const char *buf, size_t len, const char *ifc,
+                                size_t *start, size_t *end)
+{
+    static const char key[] = "ctrl_interface=";
+    const char *value, *eol;
+    size_t mlen = strlen(ifc);
+
+    value = memmem(buf, len, key, sizeof(key) - 1);
+    if (value == NULL)
+        return -1;
+    if (memmem(buf, len, "ctrl_interface=DIR=", 19) ||
+            memmem(buf, len, "ctrl_interface=/", 16))
+        return 0;
+
+    value += sizeof(key) - 1;
+    if ((size_t) (buf + len - value) >= mlen && memcmp(value, ifc, mlen) == 0)
+        return 0;
+
+    eol = memchr(value, '\n', buf + len - value);
+    *start = value - buf;
+    *end = eol ? (size_t) (eol - buf) : len;
+    return 1;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        n = TEMP_FAILURE_RETRY(write(fd, p, len));
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * Replace config_file with buf, where [start, end) is swapped for ifc if ifc
+ * is not NULL.  The new file is written next to the old one and renamed over
+ * it, so a crash never leaves a truncated config behind.
+ */
+static int write_config(const char *config_file, const char *buf, size_t len,
+                        const char *ifc, size_t start, size_t end)
+{
+    char tmp[PATH_MAX];
+    int fd;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", config_file);
+    fd = TEMP_FAILURE_RETRY(open(tmp, O_CREAT|O_TRUNC|O_WRONLY, 0660));
+    if (fd < 0) {
+        ALOGE("Cannot create \"%s\": %s", tmp, strerror(errno));
+        return -1;
+    }
+
+    if (ifc == NULL)
+        start = end = len;
+    if (write_all(fd, buf, start) < 0 ||
+            (ifc != NULL && write_all(fd, ifc, strlen(ifc)) < 0) ||
+            write_all(fd, buf + end, len - end) < 0 ||
+            fsync(fd) < 0) {
+        ALOGE("Error writing \"%s\": %s", tmp, strerror(errno));
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+
+    /* chmod is needed because open() didn't set permisions properly */
+    if (chmod(tmp, 0660) < 0) {
+        ALOGE("Error changing permissions of %s to 0660: %s",
+             tmp, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+
+    if (chown(tmp, AID_SYSTEM, AID_WIFI) < 0) {
+        ALOGE("Error changing group ownership of %s to %d: %s",
+             tmp, AID_WIFI, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+
+    if (rename(tmp, config_file) < 0) {
+        ALOGE("Cannot replace \"%s\": %s", config_file, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns -1 only if the file has no ctrl_interface entry, i.e. is not a
+ * usable config and may be replaced with the template.  A file that cannot
+ * be read or rewritten right now is kept as it is: it still holds the
+ * user's networks.
+ */
+int update_ctrl_interface(const char *config_file) {
+
+    char ifc[PROPERTY_VALUE_MAX];
+    size_t len, start = 0, end = 0;
+    char *buf;
+    int ret;
+
+    buf = map_config(config_file, &len);
+    if (!buf)
+        return 0;
+
+    get_ctrl_interface(config_file, ifc);
+    ret = check_ctrl_interface(buf, len, ifc, &start, &end);
+    if (ret > 0) {
+        ALOGE("ctrl_interface != %s", ifc);
+        write_config(config_file, buf, len, ifc, start, end);
         ret = 0;
-        if ((!strstr(pbuf, "ctrl_interface=DIR=")) &&
-                (!strstr(pbuf, "ctrl_interface=/"))) {
-            char *iptr = sptr + strlen("ctrl_interface=");
-            int ilen = 0;
-            int mlen = strlen(ifc);
-            int nwrite;
-            if (strncmp(ifc, iptr, mlen) != 0) {
-                ALOGE("ctrl_interface != %s", ifc);
-                while (((ilen + (iptr - pbuf)) < nread) && (iptr[ilen] != '\n'))
-                    ilen++;
-                mlen = ((ilen >= mlen) ? ilen : mlen) + 1;
-                memmove(iptr + mlen, iptr + ilen + 1, nread - (iptr + ilen + 1 - pbuf));
-                memset(iptr, '\n', mlen);
-                memcpy(iptr, ifc, strlen(ifc));
-                destfd = TEMP_FAILURE_RETRY(open(config_file, O_RDWR, 0660));
-                if (destfd < 0) {
-                    ALOGE("Cannot update \"%s\": %s", config_file, strerror(errno));
-                    free(pbuf);
-                    return -1;
-                }
-                TEMP_FAILURE_RETRY(write(destfd, pbuf, nread + mlen - ilen -1));
-                close(destfd);
-            }
-        }
     }
-    free(pbuf);
+
+    unmap_config(buf, len);
     return ret;
 }
 
 int ensure_config_file_exists(const char *config_file)
 {
-    char buf[2048];
-    int srcfd, destfd;
-    struct stat sb;
-    int nread;
+    char ifc[PROPERTY_VALUE_MAX];
+    struct timespec begin, done;
+    size_t len, start = 0, end = 0;
+    char *buf;
     int ret;
 
+    clock_gettime(CLOCK_MONOTONIC, &begin);
     ret = access(config_file, R_OK|W_OK);
     if ((ret == 0) || (errno == EACCES)) {
         if ((ret != 0) &&
@@ -503,10 +744,14 @@ int ensure_config_file_exists(const char *config_file)
         }
         /* return if we were able to update control interface properly */
         if (update_ctrl_interface(config_file) >=0) {
+            clock_gettime(CLOCK_MONOTONIC, &done);
+            ALOGV("%s checked in %ld us", config_file,
+                  (long) ((done.tv_sec - begin.tv_sec) * 1000000 +
+                          (done.tv_nsec - begin.tv_nsec) / 1000));
             return 0;
         } else {
-            /* This handles the scenario where the file had bad data
-             * for some reason. We continue and recreate the file.
+            /* This handles the scenario where the file has no
+             * ctrl_interface entry. We continue and recreate the file.
              */
         }
     } else if (errno != ENOENT) {
@@ -514,55 +759,69 @@ int ensure_config_file_exists(const char *config_file)
         return -1;
     }
 
-    srcfd = TEMP_FAILURE_RETRY(open(SUPP_CONFIG_TEMPLATE, O_RDONLY));
-    if (srcfd < 0) {
-        ALOGE("Cannot open \"%s\": %s", SUPP_CONFIG_TEMPLATE, strerror(errno));
+    /* copy the template with the control interface already filled in */
+    buf = map_config(SUPP_CONFIG_TEMPLATE, &len);
+    if (!buf)
         return -1;
-    }
 
-    destfd = TEMP_FAILURE_RETRY(open(config_file, O_CREAT|O_RDWR, 0660));
-    if (destfd < 0) {
-        close(srcfd);
-        ALOGE("Cannot create \"%s\": %s", config_file, strerror(errno));
-        return -1;
-    }
+    get_ctrl_interface(config_file, ifc);
+    ret = check_ctrl_interface(buf, len, ifc, &start, &end);
+    if (write_config(config_file, buf, len, ret > 0 ? ifc : NULL,
+                     start, end) < 0)
+        ret = -1;
+    else if (ret > 0)
+        ret = 0;
 
-    while ((nread = TEMP_FAILURE_RETRY(read(srcfd, buf, sizeof(buf)))) != 0) {
-        if (nread < 0) {
-            ALOGE("Error reading \"%s\": %s", SUPP_CONFIG_TEMPLATE, strerror(errno));
-            close(srcfd);
-            close(destfd);
-            unlink(config_file);
-            return -1;
-        }
-        TEMP_FAILURE_RETRY(write(destfd, buf, nread));
-    }
+    unmap_config(buf, len);
+    return ret;
+}
 
-    close(destfd);
-    close(srcfd);
+#ifdef USES_TI_MAC80211
+static int nl_event_handler(struct nl_msg *msg, void *arg)
+{
+    struct genlmsghdr *gnlh = nlmsg_data(nlmsg_hdr(msg));
 
-    /* chmod is needed because open() didn't set permisions properly */
-    if (chmod(config_file, 0660) < 0) {
-        ALOGE("Error changing permissions of %s to 0660: %s",
-             config_file, strerror(errno));
-        unlink(config_file);
-        return -1;
-    }
+    if (gnlh->cmd == NL80211_CMD_NEW_WIPHY || gnlh->cmd == NL80211_CMD_DEL_WIPHY)
+        cached_phy = -1;
+    return NL_SKIP;
+}
 
-    if (chown(config_file, AID_SYSTEM, AID_WIFI) < 0) {
-        ALOGE("Error changing group ownership of %s to %d: %s",
-             config_file, AID_WIFI, strerror(errno));
-        unlink(config_file);
-        return -1;
-    }
-    return update_ctrl_interface(config_file);
+/*
+ * Subscribe to phy notifications.  Failing is not fatal: the phy is then
+ * looked up again for every interface change.
+ */
+static void init_nl_events()
+{
+    int group;
+
+    nl_event_soc = nl_socket_alloc();
+    if (!nl_event_soc)
+        goto fail;
+    if (genl_connect(nl_event_soc))
+        goto fail;
+    group = genl_ctrl_resolve_grp(nl_soc, "nl80211", "config");
+    if (group < 0 || nl_socket_add_membership(nl_event_soc, group))
+        goto fail;
+    nl_socket_disable_seq_check(nl_event_soc);
+    nl_socket_set_nonblocking(nl_event_soc);
+    nl_socket_modify_cb(nl_event_soc, NL_CB_VALID, NL_CB_CUSTOM,
+                        nl_event_handler, NULL);
+    return;
+
+fail:
+    ALOGW("No nl80211 config notifications, phy index will not be cached.");
+    if (nl_event_soc)
+        nl_socket_free(nl_event_soc);
+    nl_event_soc = NULL;
 }
 
-#ifdef USES_TI_MAC80211
 static int init_nl()
 {
     int err;
 
+    if (nl_soc)
+        return 0;
+
     nl_soc = nl_socket_alloc();
     if (!nl_soc) {
         ALOGE("Failed to allocate netlink socket.");
@@ -589,20 +848,31 @@ static int init_nl()
         goto out_cache_free;
     }
 
+    init_nl_events();
+    cached_phy = -1;
     return 0;
 
 out_cache_free:
     nl_cache_free(nl_cache);
+    nl_cache = NULL;
 out_handle_destroy:
     nl_socket_free(nl_soc);
+    nl_soc = NULL;
     return err;
 }
 
 static void deinit_nl()
 {
+    if (nl_event_soc)
+        nl_socket_free(nl_event_soc);
     genl_family_put(nl80211);
     nl_cache_free(nl_cache);
     nl_socket_free(nl_soc);
+    nl_event_soc = NULL;
+    nl80211 = NULL;
+    nl_cache = NULL;
+    nl_soc = NULL;
+    cached_phy = -1;
 }
 
 // ignore the "." and ".." entries
@@ -629,10 +899,10 @@ int phy_lookup()
         usleep(WIFI_DRIVER_LOADER_DELAY);
 #endif
 
-    n = scandir("/sys/class/ieee80211", &namelist, dir_filter,
+    n = scandir(WIFI_PHY_SYSFS_DIR, &namelist, dir_filter,
                 (int (*)(const struct dirent**, const struct dirent**))alphasort);
     if (n != 1) {
-        ALOGE("unexpected - found %d phys in /sys/class/ieee80211", n);
+        ALOGE("unexpected - found %d phys in " WIFI_PHY_SYSFS_DIR, n);
         for (i = 0; i < n; i++)
             free(namelist[i]);
         if (n > 0)
@@ -640,7 +910,7 @@ int phy_lookup()
         return -1;
     }
 
-    snprintf(buf, sizeof(buf), "/sys/class/ieee80211/%s/index",
+    snprintf(buf, sizeof(buf), WIFI_PHY_SYSFS_DIR "/%s/index",
              namelist[0]->d_name);
     free(namelist[0]);
     free(namelist);
@@ -658,6 +928,30 @@ int phy_lookup()
     return atoi(buf);
 }
 
+/* The phy index, from the cache unless a notification says it changed. */
+static int get_phy()
+{
+    struct pollfd pfd;
+
+    if (!nl_event_soc)
+        return phy_lookup();
+
+    pfd.fd = nl_socket_get_fd(nl_event_soc);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    while (poll(&pfd, 1, 0) > 0) {
+        if (nl_recvmsgs_default(nl_event_soc) < 0) {
+            /* e.g. the queue overflowed: assume we missed something */
+            cached_phy = -1;
+            break;
+        }
+    }
+
+    if (cached_phy < 0)
+        cached_phy = phy_lookup();
+    return cached_phy;
+}
+
 int nl_error_handler(struct sockaddr_nl *nla, struct nlmsgerr *err, void *arg)
 {
     int *ret = (int *)arg;
@@ -690,7 +984,11 @@ static int execute_nl_interface_cmd(const char *iface,
     int add_interface = (cmd == NL80211_CMD_NEW_INTERFACE);
 
     if (add_interface) {
-        devidx = phy_lookup();
+        devidx = get_phy();
+        if (devidx < 0) {
+            ALOGE("failed to find the wiphy");
+            return -ENODEV;
+        }
     } else {
         devidx = if_nametoindex(iface);
         if (devidx == 0) {
@@ -737,6 +1035,10 @@ static int execute_nl_interface_cmd(const char *iface,
 
     while (err > 0)
         nl_recvmsgs(nl_soc, cb);
+
+    /* a stale phy index is looked up again next time */
+    if (err < 0 && add_interface)
+        cached_phy = -1;
 out:
     nl_cb_put(cb);
 out_free_msg:
@@ -772,8 +1074,10 @@ int add_remove_p2p_interface(int add)
     }
 
     ALOGD("added/removed p2p interface. add: %d", add);
+    return 0;
 
 cleanup:
+    /* start from a fresh netlink context next time */
     deinit_nl();
     return ret;
 }
@@ -782,11 +1086,7 @@ cleanup:
 int wifi_start_supplicant(int p2p_supported)
 {
     char supp_status[PROPERTY_VALUE_MAX] = {'\0'};
-    int count = 200; /* wait at most 20 seconds for completion */
-#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
-    const prop_info *pi;
-    unsigned serial = 0, i;
-#endif
+    struct prop_waiter waiter;
 
     if (p2p_supported) {
         strcpy(supplicant_name, P2P_SUPPLICANT_NAME);
@@ -832,45 +1132,25 @@ int wifi_start_supplicant(int p2p_supported)
     /* Reset sockets used for exiting from hung state */
     exit_sockets[0] = exit_sockets[1] = -1;
 
-#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
     /*
-     * Get a reference to the status property, so we can distinguish
-     * the case where it goes stopped => running => stopped (i.e.,
-     * it start up, but fails right away) from the case in which
+     * Start following the status property before the start request, so we
+     * can distinguish the case where it goes stopped => running => stopped
+     * (i.e., it start up, but fails right away) from the case in which
      * it starts in the stopped state and never manages to start
-     * running at all.
+     * running at all.  Wait at most 20 seconds for completion.
      */
-    pi = __system_property_find(supplicant_prop_name);
-    if (pi != NULL) {
-        serial = __system_property_serial(pi);
-    }
-#endif
+    prop_waiter_init(&waiter, supplicant_prop_name, 20000);
     property_get("wifi.interface", primary_iface, WIFI_TEST_INTERFACE);
 
     property_set("ctl.start", supplicant_name);
-    sched_yield();
 
-    while (count-- > 0) {
-#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
-        if (pi == NULL) {
-            pi = __system_property_find(supplicant_prop_name);
-        }
-        if (pi != NULL) {
-            __system_property_read(pi, NULL, supp_status);
-            if (strcmp(supp_status, "running") == 0) {
-                return 0;
-            } else if (__system_property_serial(pi) != serial &&
-                    strcmp(supp_status, "stopped") == 0) {
-                return -1;
-            }
-        }
-#else
-        if (property_get(supplicant_prop_name, supp_status, NULL)) {
-            if (strcmp(supp_status, "running") == 0)
-                return 0;
+    while (prop_waiter_next(&waiter, supp_status) == 0) {
+        if (strcmp(supp_status, "running") == 0) {
+            return 0;
+        } else if (prop_waiter_changed(&waiter) &&
+                strcmp(supp_status, "stopped") == 0) {
+            return -1;
         }
-#endif
-        usleep(100000);
     }
     return -1;
 }
@@ -878,7 +1158,7 @@ int wifi_start_supplicant(int p2p_supported)
 int wifi_stop_supplicant(int p2p_supported)
 {
     char supp_status[PROPERTY_VALUE_MAX] = {'\0'};
-    int count = 50; /* wait at most 5 seconds for completion */
+    struct prop_waiter waiter;
 
     if (p2p_supported) {
         strcpy(supplicant_name, P2P_SUPPLICANT_NAME);
@@ -901,20 +1181,174 @@ int wifi_stop_supplicant(int p2p_supported)
     }
 #endif
 
+    /* wait at most 5 seconds for completion */
+    prop_waiter_init(&waiter, supplicant_prop_name, 5000);
     property_set("ctl.stop", supplicant_name);
-    sched_yield();
 
-    while (count-- > 0) {
-        if (property_get(supplicant_prop_name, supp_status, NULL)) {
-            if (strcmp(supp_status, "stopped") == 0)
-                return 0;
-        }
-        usleep(100000);
+    while (prop_waiter_next(&waiter, supp_status) == 0) {
+        if (strcmp(supp_status, "stopped") == 0)
+            return 0;
     }
     ALOGE("Failed to stop supplicant");
     return -1;
 }
 
+/*
+ * Borrow an idle command connection, opening another one if all are busy.
+ * The open blocks on the supplicant, so it is done without ctrl_lock and
+ * the other callers keep getting connections meanwhile.
+ */
+static int ctrl_acquire(void)
+{
+    char path[PATH_MAX];
+    int open_failed = 0;
+    int i;
+
+    pthread_mutex_lock(&ctrl_lock);
+    for (;;) {
+        if (ctrl_count == 0) {
+            pthread_mutex_unlock(&ctrl_lock);
+            return -1;
+        }
+        for (i = 0; i < ctrl_count; i++) {
+            if (!ctrl_busy[i])
+                goto found;
+        }
+        if (!open_failed && ctrl_count + ctrl_opening < CTRL_POOL_MAX) {
+            unsigned int generation = ctrl_generation;
+            struct wpa_ctrl *conn;
+
+            ctrl_opening++;
+            strlcpy(path, ctrl_path, sizeof(path));
+            pthread_mutex_unlock(&ctrl_lock);
+            conn = wpa_ctrl_open(path);
+            pthread_mutex_lock(&ctrl_lock);
+            ctrl_opening--;
+            if (conn != NULL && generation != ctrl_generation) {
+                /* closed while we were opening */
+                wpa_ctrl_close(conn);
+                pthread_mutex_unlock(&ctrl_lock);
+                return -1;
+            }
+            if (conn != NULL) {
+                i = ctrl_count++;
+                ctrl_pool[i] = conn;
+                goto found;
+            }
+            ALOGW("Unable to open extra connection to supplicant: %s",
+                 strerror(errno));
+            /* a connection may have come free while unlocked: look again */
+            open_failed = 1;
+            continue;
+        }
+        pthread_cond_wait(&ctrl_cond, &ctrl_lock);
+    }
+found:
+    ctrl_busy[i] = 1;
+    pthread_mutex_unlock(&ctrl_lock);
+    return i;
+}
+
+static void ctrl_release(int i)
+{
+    pthread_mutex_lock(&ctrl_lock);
+    ctrl_busy[i] = 0;
+    pthread_cond_broadcast(&ctrl_cond);
+    pthread_mutex_unlock(&ctrl_lock);
+}
+
+/* Stop handing out connections, wait for requests in flight and close all. */
+static void ctrl_close_all(void)
+{
+    int i, n;
+
+    pthread_mutex_lock(&ctrl_lock);
+    n = ctrl_count;
+    ctrl_count = 0;
+    ctrl_generation++;
+    for (i = 0; i < n; i++) {
+        while (ctrl_busy[i])
+            pthread_cond_wait(&ctrl_cond, &ctrl_lock);
+        wpa_ctrl_close(ctrl_pool[i]);
+        ctrl_pool[i] = NULL;
+    }
+    ctrl_conn = NULL;
+    pthread_mutex_unlock(&ctrl_lock);
+}
+
+static void record_latency(const char *cmd, long ms, int timed_out)
+{
+    struct command_stats *stats = NULL;
+    size_t len;
+    int i, bucket;
+
+    /* account "IFNAME=wlan0 SCAN" under SCAN */
+    if (strncmp(cmd, IFNAME, IFNAMELEN) == 0 && strchr(cmd, ' ') != NULL)
+        cmd = strchr(cmd, ' ') + 1;
+    len = strcspn(cmd, " ");
+    if (len >= sizeof(stats->name))
+        len = sizeof(stats->name) - 1;
+
+    for (bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++) {
+        if (ms < (1L << bucket))
+            break;
+    }
+
+    pthread_mutex_lock(&stats_lock);
+    for (i = 0; i < command_stats_count; i++) {
+        if (strncmp(command_stats[i].name, cmd, len) == 0 &&
+                command_stats[i].name[len] == '\0') {
+            stats = &command_stats[i];
+            break;
+        }
+    }
+    if (stats == NULL) {
+        if (command_stats_count < MAX_TRACKED_COMMANDS) {
+            stats = &command_stats[command_stats_count++];
+            memcpy(stats->name, cmd, len);
+            stats->name[len] = '\0';
+        } else {
+            stats = &command_stats[MAX_TRACKED_COMMANDS];
+        }
+    }
+    stats->count++;
+    if (timed_out)
+        stats->timeouts++;
+    stats->buckets[bucket]++;
+    pthread_mutex_unlock(&stats_lock);
+}
+
+int wifi_get_command_stats(char *buf, size_t buflen)
+{
+    size_t len = 0;
+    int i, b;
+
+#define APPEND(...) \
+    len += snprintf(buf + (len < buflen ? len : buflen), \
+                    len < buflen ? buflen - len : 0, __VA_ARGS__)
+
+    pthread_mutex_lock(&stats_lock);
+    for (i = 0; i <= command_stats_count; i++) {
+        const struct command_stats *stats = &command_stats[i];
+
+        if (i == command_stats_count) {
+            /* the overflow entry, if anything went there */
+            stats = &command_stats[MAX_TRACKED_COMMANDS];
+            if (stats->count == 0)
+                break;
+        }
+        APPEND("%s count=%u timeouts=%u", stats->name, stats->count,
+               stats->timeouts);
+        for (b = 0; b < LATENCY_BUCKETS - 1; b++)
+            APPEND(" <%ldms:%u", 1L << b, stats->buckets[b]);
+        APPEND(" >=%ldms:%u\n", 1L << (LATENCY_BUCKETS - 2),
+               stats->buckets[LATENCY_BUCKETS - 1]);
+    }
+    pthread_mutex_unlock(&stats_lock);
+#undef APPEND
+    return len;
+}
+
 int wifi_connect_on_socket_path(const char *path)
 {
     char supp_status[PROPERTY_VALUE_MAX] = {'\0'};
@@ -952,6 +1386,13 @@ int wifi_connect_on_socket_path(const char *path)
         return -1;
     }
 
+    pthread_mutex_lock(&ctrl_lock);
+    strlcpy(ctrl_path, path, sizeof(ctrl_path));
+    ctrl_pool[0] = ctrl_conn;
+    ctrl_busy[0] = 0;
+    ctrl_count = 1;
+    pthread_mutex_unlock(&ctrl_lock);
+
     return 0;
 }
 
@@ -971,11 +1412,21 @@ int wifi_connect_to_supplicant()
 int wifi_send_command(const char *cmd, char *reply, size_t *reply_len)
 {
     int ret;
-    if (ctrl_conn == NULL) {
+    int conn;
+    struct timespec start, end;
+
+    conn = ctrl_acquire();
+    if (conn < 0) {
         ALOGV("Not connected to wpa_supplicant - \"%s\" command dropped.\n", cmd);
         return -1;
     }
-    ret = wpa_ctrl_request(ctrl_conn, cmd, strlen(cmd), reply, reply_len, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ret = wpa_ctrl_request(ctrl_pool[conn], cmd, strlen(cmd), reply, reply_len, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ctrl_release(conn);
+
+    record_latency(cmd, (end.tv_sec - start.tv_sec) * 1000 +
+                   (end.tv_nsec - start.tv_nsec) / 1000000, ret == -2);
     if (ret == -2) {
         ALOGD("'%s' command timed out.\n", cmd);
         /* unblocks the monitor receive socket for termination */
@@ -1089,12 +1540,178 @@ int wifi_wait_for_event(char *buf, size_t buflen)
     return wifi_wait_on_socket(buf, buflen);
 }
 
-void wifi_close_sockets()
+struct event_name {
+    const char *name;
+    size_t len;
+    enum wifi_event_type type;
+    int prefix;                 /* matches any name starting with name */
+};
+
+#define EVENT_NAME(n, t)        { n, sizeof(n) - 1, t, 0 }
+#define EVENT_PREFIX(n, t)      { n, sizeof(n) - 1, t, 1 }
+
+/* names following "CTRL-EVENT-" */
+static const struct event_name ctrl_event_names[] = {
+    EVENT_NAME("CONNECTED", WIFI_EVENT_CONNECTED),
+    EVENT_NAME("DISCONNECTED", WIFI_EVENT_DISCONNECTED),
+    EVENT_NAME("STATE-CHANGE", WIFI_EVENT_STATE_CHANGE),
+    EVENT_NAME("SCAN-STARTED", WIFI_EVENT_SCAN_STARTED),
+    EVENT_NAME("SCAN-RESULTS", WIFI_EVENT_SCAN_RESULTS),
+    EVENT_NAME("BSS-ADDED", WIFI_EVENT_BSS_ADDED),
+    EVENT_NAME("BSS-REMOVED", WIFI_EVENT_BSS_REMOVED),
+    EVENT_NAME("TERMINATING", WIFI_EVENT_TERMINATING),
+    EVENT_NAME("DRIVER-STATE", WIFI_EVENT_DRIVER_STATE),
+    EVENT_NAME("LINK-SPEED", WIFI_EVENT_LINK_SPEED),
+    EVENT_NAME("ASSOC-REJECT", WIFI_EVENT_ASSOC_REJECT),
+    EVENT_NAME("SSID-TEMP-DISABLED", WIFI_EVENT_SSID_TEMP_DISABLED),
+    EVENT_NAME("SSID-REENABLED", WIFI_EVENT_SSID_REENABLED),
+    EVENT_NAME("IGNORE", WIFI_EVENT_IGNORE),
+    EVENT_PREFIX("EAP-", WIFI_EVENT_EAP),
+    EVENT_PREFIX("REQ-", WIFI_EVENT_REQUEST),
+};
+
+static const struct event_name other_event_names[] = {
+    EVENT_PREFIX("WPS-", WIFI_EVENT_WPS),
+    EVENT_PREFIX("P2P-", WIFI_EVENT_P2P),
+    EVENT_NAME("AP-STA-CONNECTED", WIFI_EVENT_AP_STA_CONNECTED),
+    EVENT_NAME("AP-STA-DISCONNECTED", WIFI_EVENT_AP_STA_DISCONNECTED),
+};
+
+static enum wifi_event_type lookup_event(const struct event_name *names,
+                                         size_t count, const char *name,
+                                         size_t len)
 {
-    if (ctrl_conn != NULL) {
-        wpa_ctrl_close(ctrl_conn);
-        ctrl_conn = NULL;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if ((names[i].prefix ? len >= names[i].len : len == names[i].len) &&
+                memcmp(name, names[i].name, names[i].len) == 0)
+            return names[i].type;
+    }
+    return WIFI_EVENT_OTHER;
+}
+
+static enum wifi_event_type classify_event(const char *name, size_t len)
+{
+    static const char ctrl_event[] = "CTRL-EVENT-";
+    const size_t ctrl_event_len = sizeof(ctrl_event) - 1;
+
+    if (len > ctrl_event_len && memcmp(name, ctrl_event, ctrl_event_len) == 0)
+        return lookup_event(ctrl_event_names,
+                            sizeof(ctrl_event_names) / sizeof(ctrl_event_names[0]),
+                            name + ctrl_event_len, len - ctrl_event_len);
+    return lookup_event(other_event_names,
+                        sizeof(other_event_names) / sizeof(other_event_names[0]),
+                        name, len);
+}
+
+int wifi_parse_event(const char *buf, size_t len, struct wifi_event *event)
+{
+    const char *p = buf;
+    const char *end = buf + len;
+    const char *q;
+
+    memset(event, 0, sizeof(*event));
+    event->level = -1;
+
+    if (len >= IFNAMELEN && memcmp(p, IFNAME, IFNAMELEN) == 0) {
+        q = memchr(p + IFNAMELEN, ' ', len - IFNAMELEN);
+        if (q == NULL) {
+            /* what wifi_wait_for_event() reports for it */
+            event->type = WIFI_EVENT_IGNORE;
+            event->text = WPA_EVENT_IGNORE;
+            event->text_len = sizeof(WPA_EVENT_IGNORE) - 1;
+            event->name = WPA_EVENT_IGNORE;
+            event->name_len = sizeof(WPA_EVENT_IGNORE) - 2;
+            event->payload = WPA_EVENT_IGNORE + event->text_len;
+            return -1;
+        }
+        event->iface = p + IFNAMELEN;
+        event->iface_len = q - event->iface;
+        p = q + 1;
+    }
+
+    if (p < end && *p == '<') {
+        q = memchr(p, '>', end - p);
+        if (q != NULL) {
+            int level = 0;
+            const char *d;
+
+            for (d = p + 1; d < q && *d >= '0' && *d <= '9'; d++)
+                level = level * 10 + (*d - '0');
+            event->level = level;
+            p = q + 1;
+        }
+    }
+
+    event->text = p;
+    event->text_len = end - p;
+    q = memchr(p, ' ', end - p);
+    if (q == NULL)
+        q = end;
+    event->name = p;
+    event->name_len = q - p;
+    event->payload = q < end ? q + 1 : end;
+    event->payload_len = end - event->payload;
+    event->type = classify_event(event->name, event->name_len);
+    return 0;
+}
+
+/* room kept free in the batch buffer for one more event */
+#define EVENT_MIN_SPACE         256
+
+int wifi_wait_for_events(char *buf, size_t buflen, struct wifi_event *events,
+                         int max_events)
+{
+    const char *reason = NULL;
+    size_t used = 0;
+    int count = 0;
+
+    if (max_events <= 0 || buflen < EVENT_MIN_SPACE)
+        return 0;
+    if (monitor_conn == NULL)
+        reason = " - connection closed";
+
+    while (reason == NULL && count < max_events &&
+            buflen - used >= EVENT_MIN_SPACE) {
+        size_t nread = buflen - used - 1;
+        int result;
+
+        /* only the first receive may block */
+        if (count > 0 && wpa_ctrl_pending(monitor_conn) <= 0)
+            break;
+        if (count == 0)
+            result = wifi_ctrl_recv(buf + used, &nread);
+        else
+            result = wpa_ctrl_recv(monitor_conn, buf + used, &nread);
+
+        if (result == -2) {
+            reason = " - connection closed";
+        } else if (result < 0) {
+            ALOGD("wifi_ctrl_recv failed: %s\n", strerror(errno));
+            reason = " - recv error";
+        } else if (nread == 0) {
+            ALOGD("Received EOF on supplicant socket\n");
+            reason = " - signal 0 received";
+        } else {
+            buf[used + nread] = '\0';
+            /* a malformed event comes back as IGNORE, as it always did */
+            wifi_parse_event(buf + used, nread, &events[count++]);
+            used += nread + 1;
+        }
+    }
+
+    if (reason != NULL && count < max_events) {
+        int len = snprintf(buf + used, buflen - used, WPA_EVENT_TERMINATING "%s",
+                           reason);
+        wifi_parse_event(buf + used, len, &events[count++]);
     }
+    return count;
+}
+
+void wifi_close_sockets()
+{
+    ctrl_close_all();
 
     if (monitor_conn != NULL) {
         wpa_ctrl_close(monitor_conn);
@@ -1115,24 +1732,71 @@ void wifi_close_sockets()
 void wifi_close_supplicant_connection()
 {
     char supp_status[PROPERTY_VALUE_MAX] = {'\0'};
-    int count = 50; /* wait at most 5 seconds to ensure init has stopped stupplicant */
+    struct prop_waiter waiter;
 
+    /* wait at most 5 seconds to ensure init has stopped stupplicant */
+    prop_waiter_init(&waiter, supplicant_prop_name, 5000);
     wifi_close_sockets();
 
-    while (count-- > 0) {
-        if (property_get(supplicant_prop_name, supp_status, NULL)) {
-            if (strcmp(supp_status, "stopped") == 0)
-                return;
-        }
-        usleep(100000);
+    while (prop_waiter_next(&waiter, supp_status) == 0) {
+        if (strcmp(supp_status, "stopped") == 0)
+            return;
     }
 }
 
+/* Runs on a pooled connection and is timed, see wifi_command.h. */
 int wifi_command(const char *command, char *reply, size_t *reply_len)
 {
     return wifi_send_command(command, reply, reply_len);
 }
 
+/*
+ * Like any wpa_ctrl_request(), a reply longer than REPLY_BUF_SIZE - 1 bytes
+ * is cut short; page through big results such as the scan list with
+ * BSS RANGE= instead.
+ */
+int wifi_command_pooled(const char *command, char **reply, size_t *reply_len)
+{
+    char *buf = NULL;
+    int ret;
+
+    pthread_mutex_lock(&ctrl_lock);
+    if (reply_pool_count > 0)
+        buf = reply_pool[--reply_pool_count];
+    pthread_mutex_unlock(&ctrl_lock);
+    if (buf == NULL) {
+        buf = malloc(REPLY_BUF_SIZE);
+        if (buf == NULL) {
+            *reply = NULL;
+            return -1;
+        }
+    }
+
+    *reply_len = REPLY_BUF_SIZE - 1;
+    ret = wifi_send_command(command, buf, reply_len);
+    if (ret != 0) {
+        wifi_release_reply(buf);
+        *reply = NULL;
+        return ret;
+    }
+    buf[*reply_len] = '\0';
+    *reply = buf;
+    return 0;
+}
+
+void wifi_release_reply(char *reply)
+{
+    if (reply == NULL)
+        return;
+    pthread_mutex_lock(&ctrl_lock);
+    if (reply_pool_count < REPLY_POOL_MAX) {
+        reply_pool[reply_pool_count++] = reply;
+        reply = NULL;
+    }
+    pthread_mutex_unlock(&ctrl_lock);
+    free(reply);
+}
+
 const char *wifi_get_fw_path(int fw_type)
 {
     switch (fw_type) {
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_CAMERA_FRAME_POOL_H
+#define __CUTILS_CAMERA_FRAME_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*
+ * Recycled, reference counted camera frames that can be shared with other
+ * processes without a copy.
+ *
+ * All frames live in one ashmem region, and so do their reference counts and
+ * the free list, so a frame can be handed to another process as the region's
+ * fd plus the frame's offset and released from there.  The producer takes a
+ * free frame with camera_frame_pool_dequeue(), fills it and delivers it
+ * holding one reference.  Every receiver releases what it got with
+ * camera_frame_release(), and the frame goes back to the pool when the last
+ * reference is dropped, in whichever process that happens.
+ *
+ * A process other than the producer maps the pool with
+ * camera_frame_pool_attach().  References are accounted per process: to pass
+ * one on, the sender calls camera_frame_export() and sends the returned
+ * offset, and the receiver takes the reference over with
+ * camera_frame_pool_import().  A receiver that dies holding frames leaks
+ * them for the life of the region.
+ *
+ * Backpressure: when every frame is still held by receivers, or when
+ * max_in_flight frames are, dequeue returns NULL and the producer drops that
+ * frame instead of waiting.
+ *
+ * Every process that maps the pool can write all of it, the free list and
+ * the reference counts included.  Each process checks what it reads from
+ * there against the layout it saw at create or attach time, so a receiver
+ * that scribbles over the region can lose or duplicate frames, but cannot
+ * make the producer read or write outside the region.
+ */
+
+struct camera_frame_pool;
+
+typedef struct camera_frame {
+    /* fixed for the life of the pool handle */
+    struct camera_frame_pool *pool;
+    uint32_t index;
+    void *data;
+    size_t size;
+    size_t offset;              /* into the region behind camera_frame_pool_fd() */
+
+    /* set by the producer before delivery, carried across export/import */
+    int32_t msg_type;           /* CAMERA_MSG_PREVIEW_FRAME or _VIDEO_FRAME */
+    int64_t timestamp;
+    uint32_t sequence;          /* counts dropped frames too */
+} camera_frame_t;
+
+struct camera_frame_pool_stats {
+    uint32_t delivered;         /* frames handed out by dequeue */
+    uint32_t dropped;           /* dequeue calls refused for backpressure */
+    uint32_t in_flight;         /* frames not back in the pool */
+};
+
+/*
+ * count frames of frame_size bytes.  max_in_flight caps the frames receivers
+ * may hold at once, 0 meaning all of them.  count is at most 65535.  NULL on
+ * failure.
+ */
+struct camera_frame_pool *camera_frame_pool_create(const char *name,
+        uint32_t count, size_t frame_size, uint32_t max_in_flight);
+
+/*
+ * Map a pool created by another process from its region fd, which is not
+ * closed.  NULL if fd does not hold a frame pool.
+ */
+struct camera_frame_pool *camera_frame_pool_attach(int fd);
+
+/*
+ * Drop this process's hold on the pool, created or attached.  The mapping
+ * goes away once every frame referenced from this process has been released
+ * or exported.
+ */
+void camera_frame_pool_destroy(struct camera_frame_pool *pool);
+
+/* ashmem fd of the region holding the frames, for sharing with a client. */
+int camera_frame_pool_fd(const struct camera_frame_pool *pool);
+
+/*
+ * A free frame with one reference, or NULL if the frame has to be dropped.
+ * Never blocks.
+ */
+camera_frame_t *camera_frame_pool_dequeue(struct camera_frame_pool *pool);
+
+/* Take another reference, e.g. to deliver the frame to a second receiver. */
+void camera_frame_acquire(camera_frame_t *frame);
+
+/* Drop a reference; the last one returns the frame to its pool. */
+void camera_frame_release(camera_frame_t *frame);
+
+/*
+ * Hand one of this process's references to another process.  Returns the
+ * frame's offset to send along with the region fd; frame must not be used
+ * through that reference here any more.
+ */
+size_t camera_frame_export(camera_frame_t *frame);
+
+/*
+ * Take over a reference exported by another process, NULL if offset is not
+ * a frame of the pool.
+ */
+camera_frame_t *camera_frame_pool_import(struct camera_frame_pool *pool,
+        size_t offset);
+
+void camera_frame_pool_get_stats(struct camera_frame_pool *pool,
+        struct camera_frame_pool_stats *stats);
+
+__END_DECLS
+
+#endif /* __CUTILS_CAMERA_FRAME_POOL_H */
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __CUTILS_PROPERTY_WAIT_H
+#define __CUTILS_PROPERTY_WAIT_H
+
+#include <sys/cdefs.h>
+
+__BEGIN_DECLS
+
+/*
+ * Waiting for a property to change without polling.
+ *
+ * Every value a property takes gets a new serial in the property area, and
+ * init wakes the futex on that serial whenever it writes the property.  A
+ * waiter remembers the serial of the value it has seen and sleeps on the
+ * futex until the serial moves on.  A property that does not exist yet
+ * has no futex to sleep on, so its creation is polled for.
+ *
+ * Not for use by init itself: init is the only writer, and would wait for
+ * itself forever.
+ */
+
+/* Serial of a property that does not exist.  No real serial has it. */
+#define PROPERTY_SERIAL_NONE 0xffffffffu
+
+/* How often a property that does not exist yet is looked for, in ms. */
+#define PROPERTY_WAIT_CREATE_POLL_MS 20
+
+/* Serial of the current value of name, or PROPERTY_SERIAL_NONE. */
+unsigned int property_get_serial(const char *name);
+
+/*
+ * Wait until the serial of name differs from old_serial, which is usually
+ * what property_get_serial() or the previous wait returned.  Pass
+ * PROPERTY_SERIAL_NONE to wait for the property to exist.  timeout_ms < 0
+ * waits forever.
+ *
+ * Returns 0 and stores the new serial in *new_serial if it is not NULL,
+ * or -1 with errno set to ETIMEDOUT.
+ */
+int property_wait(const char *name, unsigned int old_serial, int timeout_ms,
+                  unsigned int *new_serial);
+
+__END_DECLS
+
+#endif /* __CUTILS_PROPERTY_WAIT_H */
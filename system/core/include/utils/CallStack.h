@@ -82,9 +82,33 @@ public:
     // Dump a serialized representation of the stack trace to the specified printer.
     void print(Printer& printer) const;
 
+    // Capture only the PCs of the current thread's stack, without going
+    // through libcorkscrew.  pcs must hold maxDepth entries.  Returns the
+    // number of frames captured.
+    static size_t capture(uintptr_t* pcs, size_t maxDepth, int32_t ignoreDepth=1);
+
+    // Print a stack captured with capture().
+    static void printPcs(Printer& printer, const uintptr_t* pcs, size_t count);
+
+    // Print count stacks one after the other.  Every frame that has not been
+    // seen before is symbolized in a single pass.
+    static void printStacks(Printer& printer, const CallStack* stacks, size_t count);
+
+    // Symbols are cached, keyed by the name of the mapping a PC falls in and
+    // its offset there; whatever a print does not need is dropped whenever
+    // the cache would grow past a few thousand entries.  Drop them all now,
+    // e.g. after a library has been replaced on disk.
+    static void flushSymbolCache();
+
     // Get the count of stack frames that are in this call stack.
     size_t size() const { return mCount; }
 
+    // Hash of the PCs alone.  Equal stacks hash the same within a process,
+    // but PCs move with the load address, so the hash does not carry over
+    // to other processes or runs.
+    uint64_t hash() const;
+    static uint64_t hash(const uintptr_t* pcs, size_t count);
+
 private:
     size_t mCount;
     backtrace_frame_t mStack[MAX_DEPTH];
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CALLSTACK_TABLE_H
+#define ANDROID_CALLSTACK_TABLE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/CallStack.h>
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class Printer;
+
+// Interns stacks of raw PCs: identical stacks share one id, and every id
+// carries a sample count.  This is the aggregation side of a sampling
+// profiler: record a stack per sample, dump the hottest ones.
+//
+// In memory the stacks are PCs of this process.  Only the serialized form
+// can move between processes and runs, see serialize().
+class CallStackTable {
+public:
+    enum {
+        // Returned when the table is full.
+        NO_STACK = 0,
+    };
+
+    explicit CallStackTable(size_t maxStacks = 4096);
+    ~CallStackTable();
+
+    // Id of the stack, added with no samples if it is new.
+    uint32_t intern(const uintptr_t* pcs, size_t count);
+    uint32_t intern(const CallStack& stack);
+
+    // Intern the stack and add weight samples to it.
+    uint32_t addSample(const uintptr_t* pcs, size_t count, uint32_t weight = 1);
+
+    // Capture the current thread's stack and add weight samples to it.
+    uint32_t sample(uint32_t weight = 1, int32_t ignoreDepth = 1);
+
+    size_t size() const;
+    uint64_t getSamples(uint32_t id) const;
+
+    // Copy the PCs of id, at most maxDepth of them.  Returns the depth.
+    size_t getPcs(uint32_t id, uintptr_t* pcs, size_t maxDepth) const;
+
+    void clear();
+
+    // Compact form of the table.  Stack ids are implied by their order, and
+    // each frame is stored as the path of the library it falls in and the
+    // offset there, so that it survives a different load address.
+    void serialize(Vector<uint8_t>* out) const;
+    // Merge a serialized table, from this or another process, into this
+    // one.  Frames are placed where their library is loaded here; a stack
+    // ends above a frame whose library is not loaded, or that was in no
+    // library at all.  Nothing is merged if the data is bad or the stacks
+    // do not all fit.
+    status_t deserialize(const uint8_t* data, size_t size);
+
+    // Print the maxStacks stacks with the most samples.
+    void dump(Printer& printer, size_t maxStacks = 20) const;
+
+private:
+    struct Entry {
+        uint64_t hash;
+        uint32_t offset;    // into mPcs
+        uint32_t depth;
+        uint64_t samples;
+    };
+
+                            CallStackTable(const CallStackTable&);
+            CallStackTable& operator = (const CallStackTable&);
+
+    uint32_t findLocked(const uintptr_t* pcs, size_t count, uint64_t hash,
+            size_t* bucket) const;
+    uint32_t internLocked(const uintptr_t* pcs, size_t count);
+    status_t mergeLocked(const CallStackTable& other);
+
+    const size_t mMaxStacks;
+    const size_t mBucketMask;
+    mutable Mutex mLock;
+    uint32_t* mBuckets;     // ids, 0 when empty
+    Vector<Entry> mEntries; // by id - 1
+    Vector<uintptr_t> mPcs;
+};
+
+}; // namespace android
+
+#endif // ANDROID_CALLSTACK_TABLE_H
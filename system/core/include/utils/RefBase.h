@@ -19,11 +19,13 @@
 
 #include <cutils/atomic.h>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <sys/types.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <utils/RefSampler.h>
 #include <utils/StrongPointer.h>
 #include <utils/TypeHelpers.h>
 
@@ -184,10 +186,12 @@ class LightRefBase
 {
 public:
     inline LightRefBase() : mCount(0) { }
-    inline void incStrong(__attribute__((unused)) const void* id) const {
+    inline void incStrong(const void* id) const {
+        RefSampler::onIncStrong(id);
         android_atomic_inc(&mCount);
     }
-    inline void decStrong(__attribute__((unused)) const void* id) const {
+    inline void decStrong(const void* id) const {
+        RefSampler::onDecStrong(id);
         if (android_atomic_dec(&mCount) == 1) {
             delete static_cast<const T*>(this);
         }
@@ -204,9 +208,17 @@ protected:
 
 private:
     friend class ReferenceMover;
-    inline static void renameRefs(size_t n, const ReferenceRenamer& renamer) { }
+    inline static void renameRefs(size_t n, const ReferenceRenamer& renamer) {
+        if (RefSampler::isSampling()) {
+            for (size_t i = 0; i < n; i++) {
+                renamer(i);
+            }
+        }
+    }
     inline static void renameRefId(T* ref,
-            const void* old_id, const void* new_id) { }
+            const void* old_id, const void* new_id) {
+        if (ref) RefSampler::onMoveStrong(old_id, new_id);
+    }
 
 private:
     mutable volatile int32_t mCount;
@@ -214,6 +226,202 @@ private:
 
 // ---------------------------------------------------------------------------
 
+/*
+ * A LightRefBase for objects that are referenced mostly from one thread.
+ *
+ * The thread that takes the first reference becomes the owner, and its
+ * references are counted without atomics.  Other threads count theirs in a
+ * separate atomic count.  When the owner drops its last reference, it merges
+ * into the atomic count and from then on behaves like any other thread.
+ *
+ * A reference must be released on the thread that acquired it for as long as
+ * that thread is the owner: an sp<> copied on the owner thread must not be
+ * destroyed elsewhere.  A release that would take the shared count below
+ * zero aborts.  Unless NDEBUG is defined, each side also sums the ids of the
+ * references it holds, and aborts if a side that drops to zero is left with
+ * ids it never took.
+ *
+ * Like LightRefBase it has no weak references, so it is meant for new
+ * objects that are built and consumed on one thread and never need a wp<>,
+ * such as per-frame state handed around SurfaceFlinger's main thread.
+ * RefBase subclasses such as Layer cannot switch to it, since they are
+ * reached through wp<>; their hot loops should iterate through borrowed_sp<>
+ * instead, which takes no references at all.
+ * libutils/tests/RefBase_benchmark compares the three.
+ */
+#ifndef BIASED_REFBASE_CHECKS
+#ifdef NDEBUG
+#define BIASED_REFBASE_CHECKS 0
+#else
+#define BIASED_REFBASE_CHECKS 1
+#endif
+#endif
+
+template <class T>
+class BiasedRefBase
+{
+public:
+    inline BiasedRefBase() : mBiased(0), mState(UNOWNED), mShared(0)
+#if BIASED_REFBASE_CHECKS
+            , mBiasedIds(0), mSharedIds(0)
+#endif
+            { }
+    inline void incStrong(const void* id) const {
+        RefSampler::onIncStrong(id);
+        if (isOwner()) {
+            mBiased++;
+#if BIASED_REFBASE_CHECKS
+            mBiasedIds += uint32_t(uintptr_t(id));
+#endif
+            return;
+        }
+#if BIASED_REFBASE_CHECKS
+        android_atomic_add(int32_t(uintptr_t(id)), &mSharedIds);
+#endif
+        android_atomic_add(SHARED_ONE, &mShared);
+    }
+    inline void decStrong(const void* id) const {
+        RefSampler::onDecStrong(id);
+        if (android_atomic_acquire_load(&mState) == OWNED &&
+                pthread_equal(mOwner, pthread_self())) {
+#if BIASED_REFBASE_CHECKS
+            mBiasedIds -= uint32_t(uintptr_t(id));
+#endif
+            if (--mBiased == 0) {
+#if BIASED_REFBASE_CHECKS
+                if (mBiasedIds != 0) {
+                    // the owner released a reference another thread took
+                    abort();
+                }
+#endif
+                android_atomic_release_store(MERGED, &mState);
+                if (android_atomic_or(MERGED_BIT, &mShared) == 0) {
+                    delete static_cast<const T*>(this);
+                }
+            }
+            return;
+        }
+#if BIASED_REFBASE_CHECKS
+        android_atomic_add(-int32_t(uintptr_t(id)), &mSharedIds);
+#endif
+        int32_t old = android_atomic_add(-SHARED_ONE, &mShared);
+        if (old == (SHARED_ONE | MERGED_BIT)) {
+#if BIASED_REFBASE_CHECKS
+            // every other release has come before ours
+            if (android_atomic_acquire_load(&mSharedIds) != 0) {
+                // a thread released a reference the owner took
+                abort();
+            }
+#endif
+            delete static_cast<const T*>(this);
+        } else if (old < SHARED_ONE) {
+            // releasing a reference the owner counted
+            abort();
+        }
+    }
+    //! DEBUGGING ONLY: Get current strong ref count.
+    inline int32_t getStrongCount() const {
+        return (android_atomic_acquire_load(&mState) == OWNED ? mBiased : 0) +
+                (mShared >> 1);
+    }
+
+    typedef BiasedRefBase<T> basetype;
+
+protected:
+    inline ~BiasedRefBase() { }
+
+private:
+    friend class ReferenceMover;
+    inline static void renameRefs(size_t n, const ReferenceRenamer& renamer) {
+        if (RefSampler::isSampling()) {
+            for (size_t i = 0; i < n; i++) {
+                renamer(i);
+            }
+        }
+    }
+    inline static void renameRefId(T* ref,
+            const void* old_id, const void* new_id) {
+        if (ref) RefSampler::onMoveStrong(old_id, new_id);
+    }
+
+    // Whether the calling thread owns the biased count, claiming it if
+    // nobody has yet.  The object may already be visible to other threads
+    // through a raw pointer, so the claim is a compare-and-swap.
+    inline bool isOwner() const {
+        int32_t state = android_atomic_acquire_load(&mState);
+        if (state == UNOWNED &&
+                android_atomic_acquire_cas(UNOWNED, CLAIMING, &mState) == 0) {
+            mOwner = pthread_self();
+            android_atomic_release_store(OWNED, &mState);
+            return true;
+        }
+        // a thread that loses the race, or sees the claim in progress,
+        // is not the owner
+        return state == OWNED && pthread_equal(mOwner, pthread_self());
+    }
+
+private:
+    enum {
+        MERGED_BIT  = 0x0001,
+        SHARED_ONE  = 0x0002
+    };
+    enum {
+        UNOWNED,
+        CLAIMING,
+        OWNED,
+        MERGED
+    };
+
+    // only touched by the owner
+    mutable int32_t mBiased;
+    // UNOWNED -> CLAIMING -> OWNED -> MERGED; mOwner is valid from OWNED
+    mutable volatile int32_t mState;
+    mutable pthread_t mOwner;
+    // other threads' references, plus MERGED_BIT
+    mutable volatile int32_t mShared;
+#if BIASED_REFBASE_CHECKS
+    // sums of the ids of the references held on each side
+    mutable uint32_t mBiasedIds;
+    mutable volatile int32_t mSharedIds;
+#endif
+};
+
+// ---------------------------------------------------------------------------
+
+/*
+ * A non-owning view of an object that some sp<> is known to keep alive, such
+ * as the elements of a vector being iterated.  Copying it costs no reference
+ * counting; strong() makes a real reference when one has to outlive the sp<>.
+ */
+template <typename T>
+class borrowed_sp
+{
+public:
+    inline borrowed_sp() : m_ptr(0) { }
+    inline borrowed_sp(const sp<T>& other) : m_ptr(other.get()) { }
+    template<typename U>
+    inline borrowed_sp(const sp<U>& other) : m_ptr(other.get()) { }
+    template<typename U>
+    inline borrowed_sp(const borrowed_sp<U>& other) : m_ptr(other.get()) { }
+
+    inline T& operator* () const { return *m_ptr; }
+    inline T* operator-> () const { return m_ptr; }
+    inline T* get() const { return m_ptr; }
+
+    inline sp<T> strong() const { return sp<T>(m_ptr); }
+
+    inline bool operator == (const borrowed_sp<T>& o) const { return m_ptr == o.m_ptr; }
+    inline bool operator != (const borrowed_sp<T>& o) const { return m_ptr != o.m_ptr; }
+    inline bool operator < (const borrowed_sp<T>& o) const { return m_ptr < o.m_ptr; }
+    inline bool operator == (const T* o) const { return m_ptr == o; }
+    inline bool operator != (const T* o) const { return m_ptr != o; }
+
+private:
+    T* m_ptr;
+};
+
+// ---------------------------------------------------------------------------
+
 template <typename T>
 class wp
 {
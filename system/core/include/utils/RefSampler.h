@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_REF_SAMPLER_H
+#define ANDROID_REF_SAMPLER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+class Printer;
+
+// Sampled strong reference tracking, cheap enough to leave on in production.
+//
+// One reference in every period is followed.  References are picked by
+// hashing their id (the address of the sp<>), so the release of a sampled
+// reference is always sampled too.  Each sampled acquisition records a few
+// raw PCs and is counted against its call site; the call sites and the live
+// sampled ids are kept in lock-free tables.  dump() prints the call sites
+// that still hold references, most first.
+//
+// A sampled reference whose sp<> is moved onto an id that is not sampled
+// stops being counted, and one moved the other way is not picked up, so
+// references kept in vectors that shift are undercounted.
+//
+// The hooks are called from RefBase.cpp and inlined into every LightRefBase
+// and BiasedRefBase user, so they are only compiled in with REFBASE_SAMPLING
+// defined for the whole build (COMMON_GLOBAL_CFLAGS += -DREFBASE_SAMPLING in
+// BoardConfig.mk).
+// Without it they are empty and setPeriod() only logs a warning.
+class RefSampler {
+public:
+    enum {
+        // PCs kept per call site.
+        MAX_DEPTH = 8,
+    };
+
+    // Follow one reference in period, rounded up to a power of two, or stop
+    // sampling with 0.  Resets the counts.
+    static void setPeriod(uint32_t period);
+
+    // Hooks for the reference counting implementations; id is the one passed
+    // to incStrong()/decStrong().  onMoveStrong() follows a reference whose
+    // sp<> was moved in memory, as Vector<sp<T> > does.
+#ifdef REFBASE_SAMPLING
+    static inline bool isSampling() {
+        return sBits >= 0;
+    }
+    static inline void onIncStrong(const void* id) {
+        int32_t bits = sBits;
+        if (bits >= 0 && isSampled(id, bits)) recordInc(id);
+    }
+    static inline void onDecStrong(const void* id) {
+        int32_t bits = sBits;
+        if (bits >= 0 && isSampled(id, bits)) recordDec(id);
+    }
+    static inline void onMoveStrong(const void* oldId, const void* newId) {
+        int32_t bits = sBits;
+        if (bits >= 0 && (isSampled(oldId, bits) || isSampled(newId, bits))) {
+            recordMove(oldId, newId);
+        }
+    }
+#else
+    static inline bool isSampling() { return false; }
+    static inline void onIncStrong(const void*) { }
+    static inline void onDecStrong(const void*) { }
+    static inline void onMoveStrong(const void*, const void*) { }
+#endif
+
+    // Print the live references per call site, scaled by the period.
+    static void dump(Printer& printer);
+    static void dump(int fd);
+    static void log(const char* logtag);
+
+    // Forget every reference seen so far.
+    static void reset();
+
+private:
+    static inline uint32_t hash(const void* id) {
+        return uint32_t(uintptr_t(id)) * 2654435761u;
+    }
+    // Only the top bits of the product are well mixed, so those are the
+    // ones that pick the sampled ids.
+    static inline bool isSampled(const void* id, int32_t bits) {
+        return (hash(id) & ~(0xffffffffu >> bits)) == 0;
+    }
+    static void recordInc(const void* id);
+    static void recordDec(const void* id);
+    static void recordMove(const void* oldId, const void* newId);
+
+    // log2 of the period, or -1 while disabled
+    static volatile int32_t sBits;
+};
+
+}; // namespace android
+
+#endif // ANDROID_REF_SAMPLER_H
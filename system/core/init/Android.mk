@@ -6,15 +6,21 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
 	builtins.c \
 	init.c \
+	environment.c \
 	devices.c \
 	property_service.c \
 	util.c \
 	parser.c \
 	keychords.c \
 	signal_handler.c \
+	hwrng.c \
+	wait_property.c \
+	boot_props.c \
+	klog_ring.c \
 	init_parser.c \
 	ueventd.c \
 	ueventd_parser.c \
+	ueventd_rules.c \
 	watchdogd.c \
 	vendor_init.c
 
@@ -94,3 +100,22 @@ ALL_DEFAULT_INSTALLED_MODULES += $(SYMLINKS)
 # local module name
 ALL_MODULES.$(LOCAL_MODULE).INSTALLED := \
     $(ALL_MODULES.$(LOCAL_MODULE).INSTALLED) $(SYMLINKS)
+
+# Host tool to rebuild a property area snapshot with a compact layout
+include $(CLEAR_VARS)
+LOCAL_MODULE := propcompact
+LOCAL_SRC_FILES := propcompact.c
+include $(BUILD_HOST_EXECUTABLE)
+
+# Host tool to check ueventd rules and compile them for ueventd to load
+include $(CLEAR_VARS)
+LOCAL_MODULE := ueventd_compile
+LOCAL_SRC_FILES := \
+	ueventd_compile.c \
+	ueventd_parser.c \
+	ueventd_rules.c \
+	parser.c
+LOCAL_CFLAGS := -DUEVENTD_RULES_HOST
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "boot_props.h"
+#include "log.h"
+#include "parser.h"
+#include "property_service.h"
+#include "util.h"
+
+struct boot_prop_alias {
+    const char *src_prop;
+    const char *dest_prop;
+    const char *def_val;        /* NULL: leave dest_prop unset */
+};
+
+struct boot_param {
+    char *name;
+    char *value;
+};
+
+static const struct boot_prop_alias builtin_aliases[] = {
+    { "ro.boot.serialno", "ro.serialno", "", },
+    { "ro.boot.mode", "ro.bootmode", "unknown", },
+    { "ro.boot.baseband", "ro.baseband", "unknown", },
+    { "ro.boot.bootloader", "ro.bootloader", "unknown", },
+};
+
+static struct boot_prop_alias *aliases;
+static unsigned alias_count;
+
+static struct boot_param *params;
+static unsigned param_count;
+
+static int aliases_init(void)
+{
+    if (aliases)
+        return 0;
+    aliases = malloc(sizeof(builtin_aliases));
+    if (!aliases) {
+        ERROR("could not allocate boot property aliases\n");
+        return -1;
+    }
+    memcpy(aliases, builtin_aliases, sizeof(builtin_aliases));
+    alias_count = ARRAY_SIZE(builtin_aliases);
+    return 0;
+}
+
+static int alias_add(const char *src, const char *dest, const char *def_val)
+{
+    struct boot_prop_alias *grown;
+    unsigned i;
+
+    if (aliases_init())
+        return -1;
+
+    for (i = 0; i < alias_count; i++) {
+        if (!strcmp(aliases[i].dest_prop, dest))
+            break;
+    }
+    if (i == alias_count) {
+        grown = realloc(aliases, (alias_count + 1) * sizeof(*aliases));
+        if (!grown) {
+            ERROR("could not allocate boot property aliases\n");
+            return -1;
+        }
+        aliases = grown;
+        alias_count++;
+    }
+    aliases[i].src_prop = src;
+    aliases[i].dest_prop = dest;
+    aliases[i].def_val = def_val;
+    return 0;
+}
+
+static void parse_alias(struct parse_state *state, int nargs, char **args)
+{
+    if (nargs == 0)
+        return;
+    if (nargs < 2 || nargs > 3) {
+        parse_error(state, "expected <source> <destination> [<default>]\n");
+        return;
+    }
+    alias_add(args[0], args[1], nargs > 2 ? args[2] : NULL);
+}
+
+int boot_props_load(const char *fn)
+{
+    struct parse_state state;
+    char *args[4];
+    char *data;
+    int nargs = 0;
+
+    data = read_file(fn, 0);
+    if (!data)
+        return -1;
+
+    /* the aliases keep pointing into data, which is never freed */
+    state.filename = fn;
+    state.line = 0;
+    state.ptr = data;
+    state.nexttoken = 0;
+    for (;;) {
+        switch (next_token(&state)) {
+        case T_EOF:
+            parse_alias(&state, nargs, args);
+            return 0;
+        case T_NEWLINE:
+            state.line++;
+            parse_alias(&state, nargs, args);
+            nargs = 0;
+            break;
+        case T_TEXT:
+            /* one past the limit is enough to report the line */
+            if (nargs < 4)
+                args[nargs++] = state.text;
+            break;
+        }
+    }
+}
+
+void boot_props_add(const char *name, const char *value)
+{
+    struct boot_param *grown;
+
+    /* like the read-only property, the first one given wins */
+    if (boot_props_get(name))
+        return;
+
+    grown = realloc(params, (param_count + 1) * sizeof(*params));
+    if (!grown)
+        return;
+    params = grown;
+    params[param_count].name = strdup(name);
+    params[param_count].value = strdup(value);
+    if (!params[param_count].name || !params[param_count].value) {
+        free(params[param_count].name);
+        free(params[param_count].value);
+        return;
+    }
+    param_count++;
+}
+
+const char *boot_props_get(const char *name)
+{
+    unsigned i;
+
+    for (i = 0; i < param_count; i++) {
+        if (!strcmp(params[i].name, name))
+            return params[i].value;
+    }
+    return NULL;
+}
+
+void boot_props_export(void)
+{
+    const char *value;
+    unsigned i;
+
+    if (aliases_init())
+        return;
+
+    for (i = 0; i < alias_count; i++) {
+        value = boot_props_get(aliases[i].src_prop);
+        if (!value || !*value)
+            value = aliases[i].def_val;
+        if (value)
+            property_set(aliases[i].dest_prop, value);
+    }
+}
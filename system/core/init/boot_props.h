@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_BOOT_PROPS_H_
+#define _INIT_BOOT_PROPS_H_
+
+/*
+ * Extra ro.boot.* -> ro.* aliases, one per line:
+ *
+ *     <source property> <destination property> [<default value>]
+ *
+ * e.g. "ro.boot.carrier ro.carrier unknown".  An entry for a destination
+ * that is already mapped replaces the old one.
+ */
+#define BOOT_PROPS_FILE "/init.boot_props.rc"
+
+/* Read aliases from fn on top of the built-in ones. */
+int boot_props_load(const char *fn);
+
+/* Remember a ro.boot.* property set from the command line. */
+void boot_props_add(const char *name, const char *value);
+
+/* Value given for name on the command line, or NULL. */
+const char *boot_props_get(const char *name);
+
+/*
+ * Set every destination property, from its source or else its default.
+ * Destinations without a default are left alone when the source is unset.
+ */
+void boot_props_export(void);
+
+#endif
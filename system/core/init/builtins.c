@@ -48,6 +48,8 @@
 #include "init_parser.h"
 #include "util.h"
 #include "log.h"
+#include "hwrng.h"
+#include "wait_property.h"
 
 #include <private/android_filesystem_config.h>
 
@@ -325,6 +327,21 @@ int do_ifup(int nargs, char **args)
     return __ifupdown(args[1], 1);
 }
 
+int do_mix_hwrng(int nargs, char **args)
+{
+    /* mix_hwrng <bytes> [<path>] */
+    char *end;
+    unsigned long bytes;
+
+    errno = 0;
+    bytes = strtoul(args[1], &end, 0);
+    if (errno || end == args[1] || *end) {
+        ERROR("mix_hwrng: invalid byte count '%s'\n", args[1]);
+        return -EINVAL;
+    }
+    return hwrng_seed_start(nargs > 2 ? args[2] : HWRNG_DEFAULT_PATH, bytes);
+}
+
 
 static int do_insmod_inner(int nargs, char **args, int opt_len)
 {
@@ -711,6 +728,7 @@ int do_powerctl(int nargs, char **args)
         return -EINVAL;
     }
 
+    klog_ring_flush();
     return android_reboot(cmd, 0, reboot_target);
 }
 
@@ -977,3 +995,13 @@ int do_wait(int nargs, char **args)
     } else
         return -1;
 }
+
+int do_wait_for_prop(int nargs, char **args)
+{
+    if (nargs == 3) {
+        return wait_for_property(args[1], args[2], COMMAND_RETRY_TIMEOUT);
+    } else if (nargs == 4) {
+        return wait_for_property(args[1], args[2], atoi(args[3]));
+    } else
+        return -1;
+}
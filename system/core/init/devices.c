@@ -44,6 +44,7 @@
 #include <cutils/uevent.h>
 
 #include "devices.h"
+#include "ueventd_rules.h"
 #include "util.h"
 #include "log.h"
 
@@ -69,20 +70,6 @@ struct uevent {
     int minor;
 };
 
-struct perms_ {
-    char *name;
-    char *attr;
-    mode_t perm;
-    unsigned int uid;
-    unsigned int gid;
-    unsigned short prefix;
-};
-
-struct perm_node {
-    struct perms_ dp;
-    struct listnode plist;
-};
-
 struct platform_node {
     char *name;
     char *path;
@@ -90,99 +77,46 @@ struct platform_node {
     struct listnode list;
 };
 
-static list_declare(sys_perms);
-static list_declare(dev_perms);
 static list_declare(platform_names);
 
-int add_dev_perms(const char *name, const char *attr,
-                  mode_t perm, unsigned int uid, unsigned int gid,
-                  unsigned short prefix) {
-    struct perm_node *node = calloc(1, sizeof(*node));
-    if (!node)
-        return -ENOMEM;
-
-    node->dp.name = strdup(name);
-    if (!node->dp.name)
-        return -ENOMEM;
-
-    if (attr) {
-        node->dp.attr = strdup(attr);
-        if (!node->dp.attr)
-            return -ENOMEM;
-    }
-
-    node->dp.perm = perm;
-    node->dp.uid = uid;
-    node->dp.gid = gid;
-    node->dp.prefix = prefix;
-
-    if (attr)
-        list_add_tail(&sys_perms, &node->plist);
-    else
-        list_add_tail(&dev_perms, &node->plist);
-
-    return 0;
-}
-
-void fixup_sys_perms(const char *upath)
+static void fixup_sys_perm(const struct ueventd_rule *dp, void *cookie)
 {
+    const char *upath = cookie;
     char buf[512];
-    struct listnode *node;
-    struct perms_ *dp;
     char *secontext;
 
-        /* upaths omit the "/sys" that paths in this list
-         * contain, so we add 4 when comparing...
-         */
-    list_for_each(node, &sys_perms) {
-        dp = &(node_to_item(node, struct perm_node, plist))->dp;
-        if (dp->prefix) {
-            if (strncmp(upath, dp->name + 4, strlen(dp->name + 4)))
-                continue;
-        } else {
-            if (strcmp(upath, dp->name + 4))
-                continue;
-        }
-
-        if ((strlen(upath) + strlen(dp->attr) + 6) > sizeof(buf))
-            return;
+    if ((strlen(upath) + strlen(dp->attr) + 6) > sizeof(buf))
+        return;
 
-        sprintf(buf,"/sys%s/%s", upath, dp->attr);
-        INFO("fixup %s %d %d 0%o\n", buf, dp->uid, dp->gid, dp->perm);
-        chown(buf, dp->uid, dp->gid);
-        chmod(buf, dp->perm);
-        if (sehandle) {
-            secontext = NULL;
-            selabel_lookup(sehandle, &secontext, buf, 0);
-            if (secontext) {
-                setfilecon(buf, secontext);
-                freecon(secontext);
-           }
-        }
+    sprintf(buf,"/sys%s/%s", upath, dp->attr);
+    INFO("fixup %s %d %d 0%o\n", buf, dp->uid, dp->gid, dp->perm);
+    chown(buf, dp->uid, dp->gid);
+    chmod(buf, dp->perm);
+    if (sehandle) {
+        secontext = NULL;
+        selabel_lookup(sehandle, &secontext, buf, 0);
+        if (secontext) {
+            setfilecon(buf, secontext);
+            freecon(secontext);
+       }
     }
 }
 
+void fixup_sys_perms(const char *upath)
+{
+    /* upaths omit the "/sys" that paths in the rules contain */
+    ueventd_rules_for_each_sys(upath, fixup_sys_perm, (void *) upath);
+}
+
 static mode_t get_device_perm(const char *path, unsigned *uid, unsigned *gid)
 {
-    mode_t perm;
-    struct listnode *node;
-    struct perm_node *perm_node;
-    struct perms_ *dp;
+    const struct ueventd_rule *dp;
 
-    /* search the perms list in reverse so that ueventd.$hardware can
+    /* the last matching rule wins, so that ueventd.$hardware can
      * override ueventd.rc
      */
-    list_for_each_reverse(node, &dev_perms) {
-        perm_node = node_to_item(node, struct perm_node, plist);
-        dp = &perm_node->dp;
-
-        if (dp->prefix) {
-            if (strncmp(path, dp->name, strlen(dp->name)))
-                continue;
-        } else {
-            if (strcmp(path, dp->name))
-                continue;
-        }
+    dp = ueventd_rules_find_dev(path);
+    if (dp) {
         *uid = dp->uid;
         *gid = dp->gid;
         return dp->perm;
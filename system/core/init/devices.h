@@ -21,8 +21,5 @@
 
 extern void handle_device_fd();
 extern void device_init(void);
-extern int add_dev_perms(const char *name, const char *attr,
-                         mode_t perm, unsigned int uid,
-                         unsigned int gid, unsigned short prefix);
 int get_device_fd();
 #endif	/* _INIT_DEVICES_H */
@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "environment.h"
+#include "log.h"
+
+/*
+ * The environment handed to services, "key=value" strings in the order the
+ * keys were first added, NULL terminated.  env_index maps a key's hash to
+ * its slot in ENV (plus one, 0 being empty) so lookups do not scan.
+ */
+static char *env_none[] = { NULL };
+static char **ENV = env_none;
+static size_t env_count;
+static size_t env_capacity;
+static unsigned *env_index;
+static size_t env_index_size;
+
+static unsigned env_hash(const char *key, size_t len)
+{
+    unsigned hash = 2166136261u;
+    while (len--)
+        hash = (hash ^ (unsigned char) *key++) * 16777619u;
+    return hash;
+}
+
+/* Slot in env_index for key: either its entry or the empty slot to use. */
+static size_t env_find(const char *key, size_t len)
+{
+    size_t mask = env_index_size - 1;
+    size_t i = env_hash(key, len) & mask;
+
+    while (env_index[i]) {
+        const char *entry = ENV[env_index[i] - 1];
+        if (!strncmp(entry, key, len) && entry[len] == '=')
+            break;
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static const char *env_lookup(const char *key, size_t len)
+{
+    size_t i;
+
+    if (!env_index_size)
+        return NULL;
+    i = env_find(key, len);
+    return env_index[i] ? ENV[env_index[i] - 1] + len + 1 : NULL;
+}
+
+/* Make room for one more entry, keeping the index at most half full. */
+static int env_grow(void)
+{
+    if (env_count + 1 >= env_capacity) {
+        size_t capacity = env_capacity ? env_capacity * 2 : 32;
+        char **env = realloc(ENV == env_none ? NULL : ENV,
+                             capacity * sizeof(char *));
+        if (!env)
+            return -1;
+        ENV = env;
+        env_capacity = capacity;
+    }
+
+    if ((env_count + 1) * 2 > env_index_size) {
+        size_t size = env_index_size ? env_index_size * 2 : 64;
+        unsigned *index = calloc(size, sizeof(unsigned));
+        size_t n;
+        if (!index)
+            return -1;
+        free(env_index);
+        env_index = index;
+        env_index_size = size;
+        for (n = 0; n < env_count; n++)
+            env_index[env_find(ENV[n], strcspn(ENV[n], "="))] = n + 1;
+    }
+    return 0;
+}
+
+static int append(char **buf, size_t *len, size_t *size,
+                  const char *s, size_t n)
+{
+    if (*len + n + 1 > *size) {
+        size_t new_size = (*len + n + 1) * 2;
+        char *p = realloc(*buf, new_size);
+        if (!p)
+            return -1;
+        *buf = p;
+        *size = new_size;
+    }
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    (*buf)[*len] = '\0';
+    return 0;
+}
+
+/*
+ * Replace every ${var} in val with the current value of var, or with nothing
+ * if var is not set.  A "${" without a closing brace is kept as is.
+ */
+static char *expand_environment(const char *val)
+{
+    char *expanded = NULL;
+    size_t len = 0, size = 0;
+    const char *start, *end, *value;
+
+    if (!val) {
+        return NULL;
+    }
+
+    if (append(&expanded, &len, &size, "", 0))
+        return NULL;
+
+    while ((start = strstr(val, "${")) && (end = strchr(start + 2, '}'))) {
+        if (append(&expanded, &len, &size, val, start - val))
+            goto failed;
+        value = env_lookup(start + 2, end - start - 2);
+        if (value && append(&expanded, &len, &size, value, strlen(value)))
+            goto failed;
+        val = end + 1;
+    }
+    if (append(&expanded, &len, &size, val, strlen(val)))
+        goto failed;
+
+    /* caller free */
+    return expanded;
+
+failed:
+    free(expanded);
+    return NULL;
+}
+
+int add_environment(const char *key, const char *val)
+{
+    size_t keylen = strlen(key);
+    size_t len, i;
+    char *expanded;
+    char *entry;
+
+    expanded = expand_environment(val);
+    if (!expanded) {
+        goto failed;
+    }
+
+    len = keylen + strlen(expanded) + 2;
+    entry = malloc(len);
+    if (!entry) {
+        goto failed_cleanup;
+    }
+    snprintf(entry, len, "%s=%s", key, expanded);
+    free(expanded);
+
+    if (env_index_size) {
+        i = env_find(key, keylen);
+        if (env_index[i]) {
+            /* replace in place, keeping the original position */
+            free(ENV[env_index[i] - 1]);
+            ENV[env_index[i] - 1] = entry;
+            return 0;
+        }
+    }
+
+    if (env_grow()) {
+        free(entry);
+        goto failed;
+    }
+    i = env_find(key, keylen);
+    env_index[i] = env_count + 1;
+    ENV[env_count++] = entry;
+    ENV[env_count] = NULL;
+    return 0;
+
+failed_cleanup:
+    free(expanded);
+failed:
+    ERROR("Fail to add env variable: %s. Not enough memory!", key);
+    return 1;
+}
+
+char **environment(void)
+{
+    return ENV;
+}
@@ -0,0 +1,30 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_ENVIRONMENT_H_
+#define _INIT_ENVIRONMENT_H_
+
+/*
+ * add_environment - add "key=value" to the environment handed to services,
+ * expanding every ${var} in val first.  Re-adding a key replaces its value
+ * in place.  Returns 0, or 1 if out of memory.
+ */
+int add_environment(const char *key, const char *val);
+
+/* The environment as "key=value" strings in insertion order, NULL terminated. */
+char **environment(void);
+
+#endif
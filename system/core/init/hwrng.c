@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/random.h>
+
+#include "hwrng.h"
+#include "log.h"
+#include "property_service.h"
+
+/* how long to wait before reading again after EAGAIN, since the hwrng
+ * driver may report itself readable without having any data */
+#define HWRNG_RETRY_MS 10
+
+#define HWRNG_CHUNK 512
+
+static int hwrng_fd = -1;
+static int random_fd = -1;
+static char *hwrng_path;
+static size_t hwrng_wanted;
+static size_t hwrng_seeded;
+static long long hwrng_deadline;
+static long long hwrng_retry_at;
+static int hwrng_credit;
+
+static union {
+    struct rand_pool_info info;
+    char raw[sizeof(struct rand_pool_info) + HWRNG_CHUNK];
+} pool;
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static void hwrng_progress(void)
+{
+    char value[PROP_VALUE_MAX];
+
+    snprintf(value, sizeof(value), "%zu/%zu", hwrng_seeded, hwrng_wanted);
+    property_set(HWRNG_PROGRESS_PROP, value);
+}
+
+static void hwrng_finish(int ok)
+{
+    if (ok) {
+        INFO("Mixed %zu bytes from %s into the kernel entropy pool%s\n",
+             hwrng_seeded, hwrng_path,
+             hwrng_credit ? "" : " without credit");
+        hwrng_progress();
+    } else {
+        property_set(HWRNG_PROGRESS_PROP, "failed");
+    }
+
+    close(hwrng_fd);
+    close(random_fd);
+    hwrng_fd = -1;
+    random_fd = -1;
+    free(hwrng_path);
+    hwrng_path = NULL;
+    memset(&pool, 0, sizeof(pool));
+}
+
+/* hand the bytes in pool.info.buf to the kernel */
+static int hwrng_mix(size_t len)
+{
+    const char *buf = (const char *) pool.info.buf;
+    ssize_t written;
+
+    if (hwrng_credit) {
+        pool.info.entropy_count = len * HWRNG_ENTROPY_BITS;
+        pool.info.buf_size = len;
+        if (ioctl(random_fd, RNDADDENTROPY, &pool.info) == 0)
+            return 0;
+        /* needs CAP_SYS_ADMIN, and a random device to talk to */
+        ERROR("RNDADDENTROPY failed, mixing without credit: %s\n",
+              strerror(errno));
+        hwrng_credit = 0;
+    }
+
+    while (len) {
+        written = TEMP_FAILURE_RETRY(write(random_fd, buf, len));
+        if (written < 0) {
+            ERROR("Failed to write to /dev/urandom: %s\n", strerror(errno));
+            return -1;
+        }
+        buf += written;
+        len -= written;
+    }
+    return 0;
+}
+
+int hwrng_seed_start(const char *path, size_t bytes)
+{
+    if (hwrng_fd >= 0) {
+        INFO("Still seeding from %s, ignoring %s\n", hwrng_path, path);
+        return 0;
+    }
+    if (bytes == 0)
+        return 0;
+
+    hwrng_fd = TEMP_FAILURE_RETRY(
+            open(path, O_RDONLY | O_NONBLOCK | O_NOFOLLOW));
+    if (hwrng_fd == -1) {
+        if (errno == ENOENT) {
+            ERROR("%s not found\n", path);
+            /* It's not an error to not have a Hardware RNG. */
+            return 0;
+        }
+        ERROR("Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    random_fd = TEMP_FAILURE_RETRY(
+            open("/dev/urandom", O_WRONLY | O_NOFOLLOW));
+    if (random_fd == -1) {
+        ERROR("Failed to open /dev/urandom: %s\n", strerror(errno));
+        close(hwrng_fd);
+        hwrng_fd = -1;
+        return -1;
+    }
+    fcntl(hwrng_fd, F_SETFD, FD_CLOEXEC);
+    fcntl(random_fd, F_SETFD, FD_CLOEXEC);
+
+    hwrng_path = strdup(path);
+    hwrng_wanted = bytes;
+    hwrng_seeded = 0;
+    hwrng_credit = 1;
+    hwrng_retry_at = 0;
+    hwrng_deadline = now_ms() + HWRNG_READ_TIMEOUT_MS;
+    hwrng_progress();
+    return 0;
+}
+
+int get_hwrng_fd(void)
+{
+    /* while backing off the timeout takes care of the next read */
+    return hwrng_retry_at ? -1 : hwrng_fd;
+}
+
+int hwrng_poll_timeout(void)
+{
+    long long next, now;
+
+    if (hwrng_fd < 0)
+        return -1;
+
+    next = hwrng_deadline;
+    if (hwrng_retry_at && hwrng_retry_at < next)
+        next = hwrng_retry_at;
+    now = now_ms();
+    return next > now ? next - now : 0;
+}
+
+void handle_hwrng(short revents)
+{
+    size_t len;
+    ssize_t chunk;
+    long long now;
+
+    if (hwrng_fd < 0)
+        return;
+
+    now = now_ms();
+    if (revents || (hwrng_retry_at && now >= hwrng_retry_at)) {
+        hwrng_retry_at = 0;
+
+        len = hwrng_wanted - hwrng_seeded;
+        if (len > HWRNG_CHUNK)
+            len = HWRNG_CHUNK;
+        chunk = TEMP_FAILURE_RETRY(read(hwrng_fd, pool.info.buf, len));
+        if (chunk > 0) {
+            if (hwrng_mix(chunk)) {
+                hwrng_finish(0);
+                return;
+            }
+            hwrng_seeded += chunk;
+            if (hwrng_seeded >= hwrng_wanted) {
+                hwrng_finish(1);
+                return;
+            }
+            hwrng_progress();
+            hwrng_deadline = now + HWRNG_READ_TIMEOUT_MS;
+            return;
+        } else if (chunk == 0) {
+            ERROR("Failed to read from %s: EOF\n", hwrng_path);
+            hwrng_finish(0);
+            return;
+        } else if (errno != EAGAIN) {
+            ERROR("Failed to read from %s: %s\n", hwrng_path, strerror(errno));
+            hwrng_finish(0);
+            return;
+        }
+        hwrng_retry_at = now + HWRNG_RETRY_MS;
+    }
+
+    if (now >= hwrng_deadline) {
+        ERROR("Timed out reading from %s after %zu bytes\n", hwrng_path,
+              hwrng_seeded);
+        hwrng_finish(0);
+    }
+}
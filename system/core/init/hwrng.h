@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_HWRNG_H_
+#define _INIT_HWRNG_H_
+
+#include <stddef.h>
+
+#define HWRNG_DEFAULT_PATH  "/dev/hw_random"
+#define HWRNG_DEFAULT_BYTES 512
+
+/* entropy credited per byte read, in bits */
+#define HWRNG_ENTROPY_BITS 1
+
+/* give up when a single read takes longer than this */
+#define HWRNG_READ_TIMEOUT_MS 1000
+
+/* bytes credited so far, as "<seeded>/<requested>", or "failed" */
+#define HWRNG_PROGRESS_PROP "init.hwrng.seeded"
+
+/*
+ * Start feeding bytes from path into the kernel pool in the background of
+ * the main loop.  Returns 0 if seeding started or there is no such device,
+ * -1 on error.
+ */
+int hwrng_seed_start(const char *path, size_t bytes);
+
+/* fd to poll for POLLIN while seeding, -1 otherwise */
+int get_hwrng_fd(void);
+/* poll timeout in ms before the current read times out, -1 if idle */
+int hwrng_poll_timeout(void);
+/* called after every poll while get_hwrng_fd() >= 0 */
+void handle_hwrng(short revents);
+
+#endif
@@ -64,6 +64,10 @@
 #include "ueventd.h"
 #include "watchdogd.h"
 #include "vendor_init.h"
+#include "hwrng.h"
+#include "boot_props.h"
+#include "environment.h"
+#include "wait_property.h"
 
 struct selabel_handle *sehandle;
 struct selabel_handle *sehandle_prop;
@@ -79,6 +83,12 @@ static int   bootchart_count;
 #define BOARD_CHARGING_CMDLINE_VALUE "true"
 #endif
 
+/*
+ * Everything androidboot.mode=charger needs, in place of /init.rc and the
+ * files it imports.  Optional; without it charger mode uses /init.rc.
+ */
+#define CHARGER_RC_FILE "/init.charger.rc"
+
 static char console[32];
 static char bootmode[32];
 static char hardware[32];
@@ -88,6 +98,7 @@ static char battchg_pause[32];
 
 static struct action *cur_action = NULL;
 static struct command *cur_command = NULL;
+
 static struct listnode *command_queue = NULL;
 
 void notify_service_state(const char *name, const char *state)
@@ -104,113 +115,12 @@ static int have_console;
 static char console_name[PROP_VALUE_MAX] = "/dev/console";
 static time_t process_needs_restart;
 
-static const char *ENV[32];
-
 static unsigned emmc_boot = 0;
 
 static unsigned charging_mode = 0;
 
-static const char *expand_environment(const char *val)
-{
-    int n;
-    const char *prev_pos = NULL, *copy_pos;
-    size_t len, prev_len = 0, copy_len;
-    char *expanded;
-
-    /* Basic expansion of environment variable; for now
-       we only assume 1 expansion at the start of val
-       and that it is marked as ${var} */
-    if (!val) {
-        return NULL;
-    }
-
-    if ((val[0] == '$') && (val[1] == '{')) {
-        for (n = 0; n < 31; n++) {
-            if (ENV[n]) {
-                len = strcspn(ENV[n], "=");
-                if (!strncmp(&val[2], ENV[n], len)
-                      && (val[2 + len] == '}')) {
-                    /* Matched existing env */
-                    prev_pos = &ENV[n][len + 1];
-                    prev_len = strlen(prev_pos);
-                    break;
-                }
-            }
-        }
-        copy_pos = index(val, '}');
-        if (copy_pos) {
-            copy_pos++;
-            copy_len = strlen(copy_pos);
-        } else {
-            copy_pos = val;
-            copy_len = strlen(val);
-        }
-    } else {
-        copy_pos = val;
-        copy_len = strlen(val);
-    }
-
-    len = prev_len + copy_len + 1;
-    expanded = malloc(len);
-    if (expanded) {
-        if (prev_pos) {
-            snprintf(expanded, len, "%s%s", prev_pos, copy_pos);
-        } else {
-            snprintf(expanded, len, "%s", copy_pos);
-        }
-    }
-
-    /* caller free */
-    return expanded;
-}
-
-/* add_environment - add "key=value" to the current environment */
-int add_environment(const char *key, const char *val)
-{
-    int n;
-    const char *expanded;
-
-    expanded = expand_environment(val);
-    if (!expanded) {
-        goto failed;
-    }
-
-    for (n = 0; n < 31; n++) {
-        if (!ENV[n]) {
-            size_t len = strlen(key) + strlen(expanded) + 2;
-            char *entry = malloc(len);
-            if (!entry) {
-                goto failed_cleanup;
-            }
-            snprintf(entry, len, "%s=%s", key, expanded);
-            free((char *)expanded);
-            ENV[n] = entry;
-            return 0;
-        } else {
-            char *entry;
-            size_t len = strlen(key);
-            if(!strncmp(ENV[n], key, len) && ENV[n][len] == '=') {
-                len = len + strlen(expanded) + 2;
-                entry = malloc(len);
-                if (!entry) {
-                    goto failed_cleanup;
-                }
-
-                free((char *)ENV[n]);
-                snprintf(entry, len, "%s=%s", key, expanded);
-                free((char *)expanded);
-                ENV[n] = entry;
-                return 0;
-            }
-        }
-    }
-
-failed_cleanup:
-    free((char *)expanded);
-failed:
-    ERROR("Fail to add env variable: %s. Not enough memory!", key);
-    return 1;
-}
+/* set when only CHARGER_RC_FILE was read */
+static unsigned charger_rc_only = 0;
 
 static void zap_stdio(void)
 {
@@ -381,8 +291,8 @@ void service_start(struct service *svc, const char *dynamic_args)
         for (n = 0; svc->args[n]; n++) {
             INFO("args[%d] = '%s'\n", n, svc->args[n]);
         }
-        for (n = 0; ENV[n]; n++) {
-            INFO("env[%d] = '%s'\n", n, ENV[n]);
+        for (n = 0; environment()[n]; n++) {
+            INFO("env[%d] = '%s'\n", n, environment()[n]);
         }
 #endif
 
@@ -416,7 +326,7 @@ void service_start(struct service *svc, const char *dynamic_args)
 
         if (!dynamic_args) {
             ERROR("No dynamic_args: Try to execve('%s'): args: %s\n", svc->args[0], svc->args);
-            if (execve(svc->args[0], (char**) svc->args, (char**) ENV) < 0) {
+            if (execve(svc->args[0], (char**) svc->args, environment()) < 0) {
                 ERROR("cannot execve('%s'): %s\n", svc->args[0], strerror(errno));
             }
         } else {
@@ -437,7 +347,7 @@ void service_start(struct service *svc, const char *dynamic_args)
             arg_ptrs[arg_idx] = '\0';
 
             ERROR("Try with dynamic args to execve('%s'): args: %s\n", svc->args[0], svc->args);
-            execve(svc->args[0], (char**) arg_ptrs, (char**) ENV);
+            execve(svc->args[0], (char**) arg_ptrs, environment());
         }
         _exit(127);
     }
@@ -512,6 +422,8 @@ void property_changed(const char *name, const char *value)
 {
     if (property_triggers_enabled)
         queue_property_triggers(name, value);
+
+    wait_for_property_changed(name, value);
 }
 
 static void restart_service_if_needed(struct service *svc)
@@ -636,6 +548,9 @@ void execute_one_command(void)
 {
     int ret;
 
+    if (wait_for_property_left() >= 0)
+        return;
+
     if (!cur_action || !cur_command || is_last_command(cur_action, cur_command)) {
         cur_action = action_remove_queue_head();
         cur_command = NULL;
@@ -672,81 +587,23 @@ static int wait_for_coldboot_done_action(int nargs, char **args)
 }
 
 /*
- * Writes 512 bytes of output from Hardware RNG (/dev/hw_random, backed
- * by Linux kernel's hw_random framework) into Linux RNG's via /dev/urandom.
+ * Mixes 512 bytes of output from Hardware RNG (/dev/hw_random, backed
+ * by Linux kernel's hw_random framework) into Linux RNG via RNDADDENTROPY.
  * Does nothing if Hardware RNG is not present.
  *
- * Since we don't yet trust the quality of Hardware RNG, these bytes are not
- * mixed into the primary pool of Linux RNG and the entropy estimate is left
- * unmodified.
+ * Since we don't yet fully trust the quality of Hardware RNG, only
+ * HWRNG_ENTROPY_BITS of every byte are credited to the entropy estimate.
  *
- * If the HW RNG device /dev/hw_random is present, we require that at least
- * 512 bytes read from it are written into Linux RNG. QA is expected to catch
- * devices/configurations where these I/O operations are blocking for a long
- * time. We do not reboot or halt on failures, as this is a best-effort
- * attempt.
+ * The bytes are read from the main loop, so a slow device does not hold up
+ * the action queue; each read has to complete within HWRNG_READ_TIMEOUT_MS.
+ * Progress is reported in HWRNG_PROGRESS_PROP.  We do not reboot or halt on
+ * failures, as this is a best-effort attempt.  Use the mix_hwrng command
+ * for a different byte count or device.
  */
 static int mix_hwrng_into_linux_rng_action(int nargs, char **args)
 {
-    int result = -1;
-    int hwrandom_fd = -1;
-    int urandom_fd = -1;
-    char buf[512];
-    ssize_t chunk_size;
-    size_t total_bytes_written = 0;
-
-    hwrandom_fd = TEMP_FAILURE_RETRY(
-            open("/dev/hw_random", O_RDONLY | O_NOFOLLOW));
-    if (hwrandom_fd == -1) {
-        if (errno == ENOENT) {
-          ERROR("/dev/hw_random not found\n");
-          /* It's not an error to not have a Hardware RNG. */
-          result = 0;
-        } else {
-          ERROR("Failed to open /dev/hw_random: %s\n", strerror(errno));
-        }
-        goto ret;
-    }
-
-    urandom_fd = TEMP_FAILURE_RETRY(
-            open("/dev/urandom", O_WRONLY | O_NOFOLLOW));
-    if (urandom_fd == -1) {
-        ERROR("Failed to open /dev/urandom: %s\n", strerror(errno));
-        goto ret;
-    }
-
-    while (total_bytes_written < sizeof(buf)) {
-        chunk_size = TEMP_FAILURE_RETRY(
-                read(hwrandom_fd, buf, sizeof(buf) - total_bytes_written));
-        if (chunk_size == -1) {
-            ERROR("Failed to read from /dev/hw_random: %s\n", strerror(errno));
-            goto ret;
-        } else if (chunk_size == 0) {
-            ERROR("Failed to read from /dev/hw_random: EOF\n");
-            goto ret;
-        }
-
-        chunk_size = TEMP_FAILURE_RETRY(write(urandom_fd, buf, chunk_size));
-        if (chunk_size == -1) {
-            ERROR("Failed to write to /dev/urandom: %s\n", strerror(errno));
-            goto ret;
-        }
-        total_bytes_written += chunk_size;
-    }
-
-    INFO("Mixed %d bytes from /dev/hw_random into /dev/urandom",
-                total_bytes_written);
-    result = 0;
-
-ret:
-    if (hwrandom_fd != -1) {
-        close(hwrandom_fd);
-    }
-    if (urandom_fd != -1) {
-        close(urandom_fd);
-    }
-    memset(buf, 0, sizeof(buf));
-    return result;
+    /* reads continue from the main loop, see handle_hwrng() */
+    return hwrng_seed_start(HWRNG_DEFAULT_PATH, HWRNG_DEFAULT_BYTES);
 }
 
 static int keychord_init_action(int nargs, char **args)
@@ -838,38 +695,22 @@ static void import_kernel_nv(char *name, int for_emulator)
         int cnt;
 
         cnt = snprintf(prop, sizeof(prop), "ro.boot.%s", boot_prop_name);
-        if (cnt < PROP_NAME_MAX)
-            property_set(prop, value);
+        if (cnt < PROP_NAME_MAX && property_set(prop, value) == 0)
+            boot_props_add(prop, value);
     }
 }
 
 static void export_kernel_boot_props(void)
 {
     char tmp[PROP_VALUE_MAX];
-    int ret;
-    unsigned i;
-    struct {
-        const char *src_prop;
-        const char *dest_prop;
-        const char *def_val;
-    } prop_map[] = {
-        { "ro.boot.serialno", "ro.serialno", "", },
-        { "ro.boot.mode", "ro.bootmode", "unknown", },
-        { "ro.boot.baseband", "ro.baseband", "unknown", },
-        { "ro.boot.bootloader", "ro.bootloader", "unknown", },
-    };
-
-    for (i = 0; i < ARRAY_SIZE(prop_map); i++) {
-        ret = property_get(prop_map[i].src_prop, tmp);
-        if (ret > 0)
-            property_set(prop_map[i].dest_prop, tmp);
-        else
-            property_set(prop_map[i].dest_prop, prop_map[i].def_val);
-    }
+    const char *value;
 
-    ret = property_get("ro.boot.console", tmp);
-    if (ret)
-        strlcpy(console, tmp, sizeof(console));
+    /* ro.boot.* -> ro.* aliases, see boot_props.h */
+    boot_props_export();
+
+    value = boot_props_get("ro.boot.console");
+    if (value && *value)
+        strlcpy(console, value, sizeof(console));
 
     /* save a copy for init's usage during boot */
     property_get("ro.bootmode", tmp);
@@ -877,9 +718,9 @@ static void export_kernel_boot_props(void)
 
     /* if this was given on kernel command line, override what we read
      * before (e.g. from /proc/cpuinfo), if anything */
-    ret = property_get("ro.boot.hardware", tmp);
-    if (ret)
-        strlcpy(hardware, tmp, sizeof(hardware));
+    value = boot_props_get("ro.boot.hardware");
+    if (value && *value)
+        strlcpy(hardware, value, sizeof(hardware));
     property_set("ro.hardware", hardware);
 
     snprintf(tmp, PROP_VALUE_MAX, "%d", revision);
@@ -901,6 +742,9 @@ static void process_kernel_cmdline(void)
     /* don't expose the raw commandline to nonpriv processes */
     chmod("/proc/cmdline", 0440);
 
+    /* vendor aliases for the boot properties, if any */
+    boot_props_load(BOOT_PROPS_FILE);
+
     /* first pass does the common stuff, and finds if we are in qemu.
      * second pass is only necessary for qemu to export all kernel params
      * as props.
@@ -931,6 +775,18 @@ static int property_service_init_action(int nargs, char **args)
     return 0;
 }
 
+static int charger_property_service_init_action(int nargs, char **args)
+{
+    /* nothing is mounted, so there are no property files to read */
+    start_property_socket();
+
+    /* the vendor overrides still apply; they mostly read the cmdline
+     * and ro.boot.* properties, which are set by now
+     */
+    vendor_load_properties();
+    return 0;
+}
+
 static int signal_init_action(int nargs, char **args)
 {
     signal_init();
@@ -1116,7 +972,9 @@ static void selinux_initialize(void)
 int main(int argc, char **argv)
 {
     int fd_count = 0;
+    /* the last one is left for get_hwrng_fd() */
     struct pollfd ufds[4];
+    int hwrng_fd;
     char *tmpdev;
     char* debuggable;
     char tmp[32];
@@ -1165,6 +1023,7 @@ int main(int argc, char **argv)
          */
     open_devnull_stdio();
     klog_init();
+    klog_ring_init("init", -1);
 #endif
     property_init();
 
@@ -1197,19 +1056,21 @@ int main(int argc, char **argv)
 
     INFO("reading config file\n");
 
-    if (!charging_mode_booting())
-       init_parse_config_file("/init.rc");
-    else
+    if (charging_mode_booting())
        init_parse_config_file("/lpm.rc");
+    else if (is_charger && init_parse_config_file(CHARGER_RC_FILE) == 0)
+       charger_rc_only = 1;
+    else
+       init_parse_config_file("/init.rc");
 
     /* Check for an emmc initialisation file and read if present */
-    if (emmc_boot && access("/init.emmc.rc", R_OK) == 0) {
+    if (!charger_rc_only && emmc_boot && access("/init.emmc.rc", R_OK) == 0) {
         INFO("Reading emmc config file");
             init_parse_config_file("/init.emmc.rc");
     }
 
     /* Check for a target specific initialisation file and read if present */
-    if (access("/init.target.rc", R_OK) == 0) {
+    if (!charger_rc_only && access("/init.target.rc", R_OK) == 0) {
         INFO("Reading target specific config file");
             init_parse_config_file("/init.target.rc");
     }
@@ -1241,7 +1102,10 @@ int main(int argc, char **argv)
      */
     queue_builtin_action(mix_hwrng_into_linux_rng_action, "mix_hwrng_into_linux_rng");
 
-    queue_builtin_action(property_service_init_action, "property_service_init");
+    if (charger_rc_only)
+        queue_builtin_action(charger_property_service_init_action, "property_service_init");
+    else
+        queue_builtin_action(property_service_init_action, "property_service_init");
     queue_builtin_action(signal_init_action, "signal_init");
     queue_builtin_action(check_startup_action, "check_startup");
 
@@ -1299,8 +1163,23 @@ int main(int argc, char **argv)
                 timeout = 0;
         }
 
-        if (!action_queue_empty() || cur_action)
+        hwrng_fd = get_hwrng_fd();
+        if (hwrng_fd >= 0) {
+            ufds[fd_count].fd = hwrng_fd;
+            ufds[fd_count].events = POLLIN;
+            ufds[fd_count].revents = 0;
+        }
+        i = hwrng_poll_timeout();
+        if (i >= 0 && (timeout < 0 || timeout > i))
+            timeout = i;
+
+        i = wait_for_property_left();
+        if (i >= 0) {
+            if (timeout < 0 || timeout > i * 1000)
+                timeout = i * 1000;
+        } else if (!action_queue_empty() || cur_action) {
             timeout = 0;
+        }
 
 #if BOOTCHART
         if (bootchart_count > 0) {
@@ -1313,7 +1192,17 @@ int main(int argc, char **argv)
         }
 #endif
 
-        nr = poll(ufds, fd_count, timeout);
+        /*
+         * write out what the commands above logged before sleeping; while
+         * commands are queued the loop does not sleep, so only now and then
+         */
+        if (timeout != 0)
+            klog_ring_flush();
+        else
+            klog_ring_flush_old();
+
+        nr = poll(ufds, fd_count + (hwrng_fd >= 0), timeout);
+        handle_hwrng(nr > 0 && hwrng_fd >= 0 ? ufds[fd_count].revents : 0);
         if (nr <= 0)
             continue;
 
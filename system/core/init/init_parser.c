@@ -45,6 +45,27 @@ struct import {
     const char *filename;
 };
 
+/* "export <name> <value>" lines seen while parsing a config file, replayed
+ * by export_rc so that it does not have to read the file a second time */
+struct export_rc {
+    struct listnode list;
+    const char *filename;
+    struct listnode exports;
+    int incomplete;
+};
+
+struct export_env {
+    struct listnode list;
+    const char *name;
+    const char *value;
+};
+
+static list_declare(export_rc_list);
+
+static struct export_rc *export_rc_add(const char *fn);
+static void export_rc_record(struct export_rc *rc, const char *name,
+                             const char *value);
+
 static void *parse_service(struct parse_state *state, int nargs, char **args);
 static void parse_line_service(struct parse_state *state, int nargs, char **args);
 
@@ -124,6 +145,7 @@ int lookup_keyword(const char *s)
         if (!strcmp(s, "oad_persist_props")) return K_load_persist_props;
         break;
     case 'm':
+        if (!strcmp(s, "ix_hwrng")) return K_mix_hwrng;
         if (!strcmp(s, "kdir")) return K_mkdir;
         if (!strcmp(s, "ount_all")) return K_mount_all;
         if (!strcmp(s, "ount")) return K_mount;
@@ -168,6 +190,7 @@ int lookup_keyword(const char *s)
     case 'w':
         if (!strcmp(s, "rite")) return K_write;
         if (!strcmp(s, "ait")) return K_wait;
+        if (!strcmp(s, "ait_for_prop")) return K_wait_for_prop;
         break;
     }
     return K_UNKNOWN;
@@ -353,6 +376,7 @@ static void parse_config(const char *fn, char *s)
     struct parse_state state;
     struct listnode import_list;
     struct listnode *node;
+    struct export_rc *exports;
     char *args[INIT_PARSER_MAXARGS];
     int nargs;
 
@@ -365,16 +389,24 @@ static void parse_config(const char *fn, char *s)
 
     list_init(&import_list);
     state.priv = &import_list;
+    exports = export_rc_add(fn);
 
     for (;;) {
         switch (next_token(&state)) {
         case T_EOF:
+            /* an unterminated quote ends the file mid line, and export_rc
+             * still takes an export from it */
+            if (nargs >= 3 && exports && lookup_keyword(args[0]) == K_export)
+                export_rc_record(exports, args[1], args[2]);
             state.parse_line(&state, 0, 0);
             goto parser_done;
         case T_NEWLINE:
             state.line++;
             if (nargs) {
                 int kw = lookup_keyword(args[0]);
+                /* export_rc takes these from any line, inside a section or not */
+                if (kw == K_export && nargs >= 3 && exports)
+                    export_rc_record(exports, args[1], args[2]);
                 if (kw_is(kw, SECTION)) {
                     state.parse_line(&state, 0, 0);
                     parse_new_section(&state, kw, nargs, args);
@@ -416,6 +448,55 @@ int init_parse_config_file(const char *fn)
     return 0;
 }
 
+static struct export_rc *export_rc_find(const char *fn)
+{
+    struct listnode *node;
+    list_for_each(node, &export_rc_list) {
+        struct export_rc *rc = node_to_item(node, struct export_rc, list);
+        if (!strcmp(rc->filename, fn))
+            return rc;
+    }
+    return 0;
+}
+
+static struct export_rc *export_rc_add(const char *fn)
+{
+    struct export_rc *rc;
+
+    if (export_rc_find(fn))
+        return 0;
+    rc = calloc(1, sizeof(*rc));
+    if (!rc)
+        return 0;
+    rc->filename = strdup(fn);
+    if (!rc->filename) {
+        free(rc);
+        return 0;
+    }
+    list_init(&rc->exports);
+    list_add_tail(&export_rc_list, &rc->list);
+    return rc;
+}
+
+static void export_rc_record(struct export_rc *rc, const char *name,
+                             const char *value)
+{
+    struct export_env *env;
+
+    if (rc->incomplete)
+        return;
+    env = malloc(sizeof(*env));
+    if (!env) {
+        ERROR("out of memory recording exports of '%s'\n", rc->filename);
+        rc->incomplete = 1;
+        return;
+    }
+    /* the file's tokens are kept for the life of init */
+    env->name = name;
+    env->value = value;
+    list_add_tail(&rc->exports, &env->list);
+}
+
 typedef enum {
     ENV_NOTREADY,
     ENV_NAME,
@@ -423,7 +504,7 @@ typedef enum {
     ENV_WAITFORNEXTLINE,
 } export_rc_state_t;
 
-int init_export_rc_file(const char *fn)
+static int export_rc_read(const char *fn)
 {
     char *data;
     struct parse_state state;
@@ -473,6 +554,24 @@ int init_export_rc_file(const char *fn)
     return 0;
 }
 
+int init_export_rc_file(const char *fn)
+{
+    struct export_rc *rc;
+    struct listnode *node;
+
+    rc = export_rc_find(fn);
+    if (!rc || rc->incomplete) {
+        /* not one of the config files, read it now */
+        return export_rc_read(fn);
+    }
+
+    list_for_each(node, &rc->exports) {
+        struct export_env *env = node_to_item(node, struct export_env, list);
+        add_environment(env->name, env->value);
+    }
+    return 0;
+}
+
 static int valid_name(const char *name)
 {
     if (strlen(name) > 16) {
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <time.h>
+
+#include <cutils/klog.h>
+
+#include "klog_ring.h"
+
+#define KLOG_RING_NODE "/dev/__kmsg_ring__"
+
+/*
+ * Each message is a 16-bit length followed by its text, padded to keep the
+ * lengths aligned.  A message never wraps: when there is no room for the
+ * longest one before the end, a zero length marks the rest as unused and
+ * the next one starts at the beginning.
+ */
+#define REC_HDR         sizeof(uint16_t)
+#define REC_ALIGN(x)    (((x) + 1) & ~1u)
+#define REC_MAX         (REC_HDR + REC_ALIGN(KLOG_RING_MSG_MAX))
+
+/* one ring per process; init and ueventd are single threaded */
+static union {
+    uint16_t len[KLOG_RING_SIZE / REC_HDR];
+    char bytes[KLOG_RING_SIZE];
+} ring;
+static unsigned ring_head;      /* where the next message goes */
+static unsigned ring_tail;      /* oldest queued message */
+static unsigned ring_fill;      /* bytes between them, markers included */
+static unsigned ring_dropped;
+/* when the oldest queued message was queued, in ms */
+static int64_t ring_oldest_ms;
+
+static int ring_fd = -1;
+static pid_t ring_pid;
+/* who the dropped messages note is from */
+static const char *ring_tag;
+/* messages per writev(), see klog_ring_init() */
+static int ring_batch = 1;
+
+static void klog_direct(int level, const char *fmt, va_list ap)
+{
+    char buf[KLOG_RING_MSG_MAX];
+
+    if (level > klog_get_level())
+        return;
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    klog_write(level, "%s", buf);
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+static int ring_owner(void)
+{
+    return ring_fd >= 0 && getpid() == ring_pid;
+}
+
+/*
+ * Before 3.5 a write to /dev/kmsg is passed to printk(), which splits it
+ * into lines and reads the level of each.  Later kernels store a write as
+ * a single record at the level of its first line, so there every message
+ * needs a write of its own.
+ */
+static int kmsg_splits_lines(void)
+{
+    struct utsname u;
+    int major, minor;
+
+    if (uname(&u) || sscanf(u.release, "%d.%d", &major, &minor) != 2)
+        return 0;
+    return major < 3 || (major == 3 && minor < 5);
+}
+
+int klog_ring_init(const char *tag, int fd)
+{
+    static const char *name = KLOG_RING_NODE;
+
+    if (fd < 0) {
+        /* like klog_init(), as /dev/kmsg may not have been created yet */
+        if (mknod(name, S_IFCHR | 0600, (1 << 8) | 11) == 0) {
+            fd = open(name, O_WRONLY | O_CLOEXEC);
+            unlink(name);
+        }
+        if (fd < 0)
+            return -1;
+        ring_batch = kmsg_splits_lines() ? KLOG_RING_BATCH : 1;
+    } else {
+        ring_batch = KLOG_RING_BATCH;
+    }
+
+    ring_tag = tag;
+    ring_fd = fd;
+    ring_pid = getpid();
+    ring_head = ring_tail = ring_fill = 0;
+    atexit(klog_ring_flush);
+    return 0;
+}
+
+static void write_batch(struct iovec *iov, int count)
+{
+    ssize_t ret;
+
+    while (count) {
+        ret = writev(ring_fd, iov, count);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0) {
+            ring_dropped += count;
+            return;
+        }
+        /* a short write: go on from where it stopped */
+        while (count && (size_t) ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count) {
+            iov->iov_base = (char *) iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+}
+
+/* Add a message to the batch in iov, writing the batch out when it is full. */
+static void batch_add(struct iovec *iov, int *count, size_t *bytes,
+                      void *text, size_t len)
+{
+    if (*count && (*count >= ring_batch || *bytes + len > KLOG_RING_WRITE_MAX)) {
+        write_batch(iov, *count);
+        *count = 0;
+        *bytes = 0;
+    }
+    iov[*count].iov_base = text;
+    iov[*count].iov_len = len;
+    (*count)++;
+    *bytes += len;
+}
+
+void klog_ring_flush(void)
+{
+    struct iovec iov[KLOG_RING_BATCH];
+    char note[KLOG_RING_MSG_MAX];
+    size_t bytes = 0;
+    int count = 0;
+
+    if (!ring_owner())
+        return;
+
+    if (ring_dropped) {
+        snprintf(note, sizeof(note),
+                 "<4>%s: %u kernel log messages dropped\n", ring_tag,
+                 ring_dropped);
+        ring_dropped = 0;
+        batch_add(iov, &count, &bytes, note, strlen(note));
+    }
+
+    while (ring_fill) {
+        uint16_t len = ring.len[ring_tail / REC_HDR];
+
+        if (len == 0) {
+            /* the end of the ring was left unused */
+            ring_fill -= KLOG_RING_SIZE - ring_tail;
+            ring_tail = 0;
+            continue;
+        }
+        batch_add(iov, &count, &bytes, ring.bytes + ring_tail + REC_HDR, len);
+        /* nothing is queued while flushing, so the space can go now */
+        ring_fill -= REC_HDR + REC_ALIGN(len);
+        ring_tail += REC_HDR + REC_ALIGN(len);
+        if (ring_tail == KLOG_RING_SIZE)
+            ring_tail = 0;
+    }
+    if (count)
+        write_batch(iov, count);
+    ring_head = ring_tail = 0;
+}
+
+void klog_ring_flush_old(void)
+{
+    if (!ring_owner() || (!ring_fill && !ring_dropped))
+        return;
+    if (ring_fill >= KLOG_RING_SIZE / 2 ||
+            now_ms() - ring_oldest_ms >= KLOG_RING_MAX_DELAY_MS)
+        klog_ring_flush();
+}
+
+/* Space for the longest message at ring_head, or NULL if the ring is full. */
+static char *ring_reserve(void)
+{
+    unsigned rest = KLOG_RING_SIZE - ring_head;
+
+    if (rest < REC_MAX) {
+        if (ring_fill + rest + REC_MAX > KLOG_RING_SIZE)
+            return NULL;
+        ring.len[ring_head / REC_HDR] = 0;
+        ring_fill += rest;
+        ring_head = 0;
+    }
+    if (ring_fill + REC_MAX > KLOG_RING_SIZE)
+        return NULL;
+    return ring.bytes + ring_head + REC_HDR;
+}
+
+void klog_ring_write(int level, const char *fmt, ...)
+{
+    va_list ap;
+    char *text;
+    int len;
+
+    va_start(ap, fmt);
+    if (!ring_owner()) {
+        klog_direct(level, fmt, ap);
+        va_end(ap);
+        return;
+    }
+    if (level > klog_get_level()) {
+        va_end(ap);
+        return;
+    }
+
+    text = ring_reserve();
+    if (!text) {
+        klog_ring_flush();
+        text = ring_reserve();
+    }
+    if (!text) {
+        ring_dropped++;
+        va_end(ap);
+        return;
+    }
+
+    len = vsnprintf(text, KLOG_RING_MSG_MAX, fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return;
+    if (len >= KLOG_RING_MSG_MAX)
+        len = KLOG_RING_MSG_MAX - 1;
+    if (len == 0)
+        return;
+
+    if (!ring_fill)
+        ring_oldest_ms = now_ms();
+    ring.len[ring_head / REC_HDR] = len;
+    ring_head += REC_HDR + REC_ALIGN(len);
+    ring_fill += REC_HDR + REC_ALIGN(len);
+    if (ring_head == KLOG_RING_SIZE)
+        ring_head = 0;
+
+    /* errors go out now, in case init does not live to flush them */
+    if (level <= KLOG_ERROR_LEVEL)
+        klog_ring_flush();
+}
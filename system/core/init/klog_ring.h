@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_KLOG_RING_H_
+#define _INIT_KLOG_RING_H_
+
+/*
+ * Kernel log messages are queued in a ring owned by the process that
+ * called klog_ring_init() and written out later by klog_ring_flush(),
+ * which the main loops call before they sleep, or by klog_ring_flush_old()
+ * between commands.  Messages at KLOG_ERROR_LEVEL or below are written out
+ * at once, along with anything queued before them.  When the ring is full
+ * and cannot be flushed, new messages are dropped and counted, and the
+ * count is logged later.
+ *
+ * Queued messages are batched into one writev() only on kernels before
+ * 3.5, whose /dev/kmsg splits a write into lines.  Later kernels make a
+ * write a single record, so there each message still costs a write; the
+ * ring only moves those writes out of the way of the commands.  Either way
+ * the kernel stamps a message when it is written, so dmesg shows queued
+ * messages up to KLOG_RING_MAX_DELAY_MS, plus the command running, late.
+ *
+ * Until klog_ring_init() is called, and in forked children, messages go
+ * straight to klog_write().
+ *
+ * The ring is a plain byte ring without locks or atomics: init and ueventd
+ * are single threaded, and only the process that owns the ring touches it.
+ * It must not be written from more than one thread.
+ */
+
+/* bytes of queued messages */
+#define KLOG_RING_SIZE      (32 * 1024)
+/* longest message, as in klog_write() */
+#define KLOG_RING_MSG_MAX   512
+/* messages per writev() */
+#define KLOG_RING_BATCH     64
+/*
+ * bytes per writev(): before 3.5 the kernel formats a write into the
+ * 1024 byte printk_buf and cuts off whatever does not fit
+ */
+#define KLOG_RING_WRITE_MAX 1000
+/* how long klog_ring_flush_old() lets a message wait */
+#define KLOG_RING_MAX_DELAY_MS  100
+
+/*
+ * Start queueing, writing to fd, or to the kernel log if fd < 0.  tag, a
+ * string that must outlive the ring, names the process in the note about
+ * dropped messages.  Returns -1 if the kernel log could not be opened.
+ */
+int klog_ring_init(const char *tag, int fd);
+
+void klog_ring_write(int level, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/* Write out everything queued. */
+void klog_ring_flush(void);
+
+/*
+ * Write out everything queued if the oldest message has waited
+ * KLOG_RING_MAX_DELAY_MS or the ring is half full.
+ */
+void klog_ring_flush_old(void);
+
+#endif
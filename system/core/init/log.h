@@ -19,9 +19,12 @@
 
 #include <cutils/klog.h>
 
-#define ERROR(x...)   KLOG_ERROR("init", x)
-#define NOTICE(x...)  KLOG_NOTICE("init", x)
-#define INFO(x...)    KLOG_INFO("init", x)
+#include "klog_ring.h"
+
+/* as KLOG_ERROR() and friends, but queued; see klog_ring.h */
+#define ERROR(x...)   klog_ring_write(KLOG_ERROR_LEVEL, "<3>init: " x)
+#define NOTICE(x...)  klog_ring_write(KLOG_NOTICE_LEVEL, "<5>init: " x)
+#define INFO(x...)    klog_ring_write(KLOG_INFO_LEVEL, "<6>init: " x)
 
 #define LOG_UEVENTS        1  /* log uevent messages if 1. verbose */
 
@@ -1,7 +1,14 @@
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #include "parser.h"
 #include "log.h"
 
@@ -66,10 +73,106 @@ void parse_error(struct parse_state *state, const char *fmt, ...)
     ERROR("%s", buf);
 }
 
+/*
+ * Length of the run of plain text at x, up to the next character that
+ * next_token() has to look at: NUL, whitespace, a quote or a backslash.
+ *
+ * The vector versions only do aligned 16 byte loads.  Those never cross a
+ * page boundary, so reading past the terminating NUL is safe, but memory
+ * checkers see the bytes after it being read.  ASan is told to leave these
+ * loads alone; under valgrind, run with --partial-loads-ok=yes.
+ */
+#if defined(__SANITIZE_ADDRESS__)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define NO_SANITIZE_ADDRESS __attribute__((no_sanitize_address))
+#endif
+#endif
+#ifndef NO_SANITIZE_ADDRESS
+#define NO_SANITIZE_ADDRESS
+#endif
+
+#if defined(__SSE2__)
+NO_SANITIZE_ADDRESS
+static inline unsigned special_mask(const char *p)
+{
+    __m128i v = _mm_load_si128((const __m128i *) p);
+    __m128i m = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+    return _mm_movemask_epi8(m);
+}
+
+NO_SANITIZE_ADDRESS
+static size_t plain_run(const char *x)
+{
+    const char *p = (const char *) ((uintptr_t) x & ~(uintptr_t) 15);
+    unsigned mask = special_mask(p) >> (x - p);
+
+    while (!mask) {
+        p += 16;
+        mask = special_mask(p);
+        if (mask)
+            return p + __builtin_ctz(mask) - x;
+    }
+    return __builtin_ctz(mask);
+}
+#elif defined(__ARM_NEON__)
+/* 4 bits per byte, as NEON has no movemask */
+NO_SANITIZE_ADDRESS
+static inline uint64_t special_mask(const char *p)
+{
+    uint8x16_t v = vld1q_u8((const uint8_t *) __builtin_assume_aligned(p, 16));
+    uint8x16_t m = vceqq_u8(v, vdupq_n_u8(0));
+    m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8(' ')));
+    m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\t')));
+    m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\r')));
+    m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\n')));
+    m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('"')));
+    m = vorrq_u8(m, vceqq_u8(v, vdupq_n_u8('\\')));
+    return vget_lane_u64(vreinterpret_u64_u8(
+            vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+}
+
+NO_SANITIZE_ADDRESS
+static size_t plain_run(const char *x)
+{
+    const char *p = (const char *) ((uintptr_t) x & ~(uintptr_t) 15);
+    uint64_t mask = special_mask(p) >> ((x - p) * 4);
+
+    while (!mask) {
+        p += 16;
+        mask = special_mask(p);
+        if (mask)
+            return p + __builtin_ctzll(mask) / 4 - x;
+    }
+    return __builtin_ctzll(mask) / 4;
+}
+#else
+static const unsigned char text_special[256] = {
+    [0] = 1, [' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['"'] = 1, ['\\'] = 1,
+};
+
+static size_t plain_run(const char *x)
+{
+    const char *p = x;
+
+    while (!text_special[(unsigned char) *p])
+        p++;
+    return p - x;
+}
+#endif
+
 int next_token(struct parse_state *state)
 {
     char *x = state->ptr;
     char *s;
+    size_t n;
 
     if (state->nexttoken) {
         int t = state->nexttoken;
@@ -92,7 +195,7 @@ int next_token(struct parse_state *state)
             x++;
             continue;
         case '#':
-            while (*x && (*x != '\n')) x++;
+            x += strcspn(x, "\n");
             if (*x == '\n') {
                 state->ptr = x+1;
                 return T_NEWLINE;
@@ -113,6 +216,14 @@ text:
     state->text = s = x;
 textresume:
     for (;;) {
+        /* text is unescaped in place, so a run is only moved after an escape */
+        n = plain_run(x);
+        if (n) {
+            if (s != x)
+                memmove(s, x, n);
+            s += n;
+            x += n;
+        }
         switch (*x) {
         case 0:
             goto textdone;
@@ -127,20 +238,18 @@ textresume:
             goto textdone;
         case '"':
             x++;
-            for (;;) {
-                switch (*x) {
-                case 0:
-                        /* unterminated quoted thing */
-                    state->ptr = x;
-                    return T_EOF;
-                case '"':
-                    x++;
-                    goto textresume;
-                default:
-                    *s++ = *x++;
-                }
+            n = strcspn(x, "\"");
+            if (s != x)
+                memmove(s, x, n);
+            s += n;
+            x += n;
+            if (*x == 0) {
+                    /* unterminated quoted thing */
+                state->ptr = x;
+                return T_EOF;
             }
-            break;
+            x++;
+            goto textresume;
         case '\\':
             x++;
             switch (*x) {
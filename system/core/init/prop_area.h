@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_PROP_AREA_H_
+#define _INIT_PROP_AREA_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Read-only view of the property area as bionic's system_properties.c lays
+ * it out: a header, then a trie of name segments.  The siblings below a
+ * node form a binary search tree ordered by length and then by name, and a
+ * node that ends a property name points at its prop_info.  Everything is
+ * carved out of the area in the order it is first needed and never freed.
+ *
+ * Shared by init, which reports on the live area, and by the host tool
+ * propcompact, which works on snapshots of it.
+ */
+
+#ifndef PA_SIZE
+#define PA_SIZE             (128 * 1024)
+#endif
+#ifndef PROP_AREA_MAGIC
+#define PROP_AREA_MAGIC     0x504f5250
+#endif
+#ifndef PROP_AREA_VERSION
+#define PROP_AREA_VERSION   0xfc6ed0ab
+#endif
+#ifndef PROP_NAME_MAX
+#define PROP_NAME_MAX       32
+#endif
+#ifndef PROP_VALUE_MAX
+#define PROP_VALUE_MAX      92
+#endif
+
+struct prop_area_hdr {
+    uint32_t bytes_used;
+    uint32_t serial;
+    uint32_t magic;
+    uint32_t version;
+    uint32_t reserved[28];
+};
+
+/* trie node; offsets are from the end of the header, 0 meaning none */
+struct prop_area_bt {
+    uint8_t namelen;
+    uint8_t reserved[3];
+    uint32_t prop;
+    uint32_t left;
+    uint32_t right;
+    uint32_t children;
+    char name[0];
+};
+
+struct prop_area_info {
+    uint32_t serial;
+    char value[PROP_VALUE_MAX];
+    char name[0];
+};
+
+#define PROP_AREA_DATA_SIZE (PA_SIZE - sizeof(struct prop_area_hdr))
+#define PROP_AREA_ALIGN(x)  (((x) + 3) & ~3u)
+
+struct prop_area_stats {
+    unsigned capacity;      /* bytes available for nodes and properties */
+    unsigned used;
+    unsigned props;
+    unsigned nodes;
+    /* bytes of names and values actually stored, with their terminators */
+    unsigned payload;
+    /* trie nodes compared by all lookups of every property, in total */
+    unsigned probes;
+};
+
+/* Pointer to a whole object at off in the data of area, or NULL. */
+static inline const void *prop_area_obj(const void *area, uint32_t used,
+                                        uint32_t off, size_t size)
+{
+    if (off >= used || size > used - off)
+        return NULL;
+    return (const char *) area + sizeof(struct prop_area_hdr) + off;
+}
+
+/*
+ * Walk the trie of a mapped area or snapshot of it, which is size bytes
+ * long.  If fn is not NULL it is called for every property.  Returns -1
+ * if the area does not look like one.
+ */
+static inline int prop_area_walk(const void *area, size_t size,
+        struct prop_area_stats *stats,
+        void (*fn)(const char *name, const char *value, void *cookie),
+        void *cookie)
+{
+    const struct prop_area_hdr *hdr = (const struct prop_area_hdr *) area;
+    /* offset and number of nodes compared to reach it */
+    struct { uint32_t off, probes; } *stack;
+    unsigned depth = 0, max;
+    uint32_t used;
+
+    if (size < sizeof(*hdr) || hdr->magic != PROP_AREA_MAGIC ||
+            hdr->version != PROP_AREA_VERSION)
+        return -1;
+    used = hdr->bytes_used;
+    if (used > size - sizeof(*hdr))
+        return -1;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = size - sizeof(*hdr);
+    stats->used = used;
+
+    /* every node is pushed at most once, and no node is smaller than this */
+    max = used / sizeof(struct prop_area_bt) + 1;
+    stack = malloc(max * sizeof(*stack));
+    if (!stack)
+        return -1;
+
+    /* the root is the nameless node at offset 0 */
+    stack[depth].off = 0;
+    stack[depth].probes = 0;
+    depth++;
+    while (depth) {
+        const struct prop_area_bt *bt;
+        uint32_t off = stack[--depth].off;
+        uint32_t probes = stack[depth].probes;
+
+        bt = (const struct prop_area_bt *) prop_area_obj(area, used, off,
+                sizeof(*bt));
+        if (!bt || !prop_area_obj(area, used, off, sizeof(*bt) + bt->namelen))
+            goto corrupt;
+        /* everything is allocated after the node that points to it */
+        if ((bt->prop && bt->prop <= off) || (bt->left && bt->left <= off) ||
+                (bt->right && bt->right <= off) ||
+                (bt->children && bt->children <= off))
+            goto corrupt;
+        stats->nodes++;
+
+        if (bt->prop) {
+            const struct prop_area_info *pi = (const struct prop_area_info *)
+                    prop_area_obj(area, used, bt->prop, sizeof(*pi) + 1);
+            size_t namelen, valuelen;
+
+            if (!pi)
+                goto corrupt;
+            namelen = strnlen(pi->name, used - bt->prop - sizeof(*pi));
+            valuelen = strnlen(pi->value, PROP_VALUE_MAX);
+            if (namelen >= PROP_NAME_MAX || valuelen >= PROP_VALUE_MAX)
+                goto corrupt;
+            stats->props++;
+            stats->payload += namelen + 1 + valuelen + 1;
+            stats->probes += probes;
+            if (fn)
+                fn(pi->name, pi->value, cookie);
+        }
+
+        /* only a node reachable twice could overflow this */
+        if (depth + 3 > max)
+            goto corrupt;
+        if (bt->left) {
+            stack[depth].off = bt->left;
+            stack[depth++].probes = probes + 1;
+        }
+        if (bt->right) {
+            stack[depth].off = bt->right;
+            stack[depth++].probes = probes + 1;
+        }
+        if (bt->children) {
+            stack[depth].off = bt->children;
+            stack[depth++].probes = probes + 1;
+        }
+    }
+    free(stack);
+    return 0;
+
+corrupt:
+    free(stack);
+    return -1;
+}
+
+#endif
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * propcompact: rebuild a property area snapshot with a dense, sorted layout.
+ *
+ * The snapshot is either a copy of /dev/__properties__ or a text file of
+ * name=value lines.  The output holds the same properties, with every set
+ * of sibling trie nodes balanced and stored next to each other, and reports
+ * how much space and how many node comparisons per lookup that saves.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "prop_area.h"
+
+struct entry {
+    char *name;
+    char *value;
+};
+
+struct seg {
+    const char *name;       /* points into an entry's name */
+    unsigned len;
+    int prop;               /* entry index, or -1 */
+    struct seg *kids;
+    unsigned nkids;
+    unsigned cap;
+};
+
+struct image {
+    char *data;             /* PA_SIZE bytes, header included */
+    uint32_t used;
+};
+
+static struct entry *entries;
+static unsigned entry_count;
+
+static void die(const char *fmt, ...) __attribute__((noreturn, format(printf, 1, 2)));
+static void die(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    fprintf(stderr, "propcompact: ");
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    exit(1);
+}
+
+static void add_entry(const char *name, const char *value, void *cookie)
+{
+    static unsigned cap;
+
+    if (strlen(name) >= PROP_NAME_MAX || strlen(value) >= PROP_VALUE_MAX) {
+        fprintf(stderr, "propcompact: skipping '%s', too long\n", name);
+        return;
+    }
+    if (entry_count == cap) {
+        cap = cap ? cap * 2 : 256;
+        entries = realloc(entries, cap * sizeof(*entries));
+        if (!entries)
+            die("out of memory\n");
+    }
+    entries[entry_count].name = strdup(name);
+    entries[entry_count].value = strdup(value);
+    if (!entries[entry_count].name || !entries[entry_count].value)
+        die("out of memory\n");
+    entry_count++;
+}
+
+static char *read_all(const char *fn, size_t *size)
+{
+    FILE *f = fopen(fn, "rb");
+    char *data = NULL;
+    size_t len = 0, cap = 0, n;
+
+    if (!f)
+        die("cannot open %s: %s\n", fn, strerror(errno));
+    do {
+        if (len + 4096 + 1 > cap) {
+            cap = cap ? cap * 2 : 65536;
+            data = realloc(data, cap);
+            if (!data)
+                die("out of memory\n");
+        }
+        n = fread(data + len, 1, cap - len - 1, f);
+        len += n;
+    } while (n > 0);
+    fclose(f);
+    data[len] = '\0';
+    *size = len;
+    return data;
+}
+
+/* name=value lines, in the format of build.prop */
+static void parse_text(char *data)
+{
+    char *line, *next, *eq, *name, *value, *end;
+
+    for (line = data; line && *line; line = next) {
+        next = strchr(line, '\n');
+        if (next)
+            *next++ = '\0';
+        while (isspace((unsigned char) *line))
+            line++;
+        if (*line == '#' || !(eq = strchr(line, '=')))
+            continue;
+
+        name = line;
+        value = eq + 1;
+        for (end = eq; end > name && isspace((unsigned char) end[-1]); end--)
+            ;
+        *end = '\0';
+        while (isspace((unsigned char) *value))
+            value++;
+        for (end = value + strlen(value);
+                end > value && isspace((unsigned char) end[-1]); end--)
+            ;
+        *end = '\0';
+        if (*name)
+            add_entry(name, value, NULL);
+    }
+}
+
+/* by name, with '.' first so that names sharing a segment stay together */
+static int compare_entries(const void *a, const void *b)
+{
+    const unsigned char *na = (const unsigned char *) ((const struct entry *) a)->name;
+    const unsigned char *nb = (const unsigned char *) ((const struct entry *) b)->name;
+    int ca, cb;
+
+    for (;; na++, nb++) {
+        ca = *na == '.' ? 1 : *na;
+        cb = *nb == '.' ? 1 : *nb;
+        if (ca != cb || !ca)
+            return ca - cb;
+    }
+}
+
+/* the order bionic keeps siblings in: shorter names first */
+static int compare_segs(const void *a, const void *b)
+{
+    const struct seg *sa = a, *sb = b;
+
+    if (sa->len != sb->len)
+        return sa->len < sb->len ? -1 : 1;
+    return strncmp(sa->name, sb->name, sa->len);
+}
+
+static struct seg *seg_child(struct seg *parent, const char *name, unsigned len)
+{
+    struct seg *kid;
+
+    /* entries are sorted, so a repeated segment is always the last one */
+    if (parent->nkids) {
+        kid = &parent->kids[parent->nkids - 1];
+        if (kid->len == len && !strncmp(kid->name, name, len))
+            return kid;
+    }
+    if (parent->nkids == parent->cap) {
+        parent->cap = parent->cap ? parent->cap * 2 : 4;
+        parent->kids = realloc(parent->kids, parent->cap * sizeof(*kid));
+        if (!parent->kids)
+            die("out of memory\n");
+    }
+    kid = &parent->kids[parent->nkids++];
+    memset(kid, 0, sizeof(*kid));
+    kid->name = name;
+    kid->len = len;
+    kid->prop = -1;
+    return kid;
+}
+
+static void build_tree(struct seg *root)
+{
+    unsigned i;
+
+    memset(root, 0, sizeof(*root));
+    root->prop = -1;
+    for (i = 0; i < entry_count; i++) {
+        const char *name = entries[i].name;
+        struct seg *seg = root;
+
+        for (;;) {
+            const char *dot = strchr(name, '.');
+            unsigned len = dot ? (unsigned) (dot - name) : strlen(name);
+
+            seg = seg_child(seg, name, len);
+            if (!dot)
+                break;
+            name = dot + 1;
+        }
+        if (seg->prop >= 0)
+            fprintf(stderr, "propcompact: '%s' is listed twice, keeping the "
+                    "last value\n", entries[i].name);
+        seg->prop = i;
+    }
+}
+
+static uint32_t alloc_obj(struct image *img, size_t size)
+{
+    uint32_t off = img->used;
+
+    size = PROP_AREA_ALIGN(size);
+    if (size > PROP_AREA_DATA_SIZE - img->used)
+        die("properties do not fit in %u bytes\n",
+            (unsigned) PROP_AREA_DATA_SIZE);
+    img->used += size;
+    return off;
+}
+
+static struct prop_area_bt *bt_at(struct image *img, uint32_t off)
+{
+    return (struct prop_area_bt *)
+            (img->data + sizeof(struct prop_area_hdr) + off);
+}
+
+/* Allocate kids[lo..hi) as a balanced tree, returning its root. */
+static uint32_t emit_bst(struct image *img, struct seg *kids, uint32_t *offs,
+                         int lo, int hi)
+{
+    int mid;
+    struct prop_area_bt *bt;
+    uint32_t left, right;
+
+    if (lo >= hi)
+        return 0;
+    mid = lo + (hi - lo) / 2;
+    offs[mid] = alloc_obj(img, sizeof(*bt) + kids[mid].len + 1);
+    bt = bt_at(img, offs[mid]);
+    bt->namelen = kids[mid].len;
+    memcpy(bt->name, kids[mid].name, kids[mid].len);
+
+    left = emit_bst(img, kids, offs, lo, mid);
+    right = emit_bst(img, kids, offs, mid + 1, hi);
+    bt = bt_at(img, offs[mid]);
+    bt->left = left;
+    bt->right = right;
+    return offs[mid];
+}
+
+static void emit_children(struct image *img, struct seg *seg, uint32_t off)
+{
+    uint32_t *offs;
+    uint32_t root;
+    unsigned i;
+
+    if (!seg->nkids)
+        return;
+    qsort(seg->kids, seg->nkids, sizeof(*seg->kids), compare_segs);
+    offs = malloc(seg->nkids * sizeof(*offs));
+    if (!offs)
+        die("out of memory\n");
+
+    /* all the siblings first, so that one lookup stays within a few lines */
+    root = emit_bst(img, seg->kids, offs, 0, seg->nkids);
+    bt_at(img, off)->children = root;
+
+    for (i = 0; i < seg->nkids; i++) {
+        struct seg *kid = &seg->kids[i];
+
+        if (kid->prop >= 0) {
+            const struct entry *e = &entries[kid->prop];
+            size_t namelen = strlen(e->name);
+            size_t valuelen = strlen(e->value);
+            uint32_t pioff = alloc_obj(img,
+                    sizeof(struct prop_area_info) + namelen + 1);
+            struct prop_area_info *pi = (struct prop_area_info *)
+                    (img->data + sizeof(struct prop_area_hdr) + pioff);
+
+            pi->serial = valuelen << 24;
+            memcpy(pi->value, e->value, valuelen + 1);
+            memcpy(pi->name, e->name, namelen + 1);
+            bt_at(img, offs[i])->prop = pioff;
+        }
+        emit_children(img, kid, offs[i]);
+    }
+    free(offs);
+}
+
+static void print_stats(const char *what, const struct prop_area_stats *st)
+{
+    printf("%s: %u of %u bytes used (%u%%), %u properties, %u nodes, "
+           "%u%% overhead, %.2f nodes compared per lookup\n",
+           what, st->used, st->capacity, st->used * 100 / st->capacity,
+           st->props, st->nodes,
+           st->used ? (st->used - st->payload) * 100 / st->used : 0,
+           st->props ? (double) st->probes / st->props : 0.0);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: propcompact [-o <area>] <snapshot>\n"
+            "  snapshot is a copy of /dev/__properties__ or name=value lines\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = NULL, *in = NULL;
+    struct prop_area_stats st;
+    struct prop_area_hdr *hdr;
+    struct image img;
+    struct seg root;
+    char *data;
+    size_t size;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            out = argv[++i];
+        else if (argv[i][0] == '-' || in)
+            usage();
+        else
+            in = argv[i];
+    }
+    if (!in)
+        usage();
+
+    data = read_all(in, &size);
+    if (size >= sizeof(struct prop_area_hdr) &&
+            ((struct prop_area_hdr *) data)->magic == PROP_AREA_MAGIC) {
+        if (prop_area_walk(data, size, &st, add_entry, NULL))
+            die("%s is not a readable property area\n", in);
+        print_stats("snapshot", &st);
+    } else {
+        parse_text(data);
+    }
+
+    qsort(entries, entry_count, sizeof(*entries), compare_entries);
+    build_tree(&root);
+
+    img.data = calloc(1, PA_SIZE);
+    if (!img.data)
+        die("out of memory\n");
+    img.used = 0;
+    alloc_obj(&img, sizeof(struct prop_area_bt) + 1);   /* the root */
+    emit_children(&img, &root, 0);
+
+    hdr = (struct prop_area_hdr *) img.data;
+    hdr->bytes_used = img.used;
+    hdr->magic = PROP_AREA_MAGIC;
+    hdr->version = PROP_AREA_VERSION;
+    if (prop_area_walk(img.data, PA_SIZE, &st, NULL, NULL))
+        die("built an unreadable area\n");
+    print_stats("compacted", &st);
+
+    if (out) {
+        FILE *f = fopen(out, "wb");
+
+        if (!f || fwrite(img.data, PA_SIZE, 1, f) != 1 || fclose(f))
+            die("cannot write %s: %s\n", out, strerror(errno));
+    }
+    return 0;
+}
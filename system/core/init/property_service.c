@@ -48,6 +48,7 @@
 #include "init.h"
 #include "util.h"
 #include "log.h"
+#include "prop_area.h"
 
 #include <device_perms.h>
 
@@ -149,6 +150,15 @@ static int init_workspace(workspace *w, size_t size)
 
 static workspace pa_workspace;
 
+/* usage in percent at which PROP_AREA_WARN_PROP is set, and every step above */
+#define PROP_AREA_WARN_PERCENT  80
+#define PROP_AREA_WARN_STEP     5
+#define PROP_AREA_WARN_PROP     "init.prop_area.warning"
+
+/* init's own read-only view of the area, for the statistics */
+static const void *pa_view;
+static unsigned pa_warn_percent = PROP_AREA_WARN_PERCENT;
+
 static int init_property_area(void)
 {
     if (property_area_inited)
@@ -162,10 +172,68 @@ static int init_property_area(void)
 
     fcntl(pa_workspace.fd, F_SETFD, FD_CLOEXEC);
 
+    pa_view = mmap(NULL, PA_SIZE, PROT_READ, MAP_SHARED, pa_workspace.fd, 0);
+    if (pa_view == MAP_FAILED) {
+        ERROR("Unable to map property area for statistics: %s\n",
+              strerror(errno));
+        pa_view = NULL;
+    }
+
     property_area_inited = 1;
     return 0;
 }
 
+int property_area_get_stats(struct prop_area_stats *stats)
+{
+    if (!pa_view)
+        return -1;
+    return prop_area_walk(pa_view, PA_SIZE, stats, NULL, NULL);
+}
+
+void property_area_log_stats(void)
+{
+    struct prop_area_stats st;
+
+    if (property_area_get_stats(&st)) {
+        ERROR("property area is unreadable\n");
+        return;
+    }
+    /* overhead: trie nodes, the fixed size value slots and padding */
+    NOTICE("property area: %u of %u bytes used (%u%%), %u properties, "
+           "%u nodes, %u%% overhead, %u.%02u nodes compared per lookup\n",
+           st.used, st.capacity, st.used * 100 / st.capacity, st.props,
+           st.nodes, st.used ? (st.used - st.payload) * 100 / st.used : 0,
+           st.props ? st.probes / st.props : 0,
+           st.props ? st.probes * 100 / st.props % 100 : 0);
+}
+
+/*
+ * The area never shrinks, so look at its usage whenever it grows.  Only the
+ * header is read here; the full statistics are logged once a threshold is
+ * crossed.
+ */
+static void check_property_area_usage(void)
+{
+    const struct prop_area_hdr *hdr = (const struct prop_area_hdr *) pa_view;
+    unsigned percent;
+    char value[PROP_VALUE_MAX];
+
+    if (!hdr)
+        return;
+    percent = hdr->bytes_used * 100ULL / PROP_AREA_DATA_SIZE;
+    if (percent < pa_warn_percent)
+        return;
+
+    /* first, as setting the warning may itself use up space */
+    while (pa_warn_percent <= percent)
+        pa_warn_percent += PROP_AREA_WARN_STEP;
+
+    ERROR("property area is %u%% full\n", percent);
+    property_area_log_stats();
+    snprintf(value, sizeof(value), "%u", percent);
+    property_set(PROP_AREA_WARN_PROP, value);
+}
+
 static int check_mac_perms(const char *name, char *sctx)
 {
     if (is_selinux_enabled() <= 0)
@@ -376,8 +444,10 @@ int property_set(const char *name, const char *value)
         ret = __system_property_add(name, namelen, value, valuelen);
         if (ret < 0) {
             ERROR("Failed to set '%s'='%s'\n", name, value);
+            check_property_area_usage();
             return ret;
         }
+        check_property_area_usage();
     }
     /* If name starts with "net." treat as a DNS property. */
     if (strncmp("net.", name, strlen("net.")) == 0)  {
@@ -628,17 +698,24 @@ void load_persist_props(void)
     load_override_properties();
     /* Read persistent properties after all default values have been loaded. */
     load_persistent_properties();
+    property_area_log_stats();
 }
 
 void start_property_service(void)
 {
-    int fd;
-
     load_properties_from_file(PROP_PATH_SYSTEM_BUILD);
     load_properties_from_file(PROP_PATH_SYSTEM_DEFAULT);
     load_override_properties();
     /* Read persistent properties after all default values have been loaded. */
     load_persistent_properties();
+    property_area_log_stats();
+
+    start_property_socket();
+}
+
+void start_property_socket(void)
+{
+    int fd;
 
     fd = create_socket(PROP_SERVICE_NAME, SOCK_STREAM, 0666, 0, 0, NULL);
     if(fd < 0) return;
@@ -25,12 +25,18 @@ extern void property_init(void);
 extern void property_load_boot_defaults(void);
 extern void load_persist_props(void);
 extern void start_property_service(void);
+/* start_property_service() without reading any property files */
+extern void start_property_socket(void);
 void get_property_workspace(int *fd, int *sz);
 extern int __property_get(const char *name, char *value);
 extern int property_set(const char *name, const char *value);
 extern int properties_inited();
 int get_property_set_fd(void);
 
+struct prop_area_stats;
+int property_area_get_stats(struct prop_area_stats *stats);
+void property_area_log_stats(void);
+
 extern void __property_get_size_error()
     __attribute__((__error__("property_get called with too small buffer")));
 
@@ -0,0 +1,108 @@
+# Copyright 2014 The Android Open Source Project
+#
+# Tests and benchmarks for init.  Each one builds the init sources it covers
+# and supplies its own klog_ring_write(), as the host tools do, or for the
+# klog_ring.c test its own klog_write().  The ones that build init_parser.c
+# need bionic's property headers, so they are built for the target and run
+# from adb shell.
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_environment_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	environment_test.c \
+	../environment.c
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_parser_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	parser_test.c \
+	reference_tokenizer.c
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_tokenize_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	tokenize_bench.c \
+	reference_tokenizer.c \
+	read_file.c \
+	../parser.c
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_klog_ring_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	klog_ring_test.c \
+	../klog_ring.c
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_hwrng_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := hwrng_test.c
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_wait_property_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := wait_property_test.c
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_ueventd_rules_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	ueventd_rules_test.c \
+	read_file.c \
+	../ueventd_parser.c \
+	../ueventd_rules.c \
+	../parser.c
+LOCAL_CFLAGS := -DUEVENTD_RULES_HOST
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_export_rc_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	export_rc_test.c \
+	init_parser_stubs.c \
+	read_file.c \
+	../parser.c
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_boot_props_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	boot_props_test.c \
+	read_file.c \
+	../boot_props.c \
+	../parser.c
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := propcompact_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := propcompact_bench.c
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := init_parse_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	parse_bench.c \
+	init_parser_stubs.c \
+	read_file.c \
+	../init_parser.c \
+	../parser.c
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
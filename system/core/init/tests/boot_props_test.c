@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * boot_props_test: check the ro.boot.* -> ro.* aliases of boot_props.c.
+ *
+ *   - the built-in aliases copy what the command line gave and fall back to
+ *     their defaults when it gave nothing or an empty value
+ *   - the first value given for a ro.boot.* property wins
+ *   - an aliases file adds aliases, replaces the one of a destination that
+ *     is already mapped, and leaves destinations without a default unset
+ *   - malformed lines in the file are reported and skipped
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../boot_props.h"
+#include "../log.h"
+
+#define MAX_PROPS       32
+
+struct prop {
+    char name[64];
+    char value[92];
+};
+
+static struct prop props[MAX_PROPS];
+static int nprops;
+static int parse_errors;
+static int errors;
+
+/* parse_error() logs through ERROR(), which is all this counts */
+void klog_ring_write(int level, const char *fmt, ...)
+{
+    if (level <= KLOG_ERROR_LEVEL)
+        parse_errors++;
+}
+
+int property_set(const char *name, const char *value)
+{
+    int i;
+
+    for (i = 0; i < nprops; i++)
+        if (!strcmp(props[i].name, name))
+            break;
+    if (i == MAX_PROPS)
+        return -1;
+    if (i == nprops)
+        nprops++;
+    snprintf(props[i].name, sizeof(props[i].name), "%s", name);
+    snprintf(props[i].value, sizeof(props[i].value), "%s", value);
+    return 0;
+}
+
+static void expect(const char *name, const char *value)
+{
+    const char *got = NULL;
+    int i;
+
+    for (i = 0; i < nprops; i++)
+        if (!strcmp(props[i].name, name))
+            got = props[i].value;
+    if (value ? !got || strcmp(got, value) : got != NULL) {
+        printf("FAIL: %s is %s%s%s, expected %s%s%s\n", name,
+               got ? "'" : "", got ? got : "unset", got ? "'" : "",
+               value ? "'" : "", value ? value : "unset", value ? "'" : "");
+        errors++;
+    }
+}
+
+static const char aliases[] =
+    "# carrier and a replacement for the built-in ro.bootmode alias\n"
+    "ro.boot.carrier ro.carrier unknown\n"
+    "ro.boot.bootmode ro.bootmode normal\n"
+    "\n"
+    "ro.boot.wifimac ro.wifimac\n"
+    "ro.boot.only_one\n"
+    "ro.boot.a ro.a default extra\n"
+    "ro.boot.last ro.last last";
+
+int main(int argc, char **argv)
+{
+    char path[] = "/data/local/tmp/boot_props_test.XXXXXX";
+    char *fn = path;
+    FILE *f;
+    int fd;
+
+#ifndef HAVE_ANDROID_OS
+    fn += strlen("/data/local");
+#endif
+
+    /* as import_kernel_nv() would from the command line */
+    boot_props_add("ro.boot.serialno", "0123456789");
+    boot_props_add("ro.boot.serialno", "overridden");
+    boot_props_add("ro.boot.baseband", "");
+    boot_props_add("ro.boot.bootmode", "charger");
+    boot_props_add("ro.boot.carrier", "att");
+
+    if (!boot_props_get("ro.boot.serialno") ||
+            strcmp(boot_props_get("ro.boot.serialno"), "0123456789")) {
+        printf("FAIL: the second ro.boot.serialno replaced the first\n");
+        errors++;
+    }
+    if (boot_props_get("ro.boot.hardware")) {
+        printf("FAIL: ro.boot.hardware was never given\n");
+        errors++;
+    }
+
+    /* the built-in aliases alone */
+    boot_props_export();
+    expect("ro.serialno", "0123456789");
+    expect("ro.bootmode", "unknown");
+    expect("ro.baseband", "unknown");
+    expect("ro.bootloader", "unknown");
+    expect("ro.carrier", NULL);
+
+    /* and with the file */
+    fd = mkstemp(fn);
+    f = fd < 0 ? NULL : fdopen(fd, "w");
+    if (!f || fputs(aliases, f) < 0 || fclose(f)) {
+        printf("FAIL: cannot write %s\n", fn);
+        return 1;
+    }
+    if (boot_props_load(fn)) {
+        printf("FAIL: cannot load %s\n", fn);
+        errors++;
+    }
+    unlink(fn);
+    if (parse_errors != 2) {
+        printf("FAIL: %d lines reported, expected 2\n", parse_errors);
+        errors++;
+    }
+
+    nprops = 0;
+    boot_props_export();
+    expect("ro.serialno", "0123456789");
+    expect("ro.bootmode", "charger");
+    expect("ro.baseband", "unknown");
+    expect("ro.carrier", "att");
+    expect("ro.wifimac", NULL);
+    expect("ro.a", NULL);
+    expect("ro.last", "last");
+    if (nprops != 6) {
+        printf("FAIL: %d properties set, expected 6\n", nprops);
+        errors++;
+    }
+
+    if (boot_props_load("/nonexistent/init.boot_props.rc") != -1) {
+        printf("FAIL: loaded a file that is not there\n");
+        errors++;
+    }
+
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
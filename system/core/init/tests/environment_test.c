@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * environment_test: export 1000 variables the way init.rc "export" lines
+ * do, each one expanding the one before it, and check that:
+ *
+ *   - every variable is kept, in the order first exported
+ *   - ${var} expands anywhere in a value, any number of times
+ *   - unknown variables expand to nothing and an unclosed "${" stays as is
+ *   - exporting a key again replaces its value without moving it
+ *
+ * and reports how long the exports took.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../environment.h"
+#include "../log.h"
+
+#define EXPORTS         1000
+
+static int errors;
+
+void klog_ring_write(int level, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+/* The value of key in the environment, NULL if it is not there. */
+static const char *get(const char *key)
+{
+    char **env = environment();
+    size_t len = strlen(key);
+
+    for (; *env; env++)
+        if (!strncmp(*env, key, len) && (*env)[len] == '=')
+            return *env + len + 1;
+    return NULL;
+}
+
+static void check(const char *key, const char *expected)
+{
+    const char *value = get(key);
+
+    if (!value || strcmp(value, expected)) {
+        printf("%s is '%s', expected '%s'\n", key, value ? value : "(unset)",
+               expected);
+        fail("expansion");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct timespec start, end;
+    char key[32], value[64], expected[32];
+    char **env;
+    double ms;
+    int i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < EXPORTS; i++) {
+        snprintf(key, sizeof(key), "VAR%d", i);
+        if (i == 0)
+            snprintf(value, sizeof(value), "0");
+        else
+            snprintf(value, sizeof(value), "${VAR%d}", i - 1);
+        if (add_environment(key, value))
+            fail("add");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ms = (end.tv_sec - start.tv_sec) * 1000.0 +
+         (end.tv_nsec - start.tv_nsec) / 1e6;
+    printf("exports:          %d in %.2f ms\n", EXPORTS, ms);
+
+    /* each one took the value of the one before, all the way down */
+    for (i = 0, env = environment(); i < EXPORTS; i++, env++) {
+        snprintf(expected, sizeof(expected), "VAR%d=0", i);
+        if (!*env || strcmp(*env, expected)) {
+            printf("entry %d is '%s', expected '%s'\n", i, *env ? *env : "(end)",
+                   expected);
+            fail("order");
+            break;
+        }
+    }
+    if (i == EXPORTS && *env)
+        fail("extra entries");
+
+    add_environment("PATH", "/sbin:/system/bin");
+    add_environment("MID", "a${PATH}b${PATH}c");
+    check("MID", "a/sbin:/system/binb/sbin:/system/binc");
+    add_environment("CHAIN", "${VAR999}${VAR500}:${UNSET}:");
+    check("CHAIN", "00::");
+    add_environment("OPEN", "x${PATH");
+    check("OPEN", "x${PATH");
+    add_environment("EMPTY", "${}");
+    check("EMPTY", "");
+
+    /* redefining keeps the first position */
+    add_environment("VAR10", "${PATH}:/vendor/bin");
+    check("VAR10", "/sbin:/system/bin:/vendor/bin");
+    if (strcmp(environment()[10], "VAR10=/sbin:/system/bin:/vendor/bin"))
+        fail("redefinition moved the entry");
+    check("VAR11", "0");
+
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
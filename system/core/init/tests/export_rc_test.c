@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * export_rc_test: check that export_rc replaying what parse_config()
+ * recorded sets the same variables, in the same order, as reading the file
+ * again the way export_rc used to.  Runs a fixed config file and random ones
+ * mixing export lines with sections, commands, comments, quotes and
+ * continuations, then checks that a file init never parsed is still read.
+ *
+ * init_parser.c is included so that the static export_rc_read() can be
+ * reached.  Usage: init_export_rc_test [files [seed]]
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../init_parser.c"
+
+#define MAX_CALLS       256
+
+struct call {
+    char *name;
+    char *value;
+};
+
+static struct call calls[MAX_CALLS];
+static int ncalls;
+#ifdef HAVE_ANDROID_OS
+static char dir[] = "/data/local/tmp/export_rc_test.XXXXXX";
+#else
+static char dir[] = "/tmp/export_rc_test.XXXXXX";
+#endif
+static int errors;
+
+void add_environment(const char *name, const char *value)
+{
+    if (ncalls < MAX_CALLS) {
+        calls[ncalls].name = strdup(name);
+        calls[ncalls].value = strdup(value);
+    }
+    ncalls++;
+}
+
+static void reset_calls(void)
+{
+    int i;
+
+    for (i = 0; i < ncalls && i < MAX_CALLS; i++) {
+        free(calls[i].name);
+        free(calls[i].value);
+    }
+    ncalls = 0;
+}
+
+static const char sample[] =
+    "# exports at the top level, in sections and under services\n"
+    "export PATH /sbin:/vendor/bin:/system/sbin:/system/bin\n"
+    "export LD_LIBRARY_PATH /vendor/lib:/system/lib\n"
+    "\n"
+    "on init\n"
+    "    export ANDROID_ROOT /system\n"
+    "    export ANDROID_DATA \"/data with spaces\"\n"
+    "    export EXTRA a b c\n"
+    "    export ONLY_NAME\n"
+    "    mkdir /system\n"
+    "    export CONTINUED \\\n"
+    "        /continued\n"
+    "\n"
+    "service foo /system/bin/foo\n"
+    "    setenv NOT_EXPORTED 1\n"
+    "    export IN_SERVICE 1\n"
+    "\n"
+    "export PATH ${PATH}:/xbin   # comment\n"
+    "export ESCAPED a\\tb\\\\c\n";
+
+static const char *write_file(const char *name, const char *text)
+{
+    static char path[256];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "w");
+    if (!f || fputs(text, f) < 0 || fclose(f)) {
+        perror(path);
+        exit(1);
+    }
+    return path;
+}
+
+/* Random config text; the words include every keyword export_rc cares about. */
+static void random_config(char *text, size_t size)
+{
+    static const char *words[] = {
+        "export", "export", "export", "on", "service", "boot", "A", "B", "C",
+        "/x", "${A}", "\"q u\"", "\"", "\\", "\\n", "#", "setenv", "mkdir",
+        "class", "oneshot", "", "\\\n",
+    };
+    static const char *seps[] = { " ", " ", "\t", "\n", "\n", "\r\n", "  " };
+    size_t len = 0;
+    int n = rand() % 60;
+
+    text[0] = 0;
+    while (n-- > 0 && len + 32 < size) {
+        len += snprintf(text + len, size - len, "%s%s",
+                        words[rand() % (sizeof(words) / sizeof(words[0]))],
+                        seps[rand() % (sizeof(seps) / sizeof(seps[0]))]);
+    }
+}
+
+static void snapshot(struct call *saved, int *nsaved)
+{
+    memcpy(saved, calls, sizeof(calls));
+    *nsaved = ncalls;
+    ncalls = 0;
+}
+
+/* Parse path as init does, without the section names parse_config prints. */
+static int parse_quietly(const char *path)
+{
+    int out = dup(1);
+    int null = open("/dev/null", O_WRONLY);
+    int ret;
+
+    fflush(stdout);
+    dup2(null, 1);
+    ret = init_parse_config_file(path);
+    fflush(stdout);
+    dup2(out, 1);
+    close(out);
+    close(null);
+    return ret;
+}
+
+static void check_file(const char *path)
+{
+    struct call replayed[MAX_CALLS];
+    int nreplayed, i;
+
+    if (parse_quietly(path)) {
+        printf("FAIL: cannot parse %s\n", path);
+        errors++;
+        return;
+    }
+
+    reset_calls();
+    init_export_rc_file(path);
+    snapshot(replayed, &nreplayed);
+    export_rc_read(path);
+
+    if (nreplayed != ncalls)
+        goto mismatch;
+    for (i = 0; i < ncalls && i < MAX_CALLS; i++) {
+        if (strcmp(replayed[i].name, calls[i].name) ||
+                strcmp(replayed[i].value, calls[i].value))
+            goto mismatch;
+    }
+    goto done;
+
+mismatch:
+    printf("FAIL: %s: replayed %d exports, read %d\n", path, nreplayed, ncalls);
+    for (i = 0; i < nreplayed && i < MAX_CALLS; i++)
+        printf("  replayed %s='%s'\n", replayed[i].name, replayed[i].value);
+    for (i = 0; i < ncalls && i < MAX_CALLS; i++)
+        printf("  read     %s='%s'\n", calls[i].name, calls[i].value);
+    errors++;
+done:
+    reset_calls();
+    for (i = 0; i < nreplayed && i < MAX_CALLS; i++) {
+        free(replayed[i].name);
+        free(replayed[i].value);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int files = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+    char name[32], text[1024];
+    const char *path;
+    int i;
+
+    if (!mkdtemp(dir)) {
+        perror(dir);
+        return 1;
+    }
+
+    check_file(write_file("sample.rc", sample));
+
+    srand(seed);
+    for (i = 0; i < files && errors < 5; i++) {
+        /* a parsed file is recorded once, so each gets its own name */
+        snprintf(name, sizeof(name), "random%d.rc", i);
+        random_config(text, sizeof(text));
+        path = write_file(name, text);
+        check_file(path);
+        unlink(path);
+    }
+
+    /* not parsed by init, so export_rc has to read it */
+    path = write_file("unparsed.rc", "export LATE 1\n");
+    init_export_rc_file(path);
+    if (ncalls != 1 || strcmp(calls[0].name, "LATE"))
+    {
+            printf("FAIL: export_rc ignored a file init did not parse\n");
+            errors++;
+        }
+    reset_calls();
+
+    unlink(path);
+    unlink(write_file("sample.rc", ""));
+    rmdir(dir);
+    printf("%d random files, seed %u\n", i, seed);
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
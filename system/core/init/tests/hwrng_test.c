@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * hwrng_test: seed from a FIFO standing in for /dev/hw_random, driven by a
+ * poll loop like init's, and check that:
+ *
+ *   - bytes written in pieces reach the kernel pool whole and in order,
+ *     credited through RNDADDENTROPY when that works
+ *   - they are written to /dev/urandom instead when it does not
+ *   - a read that finds nothing backs off instead of polling the fd, and
+ *     is retried when the back off is over
+ *   - a second start while seeding is ignored
+ *   - EOF and a silent device end seeding as failed
+ *   - a missing device is not an error
+ *
+ * hwrng.c is included so that open() and ioctl() can be pointed at files
+ * of the test's own.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/random.h>
+
+/* property_service.h, without bionic's property headers */
+#define _INIT_PROPERTY_H
+#define PROP_VALUE_MAX 92
+int property_set(const char *name, const char *value);
+
+static int test_open(const char *path, int flags, ...);
+static int test_ioctl(int fd, unsigned long request, ...);
+
+#define open test_open
+#define ioctl test_ioctl
+#include "../hwrng.c"
+#undef open
+#undef ioctl
+
+#define SEED_BYTES      (HWRNG_CHUNK * 2 + 100)
+#define PIECE           300
+
+#ifdef HAVE_ANDROID_OS
+#define TMP_DIR "/data/local/tmp"
+#else
+#define TMP_DIR "/tmp"
+#endif
+
+static const char fifo_path[] = TMP_DIR "/hwrng_test.fifo";
+static const char urandom_path[] = TMP_DIR "/hwrng_test.urandom";
+
+static char progress[PROP_VALUE_MAX];
+static unsigned char credited[SEED_BYTES];
+static size_t credited_len;
+static int credited_bits;
+static int ioctl_works;
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+void klog_ring_write(int level, const char *fmt, ...)
+{
+}
+
+int property_set(const char *name, const char *value)
+{
+    if (!strcmp(name, HWRNG_PROGRESS_PROP))
+        snprintf(progress, sizeof(progress), "%s", value);
+    return 0;
+}
+
+/* /dev/urandom is a file the test reads back */
+static int test_open(const char *path, int flags, ...)
+{
+    if (!strcmp(path, "/dev/urandom"))
+        return open(urandom_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    return open(path, flags);
+}
+
+static int test_ioctl(int fd, unsigned long request, ...)
+{
+    struct rand_pool_info *info;
+    va_list ap;
+
+    va_start(ap, request);
+    info = va_arg(ap, struct rand_pool_info *);
+    va_end(ap);
+    if (request != RNDADDENTROPY || !ioctl_works) {
+        errno = EPERM;
+        return -1;
+    }
+    if (credited_len + info->buf_size > sizeof(credited)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(credited + credited_len, info->buf, info->buf_size);
+    credited_len += info->buf_size;
+    credited_bits += info->entropy_count;
+    return 0;
+}
+
+/* init's main loop, as far as the hwrng goes */
+static void run(void)
+{
+    struct pollfd ufd;
+    int nr;
+
+    while (hwrng_poll_timeout() >= 0) {
+        ufd.fd = get_hwrng_fd();
+        ufd.events = POLLIN;
+        ufd.revents = 0;
+        nr = poll(&ufd, ufd.fd >= 0, hwrng_poll_timeout());
+        handle_hwrng(nr > 0 && ufd.fd >= 0 ? ufd.revents : 0);
+    }
+}
+
+static unsigned char pattern[SEED_BYTES];
+static int writer_fd;
+
+static void *writer(void *arg)
+{
+    size_t done, n;
+
+    for (done = 0; done < sizeof(pattern); done += n) {
+        n = sizeof(pattern) - done < PIECE ? sizeof(pattern) - done : PIECE;
+        write(writer_fd, pattern + done, n);
+        usleep(20000);
+    }
+    return NULL;
+}
+
+static int start(void)
+{
+    unlink(fifo_path);
+    mkfifo(fifo_path, 0600);
+    if (hwrng_seed_start(fifo_path, SEED_BYTES) || get_hwrng_fd() < 0)
+        return -1;
+    /* a reader is there, so this does not block */
+    writer_fd = open(fifo_path, O_WRONLY | O_NONBLOCK);
+    return writer_fd < 0 ? -1 : 0;
+}
+
+static void test_seed(int credit)
+{
+    static unsigned char mixed[SEED_BYTES + 1];
+    char expected[PROP_VALUE_MAX];
+    pthread_t thread;
+    ssize_t len;
+    int fd;
+
+    ioctl_works = credit;
+    credited_len = 0;
+    credited_bits = 0;
+    if (start()) {
+        fail("starting on a FIFO");
+        return;
+    }
+    pthread_create(&thread, NULL, writer, NULL);
+    run();
+    pthread_join(thread, NULL);
+    close(writer_fd);
+
+    snprintf(expected, sizeof(expected), "%d/%d", SEED_BYTES, SEED_BYTES);
+    if (strcmp(progress, expected))
+        fail("progress at the end of seeding");
+    if (credit) {
+        if (credited_len != SEED_BYTES ||
+                memcmp(credited, pattern, SEED_BYTES))
+            fail("credited bytes");
+        if (credited_bits != SEED_BYTES * HWRNG_ENTROPY_BITS)
+            fail("entropy credited");
+    }
+
+    fd = open(urandom_path, O_RDONLY);
+    len = read(fd, mixed, sizeof(mixed));
+    close(fd);
+    if (credit ? len != 0 :
+            len != SEED_BYTES || memcmp(mixed, pattern, SEED_BYTES))
+        fail(credit ? "bytes written when they were credited" :
+                      "bytes written to /dev/urandom");
+}
+
+static void test_backoff(void)
+{
+    char expected[PROP_VALUE_MAX];
+
+    if (start()) {
+        fail("starting on a FIFO");
+        return;
+    }
+    if (hwrng_seed_start("/nonexistent", SEED_BYTES) ||
+            strcmp(hwrng_path, fifo_path))
+        fail("a second start while seeding");
+
+    /* readable, but nothing there */
+    handle_hwrng(POLLIN);
+    if (get_hwrng_fd() >= 0)
+        fail("the fd polled right after EAGAIN");
+    if (hwrng_poll_timeout() < 0 || hwrng_poll_timeout() > HWRNG_RETRY_MS)
+        fail("the timeout after EAGAIN");
+
+    /* the read is retried once the back off is over, without an event */
+    write(writer_fd, pattern, 10);
+    usleep(HWRNG_RETRY_MS * 1000);
+    handle_hwrng(0);
+    snprintf(expected, sizeof(expected), "10/%d", SEED_BYTES);
+    if (strcmp(progress, expected) || get_hwrng_fd() < 0)
+        fail("the read retried after backing off");
+
+    /* EOF */
+    close(writer_fd);
+    run();
+    if (strcmp(progress, "failed"))
+        fail("progress after EOF");
+    if (get_hwrng_fd() >= 0 || hwrng_poll_timeout() >= 0)
+        fail("idle after EOF");
+}
+
+static void test_timeout(void)
+{
+    long long started;
+
+    if (start()) {
+        fail("starting on a FIFO");
+        return;
+    }
+    started = now_ms();
+    run();
+    if (strcmp(progress, "failed"))
+        fail("progress after a timeout");
+    if (now_ms() - started < HWRNG_READ_TIMEOUT_MS)
+        fail("timed out early");
+    close(writer_fd);
+}
+
+static void test_missing(void)
+{
+    progress[0] = 0;
+    if (hwrng_seed_start(TMP_DIR "/hwrng_test.none", SEED_BYTES))
+        fail("a missing device is an error");
+    if (get_hwrng_fd() >= 0 || hwrng_poll_timeout() >= 0 || progress[0])
+        fail("seeding from a missing device");
+}
+
+int main(int argc, char **argv)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(pattern); i++)
+        pattern[i] = i * 7 + i / 251;
+
+    test_seed(1);
+    test_seed(0);
+    test_backoff();
+    test_timeout();
+    test_missing();
+
+    unlink(fifo_path);
+    unlink(urandom_path);
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
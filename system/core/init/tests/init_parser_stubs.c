@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * What init_parser.c needs from the rest of init, for tests that parse
+ * config files without running anything.  The builtins do nothing, no
+ * property is set, and log messages are dropped.  read_file() is in
+ * read_file.c.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../log.h"
+#include "../util.h"
+
+#include "../keywords.h"
+
+int do_chroot(int nargs, char **args) { return 0; }
+int do_chdir(int nargs, char **args) { return 0; }
+int do_class_start(int nargs, char **args) { return 0; }
+int do_class_stop(int nargs, char **args) { return 0; }
+int do_class_reset(int nargs, char **args) { return 0; }
+int do_domainname(int nargs, char **args) { return 0; }
+int do_exec(int nargs, char **args) { return 0; }
+int do_export(int nargs, char **args) { return 0; }
+int do_export_rc(int nargs, char **args) { return 0; }
+int do_hostname(int nargs, char **args) { return 0; }
+int do_ifup(int nargs, char **args) { return 0; }
+int do_insmod(int nargs, char **args) { return 0; }
+int do_mix_hwrng(int nargs, char **args) { return 0; }
+int do_mkdir(int nargs, char **args) { return 0; }
+int do_mount_all(int nargs, char **args) { return 0; }
+int do_mount(int nargs, char **args) { return 0; }
+int do_powerctl(int nargs, char **args) { return 0; }
+int do_restart(int nargs, char **args) { return 0; }
+int do_restorecon(int nargs, char **args) { return 0; }
+int do_restorecon_recursive(int nargs, char **args) { return 0; }
+int do_rm(int nargs, char **args) { return 0; }
+int do_rmdir(int nargs, char **args) { return 0; }
+int do_setcon(int nargs, char **args) { return 0; }
+int do_setenforce(int nargs, char **args) { return 0; }
+int do_setkey(int nargs, char **args) { return 0; }
+int do_setprop(int nargs, char **args) { return 0; }
+int do_setrlimit(int nargs, char **args) { return 0; }
+int do_setsebool(int nargs, char **args) { return 0; }
+int do_start(int nargs, char **args) { return 0; }
+int do_stop(int nargs, char **args) { return 0; }
+int do_swapon_all(int nargs, char **args) { return 0; }
+int do_trigger(int nargs, char **args) { return 0; }
+int do_symlink(int nargs, char **args) { return 0; }
+int do_sysclktz(int nargs, char **args) { return 0; }
+int do_write(int nargs, char **args) { return 0; }
+int do_copy(int nargs, char **args) { return 0; }
+int do_chown(int nargs, char **args) { return 0; }
+int do_chmod(int nargs, char **args) { return 0; }
+int do_loglevel(int nargs, char **args) { return 0; }
+int do_load_persist_props(int nargs, char **args) { return 0; }
+int do_wait(int nargs, char **args) { return 0; }
+int do_wait_for_prop(int nargs, char **args) { return 0; }
+
+int __property_get(const char *name, char *value)
+{
+    value[0] = 0;
+    return 0;
+}
+
+unsigned int decode_uid(const char *s)
+{
+    return s ? strtoul(s, 0, 0) : 0;
+}
+
+void klog_ring_write(int level, const char *fmt, ...)
+{
+}
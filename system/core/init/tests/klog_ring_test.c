@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * klog_ring_test: queue messages of every length up to a few hundred bytes
+ * into a ring writing to a SOCK_SEQPACKET socket, which keeps each writev()
+ * a packet of its own, and check that:
+ *
+ *   - every message comes out once and in order
+ *   - no writev() is longer than KLOG_RING_WRITE_MAX
+ *   - klog_ring_flush_old() leaves a young, nearly empty ring alone
+ *   - an error goes out at once, with what was queued before it
+ *   - messages that could not be written are counted, and the count goes
+ *     out under the tag given to klog_ring_init()
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <cutils/klog.h>
+
+#include "../klog_ring.h"
+
+#define MESSAGES        20000
+
+static char expected[8 * 1024 * 1024];
+static size_t expected_len;
+static char received[8 * 1024 * 1024];
+static size_t received_len;
+static size_t longest_write;
+static int sock[2];
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+int klog_get_level(void)
+{
+    return KLOG_INFO_LEVEL;
+}
+
+void klog_write(int level, const char *fmt, ...)
+{
+}
+
+static void *reader(void *arg)
+{
+    ssize_t n;
+
+    while ((n = recv(sock[1], received + received_len,
+                     sizeof(received) - received_len, 0)) > 0) {
+        received_len += n;
+        if ((size_t) n > longest_write)
+            longest_write = n;
+    }
+    return NULL;
+}
+
+static void queue(int level, int i)
+{
+    static const char pad[] = "................................................"
+                              "................................................"
+                              "................................................"
+                              "................................................"
+                              "................................................"
+                              "................................................";
+    int pad_len = (i * 37) % (sizeof(pad) - 1);
+
+    expected_len += sprintf(expected + expected_len, "<6>init: message %d %.*s\n",
+                            i, pad_len, pad);
+    klog_ring_write(level, "<6>init: message %d %.*s\n", i, pad_len, pad);
+}
+
+int main(int argc, char **argv)
+{
+    pthread_t thread;
+    size_t before;
+    int saved, bad, n, i;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sock) < 0) {
+        printf("FAIL: socketpair\n");
+        return 1;
+    }
+    pthread_create(&thread, NULL, reader, NULL);
+    klog_ring_init("klog_ring_test", sock[0]);
+
+    for (i = 0; i < MESSAGES; i++) {
+        queue(KLOG_INFO_LEVEL, i);
+        if (i % 100 == 0)
+            klog_ring_flush_old();
+    }
+    klog_ring_flush();
+
+    /* nothing written for a young message, everything with an error */
+    usleep(10000);
+    before = received_len;
+    queue(KLOG_INFO_LEVEL, i++);
+    klog_ring_flush_old();
+    usleep(10000);
+    if (received_len != before)
+        fail("flush_old wrote a message that had not waited");
+    queue(KLOG_ERROR_LEVEL, i++);
+    usleep(10000);
+    if (received_len != expected_len)
+        fail("an error was held back");
+
+    /* writes that fail are dropped, and then noted */
+    saved = dup(sock[0]);
+    bad = open("/dev/null", O_RDONLY);
+    dup2(bad, sock[0]);
+    for (n = 0; n < 3; n++)
+        klog_ring_write(KLOG_INFO_LEVEL, "<6>init: lost %d\n", n);
+    klog_ring_flush();
+    dup2(saved, sock[0]);
+    close(saved);
+    close(bad);
+    klog_ring_flush();
+    expected_len += sprintf(expected + expected_len,
+                            "<4>klog_ring_test: 3 kernel log messages dropped\n");
+    usleep(10000);
+
+    shutdown(sock[0], SHUT_WR);
+    pthread_join(thread, NULL);
+
+    printf("messages:         %d, %zu bytes\n", i, expected_len);
+    printf("longest write:    %zu bytes\n", longest_write);
+    if (received_len != expected_len ||
+            memcmp(received, expected, expected_len))
+        fail("messages lost, repeated or reordered");
+    if (longest_write > KLOG_RING_WRITE_MAX)
+        fail("a write longer than the kernel takes");
+
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
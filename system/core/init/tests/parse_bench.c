@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * init_parse_bench: time init_parse_config_file() on each file given,
+ * imports included, the way init reads its config at boot.  To compare a
+ * normal boot with a charger boot:
+ *
+ *   adb shell init_parse_bench /init.rc /init.charger.rc
+ *
+ * The files given, though not the ones they import, are read once
+ * beforehand so that the times leave out the first read from the ramdisk.
+ * Commands are not run; services and actions are only added to init's
+ * lists, and the "[ on ... ]" lines the parser prints go to /dev/null.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../init_parser.h"
+#include "../util.h"
+
+void add_environment(const char *name, const char *value)
+{
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    double start, ms;
+    int out, null, ret, i;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: init_parse_bench <rc file>...\n");
+        return 2;
+    }
+
+    for (i = 1; i < argc; i++)
+        free(read_file(argv[i], NULL));
+
+    out = dup(1);
+    null = open("/dev/null", O_WRONLY);
+    for (i = 1; i < argc; i++) {
+        fflush(stdout);
+        dup2(null, 1);
+        start = now_ms();
+        ret = init_parse_config_file(argv[i]);
+        ms = now_ms() - start;
+        fflush(stdout);
+        dup2(out, 1);
+        if (ret < 0)
+            printf("%-24s cannot be read\n", argv[i]);
+        else
+            printf("%-24s %.3f ms\n", argv[i], ms);
+    }
+    close(null);
+    close(out);
+    return 0;
+}
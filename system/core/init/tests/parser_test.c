@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * parser_test: fuzz the tokenizer against scalar references.
+ *
+ *   - plain_run(), the SSE2 or NEON version on hosts that have one, must
+ *     agree with a byte at a time scan for random text at every alignment,
+ *     including text that ends right before an unmapped page
+ *   - next_token() must split random config text into the same tokens,
+ *     with the same line count, as the byte at a time tokenizer it replaced
+ *
+ * parser.c is included so that the static plain_run() can be reached.
+ * Usage: init_parser_test [iterations [seed]]
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../parser.c"
+#include "reference_tokenizer.h"
+
+#define MAX_TEXT        200
+
+static int errors;
+
+void klog_ring_write(int level, const char *fmt, ...)
+{
+}
+
+static void fail(const char *what, const char *text)
+{
+    printf("FAIL: %s for \"", what);
+    for (; *text; text++)
+        printf(*text >= ' ' && *text < 0x7f ? "%c" : "\\x%02x",
+               (unsigned char) *text);
+    printf("\"\n");
+    errors++;
+}
+
+static size_t reference_run(const char *x)
+{
+    const char *p = x;
+
+    while (*p && !strchr(" \t\r\n\"\\", *p))
+        p++;
+    return p - x;
+}
+
+/*
+ * Random text, mostly plain runs of random length with the characters the
+ * tokenizer treats specially mixed in, and now and then any byte at all.
+ */
+static void random_text(char *text, size_t len)
+{
+    static const char special[] = " \t\r\n\"\\#nrt";
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        int r = rand() % 100;
+        if (r < 15)
+            text[i] = special[rand() % (sizeof(special) - 1)];
+        else if (r < 17)
+            text[i] = 1 + rand() % 255;
+        else
+            text[i] = 'a' + rand() % 26;
+    }
+    text[len] = 0;
+}
+
+static void check_runs(const char *text)
+{
+    const char *p;
+
+    for (p = text; *p; p++) {
+        if (plain_run(p) != reference_run(p)) {
+            fail("plain_run", p);
+            return;
+        }
+    }
+}
+
+static void check_tokens(const char *text)
+{
+    char a[MAX_TEXT + 1], b[MAX_TEXT + 1];
+    struct parse_state sa, sb;
+    int ta, tb;
+
+    strcpy(a, text);
+    strcpy(b, text);
+    memset(&sa, 0, sizeof(sa));
+    memset(&sb, 0, sizeof(sb));
+    sa.ptr = a;
+    sb.ptr = b;
+    do {
+        ta = next_token(&sa);
+        tb = reference_next_token(&sb);
+        if (ta != tb || sa.line != sb.line ||
+                (ta == T_TEXT && strcmp(sa.text, sb.text))) {
+            fail("next_token", text);
+            return;
+        }
+    } while (ta != T_EOF);
+}
+
+int main(int argc, char **argv)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    unsigned seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+    char text[MAX_TEXT + 1];
+    char *guarded;
+    int i;
+
+    /* text placed against a page nobody may read */
+    guarded = mmap(NULL, page * 2, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (guarded == MAP_FAILED || mprotect(guarded + page, page, PROT_NONE)) {
+        printf("FAIL: cannot map the guard page\n");
+        return 1;
+    }
+
+    srand(seed);
+    for (i = 0; i < iterations && errors < 10; i++) {
+        size_t len = rand() % (MAX_TEXT + 1);
+        char *end;
+
+        random_text(text, len);
+        check_runs(text);
+        check_tokens(text);
+
+        /* the same text ending at every offset of a 16 byte block */
+        end = guarded + page - 1 - (i % 16);
+        len = strlen(text) < (size_t) (end - guarded) ? strlen(text) : 0;
+        memcpy(end - len, text, len + 1);
+        check_runs(end - len);
+    }
+
+    printf("%d texts, seed %u, %s plain_run\n", i, seed,
+#if defined(__SSE2__)
+           "SSE2"
+#elif defined(__ARM_NEON__)
+           "NEON"
+#else
+           "scalar"
+#endif
+           );
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
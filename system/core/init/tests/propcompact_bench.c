@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * propcompact_bench: time property lookups in an area filled the way
+ * bionic fills it, properties added in boot order with each trie node
+ * allocated when first needed, against the same properties laid out by
+ * propcompact.  Every property is looked up as __system_property_find()
+ * does, in a scrambled order, and the best of several runs is reported
+ * with the nodes compared per lookup.
+ *
+ * The area is 1M rather than the device's 128K so that 5000 properties
+ * fit.  propcompact.c is included to build the compacted area in process.
+ * Usage: propcompact_bench [properties [seed]]
+ */
+
+#include <time.h>
+
+#define PA_SIZE         (1024 * 1024)
+#define main            propcompact_main
+#include "../propcompact.c"
+#undef main
+
+#define RUNS            20
+#define PASSES          5
+
+static const char *prefixes[] = {
+    "persist.sys", "persist.vendor.radio", "ro.vendor", "vendor.camera",
+    "sys", "ro.boot", "debug.hwui", "dalvik.vm", "net", "ril", "wifi.direct",
+};
+
+static void *area_obj(char *area, uint32_t off)
+{
+    return area + sizeof(struct prop_area_hdr) + off;
+}
+
+static uint32_t area_alloc(char *area, size_t size)
+{
+    struct prop_area_hdr *hdr = (struct prop_area_hdr *) area;
+    uint32_t off = hdr->bytes_used;
+
+    size = PROP_AREA_ALIGN(size);
+    if (size > PROP_AREA_DATA_SIZE - off)
+        die("properties do not fit in %u bytes\n",
+            (unsigned) PROP_AREA_DATA_SIZE);
+    hdr->bytes_used += size;
+    return off;
+}
+
+static uint32_t new_bt(char *area, const char *name, unsigned len)
+{
+    uint32_t off = area_alloc(area, sizeof(struct prop_area_bt) + len + 1);
+    struct prop_area_bt *bt = area_obj(area, off);
+
+    bt->namelen = len;
+    memcpy(bt->name, name, len);
+    return off;
+}
+
+static int cmp_prop_name(const char *one, unsigned one_len,
+                         const char *two, unsigned two_len)
+{
+    if (one_len < two_len)
+        return -1;
+    if (one_len > two_len)
+        return 1;
+    return strncmp(one, two, one_len);
+}
+
+/* bionic's find_prop_bt(), adding the node if alloc is set */
+static struct prop_area_bt *find_bt(char *area, struct prop_area_bt *bt,
+        const char *name, unsigned len, int alloc, unsigned *probes)
+{
+    for (;;) {
+        int ret = cmp_prop_name(name, len, bt->name, bt->namelen);
+        uint32_t *next;
+
+        (*probes)++;
+        if (!ret)
+            return bt;
+        next = ret < 0 ? &bt->left : &bt->right;
+        if (*next) {
+            bt = area_obj(area, *next);
+        } else if (alloc) {
+            *next = new_bt(area, name, len);
+            return area_obj(area, *next);
+        } else {
+            return NULL;
+        }
+    }
+}
+
+/* bionic's find_property(), and __system_property_add() if value is set */
+static struct prop_area_info *find_prop(char *area, const char *name,
+        const char *value, unsigned *probes)
+{
+    struct prop_area_bt *cur = area_obj(area, 0);
+    const char *remaining = name;
+    struct prop_area_info *pi;
+    uint32_t off;
+    size_t len;
+
+    for (;;) {
+        const char *sep = strchr(remaining, '.');
+        unsigned seglen = sep ? (unsigned) (sep - remaining) : strlen(remaining);
+        struct prop_area_bt *root;
+
+        if (cur->children) {
+            root = area_obj(area, cur->children);
+        } else if (value) {
+            cur->children = new_bt(area, remaining, seglen);
+            root = area_obj(area, cur->children);
+        } else {
+            return NULL;
+        }
+        cur = find_bt(area, root, remaining, seglen, value != NULL, probes);
+        if (!cur)
+            return NULL;
+        if (!sep)
+            break;
+        remaining = sep + 1;
+    }
+
+    if (cur->prop)
+        return area_obj(area, cur->prop);
+    if (!value)
+        return NULL;
+    len = strlen(name);
+    off = area_alloc(area, sizeof(*pi) + len + 1);
+    pi = area_obj(area, off);
+    pi->serial = strlen(value) << 24;
+    strcpy(pi->value, value);
+    memcpy(pi->name, name, len + 1);
+    cur->prop = off;
+    return pi;
+}
+
+static char *new_area(void)
+{
+    char *area = calloc(1, PA_SIZE);
+    struct prop_area_hdr *hdr = (struct prop_area_hdr *) area;
+
+    if (!area)
+        die("out of memory\n");
+    hdr->magic = PROP_AREA_MAGIC;
+    hdr->version = PROP_AREA_VERSION;
+    return area;
+}
+
+/* Best ns per lookup of every name, and the nodes each one compared. */
+static double time_lookups(char *area, char **names, unsigned count,
+                           double *probes_per_lookup)
+{
+    volatile uint32_t sink = 0;
+    double best = 0;
+    unsigned probes = 0;
+    unsigned i, pass;
+    int run;
+
+    for (i = 0; i < count; i++) {
+        if (!find_prop(area, names[i], NULL, &probes))
+            die("lost %s\n", names[i]);
+    }
+    *probes_per_lookup = (double) probes / count;
+
+    for (run = 0; run < RUNS; run++) {
+        struct timespec start, end;
+        double ns;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (pass = 0; pass < PASSES; pass++) {
+            for (i = 0; i < count; i++) {
+                /* a stride that visits every name, far from boot order */
+                unsigned n = (unsigned) ((i * 2654435761ull) % count);
+                sink += find_prop(area, names[n], NULL, &probes)->serial;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        ns = ((end.tv_sec - start.tv_sec) * 1e9 +
+              (end.tv_nsec - start.tv_nsec)) / ((double) count * PASSES);
+        if (!run || ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned count = argc > 1 ? strtoul(argv[1], NULL, 0) : 5000;
+    unsigned seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 1;
+    struct prop_area_stats st;
+    struct image img;
+    struct seg root;
+    char **names;
+    char *area;
+    double ns_boot, ns_compact, probes_boot, probes_compact;
+    unsigned i;
+
+    names = calloc(count, sizeof(*names));
+    if (!names)
+        die("out of memory\n");
+    srand(seed);
+    for (i = 0; i < count; i++) {
+        char name[PROP_NAME_MAX];
+
+        snprintf(name, sizeof(name), "%s.k%d_%u",
+                 prefixes[rand() % (sizeof(prefixes) / sizeof(prefixes[0]))],
+                 rand() % 300, i);
+        names[i] = strdup(name);
+        if (!names[i])
+            die("out of memory\n");
+    }
+
+    /* as init sets them at boot; the root is the nameless node at 0 */
+    area = new_area();
+    new_bt(area, "", 0);
+    for (i = 0; i < count; i++) {
+        unsigned probes = 0;
+        find_prop(area, names[i], "value", &probes);
+    }
+    if (prop_area_walk(area, PA_SIZE, &st, add_entry, NULL))
+        die("built an unreadable area\n");
+    print_stats("boot order", &st);
+
+    /* as propcompact lays the same properties out */
+    qsort(entries, entry_count, sizeof(*entries), compare_entries);
+    build_tree(&root);
+    img.data = new_area();
+    img.used = 0;
+    alloc_obj(&img, sizeof(struct prop_area_bt) + 1);
+    emit_children(&img, &root, 0);
+    ((struct prop_area_hdr *) img.data)->bytes_used = img.used;
+    if (prop_area_walk(img.data, PA_SIZE, &st, NULL, NULL))
+        die("built an unreadable area\n");
+    print_stats("compacted", &st);
+
+    ns_boot = time_lookups(area, names, count, &probes_boot);
+    ns_compact = time_lookups(img.data, names, count, &probes_compact);
+    printf("boot order:  %.1f ns per lookup, %.2f nodes compared\n",
+           ns_boot, probes_boot);
+    printf("compacted:   %.1f ns per lookup, %.2f nodes compared\n",
+           ns_compact, probes_compact);
+    return 0;
+}
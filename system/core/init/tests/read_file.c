@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* read_file() as util.c has it, for tests that cannot link util.c */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../util.h"
+
+/* the file with a newline and a NUL appended */
+void *read_file(const char *fn, unsigned *_sz)
+{
+    struct stat sb;
+    char *data = NULL;
+    int fd;
+
+    fd = open(fn, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    if (fstat(fd, &sb) == 0) {
+        data = malloc(sb.st_size + 2);
+        if (data && read(fd, data, sb.st_size) != sb.st_size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    close(fd);
+    if (!data)
+        return NULL;
+    data[sb.st_size] = '\n';
+    data[sb.st_size + 1] = 0;
+    if (_sz)
+        *_sz = sb.st_size;
+    return data;
+}
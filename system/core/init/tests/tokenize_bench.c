@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * init_tokenize_bench: time next_token() against the byte at a time
+ * tokenizer it replaced, over a synthetic rc file of 50000 lines made of
+ * the sections, commands, comments, quoted strings and escapes init.rc
+ * files have, or over the file given.  Each time is the best of a few
+ * runs over a fresh copy, since tokenizing unescapes the text in place.
+ *
+ * Usage: init_tokenize_bench [rc file]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../parser.h"
+#include "../util.h"
+#include "reference_tokenizer.h"
+
+#define LINES   50000
+#define RUNS    50
+
+static const char *const lines[] = {
+    "on early-init",
+    "    write /proc/1/oom_adj -16",
+    "    setcon u:r:init:s0",
+    "    mkdir /mnt/shell/emulated 0700 shell shell",
+    "    chown system system /sys/devices/system/cpu/cpu0/cpufreq/scaling_max_freq",
+    "    chmod 0664 /sys/devices/system/cpu/cpu0/cpufreq/scaling_min_freq",
+    "    setprop ro.crypto.fuse_sdcard true",
+    "    export EXTERNAL_STORAGE /storage/emulated/legacy",
+    "# Backward compatibility",
+    "    symlink /system/etc /etc",
+    "service surfaceflinger /system/bin/surfaceflinger",
+    "    class main",
+    "    user system",
+    "    group graphics drmrpc",
+    "    onrestart restart zygote",
+    "service zygote /system/bin/app_process -Xzygote /system/bin --zygote --start-system-server",
+    "    socket zygote stream 660 root system",
+    "    write /sys/android_power/request_state \"wake up\"",
+    "    exec /system/bin/sh -c \"echo 1 > /proc/sys/kernel/sysrq\"",
+    "    setprop persist.sys.usb.config mtp,adb  # follows usb",
+    "    write /sys/class/android_usb/android0/iManufacturer ${ro.product.manufacturer}",
+    "    setprop net.tcp.buffersize.default 4096,87380,524288,4096,16384,110208",
+    "    setprop ro.config.greeting Hello\\ world\\tfrom\\ init",
+    "on property:sys.boot_completed=1",
+    "",
+};
+
+static char *synthetic_rc(size_t *len)
+{
+    size_t count = sizeof(lines) / sizeof(lines[0]);
+    size_t size = 0, i;
+    char *text, *p;
+
+    for (i = 0; i < LINES; i++)
+        size += strlen(lines[i % count]) + 1;
+    p = text = malloc(size + 1);
+    for (i = 0; i < LINES; i++) {
+        size_t n = strlen(lines[i % count]);
+        memcpy(p, lines[i % count], n);
+        p += n;
+        *p++ = '\n';
+    }
+    *p = 0;
+    *len = size;
+    return text;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static double tokenize(int (*next)(struct parse_state *), const char *text,
+        char *copy, size_t len, int *tokens)
+{
+    struct parse_state state;
+    double best = 0, start, ms;
+    int run, n;
+
+    for (run = 0; run < RUNS; run++) {
+        memcpy(copy, text, len + 1);
+        memset(&state, 0, sizeof(state));
+        state.ptr = copy;
+        state.line = 1;
+        n = 0;
+        start = now_ms();
+        while (next(&state) != T_EOF)
+            n++;
+        ms = now_ms() - start;
+        if (run == 0 || ms < best)
+            best = ms;
+    }
+    *tokens = n;
+    return best;
+}
+
+void klog_ring_write(int level, const char *fmt, ...)
+{
+}
+
+int main(int argc, char **argv)
+{
+    double ms, reference_ms;
+    int tokens, reference_tokens;
+    unsigned size;
+    size_t len;
+    char *text, *copy;
+
+    if (argc > 1) {
+        text = read_file(argv[1], &size);
+        if (!text) {
+            fprintf(stderr, "cannot read %s\n", argv[1]);
+            return 1;
+        }
+        len = strlen(text);
+    } else {
+        text = synthetic_rc(&len);
+    }
+    copy = malloc(len + 1);
+
+    reference_ms = tokenize(reference_next_token, text, copy, len,
+                            &reference_tokens);
+    ms = tokenize(next_token, text, copy, len, &tokens);
+    if (tokens != reference_tokens) {
+        printf("FAIL: %d tokens, %d from the reference\n", tokens,
+               reference_tokens);
+        return 1;
+    }
+
+    printf("%zu bytes, %d tokens\n", len, tokens);
+    printf("next_token            %8.2f ms\n", ms);
+    printf("byte at a time        %8.2f ms\n", reference_ms);
+    return 0;
+}
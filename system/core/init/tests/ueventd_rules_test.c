@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ueventd_rules_test: parse a ueventd.rc and a board file with planted
+ * dead rules, the way ueventd does, and check that:
+ *
+ *   - each dead rule is dropped and reported, as an error when the rule
+ *     that hides it is in the same file and as a notice across files
+ *   - the compiled lookups give every path the mode and owner that the
+ *     old in-order scan of the rules gave, for /dev and for /sys
+ *   - that still holds after the rules are saved and loaded back, without
+ *     compiling them again
+ *   - rules saved from rc files of another size or mtime, or damaged, are
+ *     not loaded
+ *
+ * Usage: ueventd_rules_test [paths [seed]]
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+
+#include <private/android_filesystem_config.h>
+
+#include "../log.h"
+#include "../ueventd_parser.h"
+#include "../ueventd_rules.h"
+
+#define MAX_REPORTS     64
+#define MAX_ATTRS       16
+
+struct spec {
+    int file;
+    const char *name;       /* with the '*' of a wildcard */
+    const char *attr;
+    mode_t perm;
+    const char *uid;
+    const char *gid;
+    char report;            /* 'E' or 'N' if the rule is dead, else 0 */
+};
+
+/* live rules, and dead ones of each kind, within a file and across files */
+static const struct spec specs[] = {
+    { 0, "/dev/null", NULL, 0666, "root", "root", 0 },
+    { 0, "/dev/graphics/*", NULL, 0660, "root", "graphics", 0 },
+    { 0, "/dev/snd/dsp", NULL, 0660, "system", "audio", 'N' },
+    { 0, "/dev/input/*", NULL, 0660, "root", "input", 0 },
+    { 0, "/dev/alarm", NULL, 0664, "system", "radio", 'E' },
+    { 0, "/dev/alarm", NULL, 0664, "system", "radio", 0 },
+    { 0, "/dev/log/main", NULL, 0666, "root", "log", 'E' },
+    { 0, "/dev/log/*", NULL, 0662, "root", "log", 0 },
+    { 0, "/dev/pmem", NULL, 0660, "system", "graphics", 'E' },
+    { 0, "/dev/pmem*", NULL, 0660, "system", "graphics", 0 },
+    { 0, "/dev/tun", NULL, 0660, "system", "vpn", 'N' },
+    { 0, "/sys/devices/virtual/input/input*",
+      "enable", 0660, "root", "input", 'N' },
+    { 0, "/sys/devices/virtual/input/input*",
+      "poll_delay", 0660, "root", "input", 0 },
+    { 0, "/sys/devices/system/cpu/cpu0",
+      "cpufreq/scaling_max_freq", 0664, "system", "system", 'N' },
+    { 0, "devices/foo", NULL, 0600, "root", "root", 'E' },
+    { 0, "/dev/bus/usb/*", NULL, 0660, "root", "shell", 0 },
+    { 1, "/dev/snd/*", NULL, 0664, "system", "audio", 0 },
+    { 1, "/dev/tun", NULL, 0666, "system", "vpn", 0 },
+    { 1, "/dev/input/event1", NULL, 0660, "root", "input", 0 },
+    { 1, "/sys/devices/system/cpu/cpu*",
+      "cpufreq/scaling_max_freq", 0664, "system", "system", 0 },
+    { 1, "/sys/devices/virtual/input/input*",
+      "enable", 0664, "system", "input", 0 },
+    { 1, "/dev/ion", NULL, 0666, "system", "system", 'E' },
+    { 1, "/dev/ion", NULL, 0664, "system", "system", 0 },
+    { 1, "/dev/ttyO1", NULL, 0660, "radio", "radio", 0 },
+};
+#define NSPECS  (sizeof(specs) / sizeof(specs[0]))
+
+static const char *fixed_paths[] = {
+    "/dev/null", "/dev/graphics/fb0", "/dev/snd/dsp", "/dev/snd/pcmC0D0p",
+    "/dev/snd", "/dev/input/event1", "/dev/input/event10", "/dev/alarm",
+    "/dev/tun", "/dev/pmem", "/dev/pmem_adsp", "/dev/log/main", "/dev/log",
+    "/dev/ion", "/dev/ttyO1", "/dev/bus/usb/001/002", "/dev/foo",
+    "/devices/virtual/input/input3",
+    "/devices/virtual/input/input", "/devices/system/cpu/cpu0",
+    "/devices/system/cpu/cpu1", "/devices/system/cpu/cpufreq",
+    "/devices/none",
+};
+#define NFIXED  (sizeof(fixed_paths) / sizeof(fixed_paths[0]))
+
+struct report {
+    int level;
+    char text[KLOG_RING_MSG_MAX];
+};
+
+static struct report reports[MAX_REPORTS];
+static int nreports;
+static char dir[] = "/tmp/ueventd_rules_test.XXXXXX";
+static char files[2][64];
+static int errors;
+
+struct attr_state {
+    const char *attr;
+    mode_t perm;
+    unsigned int uid;
+    unsigned int gid;
+};
+
+static struct attr_state want[MAX_ATTRS], got[MAX_ATTRS];
+static int nwant, ngot;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+/* what the ERROR() and NOTICE() of the rules end up in */
+void klog_ring_write(int level, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (level > KLOG_NOTICE_LEVEL || nreports == MAX_REPORTS)
+        return;
+    va_start(ap, fmt);
+    reports[nreports].level = level;
+    vsnprintf(reports[nreports].text, sizeof(reports[nreports].text), fmt, ap);
+    va_end(ap);
+    nreports++;
+}
+
+static unsigned int android_id(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < sizeof(android_ids) / sizeof(android_ids[0]); i++)
+        if (!strcmp(name, android_ids[i].name))
+            return android_ids[i].aid;
+    return -1;
+}
+
+static int spec_matches(const struct spec *s, const char *path)
+{
+    size_t len = strlen(s->name);
+
+    if (s->attr) {
+        /* uevent paths leave out the "/sys" */
+        if (s->name[len - 1] == '*')
+            return !strncmp(path, s->name + 4, len - 5);
+        return !strcmp(path, s->name + 4);
+    }
+    if (s->name[len - 1] == '*')
+        return !strncmp(path, s->name, len - 1);
+    return !strcmp(path, s->name);
+}
+
+static void write_files(void)
+{
+    unsigned int i;
+    FILE *f[2];
+
+    snprintf(files[0], sizeof(files[0]), "%s/ueventd.rc", dir);
+    snprintf(files[1], sizeof(files[1]), "%s/ueventd.board.rc", dir);
+    f[0] = fopen(files[0], "w");
+    f[1] = fopen(files[1], "w");
+    if (!f[0] || !f[1]) {
+        printf("FAIL: cannot write the rc files\n");
+        exit(1);
+    }
+    for (i = 0; i < NSPECS; i++) {
+        const struct spec *s = &specs[i];
+
+        fprintf(f[s->file], "%s %s %04o %s %s\n", s->name,
+                s->attr ? s->attr : "", s->perm, s->uid, s->gid);
+    }
+    fclose(f[0]);
+    fclose(f[1]);
+}
+
+/* Check that each dead rule, and nothing else, was reported as expected. */
+static void check_reports(void)
+{
+    unsigned int i, line[2] = { 0, 0 };
+    int expected = 0, j;
+    char where[128];
+
+    for (i = 0; i < NSPECS; i++) {
+        const struct spec *s = &specs[i];
+        int level = s->report == 'E' ? KLOG_ERROR_LEVEL : KLOG_NOTICE_LEVEL;
+
+        line[s->file]++;
+        if (!s->report)
+            continue;
+        expected++;
+        snprintf(where, sizeof(where), "%s:%u: ", files[s->file],
+                 line[s->file]);
+        for (j = 0; j < nreports; j++)
+            if (!strncmp(reports[j].text + 9, where, strlen(where)))
+                break;
+        if (j == nreports) {
+            printf("%s%s not reported\n", where, s->name);
+            fail("a dead rule was not reported");
+        } else if (reports[j].level != level) {
+            printf("%s", reports[j].text);
+            fail(level == KLOG_ERROR_LEVEL ? "a conflict in one file was "
+                 "not an error" : "an override across files was an error");
+        }
+    }
+    if (nreports != expected) {
+        for (j = 0; j < nreports; j++)
+            printf("%s", reports[j].text);
+        fail("live rules reported");
+    }
+}
+
+static void set_attr(struct attr_state *state, int *n, const char *attr,
+                     mode_t perm, unsigned int uid, unsigned int gid)
+{
+    int i;
+
+    for (i = 0; i < *n && strcmp(state[i].attr, attr); i++)
+        ;
+    if (i == *n) {
+        if (*n == MAX_ATTRS)
+            return;
+        state[(*n)++].attr = attr;
+    }
+    state[i].perm = perm;
+    state[i].uid = uid;
+    state[i].gid = gid;
+}
+
+static void collect_sys(const struct ueventd_rule *rule, void *cookie)
+{
+    set_attr(got, &ngot, rule->attr, rule->perm, rule->uid, rule->gid);
+}
+
+/* Compare the compiled rules with the old scans, which tried every rule. */
+static int check_path(const char *path, int quiet)
+{
+    const struct ueventd_rule *rule;
+    mode_t perm = 0600;
+    unsigned int uid = 0, gid = 0;
+    unsigned int i;
+    int j, k, bad = 0;
+
+    /* the last /dev rule to match won */
+    for (i = NSPECS; i-- > 0; ) {
+        if (specs[i].attr || !spec_matches(&specs[i], path))
+            continue;
+        perm = specs[i].perm;
+        uid = android_id(specs[i].uid);
+        gid = android_id(specs[i].gid);
+        break;
+    }
+    rule = ueventd_rules_find_dev(path);
+    /* device paths all start with /dev, so a rule for devices/foo is dead */
+    if (path[0] != '/')
+        rule = NULL, perm = 0600, uid = gid = 0;
+    if (rule ? (rule->perm != perm || rule->uid != uid || rule->gid != gid)
+             : (perm != 0600 || uid || gid)) {
+        if (!quiet)
+                printf("%s: %04o %u %u, expected %04o %u %u\n", path,
+                   rule ? rule->perm : 0600, rule ? rule->uid : 0,
+                   rule ? rule->gid : 0, perm, uid, gid);
+        bad = 1;
+    }
+
+    /* every /sys rule to match was applied, in file order */
+    nwant = ngot = 0;
+    for (i = 0; i < NSPECS; i++) {
+        if (specs[i].attr && spec_matches(&specs[i], path))
+            set_attr(want, &nwant, specs[i].attr, specs[i].perm,
+                     android_id(specs[i].uid), android_id(specs[i].gid));
+    }
+    ueventd_rules_for_each_sys(path, collect_sys, NULL);
+    for (j = 0; j < nwant; j++) {
+        for (k = 0; k < ngot && strcmp(want[j].attr, got[k].attr); k++)
+            ;
+        if (k == ngot || want[j].perm != got[k].perm ||
+                want[j].uid != got[k].uid || want[j].gid != got[k].gid)
+            break;
+    }
+    if (j < nwant || nwant != ngot) {
+        if (!quiet)
+            printf("%s: /sys attributes differ\n", path);
+        bad = 1;
+    }
+    return bad;
+}
+
+static void check_lookups(const char *what, int paths)
+{
+    char path[256];
+    unsigned int i;
+    int bad = 0;
+
+    for (i = 0; i < NFIXED; i++)
+        bad += check_path(fixed_paths[i], bad >= 10);
+
+    /* paths around each rule name: shorter, longer, and below it */
+    while (paths--) {
+        const struct spec *s = &specs[rand() % NSPECS];
+        const char *base = s->attr ? s->name + 4 : s->name;
+        int len = strlen(base) - rand() % 3;
+        const char *tail[] = { "", "1", "/x" };
+
+        snprintf(path, sizeof(path), "%.*s%s", len, base, tail[rand() % 3]);
+        bad += check_path(path, bad >= 10);
+    }
+    if (bad) {
+        printf("%s: %d paths\n", what, bad);
+        fail("compiled rules differ from the old scans");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    const char *sources[3];
+    char rules[64], missing[64];
+    uint32_t stamp, edited;
+    struct stat sb;
+    struct utimbuf times;
+    int paths = argc > 1 ? atoi(argv[1]) : 20000;
+    int dropped;
+    FILE *f;
+
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+    if (!mkdtemp(dir)) {
+        printf("FAIL: mkdtemp\n");
+        return 1;
+    }
+    write_files();
+    snprintf(rules, sizeof(rules), "%s/ueventd.board.rules", dir);
+    snprintf(missing, sizeof(missing), "%s/ueventd.none.rc", dir);
+
+    ueventd_parse_config_file(files[0]);
+    ueventd_parse_config_file(files[1]);
+    dropped = ueventd_rules_compile();
+    printf("dropped:          %d rules, %d reports\n", dropped, nreports);
+    check_reports();
+    check_lookups("compiled", paths);
+
+    /* a file that cannot be read is left out, as the parser leaves it */
+    sources[0] = files[0];
+    sources[1] = files[1];
+    sources[2] = missing;
+    stamp = ueventd_rules_stamp_sources(sources, 2);
+    if (ueventd_rules_stamp_sources(sources, 3) != stamp)
+        fail("a missing rc file changes the stamp");
+    if (ueventd_rules_stamp_sources(sources, 1) == stamp)
+        fail("the board file does not change the stamp");
+
+    if (ueventd_rules_save(rules, stamp)) {
+        printf("FAIL: cannot save\n");
+        return 1;
+    }
+    nreports = 0;
+    if (ueventd_rules_load(rules, stamp) < 0 || nreports)
+        fail("saved rules not loaded cleanly");
+    check_lookups("loaded", paths);
+
+    /* an rc file touched, or edited, means the saved rules are stale */
+    stat(files[1], &sb);
+    times.actime = sb.st_atime;
+    times.modtime = sb.st_mtime + 1;
+    utime(files[1], &times);
+    if (ueventd_rules_stamp_sources(sources, 2) == stamp)
+        fail("an mtime does not change the stamp");
+    if (ueventd_rules_load(rules, ueventd_rules_stamp_sources(sources, 2)) == 0)
+        fail("rules loaded for a touched rc file");
+
+    f = fopen(files[1], "a");
+    fprintf(f, "/dev/tiler 0660 media media\n");
+    fclose(f);
+    times.modtime = sb.st_mtime;
+    utime(files[1], &times);
+    edited = ueventd_rules_stamp_sources(sources, 2);
+    if (edited == stamp)
+        fail("a size does not change the stamp");
+    if (ueventd_rules_load(rules, edited) == 0)
+        fail("stale rules loaded");
+
+    /* and damaged ones are refused */
+    f = fopen(rules, "r+b");
+    fseek(f, offsetof(struct ueventd_rules_hdr, count), SEEK_SET);
+    fputc(0x7f, f);
+    fclose(f);
+    if (ueventd_rules_load(rules, stamp) == 0)
+        fail("damaged rules loaded");
+    check_lookups("after refusing", paths / 10);
+
+    unlink(rules);
+    unlink(files[0]);
+    unlink(files[1]);
+    rmdir(dir);
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * wait_property_test: run wait_for_prop's wait against a fake property
+ * area, set the way property_set() does, and a fake clock, and check that:
+ *
+ *   - a property that already has the value does not hold up the queue
+ *   - the queue is held until that property gets that value, not another
+ *     property or another value
+ *   - the time left counts down with the clock and the wait ends at the
+ *     deadline
+ *   - names and values that do not fit are refused
+ *
+ * wait_property.c is included so that it builds without bionic's property
+ * headers.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* property_service.h, without bionic's property headers */
+#define _INIT_PROPERTY_H
+#define PROP_NAME_MAX   32
+#define PROP_VALUE_MAX  92
+static int property_get(const char *name, char *value);
+
+#include "../wait_property.c"
+
+#define MAX_PROPS       8
+
+static struct {
+    char name[PROP_NAME_MAX];
+    char value[PROP_VALUE_MAX];
+} props[MAX_PROPS];
+static time_t now = 1000;
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+void klog_ring_write(int level, const char *fmt, ...)
+{
+}
+
+time_t gettime(void)
+{
+    return now;
+}
+
+static int property_get(const char *name, char *value)
+{
+    int i;
+
+    for (i = 0; i < MAX_PROPS; i++) {
+        if (!strcmp(props[i].name, name)) {
+            strcpy(value, props[i].value);
+            return strlen(value);
+        }
+    }
+    value[0] = 0;
+    return 0;
+}
+
+/* as property_set() and property_changed() do */
+static void set(const char *name, const char *value)
+{
+    int i;
+
+    for (i = 0; i < MAX_PROPS - 1 && props[i].name[0]; i++)
+        if (!strcmp(props[i].name, name))
+            break;
+    strcpy(props[i].name, name);
+    strcpy(props[i].value, value);
+    wait_for_property_changed(name, value);
+}
+
+static void test_already_set(void)
+{
+    set("sys.ready", "1");
+    if (wait_for_property("sys.ready", "1", 5) || wait_for_property_left() >= 0)
+        fail("held up by a property that has the value");
+}
+
+static void test_released(void)
+{
+    if (wait_for_property("dev.bootcomplete", "1", 5))
+        fail("starting a wait");
+    if (wait_for_property_left() != 5)
+        fail("time left at the start");
+
+    set("dev.other", "1");
+    set("dev.bootcomplete", "0");
+    set("dev.bootcomplete.x", "1");
+    if (wait_for_property_left() < 0)
+        fail("released by another property or value");
+
+    now += 2;
+    if (wait_for_property_left() != 3)
+        fail("time left after 2 s");
+
+    set("dev.bootcomplete", "1");
+    if (wait_for_property_left() >= 0)
+        fail("held after the value was set");
+}
+
+static void test_deadline(void)
+{
+    if (wait_for_property("sys.never", "1", 3))
+        fail("starting a wait");
+    now += 2;
+    if (wait_for_property_left() != 1)
+        fail("time left before the deadline");
+    now += 1;
+    if (wait_for_property_left() >= 0)
+        fail("held past the deadline");
+
+    /* a late value after the timeout changes nothing */
+    set("sys.never", "1");
+    if (wait_for_property_left() >= 0)
+        fail("held after a late value");
+}
+
+static void test_too_long(void)
+{
+    char name[PROP_NAME_MAX + 1], value[PROP_VALUE_MAX + 1];
+
+    memset(name, 'n', PROP_NAME_MAX);
+    name[PROP_NAME_MAX] = 0;
+    memset(value, 'v', PROP_VALUE_MAX);
+    value[PROP_VALUE_MAX] = 0;
+    if (wait_for_property(name, "1", 5) != -1 ||
+            wait_for_property("sys.x", value, 5) != -1)
+        fail("a name or value that does not fit");
+    if (wait_for_property_left() >= 0)
+        fail("held by a refused wait");
+}
+
+int main(int argc, char **argv)
+{
+    test_already_set();
+    test_released();
+    test_deadline();
+    test_too_long();
+
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -21,14 +21,14 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <signal.h>
-
-#include <private/android_filesystem_config.h>
+#include <unistd.h>
 
 #include "ueventd.h"
 #include "log.h"
 #include "util.h"
 #include "devices.h"
 #include "ueventd_parser.h"
+#include "ueventd_rules.h"
 
 static char hardware[32];
 static unsigned revision = 0;
@@ -56,7 +56,9 @@ int ueventd_main(int argc, char **argv)
 {
     struct pollfd ufd;
     int nr;
-    char tmp[32];
+    char tmp[64];
+    char board_rc[64];
+    const char *sources[] = { "/ueventd.rc", board_rc };
 
     /*
      * init sets the umask to 077 for forked processes. We need to
@@ -74,6 +76,7 @@ int ueventd_main(int argc, char **argv)
 
     open_devnull_stdio();
     klog_init();
+    klog_ring_init("ueventd", -1);
 
     INFO("starting ueventd\n");
 
@@ -84,10 +87,16 @@ int ueventd_main(int argc, char **argv)
 
     get_hardware_name(hardware, &revision);
 
-    ueventd_parse_config_file("/ueventd.rc");
-
-    snprintf(tmp, sizeof(tmp), "/ueventd.%s.rc", hardware);
-    ueventd_parse_config_file(tmp);
+    /* rules compiled on the host from these rc files skip the parsing */
+    snprintf(board_rc, sizeof(board_rc), "/ueventd.%s.rc", hardware);
+    snprintf(tmp, sizeof(tmp), UEVENTD_RULES_FILE, hardware);
+    if (access(tmp, R_OK) ||
+            ueventd_rules_load(tmp,
+                    ueventd_rules_stamp_sources(sources, 2)) < 0) {
+        ueventd_parse_config_file(sources[0]);
+        ueventd_parse_config_file(sources[1]);
+        ueventd_rules_compile();
+    }
 
     device_init();
 
@@ -96,6 +105,7 @@ int ueventd_main(int argc, char **argv)
 
     while(1) {
         ufd.revents = 0;
+        klog_ring_flush();
         nr = poll(&ufd, 1, -1);
         if (nr <= 0)
             continue;
@@ -103,85 +113,3 @@ int ueventd_main(int argc, char **argv)
                handle_device_fd();
     }
 }
-
-static int get_android_id(const char *id)
-{
-    unsigned int i;
-    for (i = 0; i < ARRAY_SIZE(android_ids); i++)
-        if (!strcmp(id, android_ids[i].name))
-            return android_ids[i].aid;
-    return -1;
-}
-
-void set_device_permission(int nargs, char **args)
-{
-    char *name;
-    char *attr = 0;
-    mode_t perm;
-    uid_t uid;
-    gid_t gid;
-    int prefix = 0;
-    char *endptr;
-    int ret;
-    char *tmp = 0;
-
-    if (nargs == 0)
-        return;
-
-    if (args[0][0] == '#')
-        return;
-
-    name = args[0];
-
-    if (!strncmp(name,"/sys/", 5) && (nargs == 5)) {
-        INFO("/sys/ rule %s %s\n",args[0],args[1]);
-        attr = args[1];
-        args++;
-        nargs--;
-    }
-
-    if (nargs != 4) {
-        ERROR("invalid line ueventd.rc line for '%s'\n", args[0]);
-        return;
-    }
-
-    /* If path starts with mtd@ lookup the mount number. */
-    if (!strncmp(name, "mtd@", 4)) {
-        int n = mtd_name_to_number(name + 4);
-        if (n >= 0)
-            asprintf(&tmp, "/dev/mtd/mtd%d", n);
-        name = tmp;
-    } else {
-        int len = strlen(name);
-        if (name[len - 1] == '*') {
-            prefix = 1;
-            name[len - 1] = '\0';
-        }
-    }
-
-    perm = strtol(args[1], &endptr, 8);
-    if (!endptr || *endptr != '\0') {
-        ERROR("invalid mode '%s'\n", args[1]);
-        free(tmp);
-        return;
-    }
-
-    ret = get_android_id(args[2]);
-    if (ret < 0) {
-        ERROR("invalid uid '%s'\n", args[2]);
-        free(tmp);
-        return;
-    }
-    uid = ret;
-
-    ret = get_android_id(args[3]);
-    if (ret < 0) {
-        ERROR("invalid gid '%s'\n", args[3]);
-        free(tmp);
-        return;
-    }
-    gid = ret;
-
-    add_dev_perms(name, attr, perm, uid, gid, prefix);
-    free(tmp);
-}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * ueventd_compile: check ueventd.rc files and compile them for ueventd.
+ *
+ * The files are read in the order given, as ueventd reads ueventd.rc and
+ * then ueventd.<hardware>.rc.  Rules that can never take effect are
+ * reported, and the rest can be written out with -o as the
+ * ueventd.<hardware>.rules that ueventd loads instead of the rc files, as
+ * long as it finds rc files of the same size and mtime on the device.
+ * Exits with 1 if a rule conflicts with another in the same file.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "ueventd_parser.h"
+#include "ueventd_rules.h"
+#include "util.h"
+
+static int errors;
+
+/* what the ERROR() and NOTICE() of the shared code end up in here */
+void klog_ring_write(int level, const char *fmt, ...)
+{
+    char buf[KLOG_RING_MSG_MAX];
+    const char *msg = buf;
+    va_list ap;
+
+    if (level > KLOG_NOTICE_LEVEL)
+        return;
+    if (level <= KLOG_ERROR_LEVEL)
+        errors++;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    /* drop the "<3>init: " */
+    if (!strncmp(msg, "<", 1) && strstr(msg, ": "))
+        msg = strstr(msg, ": ") + 2;
+    fprintf(stderr, "%s%s", level <= KLOG_ERROR_LEVEL ? "error: " : "", msg);
+}
+
+void *read_file(const char *fn, unsigned *_sz)
+{
+    struct stat sb;
+    char *data = NULL;
+    int fd;
+
+    fd = open(fn, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ueventd_compile: cannot open %s: %s\n", fn,
+                strerror(errno));
+        return NULL;
+    }
+    if (fstat(fd, &sb) == 0) {
+        data = malloc(sb.st_size + 2);
+        if (data && read(fd, data, sb.st_size) != sb.st_size) {
+            free(data);
+            data = NULL;
+        }
+    }
+    close(fd);
+    if (!data)
+        return NULL;
+
+    /* like init's, terminated for the tokenizer */
+    data[sb.st_size] = '\n';
+    data[sb.st_size + 1] = 0;
+    if (_sz)
+        *_sz = sb.st_size;
+    return data;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: ueventd_compile [-o <rules>] <ueventd.rc>...\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    const char *out = NULL;
+    const char **files;
+    int i, nfiles = 0, dropped;
+
+    files = calloc(argc, sizeof(*files));
+    if (!files)
+        return 1;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            out = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage();
+        } else {
+            if (ueventd_parse_config_file(argv[i]))
+                return 1;
+            files[nfiles++] = argv[i];
+        }
+    }
+    if (!nfiles)
+        usage();
+
+    dropped = ueventd_rules_compile();
+    if (dropped < 0)
+        return 1;
+    if (dropped)
+        fprintf(stderr, "%d rules can never take effect\n", dropped);
+
+    if (out && ueventd_rules_save(out,
+            ueventd_rules_stamp_sources(files, nfiles))) {
+        fprintf(stderr, "ueventd_compile: cannot write %s: %s\n", out,
+                strerror(errno));
+        return 1;
+    }
+    return errors ? 1 : 0;
+}
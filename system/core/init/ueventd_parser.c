@@ -15,11 +15,15 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <string.h>
 
+#include <private/android_filesystem_config.h>
+
 #include "ueventd_parser.h"
+#include "ueventd_rules.h"
 #include "parser.h"
 #include "log.h"
 #include "util.h"
@@ -48,6 +52,7 @@ static void parse_config(const char *fn, char *s)
                 state.parse_line(&state, nargs, args);
                 nargs = 0;
             }
+            state.line++;
             break;
         case T_TEXT:
             if (nargs < UEVENTD_PARSER_MAXARGS) {
@@ -71,5 +76,79 @@ int ueventd_parse_config_file(const char *fn)
 
 static void parse_line_device(struct parse_state* state, int nargs, char **args)
 {
+    ueventd_rules_set_source(state->filename, state->line);
     set_device_permission(nargs, args);
 }
+
+static int get_android_id(const char *id)
+{
+    unsigned int i;
+    for (i = 0; i < ARRAY_SIZE(android_ids); i++)
+        if (!strcmp(id, android_ids[i].name))
+            return android_ids[i].aid;
+    return -1;
+}
+
+void set_device_permission(int nargs, char **args)
+{
+    char *name;
+    char *attr = 0;
+    mode_t perm;
+    uid_t uid;
+    gid_t gid;
+    int prefix = 0;
+    char *endptr;
+    int ret;
+
+    if (nargs == 0)
+        return;
+
+    if (args[0][0] == '#')
+        return;
+
+    name = args[0];
+
+    if (!strncmp(name,"/sys/", 5) && (nargs == 5)) {
+        INFO("/sys/ rule %s %s\n",args[0],args[1]);
+        attr = args[1];
+        args++;
+        nargs--;
+    }
+
+    if (nargs != 4) {
+        ERROR("invalid line ueventd.rc line for '%s'\n", args[0]);
+        return;
+    }
+
+    /* mtd@ names are looked up when the rules are compiled */
+    if (strncmp(name, "mtd@", 4)) {
+        int len = strlen(name);
+        if (name[len - 1] == '*') {
+            prefix = 1;
+            name[len - 1] = '\0';
+        }
+    }
+
+    perm = strtol(args[1], &endptr, 8);
+    if (!endptr || *endptr != '\0') {
+        ERROR("invalid mode '%s'\n", args[1]);
+        return;
+    }
+
+    ret = get_android_id(args[2]);
+    if (ret < 0) {
+        ERROR("invalid uid '%s'\n", args[2]);
+        return;
+    }
+    uid = ret;
+
+    ret = get_android_id(args[3]);
+    if (ret < 0) {
+        ERROR("invalid gid '%s'\n", args[3]);
+        return;
+    }
+    gid = ret;
+
+    if (ueventd_rules_add(name, attr, perm, uid, gid, prefix))
+        ERROR("could not add rule for '%s'\n", name);
+}
@@ -0,0 +1,579 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "ueventd_rules.h"
+#include "log.h"
+#include "util.h"
+
+struct rule_entry {
+    struct ueventd_rule rule;
+    unsigned int keylen;    /* of the name, less "/sys" for /sys rules */
+    int next;               /* in the same bucket, -1 at the end */
+    int dead;
+    const char *file;
+    int line;
+};
+
+/*
+ * One hash table for the /dev rules and one for the /sys rules, keyed by
+ * the name or wildcard prefix.  A wildcard is found by hashing each prefix
+ * of the path as long as some wildcard, so lens lists those lengths.
+ */
+struct rule_index {
+    int *buckets;
+    unsigned int mask;
+    unsigned int *lens;
+    unsigned int nlens;
+    unsigned int count;
+};
+
+static struct rule_entry *rules;
+static unsigned int rule_count;
+static unsigned int rule_capacity;
+
+static struct rule_index dev_index;
+static struct rule_index sys_index;
+/* scratch for ueventd_rules_for_each_sys() */
+static int *sys_matches;
+
+static const char *source_file = "?";
+static int source_line;
+
+static inline const char *rule_key(const struct rule_entry *e)
+{
+    /* uevent paths leave out the "/sys" the /sys rules start with */
+    return e->rule.attr ? e->rule.name + 4 : e->rule.name;
+}
+
+/* FNV-1a, continuing from hash */
+static unsigned int hash_bytes(unsigned int hash, const char *p,
+                               unsigned int len)
+{
+    while (len--)
+        hash = (hash ^ (unsigned char) *p++) * 16777619u;
+    return hash;
+}
+
+static unsigned int key_hash(const char *key, unsigned int len)
+{
+    return hash_bytes(2166136261u, key, len);
+}
+
+void ueventd_rules_set_source(const char *file, int line)
+{
+    /* the rules keep pointing at it for the reports */
+    if (strcmp(source_file, file)) {
+        char *copy = strdup(file);
+
+        if (copy)
+            source_file = copy;
+    }
+    source_line = line;
+}
+
+int ueventd_rules_add(const char *name, const char *attr, mode_t perm,
+                      unsigned int uid, unsigned int gid,
+                      unsigned short prefix)
+{
+    struct rule_entry *e;
+
+    if (attr && strncmp(name, "/sys/", 5))
+        return -EINVAL;
+
+    if (rule_count == rule_capacity) {
+        unsigned int capacity = rule_capacity ? rule_capacity * 2 : 64;
+        struct rule_entry *grown = realloc(rules, capacity * sizeof(*rules));
+
+        if (!grown)
+            return -ENOMEM;
+        rules = grown;
+        rule_capacity = capacity;
+    }
+
+    e = &rules[rule_count];
+    memset(e, 0, sizeof(*e));
+    e->rule.name = strdup(name);
+    if (!e->rule.name)
+        return -ENOMEM;
+    if (attr) {
+        e->rule.attr = strdup(attr);
+        if (!e->rule.attr) {
+            free(e->rule.name);
+            return -ENOMEM;
+        }
+    }
+    e->rule.perm = perm;
+    e->rule.uid = uid;
+    e->rule.gid = gid;
+    e->rule.prefix = prefix;
+    e->file = source_file;
+    e->line = source_line;
+    rule_count++;
+    return 0;
+}
+
+static void rules_clear(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < rule_count; i++) {
+        free(rules[i].rule.name);
+        free(rules[i].rule.attr);
+    }
+    rule_count = 0;
+}
+
+static void index_free(struct rule_index *ix)
+{
+    free(ix->buckets);
+    free(ix->lens);
+    memset(ix, 0, sizeof(*ix));
+}
+
+static int index_build(struct rule_index *ix, int sys)
+{
+    unsigned int i, j, size = 16;
+
+    index_free(ix);
+    for (i = 0; i < rule_count; i++) {
+        if (!rules[i].dead && !rules[i].rule.attr == !sys)
+            ix->count++;
+    }
+    while (size < ix->count * 2)
+        size <<= 1;
+    ix->buckets = malloc(size * sizeof(*ix->buckets));
+    ix->lens = malloc((ix->count + 1) * sizeof(*ix->lens));
+    if (!ix->buckets || !ix->lens)
+        return -1;
+    memset(ix->buckets, 0xff, size * sizeof(*ix->buckets));
+    ix->mask = size - 1;
+
+    for (i = 0; i < rule_count; i++) {
+        struct rule_entry *e = &rules[i];
+        int *head;
+
+        if (e->dead || !e->rule.attr != !sys)
+            continue;
+        e->keylen = strlen(rule_key(e));
+        head = &ix->buckets[key_hash(rule_key(e), e->keylen) & ix->mask];
+        /* newest first, so later rules are found first */
+        e->next = *head;
+        *head = i;
+
+        if (!e->rule.prefix)
+            continue;
+        for (j = 0; j < ix->nlens && ix->lens[j] < e->keylen; j++)
+            ;
+        if (j < ix->nlens && ix->lens[j] == e->keylen)
+            continue;
+        memmove(&ix->lens[j + 1], &ix->lens[j],
+                (ix->nlens - j) * sizeof(*ix->lens));
+        ix->lens[j] = e->keylen;
+        ix->nlens++;
+    }
+    return 0;
+}
+
+/* The newest rule for the first len bytes of key, or -1. */
+static int index_find(const struct rule_index *ix, const char *key,
+                      unsigned int len, int prefix, const char *attr)
+{
+    int i;
+
+    if (!ix->buckets)
+        return -1;
+    for (i = ix->buckets[key_hash(key, len) & ix->mask]; i >= 0;
+            i = rules[i].next) {
+        const struct rule_entry *e = &rules[i];
+
+        if (e->keylen == len && !e->rule.prefix == !prefix &&
+                !memcmp(rule_key(e), key, len) &&
+                (!attr || !strcmp(e->rule.attr, attr)))
+            return i;
+    }
+    return -1;
+}
+
+static const char *rule_where(const struct rule_entry *e, char *buf,
+                              size_t size)
+{
+    if (e->line > 0)
+        snprintf(buf, size, "%s:%d", e->file, e->line);
+    else
+        snprintf(buf, size, "%s", e->file);
+    return buf;
+}
+
+static void report(const struct rule_entry *e, const char *what,
+                   const struct rule_entry *by)
+{
+    char where[256], by_where[256];
+    const char *sep = e->rule.attr ? " " : "";
+    const char *attr = e->rule.attr ? e->rule.attr : "";
+
+    rule_where(e, where, sizeof(where));
+    if (!by) {
+        ERROR("%s: rule for %s%s%s%s %s\n", where, e->rule.name,
+              e->rule.prefix ? "*" : "", sep, attr, what);
+        return;
+    }
+    rule_where(by, by_where, sizeof(by_where));
+    /* in one file this is a mistake, across files usually an override */
+    if (by->file == e->file || !strcmp(by->file, e->file))
+        ERROR("%s: rule for %s%s%s%s %s %s%s at %s\n", where, e->rule.name,
+              e->rule.prefix ? "*" : "", sep, attr, what, by->rule.name,
+              by->rule.prefix ? "*" : "", by_where);
+    else
+        NOTICE("%s: rule for %s%s%s%s %s %s%s at %s\n", where, e->rule.name,
+               e->rule.prefix ? "*" : "", sep, attr, what, by->rule.name,
+               by->rule.prefix ? "*" : "", by_where);
+}
+
+/* A later wildcard rule that matches everything rules[i] does, or -1. */
+static int find_cover(const struct rule_index *ix, int i)
+{
+    const struct rule_entry *e = &rules[i];
+    unsigned int j;
+    int k;
+
+    for (j = 0; j < ix->nlens && ix->lens[j] <= e->keylen; j++) {
+        k = index_find(ix, rule_key(e), ix->lens[j], 1, e->rule.attr);
+        if (k > i)
+            return k;
+    }
+    return -1;
+}
+
+static int dev_name_reachable(const char *name, int prefix)
+{
+    size_t len = strlen(name);
+
+    if (!prefix || len >= 5)
+        return !strncmp(name, "/dev/", 5);
+    return !strncmp(name, "/dev/", len);
+}
+
+#ifndef UEVENTD_RULES_HOST
+/* mtd@<name> rules are named by partition, so they are resolved here */
+static void resolve_mtd(struct rule_entry *e)
+{
+    char *name;
+    int n;
+
+    n = mtd_name_to_number(e->rule.name + 4);
+    if (n < 0 || asprintf(&name, "/dev/mtd/mtd%d", n) < 0) {
+        report(e, "names an unknown mtd partition", NULL);
+        e->dead = 1;
+        return;
+    }
+    free(e->rule.name);
+    e->rule.name = name;
+}
+#endif
+
+static void resolve_names(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < rule_count; i++) {
+        rules[i].dead = 0;
+#ifndef UEVENTD_RULES_HOST
+        if (!strncmp(rules[i].rule.name, "mtd@", 4))
+            resolve_mtd(&rules[i]);
+#endif
+    }
+}
+
+/* keep only the rules that can take effect, still in file order */
+static int drop_dead(void)
+{
+    unsigned int i, live;
+    int dropped = 0;
+
+    for (i = live = 0; i < rule_count; i++) {
+        if (rules[i].dead) {
+            free(rules[i].rule.name);
+            free(rules[i].rule.attr);
+            dropped++;
+            continue;
+        }
+        rules[live++] = rules[i];
+    }
+    rule_count = live;
+    return dropped;
+}
+
+static int index_rules(void)
+{
+    if (index_build(&dev_index, 0) || index_build(&sys_index, 1))
+        goto oom;
+    free(sys_matches);
+    sys_matches = malloc((sys_index.count + 1) * sizeof(*sys_matches));
+    if (!sys_matches)
+        goto oom;
+    return 0;
+
+oom:
+    ERROR("out of memory indexing ueventd rules\n");
+    return -1;
+}
+
+int ueventd_rules_compile(void)
+{
+    unsigned int i;
+    int dropped;
+
+    resolve_names();
+    if (index_rules())
+        return -1;
+
+    for (i = 0; i < rule_count; i++) {
+        struct rule_entry *e = &rules[i];
+        const struct rule_index *ix = e->rule.attr ? &sys_index : &dev_index;
+        int k;
+
+        if (e->dead)
+            continue;
+        if (!e->rule.attr && strncmp(e->rule.name, "mtd@", 4) &&
+                !dev_name_reachable(e->rule.name, e->rule.prefix)) {
+            report(e, "can never match a device", NULL);
+            e->dead = 1;
+            continue;
+        }
+
+        k = index_find(ix, rule_key(e), e->keylen, e->rule.prefix,
+                       e->rule.attr);
+        if (k > (int) i) {
+            const struct rule_entry *by = &rules[k];
+
+            if (by->rule.perm == e->rule.perm &&
+                    by->rule.uid == e->rule.uid &&
+                    by->rule.gid == e->rule.gid)
+                report(e, "is repeated by", by);
+            else
+                report(e, "is overridden by", by);
+            e->dead = 1;
+            continue;
+        }
+
+        k = find_cover(ix, i);
+        if (k >= 0) {
+            report(e, "is shadowed by", &rules[k]);
+            e->dead = 1;
+        }
+    }
+
+    dropped = drop_dead();
+    if (index_rules())
+        return -1;
+    return dropped;
+}
+
+const struct ueventd_rule *ueventd_rules_find_dev(const char *path)
+{
+    unsigned int len = strlen(path);
+    unsigned int j;
+    int best, k;
+
+    /* as with the rc files, the last matching rule wins */
+    best = index_find(&dev_index, path, len, 0, NULL);
+    for (j = 0; j < dev_index.nlens && dev_index.lens[j] <= len; j++) {
+        k = index_find(&dev_index, path, dev_index.lens[j], 1, NULL);
+        if (k > best)
+            best = k;
+    }
+    return best >= 0 ? &rules[best].rule : NULL;
+}
+
+void ueventd_rules_for_each_sys(const char *upath,
+        void (*fn)(const struct ueventd_rule *rule, void *cookie),
+        void *cookie)
+{
+    unsigned int len = strlen(upath);
+    unsigned int j, n = 0;
+    int i, k;
+
+    if (!sys_index.buckets)
+        return;
+
+    /* rules for several attributes can share a name, so walk the chains */
+    for (j = 0; j <= sys_index.nlens; j++) {
+        int prefix = j < sys_index.nlens;
+        unsigned int keylen = prefix ? sys_index.lens[j] : len;
+
+        if (keylen > len)
+            continue;
+        for (i = sys_index.buckets[key_hash(upath, keylen) & sys_index.mask];
+                i >= 0; i = rules[i].next) {
+            const struct rule_entry *e = &rules[i];
+
+            if (e->keylen == keylen && !e->rule.prefix == !prefix &&
+                    !memcmp(rule_key(e), upath, keylen))
+                sys_matches[n++] = i;
+        }
+    }
+
+    /* in file order, as a later rule for an attribute must win */
+    for (j = 1; j < n; j++) {
+        for (k = sys_matches[j], i = j; i > 0 && sys_matches[i - 1] > k; i--)
+            sys_matches[i] = sys_matches[i - 1];
+        sys_matches[i] = k;
+    }
+    for (j = 0; j < n; j++)
+        fn(&rules[sys_matches[j]].rule, cookie);
+}
+
+uint32_t ueventd_rules_stamp_sources(const char **files, int count)
+{
+    unsigned int hash = 2166136261u;
+    struct stat sb;
+    uint64_t stamp[2];
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (stat(files[i], &sb) < 0)
+            continue;
+        stamp[0] = sb.st_size;
+        stamp[1] = sb.st_mtime;
+        hash = hash_bytes(hash, (const char *) stamp, sizeof(stamp));
+    }
+    return hash;
+}
+
+int ueventd_rules_save(const char *fn, uint32_t sources_stamp)
+{
+    struct ueventd_rules_hdr hdr;
+    struct ueventd_rule_rec rec;
+    uint32_t offset = 1;
+    unsigned int i;
+    FILE *f;
+
+    f = fopen(fn, "wb");
+    if (!f)
+        return -1;
+
+    hdr.magic = UEVENTD_RULES_MAGIC;
+    hdr.version = UEVENTD_RULES_VERSION;
+    hdr.sources_stamp = sources_stamp;
+    hdr.count = rule_count;
+    hdr.strings_size = 1;
+    for (i = 0; i < rule_count; i++) {
+        hdr.strings_size += strlen(rules[i].rule.name) + 1;
+        if (rules[i].rule.attr)
+            hdr.strings_size += strlen(rules[i].rule.attr) + 1;
+    }
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    for (i = 0; i < rule_count; i++) {
+        const struct ueventd_rule *r = &rules[i].rule;
+
+        rec.name = offset;
+        offset += strlen(r->name) + 1;
+        rec.attr = 0;
+        if (r->attr) {
+            rec.attr = offset;
+            offset += strlen(r->attr) + 1;
+        }
+        rec.perm = r->perm;
+        rec.uid = r->uid;
+        rec.gid = r->gid;
+        rec.prefix = r->prefix;
+        fwrite(&rec, sizeof(rec), 1, f);
+    }
+
+    /* offset 0 is the empty string, for rules without an attribute */
+    fputc('\0', f);
+    for (i = 0; i < rule_count; i++) {
+        fwrite(rules[i].rule.name, strlen(rules[i].rule.name) + 1, 1, f);
+        if (rules[i].rule.attr)
+            fwrite(rules[i].rule.attr, strlen(rules[i].rule.attr) + 1, 1, f);
+    }
+
+    if (ferror(f)) {
+        fclose(f);
+        return -1;
+    }
+    return fclose(f) ? -1 : 0;
+}
+
+int ueventd_rules_load(const char *fn, uint32_t sources_stamp)
+{
+    const struct ueventd_rules_hdr *hdr;
+    const struct ueventd_rule_rec *recs;
+    const char *strings;
+    unsigned int size, i;
+    char *data;
+
+    data = read_file(fn, &size);
+    if (!data)
+        return -1;
+
+    hdr = (const struct ueventd_rules_hdr *) data;
+    if (size < sizeof(*hdr) || hdr->magic != UEVENTD_RULES_MAGIC ||
+            hdr->version != UEVENTD_RULES_VERSION ||
+            hdr->count > (size - sizeof(*hdr)) / sizeof(*recs) ||
+            size - sizeof(*hdr) - hdr->count * sizeof(*recs) !=
+                hdr->strings_size || hdr->strings_size == 0)
+        goto invalid;
+    if (hdr->sources_stamp != sources_stamp) {
+        NOTICE("ignoring ueventd rules '%s' compiled from other rc files\n",
+               fn);
+        free(data);
+        return -1;
+    }
+    recs = (const struct ueventd_rule_rec *) (hdr + 1);
+    strings = (const char *) (recs + hdr->count);
+    if (strings[hdr->strings_size - 1] != '\0')
+        goto invalid;
+    for (i = 0; i < hdr->count; i++) {
+        if (recs[i].name == 0 || recs[i].name >= hdr->strings_size ||
+                recs[i].attr >= hdr->strings_size)
+            goto invalid;
+    }
+
+    rules_clear();
+    ueventd_rules_set_source(fn, 0);
+    for (i = 0; i < hdr->count; i++) {
+        if (ueventd_rules_add(strings + recs[i].name,
+                              recs[i].attr ? strings + recs[i].attr : NULL,
+                              recs[i].perm, recs[i].uid, recs[i].gid,
+                              recs[i].prefix)) {
+            rules_clear();
+            goto invalid;
+        }
+    }
+    free(data);
+
+    /* compiled already, so only the mtd@ names are left to check */
+    resolve_names();
+    drop_dead();
+    if (index_rules()) {
+        rules_clear();
+        return -1;
+    }
+    return 0;
+
+invalid:
+    ERROR("ignoring invalid ueventd rules '%s'\n", fn);
+    free(data);
+    return -1;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_UEVENTD_RULES_H_
+#define _INIT_UEVENTD_RULES_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * The permission rules of ueventd.rc and ueventd.<hardware>.rc.
+ *
+ * Rules are added in file order and then compiled into hash tables, which
+ * drops the rules that can never take effect and reports each of them:
+ *
+ *   - a rule repeated for the same name and attribute, as only the last
+ *     one counts
+ *   - a rule that a later wildcard rule covers entirely
+ *   - a /dev rule for a name outside /dev/, which no device can match
+ *
+ * The compiled rules can be saved by the host tool ueventd_compile and
+ * loaded by ueventd in place of parsing the rc files, as long as the rc
+ * files still have the size and mtime they were compiled with.  An image
+ * that does not keep the mtimes of the rc files just gets them parsed.
+ */
+
+/* compiled rules for ueventd.<hardware>.rc, tried before the rc files */
+#define UEVENTD_RULES_FILE  "/ueventd.%s.rules"
+
+#define UEVENTD_RULES_MAGIC     0x52564555  /* "UEVR" */
+#define UEVENTD_RULES_VERSION   3
+
+struct ueventd_rules_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sources_stamp; /* see ueventd_rules_stamp_sources() */
+    uint32_t count;         /* struct ueventd_rule_rec that follow */
+    uint32_t strings_size;  /* bytes of strings after the rules */
+};
+
+struct ueventd_rule_rec {
+    uint32_t name;          /* offsets into the strings */
+    uint32_t attr;          /* 0 for /dev rules, as offset 0 is "" */
+    uint32_t perm;
+    uint32_t uid;
+    uint32_t gid;
+    uint32_t prefix;
+};
+
+struct ueventd_rule {
+    char *name;             /* without the trailing '*' of a wildcard */
+    char *attr;             /* NULL for /dev rules */
+    mode_t perm;
+    unsigned int uid;
+    unsigned int gid;
+    unsigned short prefix;
+};
+
+/* Where the rules added next come from, for the reports. */
+void ueventd_rules_set_source(const char *file, int line);
+
+int ueventd_rules_add(const char *name, const char *attr, mode_t perm,
+                      unsigned int uid, unsigned int gid,
+                      unsigned short prefix);
+
+/*
+ * Drop and report the rules that cannot take effect, and index the rest.
+ * Returns the number of rules dropped, or -1 on error.
+ */
+int ueventd_rules_compile(void);
+
+/* The rule giving the mode and owner of the device at path, or NULL. */
+const struct ueventd_rule *ueventd_rules_find_dev(const char *path);
+
+/*
+ * Call fn, in file order, for every /sys rule that matches upath, which
+ * is a uevent path without the leading "/sys".
+ */
+void ueventd_rules_for_each_sys(const char *upath,
+        void (*fn)(const struct ueventd_rule *rule, void *cookie),
+        void *cookie);
+
+/*
+ * Hash the size and mtime of the rc files, in order, leaving out the ones
+ * that are missing as the parser does.  The files are not read, so this
+ * costs a stat() each at boot.  Saved rules keep the stamp of the files
+ * they were compiled from.
+ */
+uint32_t ueventd_rules_stamp_sources(const char **files, int count);
+
+/* Write the compiled rules to fn, with the stamp of their rc files. */
+int ueventd_rules_save(const char *fn, uint32_t sources_stamp);
+
+/*
+ * Replace the rules with the compiled ones saved in fn, ready for lookups.
+ * Only mtd@ names are resolved and checked again.  Fails if the rules were
+ * compiled from rc files other than those stamped sources_stamp.
+ */
+int ueventd_rules_load(const char *fn, uint32_t sources_stamp);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+#include "property_service.h"
+#include "util.h"
+#include "wait_property.h"
+
+/* set while a wait_for_prop command holds up the action queue */
+static char wait_prop_name[PROP_NAME_MAX];
+static char wait_prop_value[PROP_VALUE_MAX];
+static time_t wait_prop_deadline;
+
+int wait_for_property(const char *name, const char *value, int timeout)
+{
+    char current[PROP_VALUE_MAX];
+
+    if (property_get(name, current) > 0 && !strcmp(current, value))
+        return 0;
+    if (strlen(name) >= sizeof(wait_prop_name) ||
+            strlen(value) >= sizeof(wait_prop_value))
+        return -1;
+
+    strcpy(wait_prop_name, name);
+    strcpy(wait_prop_value, value);
+    wait_prop_deadline = gettime() + timeout;
+    INFO("waiting for property '%s' to be '%s'\n", name, value);
+    return 0;
+}
+
+int wait_for_property_left(void)
+{
+    time_t left;
+
+    if (!wait_prop_name[0])
+        return -1;
+    left = wait_prop_deadline - gettime();
+    if (left <= 0) {
+        ERROR("timed out waiting for property '%s' to be '%s'\n",
+              wait_prop_name, wait_prop_value);
+        wait_prop_name[0] = '\0';
+        return -1;
+    }
+    return left;
+}
+
+void wait_for_property_changed(const char *name, const char *value)
+{
+    if (wait_prop_name[0] && !strcmp(name, wait_prop_name) &&
+            !strcmp(value, wait_prop_value)) {
+        INFO("property '%s' is '%s', resuming\n", name, value);
+        wait_prop_name[0] = '\0';
+    }
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_WAIT_PROPERTY_H_
+#define _INIT_WAIT_PROPERTY_H_
+
+/*
+ * Hold up the action queue until name is set to value, for at most timeout
+ * seconds.  init sets every property itself, so rather than sleeping on the
+ * property serial like other processes do (see cutils/property_wait.h), it
+ * carries on with its main loop and checks in wait_for_property_changed().
+ * Returns 0, or -1 if name or value is too long.
+ */
+int wait_for_property(const char *name, const char *value, int timeout);
+
+/* Seconds the queue is still held up for, or -1 if it is not. */
+int wait_for_property_left(void);
+
+/* called for every property init sets */
+void wait_for_property_changed(const char *name, const char *value);
+
+#endif
@@ -0,0 +1,391 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "camera_frame_pool"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
+#include <cutils/camera_frame_pool.h>
+#include <cutils/log.h>
+
+#define POOL_MAGIC      0x43465031      /* "CFP1" */
+#define MAX_FRAMES      0xffff
+
+/*
+ * The free list is a stack of frame indices.  Its head packs the index plus
+ * one (0 for empty) in the low 16 bits with a tag in the high 16 bits that
+ * every push and pop bumps, so that a pop racing with a pop and push of the
+ * same frame fails its compare-and-swap instead of corrupting the list.
+ */
+#define HEAD_INDEX(head)        ((head) & 0xffff)
+#define HEAD_NEXT(head, index)  ((int32_t)(((uint32_t)(head) + 0x10000) & 0xffff0000) | (index))
+
+/* Per frame state in the region, shared by every process using the pool. */
+struct frame_slot {
+    volatile int32_t refs;
+    volatile int32_t next;              /* index + 1 of the next free frame */
+    int32_t msg_type;
+    uint32_t sequence;
+    int64_t timestamp;
+};
+
+/* Starts the region; the frames follow it from header_size on. */
+struct pool_header {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t frame_size;
+    uint32_t stride;
+    uint32_t header_size;
+    uint32_t max_in_flight;
+    volatile int32_t free_head;
+    volatile int32_t in_flight;
+    volatile int32_t sequence;
+    volatile int32_t delivered;
+    volatile int32_t dropped;
+    struct frame_slot slots[];
+};
+
+/*
+ * One process's view of the region.  Every process can write the header, so
+ * its geometry is copied here once and the copy is what bounds every index
+ * and offset used afterwards.
+ */
+struct camera_frame_pool {
+    struct pool_header *header;
+    int fd;
+    size_t length;
+    uint32_t count;
+    uint32_t header_size;
+    uint32_t stride;
+    uint32_t max_in_flight;
+    /* this handle plus every reference taken in this process */
+    volatile int32_t holds;
+    camera_frame_t frames[];
+};
+
+static size_t header_size(uint32_t count, size_t page)
+{
+    size_t size = sizeof(struct pool_header) + count * sizeof(struct frame_slot);
+    return (size + page - 1) & ~(page - 1);
+}
+
+static void pool_free(struct camera_frame_pool *pool)
+{
+    munmap(pool->header, pool->length);
+    close(pool->fd);
+    free(pool);
+}
+
+static void pool_put(struct camera_frame_pool *pool)
+{
+    if (android_atomic_dec(&pool->holds) == 1)
+        pool_free(pool);
+}
+
+static void free_push(struct pool_header *header, uint32_t index)
+{
+    int32_t head;
+
+    do {
+        head = android_atomic_acquire_load(&header->free_head);
+        header->slots[index].next = HEAD_INDEX(head);
+    } while (android_atomic_release_cas(head, HEAD_NEXT(head, index + 1),
+                                        &header->free_head));
+}
+
+/*
+ * The list links are in shared memory, so an index that is not a frame of
+ * the pool means another process wrote over them: refuse the pop and leave
+ * the list as it is rather than follow it.
+ */
+static int free_pop(struct camera_frame_pool *pool)
+{
+    struct pool_header *header = pool->header;
+    int32_t head, index, next;
+
+    do {
+        head = android_atomic_acquire_load(&header->free_head);
+        index = HEAD_INDEX(head);
+        if (!index)
+            return -1;
+        if ((uint32_t) index > pool->count)
+            goto corrupt;
+        next = header->slots[index - 1].next;
+        if (next < 0 || (uint32_t) next > pool->count)
+            goto corrupt;
+    } while (android_atomic_acquire_cas(head, HEAD_NEXT(head, next),
+                                        &header->free_head));
+    return index - 1;
+
+corrupt:
+    ALOGE("free list of %u frames is corrupt at frame %d", pool->count, index);
+    return -1;
+}
+
+/* Local descriptors for every frame of the region mapped at header. */
+/*
+ * Local descriptors for every frame of the region mapped at header, laid out
+ * as described by geometry, which the caller has checked against length.
+ */
+static struct camera_frame_pool *pool_map(int fd, struct pool_header *header,
+        size_t length, const struct pool_header *geometry)
+{
+    struct camera_frame_pool *pool;
+    uint32_t i;
+
+    pool = calloc(1, sizeof(*pool) + geometry->count * sizeof(camera_frame_t));
+    if (!pool)
+        return NULL;
+    pool->header = header;
+    pool->fd = fd;
+    pool->length = length;
+    pool->count = geometry->count;
+    pool->header_size = geometry->header_size;
+    pool->stride = geometry->stride;
+    pool->max_in_flight = geometry->max_in_flight;
+    pool->holds = 1;
+    for (i = 0; i < pool->count; i++) {
+        camera_frame_t *frame = &pool->frames[i];
+        frame->pool = pool;
+        frame->index = i;
+        frame->offset = pool->header_size + (size_t) pool->stride * i;
+        frame->data = (char *) header + frame->offset;
+        frame->size = geometry->frame_size;
+    }
+    return pool;
+}
+
+struct camera_frame_pool *camera_frame_pool_create(const char *name,
+        uint32_t count, size_t frame_size, uint32_t max_in_flight)
+{
+    struct camera_frame_pool *pool;
+    struct pool_header *header;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t stride, hsize, length;
+    uint32_t i;
+    int fd;
+
+    if (count == 0 || count > MAX_FRAMES || frame_size == 0 ||
+            frame_size > UINT32_MAX - page)
+        return NULL;
+
+    /* page align the frames so that each one can be mapped on its own */
+    stride = (frame_size + page - 1) & ~(page - 1);
+    hsize = header_size(count, page);
+    length = hsize + stride * count;
+    fd = ashmem_create_region(name, length);
+    if (fd < 0) {
+        ALOGE("cannot create %zu byte region: %s", length, strerror(errno));
+        return NULL;
+    }
+    header = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        ALOGE("cannot map frames: %s", strerror(errno));
+        close(fd);
+        return NULL;
+    }
+
+    header->count = count;
+    header->frame_size = frame_size;
+    header->stride = stride;
+    header->header_size = hsize;
+    header->max_in_flight = max_in_flight && max_in_flight < count ?
+            max_in_flight : count;
+    for (i = count; i-- > 0; ) {
+        header->slots[i].next = header->free_head;
+        header->free_head = i + 1;
+    }
+    android_atomic_release_store(POOL_MAGIC, (volatile int32_t *) &header->magic);
+
+    pool = pool_map(fd, header, length, header);
+    if (!pool) {
+        munmap(header, length);
+        close(fd);
+    }
+    return pool;
+}
+
+struct camera_frame_pool *camera_frame_pool_attach(int fd)
+{
+    struct camera_frame_pool *pool;
+    struct pool_header *header, geometry;
+    size_t page = sysconf(_SC_PAGESIZE);
+    int size = ashmem_get_size_region(fd);
+    size_t length;
+
+    if (size < (int) sizeof(*header)) {
+        ALOGE("fd %d is not a frame pool", fd);
+        return NULL;
+    }
+    length = size;
+    header = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        ALOGE("cannot map frames: %s", strerror(errno));
+        return NULL;
+    }
+    /* check a copy, the region can change under us */
+    memcpy(&geometry, header, sizeof(geometry));
+    if (geometry.magic != POOL_MAGIC || geometry.count == 0 ||
+            geometry.count > MAX_FRAMES ||
+            geometry.header_size != header_size(geometry.count, page) ||
+            geometry.header_size > length ||
+            geometry.frame_size == 0 || geometry.stride < geometry.frame_size ||
+            geometry.stride > (length - geometry.header_size) / geometry.count ||
+            geometry.max_in_flight == 0 ||
+            geometry.max_in_flight > geometry.count) {
+        ALOGE("fd %d is not a frame pool", fd);
+        munmap(header, length);
+        return NULL;
+    }
+
+    fd = dup(fd);
+    if (fd < 0 || !(pool = pool_map(fd, header, length, &geometry))) {
+        if (fd >= 0)
+            close(fd);
+        munmap(header, length);
+        return NULL;
+    }
+    return pool;
+}
+
+void camera_frame_pool_destroy(struct camera_frame_pool *pool)
+{
+    if (pool)
+        pool_put(pool);
+}
+
+int camera_frame_pool_fd(const struct camera_frame_pool *pool)
+{
+    return pool->fd;
+}
+
+camera_frame_t *camera_frame_pool_dequeue(struct camera_frame_pool *pool)
+{
+    struct pool_header *header = pool->header;
+    camera_frame_t *frame;
+    struct frame_slot *slot;
+    uint32_t sequence;
+    int32_t in_flight;
+    int index;
+
+    sequence = android_atomic_inc(&header->sequence) + 1;
+    do {
+        in_flight = android_atomic_acquire_load(&header->in_flight);
+        if ((uint32_t) in_flight >= pool->max_in_flight)
+            goto drop;
+    } while (android_atomic_acquire_cas(in_flight, in_flight + 1,
+                                        &header->in_flight));
+
+    index = free_pop(pool);
+    if (index < 0) {
+        android_atomic_dec(&header->in_flight);
+        goto drop;
+    }
+    android_atomic_inc(&pool->holds);
+    android_atomic_inc(&header->delivered);
+
+    slot = &header->slots[index];
+    slot->refs = 1;
+    slot->next = 0;
+    frame = &pool->frames[index];
+    frame->sequence = sequence;
+    frame->msg_type = 0;
+    frame->timestamp = 0;
+    return frame;
+
+drop:
+    android_atomic_inc(&header->dropped);
+    ALOGV("dropping frame %u, receivers hold %d", sequence, in_flight);
+    return NULL;
+}
+
+void camera_frame_acquire(camera_frame_t *frame)
+{
+    struct camera_frame_pool *pool = frame->pool;
+
+    android_atomic_inc(&pool->header->slots[frame->index].refs);
+    android_atomic_inc(&pool->holds);
+}
+
+void camera_frame_release(camera_frame_t *frame)
+{
+    struct camera_frame_pool *pool = frame->pool;
+    struct pool_header *header = pool->header;
+
+    if (android_atomic_dec(&header->slots[frame->index].refs) == 1) {
+        free_push(header, frame->index);
+        android_atomic_dec(&header->in_flight);
+    }
+    pool_put(pool);
+}
+
+size_t camera_frame_export(camera_frame_t *frame)
+{
+    struct camera_frame_pool *pool = frame->pool;
+    struct frame_slot *slot = &pool->header->slots[frame->index];
+    size_t offset = frame->offset;
+
+    slot->msg_type = frame->msg_type;
+    slot->timestamp = frame->timestamp;
+    slot->sequence = frame->sequence;
+    /* the reference now belongs to whoever receives the offset */
+    pool_put(pool);
+    return offset;
+}
+
+camera_frame_t *camera_frame_pool_import(struct camera_frame_pool *pool,
+        size_t offset)
+{
+    struct pool_header *header = pool->header;
+    struct frame_slot *slot;
+    camera_frame_t *frame;
+    size_t index;
+
+    if (offset < pool->header_size ||
+            (offset - pool->header_size) % pool->stride)
+        return NULL;
+    index = (offset - pool->header_size) / pool->stride;
+    if (index >= pool->count)
+        return NULL;
+
+    slot = &header->slots[index];
+    if (android_atomic_acquire_load(&slot->refs) <= 0) {
+        ALOGE("frame at %zu imported without a reference", offset);
+        return NULL;
+    }
+    frame = &pool->frames[index];
+    frame->msg_type = slot->msg_type;
+    frame->timestamp = slot->timestamp;
+    frame->sequence = slot->sequence;
+    android_atomic_inc(&pool->holds);
+    return frame;
+}
+
+void camera_frame_pool_get_stats(struct camera_frame_pool *pool,
+        struct camera_frame_pool_stats *stats)
+{
+    struct pool_header *header = pool->header;
+
+    stats->delivered = android_atomic_acquire_load(&header->delivered);
+    stats->dropped = android_atomic_acquire_load(&header->dropped);
+    stats->in_flight = android_atomic_acquire_load(&header->in_flight);
+}
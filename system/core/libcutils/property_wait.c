@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
+#include <cutils/property_wait.h>
+
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+#define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
+#include <sys/_system_properties.h>
+#include <sys/atomics.h>
+#else
+/* How often the value is compared without a property area, in ms. */
+#define PROPERTY_WAIT_POLL_MS 100
+#endif
+
+unsigned int property_get_serial(const char *name)
+{
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+    const prop_info *pi = __system_property_find(name);
+
+    return pi ? __system_property_serial(pi) : PROPERTY_SERIAL_NONE;
+#else
+    /* no serials here; any hash that changes with the value will do */
+    char value[PROPERTY_VALUE_MAX];
+    unsigned int serial = 2166136261u;
+    int len = property_get(name, value, NULL);
+    int i;
+
+    if (len <= 0)
+        return PROPERTY_SERIAL_NONE;
+    for (i = 0; i < len; i++)
+        serial = (serial ^ (unsigned char) value[i]) * 16777619u;
+    return serial != PROPERTY_SERIAL_NONE ? serial : 0;
+#endif
+}
+
+/* Time left until deadline in *left; 0 once it has passed. */
+static int wait_left(const struct timespec *deadline, struct timespec *left)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    left->tv_sec = deadline->tv_sec - now.tv_sec;
+    left->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+    if (left->tv_nsec < 0) {
+        left->tv_sec--;
+        left->tv_nsec += 1000000000;
+    }
+    return left->tv_sec > 0 || (left->tv_sec == 0 && left->tv_nsec > 0);
+}
+
+int property_wait(const char *name, unsigned int old_serial, int timeout_ms,
+                  unsigned int *new_serial)
+{
+    struct timespec deadline, left, nap;
+    unsigned int serial;
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+    const prop_info *pi = NULL;
+    const long poll_ms = PROPERTY_WAIT_CREATE_POLL_MS;
+#else
+    const long poll_ms = PROPERTY_WAIT_POLL_MS;
+#endif
+
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    for (;;) {
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+        /* properties are never deleted, so a found one stays valid */
+        if (pi == NULL)
+            pi = __system_property_find(name);
+        serial = pi ? __system_property_serial(pi) : PROPERTY_SERIAL_NONE;
+#else
+        serial = property_get_serial(name);
+#endif
+        if (serial != old_serial) {
+            if (new_serial)
+                *new_serial = serial;
+            return 0;
+        }
+
+        if (timeout_ms >= 0 && !wait_left(&deadline, &left)) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+#ifdef HAVE_LIBC_SYSTEM_PROPERTIES
+        if (pi != NULL) {
+            /* the serial is the first word of prop_info */
+            __futex_wait((volatile void *) pi, serial,
+                         timeout_ms >= 0 ? &left : NULL);
+            continue;
+        }
+#endif
+        nap.tv_sec = 0;
+        nap.tv_nsec = poll_ms * 1000000L;
+        if (timeout_ms >= 0 && left.tv_sec == 0 && left.tv_nsec < nap.tv_nsec)
+            nap = left;
+        nanosleep(&nap, NULL);
+    }
+}
@@ -0,0 +1,32 @@
+# Copyright 2014 The Android Open Source Project
+#
+# Tests and benchmarks for libcutils.  The camera frame pool is only in the
+# target library, so its tests are built for the target and run from adb
+# shell.  property_wait.c is built on the host against a fake property area.
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := camera_frame_pool_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := camera_frame_pool_test.c
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := camera_frame_pool_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := camera_frame_pool_bench.c
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := property_wait_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	property_wait_test.c \
+	../property_wait.c
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/fake_property_area
+LOCAL_CFLAGS := -DHAVE_LIBC_SYSTEM_PROPERTIES
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * camera_frame_pool_bench: deliver preview frames from a synthetic HAL to a
+ * callback client in another process, a barcode scanner that reads the luma
+ * plane, and time the producer's side of each frame
+ *
+ *   - copied out, as for CAMERA_FRAME_CALLBACK_FLAG_BARCODE_SCANNER: the
+ *     HAL fills its own buffer and every frame is copied into a callback
+ *     heap shared with the client
+ *   - shared: the HAL fills a frame from a camera_frame_pool and the client
+ *     imports and releases it, so frames it is still reading are dropped
+ *
+ * The HAL stands in for the sensor by stamping each frame's first and last
+ * bytes, and paces itself at one frame per interval.
+ *
+ * usage: camera_frame_pool_bench [frames [interval_us]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/camera_frame_pool.h>
+
+#define WIDTH           1280
+#define HEIGHT          720
+#define FRAME_SIZE      (WIDTH * HEIGHT * 3 / 2)   /* NV21 */
+#define BUFFERS         4
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void pace(int64_t start, int frame, int interval_us)
+{
+    int64_t left = start + (int64_t) frame * interval_us * 1000 - now_ns();
+
+    if (left > 0)
+        usleep(left / 1000);
+}
+
+static void stamp(unsigned char *data, int frame)
+{
+    data[0] = frame;
+    data[FRAME_SIZE - 1] = frame;
+}
+
+/* What the scanner does with a frame: one byte of luma per cache line. */
+static unsigned scan(const unsigned char *data)
+{
+    unsigned sum = 0;
+    int i;
+
+    for (i = 0; i < WIDTH * HEIGHT; i += 64)
+        sum += data[i];
+    return sum;
+}
+
+static void report(const char *name, int64_t ns, int delivered, int dropped)
+{
+    printf("%-10s %8.1f us/frame %6d delivered %6d dropped\n", name,
+           delivered ? ns / 1000.0 / delivered : 0.0, delivered, dropped);
+}
+
+static void run_copied(int frames, int interval_us)
+{
+    unsigned char *buffers, *heap;
+    int64_t start, spent = 0, t;
+    int sock[2], fd, i, status;
+    size_t offset;
+    pid_t pid;
+
+    buffers = malloc((size_t) BUFFERS * FRAME_SIZE);
+    memset(buffers, 0, (size_t) BUFFERS * FRAME_SIZE);
+    fd = ashmem_create_region("callback heap", (size_t) BUFFERS * FRAME_SIZE);
+    heap = mmap(NULL, (size_t) BUFFERS * FRAME_SIZE, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sock);
+
+    pid = fork();
+    if (pid == 0) {
+        unsigned sum = 0;
+
+        close(sock[0]);
+        while (read(sock[1], &offset, sizeof(offset)) == sizeof(offset))
+            sum += scan(heap + offset);
+        _exit(sum == 1);
+    }
+    close(sock[1]);
+
+    start = now_ns();
+    for (i = 0; i < frames; i++) {
+        unsigned char *buffer = buffers + (size_t) (i % BUFFERS) * FRAME_SIZE;
+
+        pace(start, i, interval_us);
+        stamp(buffer, i);
+        t = now_ns();
+        offset = (size_t) (i % BUFFERS) * FRAME_SIZE;
+        memcpy(heap + offset, buffer, FRAME_SIZE);
+        write(sock[0], &offset, sizeof(offset));
+        spent += now_ns() - t;
+    }
+    close(sock[0]);
+    waitpid(pid, &status, 0);
+    report("copied", spent, frames, 0);
+
+    munmap(heap, (size_t) BUFFERS * FRAME_SIZE);
+    close(fd);
+    free(buffers);
+}
+
+static void run_shared(int frames, int interval_us)
+{
+    struct camera_frame_pool *pool;
+    struct camera_frame_pool_stats stats;
+    camera_frame_t *frame;
+    int64_t start, spent = 0, t;
+    int sock[2], i, status;
+    size_t offset;
+    pid_t pid;
+
+    pool = camera_frame_pool_create("preview", BUFFERS, FRAME_SIZE, 0);
+    if (!pool) {
+        printf("cannot create the pool\n");
+        return;
+    }
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sock);
+
+    pid = fork();
+    if (pid == 0) {
+        struct camera_frame_pool *client;
+        unsigned sum = 0;
+
+        close(sock[0]);
+        client = camera_frame_pool_attach(camera_frame_pool_fd(pool));
+        if (!client)
+            _exit(1);
+        while (read(sock[1], &offset, sizeof(offset)) == sizeof(offset)) {
+            frame = camera_frame_pool_import(client, offset);
+            if (!frame)
+                _exit(1);
+            sum += scan(frame->data);
+            camera_frame_release(frame);
+        }
+        camera_frame_pool_destroy(client);
+        _exit(sum == 1);
+    }
+    close(sock[1]);
+
+    start = now_ns();
+    for (i = 0; i < frames; i++) {
+        pace(start, i, interval_us);
+        t = now_ns();
+        frame = camera_frame_pool_dequeue(pool);
+        spent += now_ns() - t;
+        if (!frame)
+            continue;
+        /* the sensor fills the frame in place */
+        stamp(frame->data, i);
+        t = now_ns();
+        offset = camera_frame_export(frame);
+        write(sock[0], &offset, sizeof(offset));
+        spent += now_ns() - t;
+    }
+    close(sock[0]);
+    waitpid(pid, &status, 0);
+
+    camera_frame_pool_get_stats(pool, &stats);
+    report("shared", spent, stats.delivered, stats.dropped);
+    camera_frame_pool_destroy(pool);
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 1000;
+    int interval_us = argc > 2 ? atoi(argv[2]) : 2000;
+
+    printf("%d %dx%d NV21 frames, one per %d us\n", frames, WIDTH, HEIGHT,
+           interval_us);
+    run_copied(frames, interval_us);
+    run_shared(frames, interval_us);
+    return 0;
+}
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * camera_frame_pool_test: check that
+ *
+ *   - dequeue drops frames once max_in_flight frames, or all of them, are
+ *     held, and counts what it delivered and dropped
+ *   - a frame goes back to the pool with its last reference only
+ *   - a frame exported to another process comes back to the producer's pool
+ *     when that process releases it, with its data and metadata intact
+ *   - import refuses offsets that are not frames
+ *   - attach refuses a region whose layout does not fit it
+ *   - a producer whose free list was overwritten through the region drops
+ *     frames instead of following the bad links
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/camera_frame_pool.h>
+
+#define FRAMES          4
+#define FRAME_SIZE      10000
+#define SHARED_FRAMES   200
+
+/* The start of the region, as laid out by camera_frame_pool.c. */
+struct frame_slot {
+    int32_t refs;
+    int32_t next;
+    int32_t msg_type;
+    uint32_t sequence;
+    int64_t timestamp;
+};
+
+struct pool_header {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t frame_size;
+    uint32_t stride;
+    uint32_t header_size;
+    uint32_t max_in_flight;
+    int32_t free_head;
+    int32_t in_flight;
+    int32_t sequence;
+    int32_t delivered;
+    int32_t dropped;
+    struct frame_slot slots[FRAMES];
+};
+
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+static struct pool_header *map_header(struct camera_frame_pool *pool)
+{
+    void *header = mmap(NULL, sizeof(struct pool_header),
+                        PROT_READ | PROT_WRITE, MAP_SHARED,
+                        camera_frame_pool_fd(pool), 0);
+
+    return header == MAP_FAILED ? NULL : header;
+}
+
+static void test_backpressure(void)
+{
+    struct camera_frame_pool *pool;
+    struct camera_frame_pool_stats stats;
+    camera_frame_t *frames[FRAMES];
+    int i;
+
+    pool = camera_frame_pool_create("test", FRAMES, FRAME_SIZE, 2);
+    frames[0] = camera_frame_pool_dequeue(pool);
+    frames[1] = camera_frame_pool_dequeue(pool);
+    if (!frames[0] || !frames[1] || frames[0] == frames[1])
+        fail("two distinct frames out of a pool of 4");
+    if (camera_frame_pool_dequeue(pool))
+        fail("a third frame past max_in_flight 2");
+
+    camera_frame_acquire(frames[0]);
+    camera_frame_release(frames[0]);
+    if (camera_frame_pool_dequeue(pool))
+        fail("a frame back in the pool before its last release");
+    camera_frame_release(frames[0]);
+    frames[2] = camera_frame_pool_dequeue(pool);
+    if (!frames[2])
+        fail("no frame after the last release");
+
+    camera_frame_pool_get_stats(pool, &stats);
+    if (stats.delivered != 3 || stats.dropped != 2 || stats.in_flight != 2)
+        fail("stats after 3 delivered and 2 dropped");
+    camera_frame_release(frames[1]);
+    camera_frame_release(frames[2]);
+    camera_frame_pool_destroy(pool);
+
+    /* without a cap, every frame can be held */
+    pool = camera_frame_pool_create("test", FRAMES, FRAME_SIZE, 0);
+    for (i = 0; i < FRAMES; i++)
+        if (!(frames[i] = camera_frame_pool_dequeue(pool)))
+            fail("a free frame below the pool size");
+    if (camera_frame_pool_dequeue(pool))
+        fail("a frame from an empty pool");
+    for (i = 0; i < FRAMES; i++)
+        if (frames[i])
+            camera_frame_release(frames[i]);
+    camera_frame_pool_destroy(pool);
+}
+
+/* Imports every offset read from sock, checks the frame and releases it. */
+static int consume(int pool_fd, int sock)
+{
+    struct camera_frame_pool *pool = camera_frame_pool_attach(pool_fd);
+    camera_frame_t *frame;
+    size_t offset, last = 0;
+    int bad = 0;
+
+    if (!pool)
+        return 1;
+    while (read(sock, &offset, sizeof(offset)) == sizeof(offset)) {
+        frame = camera_frame_pool_import(pool, offset);
+        if (!frame)
+            return 1;
+        last = offset;
+        if (frame->msg_type != 0x10 || frame->timestamp != frame->sequence * 33 ||
+                ((unsigned char *) frame->data)[0] != (frame->sequence & 0xff) ||
+                ((unsigned char *) frame->data)[frame->size - 1] !=
+                        (frame->sequence & 0xff))
+            bad = 1;
+        camera_frame_release(frame);
+    }
+    if (camera_frame_pool_import(pool, 1) ||
+            camera_frame_pool_import(pool, last + 1))
+        bad = 1;
+    camera_frame_pool_destroy(pool);
+    return bad;
+}
+
+static void test_shared(void)
+{
+    struct camera_frame_pool *pool;
+    struct camera_frame_pool_stats stats;
+    camera_frame_t *frame;
+    size_t offset;
+    int sock[2], status, sent = 0, i;
+    pid_t pid;
+
+    pool = camera_frame_pool_create("test", FRAMES, FRAME_SIZE, 0);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sock);
+    pid = fork();
+    if (pid == 0) {
+        close(sock[0]);
+        _exit(consume(camera_frame_pool_fd(pool), sock[1]));
+    }
+    close(sock[1]);
+
+    for (i = 0; i < SHARED_FRAMES; i++) {
+        frame = camera_frame_pool_dequeue(pool);
+        if (!frame) {
+            usleep(100);
+            continue;
+        }
+        memset(frame->data, frame->sequence & 0xff, frame->size);
+        frame->msg_type = 0x10;
+        frame->timestamp = frame->sequence * 33;
+        offset = camera_frame_export(frame);
+        write(sock[0], &offset, sizeof(offset));
+        sent++;
+    }
+    close(sock[0]);
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status))
+        fail("frames as seen by the consumer");
+
+    camera_frame_pool_get_stats(pool, &stats);
+    if (sent == 0 || stats.delivered != (uint32_t) sent ||
+            stats.dropped != (uint32_t) (SHARED_FRAMES - sent))
+        fail("stats after sharing");
+    if (stats.in_flight != 0)
+        fail("frames released by the consumer back in the pool");
+    camera_frame_pool_destroy(pool);
+    printf("shared %d frames, dropped %d\n", sent, SHARED_FRAMES - sent);
+}
+
+static void test_attach(void)
+{
+    struct camera_frame_pool *pool, *attached;
+    struct pool_header *header;
+    uint32_t stride;
+
+    pool = camera_frame_pool_create("test", FRAMES, FRAME_SIZE, 0);
+    header = map_header(pool);
+    attached = camera_frame_pool_attach(camera_frame_pool_fd(pool));
+    if (!attached)
+        fail("attach to a good pool");
+    camera_frame_pool_destroy(attached);
+
+    stride = header->stride;
+    header->stride = 0x40000000;
+    if (camera_frame_pool_attach(camera_frame_pool_fd(pool)))
+        fail("attach with frames past the end of the region");
+    header->stride = stride;
+    header->max_in_flight = FRAMES + 1;
+    if (camera_frame_pool_attach(camera_frame_pool_fd(pool)))
+        fail("attach with max_in_flight above count");
+
+    munmap(header, sizeof(*header));
+    camera_frame_pool_destroy(pool);
+}
+
+static void test_corrupt_free_list(void)
+{
+    struct camera_frame_pool *pool;
+    struct pool_header *header;
+    camera_frame_t *frame;
+
+    pool = camera_frame_pool_create("test", FRAMES, FRAME_SIZE, 0);
+    header = map_header(pool);
+
+    /* as a receiver could: the head past the last frame */
+    header->free_head = 0x1234ffff;
+    if (camera_frame_pool_dequeue(pool))
+        fail("a frame from a head past the pool");
+
+    /* the head good, the link it leads to bad */
+    header->count = 0xffff;     /* ignored after create */
+    header->free_head = 1;
+    frame = camera_frame_pool_dequeue(pool);
+    if (!frame || frame->index != 0)
+        fail("the first frame from a good head");
+    header->free_head = 0;
+    camera_frame_release(frame);
+    header->slots[0].next = 0x7fff;
+    if (camera_frame_pool_dequeue(pool))
+        fail("a frame through a bad link");
+
+    munmap(header, sizeof(*header));
+    camera_frame_pool_destroy(pool);
+}
+
+int main(int argc, char **argv)
+{
+    test_backpressure();
+    test_shared();
+    test_attach();
+    test_corrupt_free_list();
+
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
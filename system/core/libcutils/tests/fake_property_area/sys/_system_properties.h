@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _FAKE_SYSTEM_PROPERTIES_H
+#define _FAKE_SYSTEM_PROPERTIES_H
+
+/*
+ * The part of bionic's property area that property_wait.c uses, for host
+ * tests that keep the area in a table of their own.  As in bionic, the
+ * serial is the first word of a prop_info and the futex its writer wakes.
+ */
+
+#define PROP_NAME_MAX   32
+#define PROP_VALUE_MAX  92
+
+typedef struct prop_info {
+    volatile unsigned int serial;
+    char value[PROP_VALUE_MAX];
+    char name[PROP_NAME_MAX];
+} prop_info;
+
+const prop_info *__system_property_find(const char *name);
+unsigned int __system_property_serial(const prop_info *pi);
+
+#endif
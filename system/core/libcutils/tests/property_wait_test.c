@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * property_wait_test: run property_wait() against a fake property area
+ * (see fake_property_area/), written by a thread the way init writes the
+ * real one, and check that:
+ *
+ *   - serials are PROPERTY_SERIAL_NONE for a missing property and change
+ *     with every value
+ *   - a wait on a stale serial returns at once with the current one
+ *   - a wait wakes on the futex when the property is set, and sleeps on it
+ *     instead of polling while nothing happens
+ *   - a property created while waiting is found
+ *   - timeouts, 0 included, end the wait with ETIMEDOUT
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include <cutils/property_wait.h>
+#include <sys/_system_properties.h>
+#include <sys/atomics.h>
+
+#define MAX_PROPS       8
+#define SET_DELAY_MS    50
+/* how late a wakeup may be on a loaded host */
+#define SLACK_MS        40
+
+static prop_info props[MAX_PROPS];
+static volatile int prop_count;
+static volatile int futex_waits;
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+const prop_info *__system_property_find(const char *name)
+{
+    int count = __atomic_load_n(&prop_count, __ATOMIC_ACQUIRE);
+    int i;
+
+    for (i = 0; i < count; i++)
+        if (!strcmp(props[i].name, name))
+            return &props[i];
+    return NULL;
+}
+
+unsigned int __system_property_serial(const prop_info *pi)
+{
+    return __atomic_load_n(&pi->serial, __ATOMIC_ACQUIRE);
+}
+
+int __futex_wait(volatile void *ftx, int val, const struct timespec *timeout)
+{
+    __sync_fetch_and_add(&futex_waits, 1);
+    return syscall(SYS_futex, ftx, FUTEX_WAIT, val, timeout, NULL, 0);
+}
+
+int __futex_wake(volatile void *ftx, int count)
+{
+    return syscall(SYS_futex, ftx, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+/* as init's __system_property_add() and __system_property_update() */
+static void set(const char *name, const char *value)
+{
+    prop_info *pi = (prop_info *) __system_property_find(name);
+    unsigned int len = strlen(value);
+
+    if (!pi) {
+        pi = &props[prop_count];
+        strcpy(pi->name, name);
+        strcpy(pi->value, value);
+        pi->serial = len << 24;
+        __atomic_store_n(&prop_count, prop_count + 1, __ATOMIC_RELEASE);
+        return;
+    }
+    pi->serial |= 1;
+    strcpy(pi->value, value);
+    __atomic_store_n(&pi->serial, (len << 24) | ((pi->serial + 1) & 0xffffff),
+                     __ATOMIC_RELEASE);
+    __futex_wake(&pi->serial, INT32_MAX);
+}
+
+static long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+static const char *later_name;
+
+static void *set_later(void *arg)
+{
+    usleep(SET_DELAY_MS * 1000);
+    set(later_name, arg);
+    return NULL;
+}
+
+static void test_serials(void)
+{
+    unsigned int a, b;
+
+    if (property_get_serial("test.missing") != PROPERTY_SERIAL_NONE)
+        fail("serial of a missing property");
+    set("test.serial", "a");
+    a = property_get_serial("test.serial");
+    set("test.serial", "b");
+    b = property_get_serial("test.serial");
+    if (a == PROPERTY_SERIAL_NONE || b == PROPERTY_SERIAL_NONE || a == b)
+        fail("serials of two values");
+}
+
+static void test_stale(void)
+{
+    unsigned int old, serial = 0;
+
+    set("test.stale", "1");
+    old = property_get_serial("test.stale");
+    set("test.stale", "2");
+    futex_waits = 0;
+    if (property_wait("test.stale", old, 1000, &serial) ||
+            serial != property_get_serial("test.stale") || futex_waits)
+        fail("a wait on a stale serial");
+}
+
+static void test_wake(void)
+{
+    unsigned int old, serial = 0;
+    pthread_t thread;
+    long start, ms;
+
+    set("test.wake", "0");
+    old = property_get_serial("test.wake");
+    later_name = "test.wake";
+    futex_waits = 0;
+    start = now_ms();
+    pthread_create(&thread, NULL, set_later, "1");
+    if (property_wait("test.wake", old, -1, &serial))
+        fail("a wait without a timeout");
+    ms = now_ms() - start;
+    pthread_join(thread, NULL);
+
+    if (serial == old || serial != property_get_serial("test.wake"))
+        fail("the serial after a wakeup");
+    if (ms < SET_DELAY_MS || ms > SET_DELAY_MS + SLACK_MS)
+        fail("the time of the wakeup");
+    /* one sleep, maybe another if woken before the serial moved */
+    if (futex_waits < 1 || futex_waits > 2)
+        fail("futex waits while waiting for a change");
+    printf("woke after %ld ms with %d futex waits\n", ms, futex_waits);
+}
+
+static void test_create(void)
+{
+    unsigned int serial = PROPERTY_SERIAL_NONE;
+    pthread_t thread;
+    long start, ms;
+
+    later_name = "test.create";
+    start = now_ms();
+    pthread_create(&thread, NULL, set_later, "1");
+    if (property_wait("test.create", PROPERTY_SERIAL_NONE, 1000, &serial))
+        fail("a wait for a new property");
+    ms = now_ms() - start;
+    pthread_join(thread, NULL);
+
+    if (serial == PROPERTY_SERIAL_NONE)
+        fail("the serial of a new property");
+    if (ms > SET_DELAY_MS + PROPERTY_WAIT_CREATE_POLL_MS + SLACK_MS)
+        fail("the time to find a new property");
+}
+
+static void test_timeouts(void)
+{
+    unsigned int old;
+    long start, ms;
+
+    set("test.quiet", "1");
+    old = property_get_serial("test.quiet");
+
+    errno = 0;
+    if (property_wait("test.quiet", old, 0, NULL) != -1 || errno != ETIMEDOUT)
+        fail("a wait with a timeout of 0");
+
+    futex_waits = 0;
+    start = now_ms();
+    errno = 0;
+    if (property_wait("test.quiet", old, 100, NULL) != -1 ||
+            errno != ETIMEDOUT)
+        fail("a wait on a property that does not change");
+    ms = now_ms() - start;
+    if (ms < 100 || ms > 100 + SLACK_MS)
+        fail("the time of a timeout");
+    if (futex_waits > 2)
+        fail("futex waits while nothing changed");
+
+    start = now_ms();
+    if (property_wait("test.none", PROPERTY_SERIAL_NONE, 100, NULL) != -1 ||
+            errno != ETIMEDOUT)
+        fail("a wait for a property that is never created");
+    ms = now_ms() - start;
+    if (ms < 100 || ms > 100 + SLACK_MS)
+        fail("the time of a timeout for a missing property");
+}
+
+int main(int argc, char **argv)
+{
+    test_serials();
+    test_stale();
+    test_wake();
+    test_create();
+    test_timeouts();
+
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -17,13 +17,240 @@
 #define LOG_TAG "CallStack"
 
 #include <utils/CallStack.h>
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
 #include <utils/Printer.h>
 #include <utils/Errors.h>
 #include <utils/Log.h>
+#include <utils/Vector.h>
 #include <corkscrew/backtrace.h>
+#include <corkscrew/map_info.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unwind.h>
 
 namespace android {
 
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// A stack to print, from a CallStack or from capture().
+struct StackRef {
+    const backtrace_frame_t* frames;
+    const uintptr_t* pcs;
+    size_t count;
+
+    inline uintptr_t pc(size_t i) const {
+        return frames ? frames[i].absolute_pc : pcs[i];
+    }
+};
+
+// A PC as the mapped file it falls in and its offset there, so that the
+// entry stays right if the library is unloaded or loaded elsewhere.  PCs
+// outside of any named mapping are kept as they are.
+struct SymbolKey {
+    uint64_t map;       // hash of the mapping's name, 0 outside of any
+    uintptr_t offset;
+
+    inline bool operator < (const SymbolKey& o) const {
+        return map != o.map ? map < o.map : offset < o.offset;
+    }
+    inline bool operator == (const SymbolKey& o) const {
+        return map == o.map && offset == o.offset;
+    }
+};
+
+struct CaptureState {
+    uintptr_t* pcs;
+    size_t count;
+    size_t maxDepth;
+    int32_t ignoreDepth;
+};
+
+} // namespace
+
+// Symbols cached at most; entries the current call does not need are
+// dropped rather than grow past it.
+static const size_t MAX_CACHED_SYMBOLS = 4096;
+
+// The strings of the cached symbols are owned by the cache.
+static Mutex gSymbolLock;
+static KeyedVector<SymbolKey, backtrace_symbol_t> gSymbols;
+
+static uint64_t hashName(const char* name) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (; *name; name++) {
+        hash = (hash ^ uint8_t(*name)) * 1099511628211ULL;
+    }
+    return hash ? hash : 1;
+}
+
+static SymbolKey symbolKey(const map_info_t* maps, uintptr_t pc) {
+    const map_info_t* mi = find_map_info(maps, pc);
+    SymbolKey key;
+    // anonymous mappings have no name to tell them apart
+    if (mi && mi->name[0]) {
+        key.map = hashName(mi->name);
+        key.offset = pc - mi->start;
+    } else {
+        key.map = 0;
+        key.offset = pc;
+    }
+    return key;
+}
+
+static char* dupString(const char* s) {
+    return s ? strdup(s) : NULL;
+}
+
+static void freeSymbol(backtrace_symbol_t* symbol) {
+    free(symbol->map_name);
+    free(symbol->symbol_name);
+    free(symbol->demangled_name);
+}
+
+static void flushSymbolsLocked() {
+    for (size_t i = 0; i < gSymbols.size(); i++) {
+        freeSymbol(&gSymbols.editValueAt(i));
+    }
+    gSymbols.clear();
+}
+
+// Empty the cache but for the entries the given keys need.
+static void evictLocked(const Vector<SymbolKey>& keys) {
+    KeyedVector<SymbolKey, backtrace_symbol_t> kept;
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        ssize_t index = gSymbols.indexOfKey(keys[i]);
+        if (index >= 0) {
+            kept.add(keys[i], gSymbols.valueAt(index));
+            gSymbols.removeItemsAt(index);
+        }
+    }
+    flushSymbolsLocked();
+    gSymbols = kept;
+}
+
+// Symbolize and format the stacks into lines, with an empty line between
+// stacks.  Called with gSymbolLock held.
+static void resolveLocked(const map_info_t* maps, const StackRef* stacks,
+        size_t count, Vector<String8>& lines) {
+    Vector<SymbolKey> keys;
+    // a PC for each frame not in the cache, so that each of them is
+    // symbolized once however often it appears
+    KeyedVector<SymbolKey, uintptr_t> missing;
+
+    for (size_t s = 0; s < count; s++) {
+        for (size_t i = 0; i < stacks[s].count; i++) {
+            uintptr_t pc = stacks[s].pc(i);
+            SymbolKey key = symbolKey(maps, pc);
+            keys.add(key);
+            if (gSymbols.indexOfKey(key) < 0 && missing.indexOfKey(key) < 0) {
+                missing.add(key, pc);
+            }
+        }
+    }
+
+    // Make room before adding, so that the cache stays within its bound.
+    // A batch with more distinct frames than that is resolved uncached.
+    if (gSymbols.size() + missing.size() > MAX_CACHED_SYMBOLS) {
+        evictLocked(keys);
+    }
+    const bool cache = gSymbols.size() + missing.size() <= MAX_CACHED_SYMBOLS;
+
+    KeyedVector<SymbolKey, backtrace_symbol_t> resolved;
+    if (missing.size()) {
+        backtrace_frame_t* frames = new backtrace_frame_t[missing.size()];
+        backtrace_symbol_t* symbols = new backtrace_symbol_t[missing.size()];
+        for (size_t i = 0; i < missing.size(); i++) {
+            frames[i].absolute_pc = missing.valueAt(i);
+            frames[i].stack_top = 0;
+            frames[i].stack_size = 0;
+        }
+        get_backtrace_symbols(frames, missing.size(), symbols);
+        resolved.setCapacity(missing.size());
+        for (size_t i = 0; i < missing.size(); i++) {
+            backtrace_symbol_t symbol;
+            symbol.relative_pc = symbols[i].relative_pc;
+            symbol.relative_symbol_addr = symbols[i].relative_symbol_addr;
+            symbol.map_name = dupString(symbols[i].map_name);
+            symbol.symbol_name = dupString(symbols[i].symbol_name);
+            symbol.demangled_name = dupString(symbols[i].demangled_name);
+            resolved.add(missing.keyAt(i), symbol);
+        }
+        free_backtrace_symbols(symbols, missing.size());
+        delete[] symbols;
+        delete[] frames;
+    }
+
+    size_t k = 0;
+    for (size_t s = 0; s < count; s++) {
+        if (s > 0) {
+            lines.add(String8());
+        }
+        for (size_t i = 0; i < stacks[s].count; i++, k++) {
+            char line[MAX_BACKTRACE_LINE_LENGTH];
+            backtrace_frame_t frame;
+            if (stacks[s].frames) {
+                frame = stacks[s].frames[i];
+            } else {
+                frame.absolute_pc = stacks[s].pcs[i];
+                frame.stack_top = 0;
+                frame.stack_size = 0;
+            }
+            ssize_t index = gSymbols.indexOfKey(keys[k]);
+            const backtrace_symbol_t& symbol = index >= 0 ?
+                    gSymbols.valueAt(index) : resolved.valueFor(keys[k]);
+            format_backtrace_line(i, &frame, &symbol, line,
+                    MAX_BACKTRACE_LINE_LENGTH);
+            lines.add(String8(line));
+        }
+    }
+
+    for (size_t i = 0; i < resolved.size(); i++) {
+        if (cache) {
+            gSymbols.add(resolved.keyAt(i), resolved.valueAt(i));
+        } else {
+            freeSymbol(&resolved.editValueAt(i));
+        }
+    }
+}
+
+static void printResolved(Printer& printer, const StackRef* stacks, size_t count) {
+    map_info_t* maps = acquire_my_map_info_list();
+    Vector<String8> lines;
+
+    {
+        Mutex::Autolock _l(gSymbolLock);
+        resolveLocked(maps, stacks, count, lines);
+    }
+    release_my_map_info_list(maps);
+
+    // a slow printer must not hold up other threads' symbolization
+    for (size_t i = 0; i < lines.size(); i++) {
+        printer.printLine(lines[i].string());
+    }
+}
+
+static _Unwind_Reason_Code captureFrame(struct _Unwind_Context* context, void* arg) {
+    CaptureState* state = static_cast<CaptureState*>(arg);
+    uintptr_t pc = _Unwind_GetIP(context);
+
+    if (pc == 0) {
+        return _URC_END_OF_STACK;
+    }
+    if (state->ignoreDepth > 0) {
+        state->ignoreDepth--;
+        return _URC_NO_REASON;
+    }
+    state->pcs[state->count++] = pc;
+    return state->count < state->maxDepth ? _URC_NO_REASON : _URC_END_OF_STACK;
+}
+
+// ---------------------------------------------------------------------------
+
 CallStack::CallStack() :
         mCount(0) {
 }
@@ -81,6 +308,31 @@ bool CallStack::operator <= (const CallStack& rhs) const {
     return !operator > (rhs);
 }
 
+// FNV-1a over each PC widened to 64 bits.
+static inline uint64_t hashPc(uint64_t hash, uint64_t pc) {
+    for (int i = 0; i < 8; i++) {
+        hash = (hash ^ (pc & 0xff)) * 1099511628211ULL;
+        pc >>= 8;
+    }
+    return hash;
+}
+
+uint64_t CallStack::hash() const {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < mCount; i++) {
+        hash = hashPc(hash, mStack[i].absolute_pc);
+    }
+    return hash;
+}
+
+uint64_t CallStack::hash(const uintptr_t* pcs, size_t count) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < count; i++) {
+        hash = hashPc(hash, pcs[i]);
+    }
+    return hash;
+}
+
 const void* CallStack::operator [] (int index) const {
     if (index >= int(mCount))
         return 0;
@@ -129,16 +381,39 @@ String8 CallStack::toString(const char* prefix) const {
 }
 
 void CallStack::print(Printer& printer) const {
-    backtrace_symbol_t symbols[mCount];
+    StackRef stack = { mStack, NULL, mCount };
+    printResolved(printer, &stack, 1);
+}
 
-    get_backtrace_symbols(mStack, mCount, symbols);
-    for (size_t i = 0; i < mCount; i++) {
-        char line[MAX_BACKTRACE_LINE_LENGTH];
-        format_backtrace_line(i, &mStack[i], &symbols[i],
-                line, MAX_BACKTRACE_LINE_LENGTH);
-        printer.printLine(line);
+size_t CallStack::capture(uintptr_t* pcs, size_t maxDepth, int32_t ignoreDepth) {
+    if (maxDepth == 0) {
+        return 0;
     }
-    free_backtrace_symbols(symbols, mCount);
+    // skip capture() itself as well
+    CaptureState state = { pcs, 0, maxDepth, ignoreDepth + 1 };
+    _Unwind_Backtrace(captureFrame, &state);
+    return state.count;
+}
+
+void CallStack::printPcs(Printer& printer, const uintptr_t* pcs, size_t count) {
+    StackRef stack = { NULL, pcs, count };
+    printResolved(printer, &stack, 1);
+}
+
+void CallStack::printStacks(Printer& printer, const CallStack* stacks, size_t count) {
+    StackRef* refs = new StackRef[count];
+    for (size_t i = 0; i < count; i++) {
+        refs[i].frames = stacks[i].mStack;
+        refs[i].pcs = NULL;
+        refs[i].count = stacks[i].mCount;
+    }
+    printResolved(printer, refs, count);
+    delete[] refs;
+}
+
+void CallStack::flushSymbolCache() {
+    Mutex::Autolock _l(gSymbolLock);
+    flushSymbolsLocked();
 }
 
 }; // namespace android
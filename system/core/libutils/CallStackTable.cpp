@@ -0,0 +1,407 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CallStackTable"
+
+#include <utils/CallStackTable.h>
+#include <utils/Printer.h>
+#include <utils/String8.h>
+#include <utils/Log.h>
+#include <corkscrew/map_info.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+// "STK2", the library count and paths, the stack count, then per stack:
+// samples, depth and per frame a library index and the offset in it.
+// Index 0 is for PCs outside any named mapping, stored as they are.
+static const uint8_t kMagic[4] = { 'S', 'T', 'K', '2' };
+
+static size_t bucketCount(size_t maxStacks) {
+    // keep the table at most half full
+    size_t count = 16;
+    while (count < maxStacks * 2) {
+        count <<= 1;
+    }
+    return count;
+}
+
+static void putVarint(Vector<uint8_t>* out, uint64_t value) {
+    while (value >= 0x80) {
+        out->add(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out->add(uint8_t(value));
+}
+
+static bool getVarint(const uint8_t** data, const uint8_t* end, uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64 && *data < end; shift += 7) {
+        uint8_t byte = *(*data)++;
+        result |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Index of the library a PC falls in, adding it to libraries as needed,
+// and the PC's offset from the library's executable mapping.
+static uint64_t libraryOf(const map_info_t* maps, uintptr_t pc,
+        Vector<String8>* libraries, uint64_t* offset) {
+    const map_info_t* mi = find_map_info(maps, pc);
+    if (mi == NULL || !mi->name[0]) {
+        *offset = pc;
+        return 0;
+    }
+    *offset = pc - mi->start;
+    for (size_t i = 0; i < libraries->size(); i++) {
+        if (strcmp(libraries->itemAt(i).string(), mi->name) == 0) {
+            return i + 1;
+        }
+    }
+    libraries->add(String8(mi->name));
+    return libraries->size();
+}
+
+// Where the library is mapped for execution in this process, or 0.
+static uintptr_t libraryBase(const map_info_t* maps, const char* name) {
+    for (const map_info_t* mi = maps; mi != NULL; mi = mi->next) {
+        if (mi->is_executable && strcmp(mi->name, name) == 0) {
+            return mi->start;
+        }
+    }
+    return 0;
+}
+
+CallStackTable::CallStackTable(size_t maxStacks) :
+        mMaxStacks(maxStacks),
+        mBucketMask(bucketCount(maxStacks) - 1) {
+    mBuckets = static_cast<uint32_t*>(calloc(mBucketMask + 1, sizeof(uint32_t)));
+    if (mBuckets == NULL) {
+        ALOGE("Cannot allocate %zu buckets", mBucketMask + 1);
+    }
+}
+
+CallStackTable::~CallStackTable() {
+    free(mBuckets);
+}
+
+// Id of the stack, or NO_STACK with the empty bucket it would go in.
+uint32_t CallStackTable::findLocked(const uintptr_t* pcs, size_t count,
+        uint64_t hash, size_t* bucket) const {
+    size_t b = size_t(hash) & mBucketMask;
+    for (;;) {
+        uint32_t id = mBuckets[b];
+        if (id == NO_STACK) {
+            break;
+        }
+        const Entry& entry = mEntries[id - 1];
+        if (entry.hash == hash && entry.depth == count &&
+                memcmp(mPcs.array() + entry.offset, pcs, count * sizeof(uintptr_t)) == 0) {
+            return id;
+        }
+        b = (b + 1) & mBucketMask;
+    }
+    *bucket = b;
+    return NO_STACK;
+}
+
+uint32_t CallStackTable::internLocked(const uintptr_t* pcs, size_t count) {
+    if (mBuckets == NULL) {
+        return NO_STACK;
+    }
+
+    uint64_t hash = CallStack::hash(pcs, count);
+    size_t bucket;
+    uint32_t id = findLocked(pcs, count, hash, &bucket);
+    if (id != NO_STACK) {
+        return id;
+    }
+
+    if (mEntries.size() >= mMaxStacks) {
+        return NO_STACK;
+    }
+    Entry entry;
+    entry.hash = hash;
+    entry.offset = mPcs.size();
+    entry.depth = count;
+    entry.samples = 0;
+    if (count) {
+        mPcs.appendArray(pcs, count);
+    }
+    mEntries.add(entry);
+    mBuckets[bucket] = mEntries.size();
+    return mEntries.size();
+}
+
+uint32_t CallStackTable::intern(const uintptr_t* pcs, size_t count) {
+    Mutex::Autolock _l(mLock);
+    return internLocked(pcs, count);
+}
+
+uint32_t CallStackTable::intern(const CallStack& stack) {
+    uintptr_t pcs[CallStack::MAX_DEPTH];
+    size_t count = stack.size();
+    for (size_t i = 0; i < count; i++) {
+        pcs[i] = reinterpret_cast<uintptr_t>(stack[i]);
+    }
+    return intern(pcs, count);
+}
+
+uint32_t CallStackTable::addSample(const uintptr_t* pcs, size_t count, uint32_t weight) {
+    Mutex::Autolock _l(mLock);
+    uint32_t id = internLocked(pcs, count);
+    if (id != NO_STACK) {
+        mEntries.editItemAt(id - 1).samples += weight;
+    }
+    return id;
+}
+
+uint32_t CallStackTable::sample(uint32_t weight, int32_t ignoreDepth) {
+    uintptr_t pcs[CallStack::MAX_DEPTH];
+    size_t count = CallStack::capture(pcs, CallStack::MAX_DEPTH, ignoreDepth + 1);
+    return addSample(pcs, count, weight);
+}
+
+size_t CallStackTable::size() const {
+    Mutex::Autolock _l(mLock);
+    return mEntries.size();
+}
+
+uint64_t CallStackTable::getSamples(uint32_t id) const {
+    Mutex::Autolock _l(mLock);
+    if (id == NO_STACK || id > mEntries.size()) {
+        return 0;
+    }
+    return mEntries[id - 1].samples;
+}
+
+size_t CallStackTable::getPcs(uint32_t id, uintptr_t* pcs, size_t maxDepth) const {
+    Mutex::Autolock _l(mLock);
+    if (id == NO_STACK || id > mEntries.size()) {
+        return 0;
+    }
+    const Entry& entry = mEntries[id - 1];
+    size_t count = entry.depth < maxDepth ? entry.depth : maxDepth;
+    if (count) {
+        memcpy(pcs, mPcs.array() + entry.offset, count * sizeof(uintptr_t));
+    }
+    return count;
+}
+
+void CallStackTable::clear() {
+    Mutex::Autolock _l(mLock);
+    if (mBuckets != NULL) {
+        memset(mBuckets, 0, (mBucketMask + 1) * sizeof(uint32_t));
+    }
+    mEntries.clear();
+    mPcs.clear();
+}
+
+void CallStackTable::serialize(Vector<uint8_t>* out) const {
+    map_info_t* maps = acquire_my_map_info_list();
+    Vector<String8> libraries;
+    Vector<uint8_t> stacks;
+
+    {
+        Mutex::Autolock _l(mLock);
+        putVarint(&stacks, mEntries.size());
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            const Entry& entry = mEntries[i];
+            putVarint(&stacks, entry.samples);
+            putVarint(&stacks, entry.depth);
+            for (size_t j = 0; j < entry.depth; j++) {
+                uint64_t offset;
+                putVarint(&stacks, libraryOf(maps, mPcs[entry.offset + j],
+                        &libraries, &offset));
+                putVarint(&stacks, offset);
+            }
+        }
+    }
+    release_my_map_info_list(maps);
+
+    out->appendArray(kMagic, sizeof(kMagic));
+    putVarint(out, libraries.size());
+    for (size_t i = 0; i < libraries.size(); i++) {
+        putVarint(out, libraries[i].length());
+        out->appendArray(reinterpret_cast<const uint8_t*>(libraries[i].string()),
+                libraries[i].length());
+    }
+    out->appendVector(stacks);
+}
+
+status_t CallStackTable::deserialize(const uint8_t* data, size_t size) {
+    const uint8_t* end = data + size;
+    uint64_t libraryCount, count;
+
+    if (size < sizeof(kMagic) || memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+        return BAD_VALUE;
+    }
+    data += sizeof(kMagic);
+    if (!getVarint(&data, end, &libraryCount)) {
+        return NOT_ENOUGH_DATA;
+    }
+    if (libraryCount > size) {
+        return BAD_VALUE;
+    }
+
+    // where each library is loaded here, 0 if it is not
+    map_info_t* maps = acquire_my_map_info_list();
+    Vector<uintptr_t> bases;
+    for (uint64_t i = 0; i < libraryCount; i++) {
+        uint64_t length;
+        if (!getVarint(&data, end, &length) || length > uint64_t(end - data)) {
+            release_my_map_info_list(maps);
+            return NOT_ENOUGH_DATA;
+        }
+        String8 name(reinterpret_cast<const char*>(data), length);
+        bases.add(libraryBase(maps, name.string()));
+        data += length;
+    }
+    release_my_map_info_list(maps);
+
+    if (!getVarint(&data, end, &count)) {
+        return NOT_ENOUGH_DATA;
+    }
+    // a stack takes at least two bytes
+    if (count > uint64_t(end - data) / 2) {
+        return BAD_VALUE;
+    }
+
+    // Parse it all before touching this table, so that bad data merges
+    // nothing.  Stacks cut short may turn out to be the same.
+    CallStackTable parsed(count);
+    for (uint64_t i = 0; i < count; i++) {
+        uintptr_t pcs[CallStack::MAX_DEPTH];
+        uint64_t samples, depth, library, offset;
+        size_t kept = 0;
+        bool placed = true;
+
+        if (!getVarint(&data, end, &samples) || !getVarint(&data, end, &depth)) {
+            return NOT_ENOUGH_DATA;
+        }
+        if (depth > CallStack::MAX_DEPTH) {
+            return BAD_VALUE;
+        }
+        for (uint64_t j = 0; j < depth; j++) {
+            if (!getVarint(&data, end, &library) || !getVarint(&data, end, &offset)) {
+                return NOT_ENOUGH_DATA;
+            }
+            if (library > libraryCount) {
+                return BAD_VALUE;
+            }
+            // A PC outside any library, or in one not loaded here, means
+            // nothing in this process: the stack ends above it.
+            if (library == 0 || bases[library - 1] == 0) {
+                placed = false;
+            }
+            if (placed) {
+                pcs[kept++] = bases[library - 1] + uintptr_t(offset);
+            }
+        }
+        uint32_t id = parsed.internLocked(pcs, kept);
+        if (id == NO_STACK) {
+            return NO_MEMORY;
+        }
+        parsed.mEntries.editItemAt(id - 1).samples += samples;
+    }
+
+    Mutex::Autolock _l(mLock);
+    return mergeLocked(parsed);
+}
+
+status_t CallStackTable::mergeLocked(const CallStackTable& other) {
+    if (mBuckets == NULL) {
+        return NO_MEMORY;
+    }
+
+    // the stacks of other are distinct, so each one not found here is new
+    size_t added = 0;
+    for (size_t i = 0; i < other.mEntries.size(); i++) {
+        const Entry& entry = other.mEntries[i];
+        size_t bucket;
+        if (findLocked(other.mPcs.array() + entry.offset, entry.depth,
+                entry.hash, &bucket) == NO_STACK) {
+            added++;
+        }
+    }
+    if (mEntries.size() + added > mMaxStacks) {
+        return NO_MEMORY;
+    }
+
+    for (size_t i = 0; i < other.mEntries.size(); i++) {
+        const Entry& entry = other.mEntries[i];
+        uint32_t id = internLocked(other.mPcs.array() + entry.offset, entry.depth);
+        mEntries.editItemAt(id - 1).samples += entry.samples;
+    }
+    return NO_ERROR;
+}
+
+void CallStackTable::dump(Printer& printer, size_t maxStacks) const {
+    Vector<uint32_t> top;
+    Vector<Entry> entries;  // of top, with offsets into pcs
+    Vector<uintptr_t> pcs;
+    size_t stacks;
+    uint64_t total = 0;
+
+    // copy out the stacks to print, so that a slow printer does not hold
+    // up sampling
+    {
+        Mutex::Autolock _l(mLock);
+
+        // insert into a sorted list of at most maxStacks, which is expected
+        // to be small
+        for (size_t i = 0; i < mEntries.size(); i++) {
+            total += mEntries[i].samples;
+            size_t pos = top.size();
+            while (pos > 0 && mEntries[top[pos - 1]].samples < mEntries[i].samples) {
+                pos--;
+            }
+            if (pos < maxStacks) {
+                top.insertAt(uint32_t(i), pos);
+                if (top.size() > maxStacks) {
+                    top.removeAt(maxStacks);
+                }
+            }
+        }
+        stacks = mEntries.size();
+
+        for (size_t i = 0; i < top.size(); i++) {
+            Entry entry = mEntries[top[i]];
+            if (entry.depth) {
+                pcs.appendArray(mPcs.array() + entry.offset, entry.depth);
+            }
+            entry.offset = pcs.size() - entry.depth;
+            entries.add(entry);
+        }
+    }
+
+    printer.printFormatLine("%zu stacks, %llu samples", stacks,
+            (unsigned long long) total);
+    for (size_t i = 0; i < top.size(); i++) {
+        const Entry& entry = entries[i];
+        printer.printFormatLine("stack %u: %llu samples", top[i] + 1,
+                (unsigned long long) entry.samples);
+        CallStack::printPcs(printer, pcs.array() + entry.offset, entry.depth);
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,319 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "RefSampler"
+
+#include <utils/RefSampler.h>
+#include <utils/CallStack.h>
+#include <utils/Mutex.h>
+#include <utils/Printer.h>
+#include <utils/Log.h>
+#include <cutils/atomic.h>
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+enum {
+    // Call sites tracked; a power of two.
+    SITE_COUNT = 1024,
+    // Sampled references held at once; a power of two.
+    ID_COUNT = 4096,
+    // Slots an id may land past the one it hashes to.
+    MAX_PROBE = 64,
+};
+
+// Id slot keys besides the ids themselves.
+enum {
+    ID_EMPTY = 0,               // never used, ends a lookup
+    ID_DELETED = 1,             // released, free for reuse
+};
+
+struct Site {
+    volatile int32_t key;       // hash of the PCs, 0 while free
+    volatile int32_t ready;     // set once pcs and depth are written
+    volatile int32_t live;      // sampled references still held
+    volatile int32_t total;     // sampled references ever taken
+    size_t depth;
+    uintptr_t pcs[RefSampler::MAX_DEPTH];
+};
+
+volatile int32_t RefSampler::sBits = -1;
+
+// Call site of a sampled reference still held.
+struct IdSlot {
+    volatile int32_t key;       // idKey() of the reference, or ID_EMPTY/DELETED
+    volatile int32_t site;      // index in gSites plus one, 0 while unset
+};
+
+// Allocated the first time sampling starts and never freed, so that the
+// lock-free lookups need no protection against them going away.
+static Site* gSites;
+static IdSlot* gIds;
+static volatile int32_t gDropped;
+
+// Serializes setPeriod() and reset(); the hooks never take it.
+static Mutex gConfigLock;
+
+static uint32_t hashPcs(const uintptr_t* pcs, size_t depth) {
+    uint64_t hash = CallStack::hash(pcs, depth);
+    uint32_t folded = uint32_t(hash ^ (hash >> 32));
+    return folded ? folded : 1;
+}
+
+static Site* findSite(Site* sites, const uintptr_t* pcs, size_t depth) {
+    const int32_t hash = int32_t(hashPcs(pcs, depth));
+
+    for (size_t i = 0; i < SITE_COUNT; i++) {
+        Site* site = &sites[(uint32_t(hash) + i) & (SITE_COUNT - 1)];
+        int32_t key = android_atomic_acquire_load(&site->key);
+        if (key == 0) {
+            if (android_atomic_cmpxchg(0, hash, &site->key) == 0) {
+                memcpy(site->pcs, pcs, depth * sizeof(uintptr_t));
+                site->depth = depth;
+                android_atomic_release_store(1, &site->ready);
+                return site;
+            }
+            key = android_atomic_acquire_load(&site->key);
+        }
+        if (key != hash) {
+            continue;
+        }
+        // claimed by another thread that is still filling it in
+        while (!android_atomic_acquire_load(&site->ready)) {
+            sched_yield();
+        }
+        if (site->depth == depth &&
+                memcmp(site->pcs, pcs, depth * sizeof(uintptr_t)) == 0) {
+            return site;
+        }
+    }
+    return NULL;
+}
+
+// Ids are sp<> addresses, or now and then NULL; keep clear of the markers.
+static int32_t idKey(const void* id) {
+    uint32_t key = uint32_t(uintptr_t(id));
+    return int32_t(key <= ID_DELETED ? key + 2 : key);
+}
+
+// The sampled ids all share the top bits of RefSampler::hash(), so place
+// them with a hash of their own.
+static uint32_t idSlot(int32_t key) {
+    uint32_t h = uint32_t(key);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+static bool addId(int32_t key, int32_t site) {
+    const uint32_t start = idSlot(key);
+
+    for (size_t i = 0; i < MAX_PROBE; i++) {
+        IdSlot* slot = &gIds[(start + i) & (ID_COUNT - 1)];
+        int32_t old = android_atomic_acquire_load(&slot->key);
+        if ((old == ID_EMPTY || old == ID_DELETED) &&
+                android_atomic_acquire_cas(old, key, &slot->key) == 0) {
+            android_atomic_release_store(site + 1, &slot->site);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Remove one reference with the given key; returns its site, or -1.
+static int32_t takeId(int32_t key) {
+    const uint32_t start = idSlot(key);
+
+    for (size_t i = 0; i < MAX_PROBE; i++) {
+        IdSlot* slot = &gIds[(start + i) & (ID_COUNT - 1)];
+        int32_t k = android_atomic_acquire_load(&slot->key);
+        if (k == ID_EMPTY) {
+            break;
+        }
+        if (k != key) {
+            continue;
+        }
+        // another reference with the same id may be coming or going here
+        int32_t site = android_atomic_acquire_load(&slot->site);
+        if (site > 0 && android_atomic_acquire_cas(site, 0, &slot->site) == 0) {
+            android_atomic_release_store(ID_DELETED, &slot->key);
+            return site - 1;
+        }
+    }
+    return -1;
+}
+
+// References taken or released while this runs may be miscounted.
+static void clearCounts() {
+    for (size_t i = 0; i < ID_COUNT; i++) {
+        android_atomic_release_store(0, &gIds[i].site);
+        android_atomic_release_store(ID_EMPTY, &gIds[i].key);
+    }
+    for (size_t i = 0; i < SITE_COUNT; i++) {
+        android_atomic_release_store(0, &gSites[i].live);
+        android_atomic_release_store(0, &gSites[i].total);
+    }
+    android_atomic_release_store(0, &gDropped);
+}
+
+void RefSampler::setPeriod(uint32_t period) {
+    Mutex::Autolock _l(gConfigLock);
+
+    android_atomic_release_store(-1, &sBits);
+    if (period == 0) {
+        return;
+    }
+#ifndef REFBASE_SAMPLING
+    ALOGW("Built without REFBASE_SAMPLING, no references will be sampled");
+#endif
+    if (gSites == NULL) {
+        gSites = static_cast<Site*>(calloc(SITE_COUNT, sizeof(Site)));
+        gIds = static_cast<IdSlot*>(calloc(ID_COUNT, sizeof(IdSlot)));
+        if (gSites == NULL || gIds == NULL) {
+            ALOGE("Cannot allocate the sampling tables");
+            free(gSites);
+            free(gIds);
+            gSites = NULL;
+            gIds = NULL;
+            return;
+        }
+    }
+
+    int32_t bits = 0;
+    while ((1u << bits) < period && bits < 30) {
+        bits++;
+    }
+    // references sampled under another period would never be released
+    clearCounts();
+    android_atomic_release_store(bits, &sBits);
+}
+
+void RefSampler::reset() {
+    Mutex::Autolock _l(gConfigLock);
+
+    if (gSites != NULL) {
+        clearCounts();
+    }
+}
+
+void RefSampler::recordInc(const void* id) {
+    // orders the gSites read after the period set up by setPeriod()
+    if (android_atomic_acquire_load(&sBits) < 0) {
+        return;
+    }
+
+    uintptr_t pcs[MAX_DEPTH];
+    size_t depth = CallStack::capture(pcs, MAX_DEPTH, 1);
+    if (depth == 0) {
+        return;
+    }
+
+    Site* site = findSite(gSites, pcs, depth);
+    if (site == NULL || !addId(idKey(id), int32_t(site - gSites))) {
+        android_atomic_inc(&gDropped);
+        return;
+    }
+    android_atomic_inc(&site->live);
+    android_atomic_inc(&site->total);
+}
+
+void RefSampler::recordDec(const void* id) {
+    if (android_atomic_acquire_load(&sBits) < 0) {
+        return;
+    }
+
+    int32_t site = takeId(idKey(id));
+    if (site >= 0) {
+        android_atomic_dec(&gSites[site].live);
+    }
+}
+
+void RefSampler::recordMove(const void* oldId, const void* newId) {
+    int32_t bits = android_atomic_acquire_load(&sBits);
+    if (bits < 0 || !isSampled(oldId, bits)) {
+        // a reference moved onto a sampled id was never recorded, and its
+        // release will find nothing to take
+        return;
+    }
+
+    int32_t site = takeId(idKey(oldId));
+    if (site < 0) {
+        return;
+    }
+    if (!isSampled(newId, bits) || !addId(idKey(newId), site)) {
+        // its release will not be seen any more
+        android_atomic_dec(&gSites[site].live);
+        if (isSampled(newId, bits)) {
+            android_atomic_inc(&gDropped);
+        }
+    }
+}
+
+static int compareLive(const void* a, const void* b) {
+    const Site* sa = *static_cast<Site* const*>(a);
+    const Site* sb = *static_cast<Site* const*>(b);
+    return sb->live - sa->live;
+}
+
+void RefSampler::dump(Printer& printer) {
+    int32_t bits = android_atomic_acquire_load(&sBits);
+    if (bits < 0 || gSites == NULL) {
+        printer.printLine("Reference sampling is off.");
+        return;
+    }
+
+    Site** sorted = static_cast<Site**>(malloc(SITE_COUNT * sizeof(Site*)));
+    if (sorted == NULL) {
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < SITE_COUNT; i++) {
+        if (android_atomic_acquire_load(&gSites[i].ready) &&
+                gSites[i].live > 0) {
+            sorted[count++] = &gSites[i];
+        }
+    }
+    qsort(sorted, count, sizeof(Site*), compareLive);
+
+    printer.printFormatLine("Sampling 1 in %d references, %zu call sites live, "
+            "%d samples dropped", 1 << bits, count, gDropped);
+    for (size_t i = 0; i < count; i++) {
+        const Site* site = sorted[i];
+
+        printer.printFormatLine("~%d live (%d sampled, %d taken):",
+                site->live * (1 << bits), site->live, site->total);
+        CallStack::printPcs(printer, site->pcs, site->depth);
+    }
+    free(sorted);
+}
+
+void RefSampler::dump(int fd) {
+    FdPrinter printer(fd);
+    dump(printer);
+}
+
+void RefSampler::log(const char* logtag) {
+    LogPrinter printer(logtag);
+    dump(printer);
+}
+
+}; // namespace android
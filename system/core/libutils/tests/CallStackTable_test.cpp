@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CallStackTable_test"
+
+#include <gtest/gtest.h>
+
+#include <utils/CallStack.h>
+#include <utils/CallStackTable.h>
+#include <utils/Errors.h>
+#include <utils/Printer.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// Functions whose code gives PCs in a named mapping, as real frames are.
+static __attribute__((noinline)) void frameA() { asm volatile(""); }
+static __attribute__((noinline)) void frameB() { asm volatile(""); }
+static __attribute__((noinline)) void frameC() { asm volatile(""); }
+
+static uintptr_t pcIn(void (*function)(), uintptr_t offset) {
+    return reinterpret_cast<uintptr_t>(function) + offset;
+}
+
+class CallStackTableTest : public ::testing::Test {
+protected:
+    enum {
+        MAX_STACKS = 16,
+    };
+
+    virtual void SetUp() {
+        mTable = new CallStackTable(MAX_STACKS);
+        mStackA[0] = pcIn(frameA, 1);
+        mStackA[1] = pcIn(frameB, 2);
+        mStackA[2] = pcIn(frameC, 3);
+        mStackB[0] = pcIn(frameC, 1);
+        mStackB[1] = pcIn(frameA, 2);
+        mStackC[0] = pcIn(frameB, 5);
+    }
+
+    virtual void TearDown() {
+        delete mTable;
+    }
+
+    // The stack of id in table, as a vector.
+    static Vector<uintptr_t> pcsOf(const CallStackTable& table, uint32_t id) {
+        uintptr_t pcs[CallStack::MAX_DEPTH];
+        Vector<uintptr_t> result;
+        size_t depth = table.getPcs(id, pcs, CallStack::MAX_DEPTH);
+        result.appendArray(pcs, depth);
+        return result;
+    }
+
+    CallStackTable* mTable;
+    uintptr_t mStackA[3];
+    uintptr_t mStackB[2];
+    uintptr_t mStackC[1];
+};
+
+TEST_F(CallStackTableTest, HashOfEqualStacksIsEqual) {
+    uintptr_t copy[3] = { mStackA[0], mStackA[1], mStackA[2] };
+    EXPECT_EQ(CallStack::hash(mStackA, 3), CallStack::hash(copy, 3));
+}
+
+TEST_F(CallStackTableTest, HashDependsOnOrderAndDepth) {
+    uintptr_t swapped[3] = { mStackA[1], mStackA[0], mStackA[2] };
+    EXPECT_NE(CallStack::hash(mStackA, 3), CallStack::hash(swapped, 3));
+    EXPECT_NE(CallStack::hash(mStackA, 3), CallStack::hash(mStackA, 2));
+}
+
+TEST_F(CallStackTableTest, HashOfCallStackIsHashOfItsPcs) {
+    CallStack stack;
+    stack.update();
+    ASSERT_GT(stack.size(), 0U);
+
+    uintptr_t pcs[CallStack::MAX_DEPTH];
+    for (size_t i = 0; i < stack.size(); i++) {
+        pcs[i] = reinterpret_cast<uintptr_t>(stack[i]);
+    }
+    EXPECT_EQ(CallStack::hash(pcs, stack.size()), stack.hash());
+}
+
+TEST_F(CallStackTableTest, InternOfEqualStacksGivesOneId) {
+    uint32_t a = mTable->intern(mStackA, 3);
+    uint32_t b = mTable->intern(mStackB, 2);
+    ASSERT_NE(uint32_t(CallStackTable::NO_STACK), a);
+    ASSERT_NE(uint32_t(CallStackTable::NO_STACK), b);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(a, mTable->intern(mStackA, 3));
+    EXPECT_EQ(2U, mTable->size());
+    EXPECT_EQ(0U, mTable->getSamples(a));
+}
+
+TEST_F(CallStackTableTest, InternOfPrefixGivesAnotherId) {
+    uint32_t a = mTable->intern(mStackA, 3);
+    uint32_t prefix = mTable->intern(mStackA, 2);
+    EXPECT_NE(a, prefix);
+    EXPECT_EQ(2U, pcsOf(*mTable, prefix).size());
+}
+
+TEST_F(CallStackTableTest, InternIntoFullTableFails) {
+    CallStackTable table(1);
+    uint32_t a = table.intern(mStackA, 3);
+    ASSERT_NE(uint32_t(CallStackTable::NO_STACK), a);
+    EXPECT_EQ(uint32_t(CallStackTable::NO_STACK), table.intern(mStackB, 2));
+    EXPECT_EQ(a, table.intern(mStackA, 3));
+}
+
+TEST_F(CallStackTableTest, GetPcsCopiesTheStack) {
+    uint32_t a = mTable->intern(mStackA, 3);
+    uintptr_t pcs[2];
+    ASSERT_EQ(2U, mTable->getPcs(a, pcs, 2));
+    EXPECT_EQ(mStackA[0], pcs[0]);
+    EXPECT_EQ(mStackA[1], pcs[1]);
+    EXPECT_EQ(0U, mTable->getPcs(CallStackTable::NO_STACK, pcs, 2));
+}
+
+TEST_F(CallStackTableTest, SamplesAreCountedIn64Bits) {
+    uint32_t a = mTable->addSample(mStackA, 3, 0xffffffff);
+    mTable->addSample(mStackA, 3, 0xffffffff);
+    mTable->addSample(mStackA, 3, 2);
+    EXPECT_EQ(0x200000000ULL, mTable->getSamples(a));
+}
+
+TEST_F(CallStackTableTest, SerializeRoundTripKeepsStacksAndSamples) {
+    uint32_t a = mTable->addSample(mStackA, 3, 7);
+    uint32_t b = mTable->addSample(mStackB, 2, 0xffffffff);
+    mTable->addSample(mStackB, 2, 1);
+    Vector<uint8_t> data;
+    mTable->serialize(&data);
+
+    CallStackTable copy(MAX_STACKS);
+    ASSERT_EQ(NO_ERROR, copy.deserialize(data.array(), data.size()));
+    ASSERT_EQ(2U, copy.size());
+    Vector<uintptr_t> pcs = pcsOf(copy, a);
+    ASSERT_EQ(3U, pcs.size());
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_EQ(mStackA[i], pcs[i]);
+    }
+    EXPECT_EQ(2U, pcsOf(copy, b).size());
+    EXPECT_EQ(7U, copy.getSamples(a));
+    EXPECT_EQ(0x100000000ULL, copy.getSamples(b));
+}
+
+TEST_F(CallStackTableTest, DeserializeMergesSamples) {
+    uint32_t a = mTable->addSample(mStackA, 3, 7);
+    Vector<uint8_t> data;
+    mTable->serialize(&data);
+
+    mTable->addSample(mStackB, 2, 1);
+    ASSERT_EQ(NO_ERROR, mTable->deserialize(data.array(), data.size()));
+    ASSERT_EQ(NO_ERROR, mTable->deserialize(data.array(), data.size()));
+    EXPECT_EQ(2U, mTable->size());
+    EXPECT_EQ(21U, mTable->getSamples(a));
+}
+
+TEST_F(CallStackTableTest, DeserializeEndsStackAboveUnplacedFrame) {
+    // nothing is mapped at the first page
+    uintptr_t pcs[3] = { mStackA[0], 0x10, mStackA[1] };
+    mTable->addSample(pcs, 3, 1);
+    Vector<uint8_t> data;
+    mTable->serialize(&data);
+
+    CallStackTable copy(MAX_STACKS);
+    ASSERT_EQ(NO_ERROR, copy.deserialize(data.array(), data.size()));
+    Vector<uintptr_t> kept = pcsOf(copy, 1);
+    ASSERT_EQ(1U, kept.size());
+    EXPECT_EQ(mStackA[0], kept[0]);
+}
+
+TEST_F(CallStackTableTest, DeserializeOfBadMagicFails) {
+    static const uint8_t data[] = { 'S', 'T', 'K', '1', 0, 0 };
+    EXPECT_EQ(BAD_VALUE, mTable->deserialize(data, sizeof(data)));
+    EXPECT_EQ(0U, mTable->size());
+}
+
+TEST_F(CallStackTableTest, DeserializeOfTruncatedDataMergesNothing) {
+    mTable->addSample(mStackA, 3, 1);
+    mTable->addSample(mStackB, 2, 1);
+    Vector<uint8_t> data;
+    mTable->serialize(&data);
+
+    CallStackTable target(MAX_STACKS);
+    uint32_t a = target.addSample(mStackA, 3, 5);
+    for (size_t size = 0; size < data.size(); size++) {
+        EXPECT_NE(NO_ERROR, target.deserialize(data.array(), size))
+                << "cut at " << size;
+        EXPECT_EQ(1U, target.size()) << "cut at " << size;
+        EXPECT_EQ(5U, target.getSamples(a)) << "cut at " << size;
+    }
+}
+
+TEST_F(CallStackTableTest, DeserializeThatDoesNotFitMergesNothing) {
+    mTable->addSample(mStackA, 3, 1);
+    mTable->addSample(mStackB, 2, 1);
+    Vector<uint8_t> data;
+    mTable->serialize(&data);
+
+    CallStackTable target(2);
+    uint32_t c = target.addSample(mStackA, 1, 3);
+    EXPECT_EQ(NO_MEMORY, target.deserialize(data.array(), data.size()));
+    EXPECT_EQ(1U, target.size());
+    EXPECT_EQ(3U, target.getSamples(c));
+}
+
+// Adds a sample to the table for every line printed, which would deadlock
+// if dump() held the table's lock while printing.
+class SamplingPrinter : public Printer {
+public:
+    SamplingPrinter(CallStackTable* table, const uintptr_t* pcs) :
+            mTable(table), mPcs(pcs) { }
+    virtual void printLine(const char* line) {
+        mTable->addSample(mPcs, 1);
+        mText.append(line);
+        mText.append("\n");
+    }
+    String8 mText;
+
+private:
+    CallStackTable* mTable;
+    const uintptr_t* mPcs;
+};
+
+TEST_F(CallStackTableTest, DumpPrintsHottestStacksFirst) {
+    mTable->addSample(mStackA, 3, 2);
+    mTable->addSample(mStackB, 2, 5);
+    mTable->addSample(mStackA, 1, 1);
+
+    SamplingPrinter printer(mTable, mStackC);
+    mTable->dump(printer, 2);
+    const char* text = printer.mText.string();
+    EXPECT_TRUE(strstr(text, "3 stacks, 8 samples") != NULL) << text;
+    const char* b = strstr(text, "stack 2: 5 samples");
+    const char* a = strstr(text, "stack 1: 2 samples");
+    ASSERT_TRUE(a != NULL && b != NULL) << text;
+    EXPECT_LT(b, a);
+    EXPECT_TRUE(strstr(text, "stack 3:") == NULL) << text;
+}
+
+} // namespace android
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// CallStack_benchmark: capture and print 10000 stacks, the way a watchdog
+// dump or RefBase tracking does, and time
+//
+//   - capturing them with update(), through libcorkscrew, and with
+//     capture(), which keeps the raw PCs only
+//   - printing them all with printStacks(), from a cold and then a warm
+//     symbol cache
+//   - printing them one by one with printPcs()
+//
+// The stacks go through 4^6 different paths of a few functions, so they
+// share most of their frames, as real ones do.
+
+#include <utils/CallStack.h>
+#include <utils/Printer.h>
+#include <utils/Timers.h>
+
+#include <stdio.h>
+
+using namespace android;
+
+enum {
+    STACKS = 10000,
+    PATH_DEPTH = 6,
+};
+
+// Counts the lines printed and drops them.
+class CountingPrinter : public Printer {
+public:
+    CountingPrinter() : mLines(0) { }
+    virtual void printLine(const char*) { mLines++; }
+    size_t mLines;
+};
+
+static CallStack gStacks[STACKS];
+static uintptr_t gPcs[STACKS][CallStack::MAX_DEPTH];
+static size_t gDepths[STACKS];
+static volatile int gSink;
+
+static void walk(int depth, uint32_t path, size_t index, bool raw);
+
+static void capture(size_t index, bool raw) {
+    if (raw) {
+        gDepths[index] = CallStack::capture(gPcs[index], CallStack::MAX_DEPTH);
+    } else {
+        gStacks[index].update();
+    }
+}
+
+#define STEP(name)                                                          \
+static __attribute__((noinline)) void name(int depth, uint32_t path,        \
+        size_t index, bool raw) {                                           \
+    if (depth == 0) {                                                       \
+        capture(index, raw);                                                \
+    } else {                                                                \
+        walk(depth - 1, path >> 2, index, raw);                             \
+    }                                                                       \
+    gSink++; /* not a tail call */                                          \
+}
+
+STEP(step0)
+STEP(step1)
+STEP(step2)
+STEP(step3)
+
+static __attribute__((noinline)) void walk(int depth, uint32_t path,
+        size_t index, bool raw) {
+    switch (path & 3) {
+    case 0: step0(depth, path, index, raw); break;
+    case 1: step1(depth, path, index, raw); break;
+    case 2: step2(depth, path, index, raw); break;
+    case 3: step3(depth, path, index, raw); break;
+    }
+    gSink++;
+}
+
+static double msSince(nsecs_t start) {
+    return (systemTime(SYSTEM_TIME_MONOTONIC) - start) / 1000000.0;
+}
+
+static void report(const char* name, double ms, size_t lines) {
+    printf("%-32s %9.2f ms %8.2f us/stack", name, ms, ms * 1000.0 / STACKS);
+    if (lines) {
+        printf(" %8zu lines", lines);
+    }
+    printf("\n");
+}
+
+int main(int, char**) {
+    nsecs_t start;
+    uint32_t path;
+
+    printf("%d stacks\n", STACKS);
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < STACKS; i++) {
+        path = uint32_t(i * 2654435761u) >> (32 - 2 * PATH_DEPTH);
+        walk(PATH_DEPTH, path, i, false);
+    }
+    report("capture, update()", msSince(start), 0);
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < STACKS; i++) {
+        path = uint32_t(i * 2654435761u) >> (32 - 2 * PATH_DEPTH);
+        walk(PATH_DEPTH, path, i, true);
+    }
+    report("capture, capture()", msSince(start), 0);
+
+    CallStack::flushSymbolCache();
+    CountingPrinter cold;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    CallStack::printStacks(cold, gStacks, STACKS);
+    report("print, printStacks() cold", msSince(start), cold.mLines);
+
+    CountingPrinter warm;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    CallStack::printStacks(warm, gStacks, STACKS);
+    report("print, printStacks() warm", msSince(start), warm.mLines);
+
+    CountingPrinter each;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < STACKS; i++) {
+        CallStack::printPcs(each, gPcs[i], gDepths[i]);
+    }
+    report("print, printPcs() each", msSince(start), each.mLines);
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// RefBase_benchmark: walk a list of layers the way SurfaceFlinger's
+// composition does, frame after frame, and time
+//
+//   - copying each sp<> out of the list, as setUpHWComposer() does
+//   - copying neighbours to compare their z, as LayerVector's sort does
+//   - the same walk through borrowed_sp<>, which counts nothing
+//
+// for RefBase, LightRefBase and BiasedRefBase layers, and for
+// BiasedRefBase layers owned by another thread.
+
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+#include <utils/threads.h>
+
+#include <pthread.h>
+#include <stdio.h>
+
+using namespace android;
+
+enum {
+    LAYERS = 32,
+    FRAMES = 100000,
+};
+
+struct Layer : public RefBase {
+    int32_t z;
+};
+
+struct LightLayer : public LightRefBase<LightLayer> {
+    int32_t z;
+};
+
+struct BiasedLayer : public BiasedRefBase<BiasedLayer> {
+    int32_t z;
+};
+
+static volatile int32_t gSink;
+
+template <typename T>
+static int32_t copyFrame(const sp<T>* layers) {
+    int32_t sum = 0;
+    for (size_t i = 0; i < LAYERS; i++) {
+        const sp<T> layer(layers[i]);
+        sum += layer->z;
+    }
+    return sum;
+}
+
+template <typename T>
+static int32_t compareFrame(const sp<T>* layers) {
+    int32_t sorted = 0;
+    for (size_t i = 1; i < LAYERS; i++) {
+        const sp<T> l(layers[i - 1]);
+        const sp<T> r(layers[i]);
+        sorted += l->z <= r->z;
+    }
+    return sorted;
+}
+
+template <typename T>
+static int32_t borrowedFrame(const sp<T>* layers) {
+    int32_t sum = 0;
+    for (size_t i = 0; i < LAYERS; i++) {
+        const borrowed_sp<T> layer(layers[i]);
+        sum += layer->z;
+    }
+    return sum;
+}
+
+template <typename T>
+static void run(const char* name, int32_t (*frame)(const sp<T>*),
+        const sp<T>* layers) {
+    int32_t sum = 0;
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < FRAMES; i++) {
+        sum += frame(layers);
+    }
+    nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    gSink = sum;
+    printf("%-36s %6.2f ns/layer\n", name,
+            double(elapsed) / (double(FRAMES) * LAYERS));
+}
+
+template <typename T>
+static void makeLayers(sp<T>* layers) {
+    for (size_t i = 0; i < LAYERS; i++) {
+        layers[i] = new T;
+        layers[i]->z = int32_t(i);
+    }
+}
+
+template <typename T>
+static void runAll(const char* type, const sp<T>* layers) {
+    char name[64];
+
+    snprintf(name, sizeof(name), "%s, copy", type);
+    run(name, copyFrame<T>, layers);
+    snprintf(name, sizeof(name), "%s, compare", type);
+    run(name, compareFrame<T>, layers);
+}
+
+// Owns the layers from another thread for as long as the benchmark runs.
+static Mutex gOwnerLock;
+static Condition gOwnerCond;
+static sp<BiasedLayer> gForeignLayers[LAYERS];
+static bool gLayersReady;
+static bool gBenchmarkDone;
+
+static void* ownerThread(void*) {
+    Mutex::Autolock _l(gOwnerLock);
+    makeLayers(gForeignLayers);
+    gLayersReady = true;
+    gOwnerCond.broadcast();
+    while (!gBenchmarkDone) {
+        gOwnerCond.wait(gOwnerLock);
+    }
+    for (size_t i = 0; i < LAYERS; i++) {
+        gForeignLayers[i].clear();
+    }
+    return NULL;
+}
+
+int main(int, char**) {
+    printf("%d layers, %d frames\n", LAYERS, FRAMES);
+
+    sp<Layer> layers[LAYERS];
+    makeLayers(layers);
+    runAll("RefBase", layers);
+    run("RefBase, borrowed_sp", borrowedFrame<Layer>, layers);
+
+    sp<LightLayer> lightLayers[LAYERS];
+    makeLayers(lightLayers);
+    runAll("LightRefBase", lightLayers);
+
+    sp<BiasedLayer> biasedLayers[LAYERS];
+    makeLayers(biasedLayers);
+    runAll("BiasedRefBase", biasedLayers);
+
+    // references taken from here are counted in the shared, atomic count
+    pthread_t owner;
+    pthread_create(&owner, NULL, ownerThread, NULL);
+    {
+        Mutex::Autolock _l(gOwnerLock);
+        while (!gLayersReady) {
+            gOwnerCond.wait(gOwnerLock);
+        }
+    }
+    sp<BiasedLayer> foreignLayers[LAYERS];
+    for (size_t i = 0; i < LAYERS; i++) {
+        foreignLayers[i] = gForeignLayers[i];
+    }
+    runAll("BiasedRefBase, other owner", foreignLayers);
+    for (size_t i = 0; i < LAYERS; i++) {
+        foreignLayers[i].clear();
+    }
+    {
+        Mutex::Autolock _l(gOwnerLock);
+        gBenchmarkDone = true;
+        gOwnerCond.broadcast();
+    }
+    pthread_join(owner, NULL);
+    return 0;
+}
@@ -0,0 +1,36 @@
+# Copyright 2014 The Android Open Source Project
+
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libalsautils
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SRC_FILES := \
+	spsc_ring.c \
+	mmap_stream.c \
+	format_convert.c \
+	offload_buffers.c \
+	listen_session.c
+
+LOCAL_C_INCLUDES += \
+	$(LOCAL_PATH)/include \
+	external/tinyalsa/include
+
+ifeq ($(BOARD_USES_ALSA_AUDIO),true)
+ifeq ($(call is-chipset-in-board-platform,msm8960),true)
+LOCAL_CFLAGS += -DQCOM_DIRECTTRACK
+endif
+endif
+
+LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)/include
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libtinyalsa
+
+include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -0,0 +1,938 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "format_convert"
+/*#define LOG_NDEBUG 0*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <cutils/log.h>
+
+#include <alsa_utils/format_convert.h>
+
+/* frames per pass through the float scratch buffers */
+#define CHUNK_FRAMES 256
+
+#define Q15_SCALE   (1.0f / 32768.0f)
+#define Q23_SCALE   (1.0f / 8388608.0f)
+#define Q31_SCALE   (1.0f / 2147483648.0f)
+
+#define M_SQRT1_2_F 0.70710678f
+
+struct format_converter {
+    enum sample_format src_format;
+    enum sample_format dst_format;
+    unsigned int src_channels;
+    unsigned int dst_channels;
+    size_t src_frame_size;
+    size_t dst_frame_size;
+    int identity_mix;
+    int dither;
+    uint32_t seed;
+    float matrix[FORMAT_CONVERT_MAX_CHANNELS][FORMAT_CONVERT_MAX_CHANNELS];
+    float in[CHUNK_FRAMES * FORMAT_CONVERT_MAX_CHANNELS];
+    float out[CHUNK_FRAMES * FORMAT_CONVERT_MAX_CHANNELS];
+};
+
+enum sample_format sample_format_from_audio_format(audio_format_t format)
+{
+    switch (format) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+        return SAMPLE_FORMAT_S16;
+    case AUDIO_FORMAT_PCM_8_24_BIT:
+        return SAMPLE_FORMAT_Q8_23;
+    case AUDIO_FORMAT_PCM_32_BIT:
+        return SAMPLE_FORMAT_S32;
+    case AUDIO_FORMAT_PCM_8_BIT:
+        return SAMPLE_FORMAT_U8;
+    default:
+        return SAMPLE_FORMAT_INVALID;
+    }
+}
+
+enum sample_format sample_format_from_pcm_format(enum pcm_format format)
+{
+    switch (format) {
+    case PCM_FORMAT_S16_LE:
+        return SAMPLE_FORMAT_S16;
+    case PCM_FORMAT_S24_LE:
+        return SAMPLE_FORMAT_Q8_23;
+    case PCM_FORMAT_S32_LE:
+        return SAMPLE_FORMAT_S32;
+    case PCM_FORMAT_S8:
+        return SAMPLE_FORMAT_S8;
+    default:
+        return SAMPLE_FORMAT_INVALID;
+    }
+}
+
+size_t sample_format_bytes(enum sample_format format)
+{
+    switch (format) {
+    case SAMPLE_FORMAT_S16:
+        return sizeof(int16_t);
+    case SAMPLE_FORMAT_Q8_23:
+    case SAMPLE_FORMAT_S32:
+        return sizeof(int32_t);
+    case SAMPLE_FORMAT_FLOAT:
+        return sizeof(float);
+    case SAMPLE_FORMAT_S8:
+    case SAMPLE_FORMAT_U8:
+        return sizeof(uint8_t);
+    default:
+        return 0;
+    }
+}
+
+static inline int16_t clamp16(int32_t sample)
+{
+    if ((sample >> 15) ^ (sample >> 31))
+        sample = 0x7fff ^ (sample >> 31);
+    return sample;
+}
+
+static inline int32_t float_to_q(float f, float scale, int32_t max)
+{
+    float v = f * scale;
+
+    if (v >= (float)max)
+        return max;
+    if (v <= -(float)max - 1.0f)
+        return -max - 1;
+    return (int32_t)(v + (v >= 0.0f ? 0.5f : -0.5f));
+}
+
+/*
+ * v + copysign(0.5, v).  Followed by a truncating convert, this rounds half
+ * away from zero like float_to_q(), so the vector kernels give the same
+ * output as the scalar ones bit for bit.
+ */
+#if defined(__ARM_NEON__)
+static inline float32x4_t add_half_away(float32x4_t v)
+{
+    const uint32x4_t sign = vdupq_n_u32(0x80000000);
+    const uint32x4_t half = vreinterpretq_u32_f32(vdupq_n_f32(0.5f));
+
+    return vaddq_f32(v, vreinterpretq_f32_u32(
+            vorrq_u32(half, vandq_u32(vreinterpretq_u32_f32(v), sign))));
+}
+#elif defined(__SSE2__)
+static inline __m128 add_half_away(__m128 v)
+{
+    return _mm_add_ps(v, _mm_or_ps(_mm_set1_ps(0.5f),
+                                   _mm_and_ps(v, _mm_set1_ps(-0.0f))));
+}
+#endif
+
+/*
+ * Integer kernels.  Narrowing rounds to nearest and saturates; every kernel
+ * walks forwards so that narrowing in place is safe.
+ */
+
+static void s16_to_s32(int32_t *dst, const int16_t *src, size_t n, int shift)
+{
+    size_t i = 0;
+
+#if defined(__ARM_NEON__)
+    if (shift == 16) {
+        for (; i + 8 <= n; i += 8) {
+            int16x8_t v = vld1q_s16(src + i);
+            vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(v), 16));
+            vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(v), 16));
+        }
+    } else {
+        for (; i + 8 <= n; i += 8) {
+            int16x8_t v = vld1q_s16(src + i);
+            vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(v), 8));
+            vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(v), 8));
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i count = _mm_cvtsi32_si128(16 - shift);
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_sra_epi32(_mm_unpacklo_epi16(zero, v), count);
+        __m128i hi = _mm_sra_epi32(_mm_unpackhi_epi16(zero, v), count);
+        _mm_storeu_si128((__m128i *)(dst + i), lo);
+        _mm_storeu_si128((__m128i *)(dst + i + 4), hi);
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = (int32_t)src[i] << shift;
+}
+
+static void s32_to_s16(int16_t *dst, const int32_t *src, size_t n, int shift)
+{
+    size_t i = 0;
+
+#if defined(__ARM_NEON__)
+    if (shift == 16) {
+        for (; i + 8 <= n; i += 8) {
+            int16x4_t lo = vqrshrn_n_s32(vld1q_s32(src + i), 16);
+            int16x4_t hi = vqrshrn_n_s32(vld1q_s32(src + i + 4), 16);
+            vst1q_s16(dst + i, vcombine_s16(lo, hi));
+        }
+    } else {
+        for (; i + 8 <= n; i += 8) {
+            int16x4_t lo = vqrshrn_n_s32(vld1q_s32(src + i), 8);
+            int16x4_t hi = vqrshrn_n_s32(vld1q_s32(src + i + 4), 8);
+            vst1q_s16(dst + i, vcombine_s16(lo, hi));
+        }
+    }
+#elif defined(__SSE2__)
+    /* shift by one less, add the rounding bit, then finish the shift */
+    const __m128i count = _mm_cvtsi32_si128(shift - 1);
+    const __m128i one = _mm_set1_epi32(1);
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(src + i + 4));
+        lo = _mm_srai_epi32(_mm_add_epi32(_mm_sra_epi32(lo, count), one), 1);
+        hi = _mm_srai_epi32(_mm_add_epi32(_mm_sra_epi32(hi, count), one), 1);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = clamp16(((src[i] >> (shift - 1)) + 1) >> 1);
+}
+
+/* Q8.23 <-> Q0.31 */
+static void q8_23_to_s32(int32_t *dst, const int32_t *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        int32_t s = src[i];
+        if (s > 0x7fffff)
+            s = 0x7fffff;
+        else if (s < -0x800000)
+            s = -0x800000;
+        dst[i] = s << 8;
+    }
+}
+
+static void s32_to_q8_23(int32_t *dst, const int32_t *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        int32_t s = src[i] >> 7;
+        dst[i] = (s >> 1) + ((s & 1) && s < 0x00ffffff);
+    }
+}
+
+/* Integer to float kernels. */
+
+static void s16_to_float(float *dst, const int16_t *src, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__ARM_NEON__)
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(src + i);
+        vst1q_f32(dst + i, vcvtq_n_f32_s32(vmovl_s16(vget_low_s16(v)), 15));
+        vst1q_f32(dst + i + 4, vcvtq_n_f32_s32(vmovl_s16(vget_high_s16(v)), 15));
+    }
+#elif defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(Q31_SCALE);
+
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128 lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(zero, v));
+        __m128 hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(zero, v));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(lo, scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(hi, scale));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = src[i] * Q15_SCALE;
+}
+
+static void s32_to_float(float *dst, const int32_t *src, size_t n, int frac_bits)
+{
+    size_t i = 0;
+    const float scale = frac_bits == 31 ? Q31_SCALE : Q23_SCALE;
+
+#if defined(__ARM_NEON__)
+    const float32x4_t vscale = vdupq_n_f32(scale);
+
+    for (; i + 4 <= n; i += 4)
+        vst1q_f32(dst + i, vmulq_f32(vcvtq_f32_s32(vld1q_s32(src + i)), vscale));
+#elif defined(__SSE2__)
+    const __m128 vscale = _mm_set1_ps(scale);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), vscale));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = src[i] * scale;
+}
+
+static void u8_to_float(float *dst, const uint8_t *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = ((int)src[i] - 0x80) * (1.0f / 128.0f);
+}
+
+static void s8_to_float(float *dst, const int8_t *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = src[i] * (1.0f / 128.0f);
+}
+
+/* Float to integer kernels.  Input outside [-1.0, 1.0) saturates. */
+
+static void float_to_s16(int16_t *dst, const float *src, size_t n)
+{
+    size_t i = 0;
+
+#if defined(__ARM_NEON__)
+    const float32x4_t scale = vdupq_n_f32(32768.0f);
+
+    /* the convert truncates and saturates, the narrowing saturates */
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t lo = add_half_away(vmulq_f32(vld1q_f32(src + i), scale));
+        float32x4_t hi = add_half_away(vmulq_f32(vld1q_f32(src + i + 4), scale));
+        vst1q_s16(dst + i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(lo)),
+                                        vqmovn_s32(vcvtq_s32_f32(hi))));
+    }
+#elif defined(__SSE2__)
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 max = _mm_set1_ps(32768.0f);
+    const __m128 min = _mm_set1_ps(-32769.0f);
+
+    for (; i + 8 <= n; i += 8) {
+        __m128 lo = add_half_away(_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+        __m128 hi = add_half_away(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale));
+        /* clamp first: cvttps returns INT_MIN for anything out of range */
+        lo = _mm_min_ps(_mm_max_ps(lo, min), max);
+        hi = _mm_min_ps(_mm_max_ps(hi, min), max);
+        _mm_storeu_si128((__m128i *)(dst + i),
+                         _mm_packs_epi32(_mm_cvttps_epi32(lo), _mm_cvttps_epi32(hi)));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = float_to_q(src[i], 32768.0f, 0x7fff);
+}
+
+static void float_to_s32(int32_t *dst, const float *src, size_t n, int frac_bits)
+{
+    size_t i = 0;
+
+    if (frac_bits == 31) {
+#if defined(__ARM_NEON__)
+        const float32x4_t scale = vdupq_n_f32(2147483648.0f);
+
+        /* the convert saturates */
+        for (; i + 4 <= n; i += 4) {
+            float32x4_t v = vmulq_f32(vld1q_f32(src + i), scale);
+            vst1q_s32(dst + i, vcvtq_s32_f32(add_half_away(v)));
+        }
+#elif defined(__SSE2__)
+        const __m128 scale = _mm_set1_ps(2147483648.0f);
+        const __m128i max = _mm_set1_epi32(0x7fffffff);
+
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+            /* out of range converts to INT_MIN, which is only right for
+             * negative input */
+            __m128i over = _mm_castps_si128(_mm_cmpge_ps(v, scale));
+            __m128i q = _mm_cvttps_epi32(add_half_away(v));
+            q = _mm_or_si128(_mm_andnot_si128(over, q), _mm_and_si128(over, max));
+            _mm_storeu_si128((__m128i *)(dst + i), q);
+        }
+#endif
+        for (; i < n; i++) {
+            float v = src[i] * 2147483648.0f;
+            if (v >= 2147483648.0f)
+                dst[i] = 0x7fffffff;
+            else if (v <= -2147483648.0f)
+                dst[i] = (int32_t)0x80000000;
+            else
+                dst[i] = (int32_t)(v + (v >= 0.0f ? 0.5f : -0.5f));
+        }
+        return;
+    }
+
+#if defined(__ARM_NEON__)
+    {
+        const float32x4_t scale = vdupq_n_f32(8388608.0f);
+        const int32x4_t max = vdupq_n_s32(0x7fffff);
+        const int32x4_t min = vdupq_n_s32(-0x800000);
+
+        for (; i + 4 <= n; i += 4) {
+            float32x4_t f = add_half_away(vmulq_f32(vld1q_f32(src + i), scale));
+            int32x4_t v = vcvtq_s32_f32(f);
+            vst1q_s32(dst + i, vmaxq_s32(vminq_s32(v, max), min));
+        }
+    }
+#elif defined(__SSE2__)
+    {
+        const __m128 scale = _mm_set1_ps(8388608.0f);
+        const __m128 max = _mm_set1_ps(8388607.0f);
+        const __m128 min = _mm_set1_ps(-8388608.0f);
+
+        for (; i + 4 <= n; i += 4) {
+            __m128 v = add_half_away(_mm_mul_ps(_mm_loadu_ps(src + i), scale));
+            v = _mm_min_ps(_mm_max_ps(v, min), max);
+            _mm_storeu_si128((__m128i *)(dst + i), _mm_cvttps_epi32(v));
+        }
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = float_to_q(src[i], 8388608.0f, 0x7fffff);
+}
+
+static void float_to_s8(int8_t *dst, const float *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = float_to_q(src[i], 128.0f, 0x7f);
+}
+
+static void float_to_u8(uint8_t *dst, const float *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        dst[i] = float_to_q(src[i], 128.0f, 0x7f) + 0x80;
+}
+
+static void to_float(float *dst, const void *src, enum sample_format format,
+                     size_t n)
+{
+    switch (format) {
+    case SAMPLE_FORMAT_S16:
+        s16_to_float(dst, src, n);
+        break;
+    case SAMPLE_FORMAT_Q8_23:
+        s32_to_float(dst, src, n, 23);
+        break;
+    case SAMPLE_FORMAT_S32:
+        s32_to_float(dst, src, n, 31);
+        break;
+    case SAMPLE_FORMAT_FLOAT:
+        if (dst != src)
+            memcpy(dst, src, n * sizeof(float));
+        break;
+    case SAMPLE_FORMAT_S8:
+        s8_to_float(dst, src, n);
+        break;
+    case SAMPLE_FORMAT_U8:
+        u8_to_float(dst, src, n);
+        break;
+    default:
+        break;
+    }
+}
+
+static void from_float(void *dst, enum sample_format format, const float *src,
+                       size_t n)
+{
+    switch (format) {
+    case SAMPLE_FORMAT_S16:
+        float_to_s16(dst, src, n);
+        break;
+    case SAMPLE_FORMAT_Q8_23:
+        float_to_s32(dst, src, n, 23);
+        break;
+    case SAMPLE_FORMAT_S32:
+        float_to_s32(dst, src, n, 31);
+        break;
+    case SAMPLE_FORMAT_FLOAT:
+        if (dst != src)
+            memmove(dst, src, n * sizeof(float));
+        break;
+    case SAMPLE_FORMAT_S8:
+        float_to_s8(dst, src, n);
+        break;
+    case SAMPLE_FORMAT_U8:
+        float_to_u8(dst, src, n);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Direct integer conversions that skip the float intermediate.  Returns 0 if
+ * the pair has no direct kernel.
+ */
+static int convert_direct(void *dst, enum sample_format dst_format,
+                          const void *src, enum sample_format src_format,
+                          size_t n)
+{
+    if (dst_format == src_format) {
+        if (dst != src)
+            memmove(dst, src, n * sample_format_bytes(dst_format));
+        return 1;
+    }
+
+    switch (src_format) {
+    case SAMPLE_FORMAT_S16:
+        if (dst_format == SAMPLE_FORMAT_S32)
+            s16_to_s32(dst, src, n, 16);
+        else if (dst_format == SAMPLE_FORMAT_Q8_23)
+            s16_to_s32(dst, src, n, 8);
+        else
+            return 0;
+        return 1;
+    case SAMPLE_FORMAT_S32:
+        if (dst_format == SAMPLE_FORMAT_S16)
+            s32_to_s16(dst, src, n, 16);
+        else if (dst_format == SAMPLE_FORMAT_Q8_23)
+            s32_to_q8_23(dst, src, n);
+        else
+            return 0;
+        return 1;
+    case SAMPLE_FORMAT_Q8_23:
+        if (dst_format == SAMPLE_FORMAT_S16)
+            s32_to_s16(dst, src, n, 8);
+        else if (dst_format == SAMPLE_FORMAT_S32)
+            q8_23_to_s32(dst, src, n);
+        else
+            return 0;
+        return 1;
+    case SAMPLE_FORMAT_FLOAT:
+        from_float(dst, dst_format, src, n);
+        return 1;
+    default:
+        if (dst_format == SAMPLE_FORMAT_FLOAT) {
+            to_float(dst, src, src_format, n);
+            return 1;
+        }
+        return 0;
+    }
+}
+
+void format_convert_samples(void *dst, enum sample_format dst_format,
+                            const void *src, enum sample_format src_format,
+                            size_t samples)
+{
+    float scratch[CHUNK_FRAMES];
+    size_t src_size = sample_format_bytes(src_format);
+    size_t dst_size = sample_format_bytes(dst_format);
+
+    if (src_size == 0 || dst_size == 0)
+        return;
+    if (convert_direct(dst, dst_format, src, src_format, samples))
+        return;
+
+    while (samples) {
+        size_t n = samples < CHUNK_FRAMES ? samples : CHUNK_FRAMES;
+
+        to_float(scratch, src, src_format, n);
+        from_float(dst, dst_format, scratch, n);
+        src = (const uint8_t *)src + n * src_size;
+        dst = (uint8_t *)dst + n * dst_size;
+        samples -= n;
+    }
+}
+
+/* Channel mixing. */
+
+static audio_channel_mask_t positional_mask(audio_channel_mask_t mask)
+{
+    if (!audio_is_input_channel(mask))
+        return mask;
+    switch (popcount(mask)) {
+    case 1:
+        return AUDIO_CHANNEL_OUT_MONO;
+    case 2:
+        return AUDIO_CHANNEL_OUT_STEREO;
+    default:
+        return 0;
+    }
+}
+
+static int channel_index(audio_channel_mask_t mask, uint32_t bit)
+{
+    if (!(mask & bit))
+        return -1;
+    return popcount(mask & (bit - 1));
+}
+
+/* Add gain * src channel to the first target present in dst. */
+static int route(struct format_converter *conv, audio_channel_mask_t dst_mask,
+                 int src, const uint32_t *targets, size_t count, float gain)
+{
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        int dst = channel_index(dst_mask, targets[i]);
+        if (dst >= 0) {
+            conv->matrix[dst][src] += gain;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void fold_channel(struct format_converter *conv,
+                         audio_channel_mask_t dst_mask, int src, uint32_t bit)
+{
+    static const uint32_t left[] = {
+        AUDIO_CHANNEL_OUT_FRONT_LEFT, AUDIO_CHANNEL_OUT_FRONT_CENTER,
+    };
+    static const uint32_t right[] = {
+        AUDIO_CHANNEL_OUT_FRONT_RIGHT, AUDIO_CHANNEL_OUT_FRONT_LEFT,
+        AUDIO_CHANNEL_OUT_FRONT_CENTER,
+    };
+    static const uint32_t back_left[] = {
+        AUDIO_CHANNEL_OUT_SIDE_LEFT, AUDIO_CHANNEL_OUT_BACK_LEFT,
+    };
+    static const uint32_t back_right[] = {
+        AUDIO_CHANNEL_OUT_SIDE_RIGHT, AUDIO_CHANNEL_OUT_BACK_RIGHT,
+    };
+    static const uint32_t back_center[] = {
+        AUDIO_CHANNEL_OUT_BACK_CENTER,
+    };
+    static const uint32_t center[] = {
+        AUDIO_CHANNEL_OUT_FRONT_CENTER,
+    };
+
+    switch (bit) {
+    case AUDIO_CHANNEL_OUT_LOW_FREQUENCY:
+        break;
+    case AUDIO_CHANNEL_OUT_FRONT_CENTER:
+    case AUDIO_CHANNEL_OUT_TOP_CENTER:
+    case AUDIO_CHANNEL_OUT_TOP_FRONT_CENTER:
+        if (route(conv, dst_mask, src, center, 1, 1.0f))
+            break;
+        route(conv, dst_mask, src, left, 1, M_SQRT1_2_F);
+        route(conv, dst_mask, src, right, 1, M_SQRT1_2_F);
+        break;
+    case AUDIO_CHANNEL_OUT_BACK_CENTER:
+    case AUDIO_CHANNEL_OUT_TOP_BACK_CENTER:
+        if (route(conv, dst_mask, src, back_center, 1, 1.0f))
+            break;
+        if (route(conv, dst_mask, src, back_left, 2, M_SQRT1_2_F)) {
+            route(conv, dst_mask, src, back_right, 2, M_SQRT1_2_F);
+            break;
+        }
+        route(conv, dst_mask, src, left, 1, 0.5f);
+        route(conv, dst_mask, src, right, 1, 0.5f);
+        break;
+    case AUDIO_CHANNEL_OUT_BACK_LEFT:
+    case AUDIO_CHANNEL_OUT_SIDE_LEFT:
+    case AUDIO_CHANNEL_OUT_TOP_BACK_LEFT:
+        if (!route(conv, dst_mask, src, back_left, 2, 1.0f))
+            route(conv, dst_mask, src, left, 2, M_SQRT1_2_F);
+        break;
+    case AUDIO_CHANNEL_OUT_BACK_RIGHT:
+    case AUDIO_CHANNEL_OUT_SIDE_RIGHT:
+    case AUDIO_CHANNEL_OUT_TOP_BACK_RIGHT:
+        if (!route(conv, dst_mask, src, back_right, 2, 1.0f))
+            route(conv, dst_mask, src, right, 3, M_SQRT1_2_F);
+        break;
+    case AUDIO_CHANNEL_OUT_FRONT_RIGHT:
+    case AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER:
+    case AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT:
+        route(conv, dst_mask, src, right, 3, 1.0f);
+        break;
+    default:
+        route(conv, dst_mask, src, left, 2, 1.0f);
+        break;
+    }
+}
+
+static void build_matrix(struct format_converter *conv,
+                         audio_channel_mask_t src_mask,
+                         audio_channel_mask_t dst_mask)
+{
+    uint32_t bits = src_mask;
+    unsigned int i, j;
+    int src = 0;
+
+    if (src_mask == dst_mask) {
+        conv->identity_mix = 1;
+        return;
+    }
+
+    while (bits) {
+        uint32_t bit = bits & -bits;
+        int dst = channel_index(dst_mask, bit);
+
+        if (dst >= 0)
+            conv->matrix[dst][src] = 1.0f;
+        else
+            fold_channel(conv, dst_mask, src, bit);
+        bits &= ~bit;
+        src++;
+    }
+
+    /* a mono source plays on both front speakers */
+    if (src_mask == AUDIO_CHANNEL_OUT_MONO) {
+        int right = channel_index(dst_mask, AUDIO_CHANNEL_OUT_FRONT_RIGHT);
+        if (right >= 0)
+            conv->matrix[right][0] = 1.0f;
+    }
+
+    for (i = 0; i < conv->dst_channels; i++) {
+        float sum = 0.0f;
+
+        for (j = 0; j < conv->src_channels; j++)
+            sum += conv->matrix[i][j];
+        if (sum > 1.0f) {
+            for (j = 0; j < conv->src_channels; j++)
+                conv->matrix[i][j] /= sum;
+        }
+    }
+}
+
+static void mix_stereo_to_mono(float *dst, const float *src, size_t frames,
+                               float gl, float gr)
+{
+    size_t i = 0;
+
+#if defined(__ARM_NEON__)
+    const float32x4_t vl = vdupq_n_f32(gl);
+    const float32x4_t vr = vdupq_n_f32(gr);
+
+    for (; i + 4 <= frames; i += 4) {
+        float32x4x2_t v = vld2q_f32(src + 2 * i);
+        vst1q_f32(dst + i, vmlaq_f32(vmulq_f32(v.val[0], vl), v.val[1], vr));
+    }
+#elif defined(__SSE2__)
+    const __m128 vl = _mm_set1_ps(gl);
+    const __m128 vr = _mm_set1_ps(gr);
+
+    for (; i + 4 <= frames; i += 4) {
+        __m128 a = _mm_loadu_ps(src + 2 * i);
+        __m128 b = _mm_loadu_ps(src + 2 * i + 4);
+        __m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_mul_ps(l, vl), _mm_mul_ps(r, vr)));
+    }
+#endif
+    for (; i < frames; i++)
+        dst[i] = src[2 * i] * gl + src[2 * i + 1] * gr;
+}
+
+static void mix_mono_to_stereo(float *dst, const float *src, size_t frames,
+                               float gl, float gr)
+{
+    size_t i = 0;
+
+#if defined(__ARM_NEON__)
+    const float32x4_t vl = vdupq_n_f32(gl);
+    const float32x4_t vr = vdupq_n_f32(gr);
+
+    for (; i + 4 <= frames; i += 4) {
+        float32x4_t v = vld1q_f32(src + i);
+        float32x4x2_t out;
+        out.val[0] = vmulq_f32(v, vl);
+        out.val[1] = vmulq_f32(v, vr);
+        vst2q_f32(dst + 2 * i, out);
+    }
+#elif defined(__SSE2__)
+    const __m128 vl = _mm_set1_ps(gl);
+    const __m128 vr = _mm_set1_ps(gr);
+
+    for (; i + 4 <= frames; i += 4) {
+        __m128 v = _mm_loadu_ps(src + i);
+        __m128 l = _mm_mul_ps(v, vl);
+        __m128 r = _mm_mul_ps(v, vr);
+        _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(l, r));
+    }
+#endif
+    for (; i < frames; i++) {
+        dst[2 * i] = src[i] * gl;
+        dst[2 * i + 1] = src[i] * gr;
+    }
+}
+
+static void mix(const struct format_converter *conv, float *dst,
+                const float *src, size_t frames)
+{
+    unsigned int in = conv->src_channels;
+    unsigned int out = conv->dst_channels;
+    size_t f;
+    unsigned int i, j;
+
+    if (in == 2 && out == 1) {
+        mix_stereo_to_mono(dst, src, frames, conv->matrix[0][0],
+                           conv->matrix[0][1]);
+        return;
+    }
+    if (in == 1 && out == 2) {
+        mix_mono_to_stereo(dst, src, frames, conv->matrix[0][0],
+                           conv->matrix[1][0]);
+        return;
+    }
+
+    for (f = 0; f < frames; f++) {
+        for (i = 0; i < out; i++) {
+            const float *row = conv->matrix[i];
+            float acc = 0.0f;
+
+            for (j = 0; j < in; j++)
+                acc += row[j] * src[j];
+            dst[i] = acc;
+        }
+        src += in;
+        dst += out;
+    }
+}
+
+/* Dither. */
+
+static inline uint32_t next_random(uint32_t *seed)
+{
+    /* xorshift32 */
+    uint32_t x = *seed;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return x;
+}
+
+static void add_tpdf_dither(struct format_converter *conv, float *samples,
+                            size_t n)
+{
+    /* one LSB of the destination format, split across the two uniform draws */
+    const float lsb = conv->dst_format == SAMPLE_FORMAT_S16 ?
+            Q15_SCALE : 1.0f / 128.0f;
+    const float scale = lsb / 4294967296.0f;
+    uint32_t seed = conv->seed;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        /* the difference of two uniform variables is triangular in [-1, 1] */
+        float a = (float)next_random(&seed);
+        float b = (float)next_random(&seed);
+        samples[i] += (a - b) * scale;
+    }
+    conv->seed = seed;
+}
+
+/* Converter. */
+
+static int narrows_to_dither(enum sample_format dst, enum sample_format src)
+{
+    if (dst != SAMPLE_FORMAT_S16 && dst != SAMPLE_FORMAT_S8 &&
+            dst != SAMPLE_FORMAT_U8)
+        return 0;
+    return sample_format_bytes(src) > sample_format_bytes(dst) ||
+           src == SAMPLE_FORMAT_FLOAT;
+}
+
+struct format_converter *format_converter_create(
+        const struct format_converter_config *config)
+{
+    struct format_converter *conv;
+    audio_channel_mask_t src_mask = positional_mask(config->src_channel_mask);
+    audio_channel_mask_t dst_mask = positional_mask(config->dst_channel_mask);
+    unsigned int src_channels = popcount(src_mask);
+    unsigned int dst_channels = popcount(dst_mask);
+
+    if (sample_format_bytes(config->src_format) == 0 ||
+            sample_format_bytes(config->dst_format) == 0) {
+        ALOGE("invalid format %d -> %d", config->src_format, config->dst_format);
+        return NULL;
+    }
+    if (src_channels == 0 || src_channels > FORMAT_CONVERT_MAX_CHANNELS ||
+            dst_channels == 0 || dst_channels > FORMAT_CONVERT_MAX_CHANNELS) {
+        ALOGE("unsupported channel masks %#x -> %#x",
+              config->src_channel_mask, config->dst_channel_mask);
+        return NULL;
+    }
+
+    conv = calloc(1, sizeof(*conv));
+    if (!conv)
+        return NULL;
+
+    conv->src_format = config->src_format;
+    conv->dst_format = config->dst_format;
+    conv->src_channels = src_channels;
+    conv->dst_channels = dst_channels;
+    conv->src_frame_size = src_channels * sample_format_bytes(conv->src_format);
+    conv->dst_frame_size = dst_channels * sample_format_bytes(conv->dst_format);
+    conv->dither = config->dither == FORMAT_DITHER_TPDF &&
+                   narrows_to_dither(conv->dst_format, conv->src_format);
+    conv->seed = 0x12345678;
+    build_matrix(conv, src_mask, dst_mask);
+
+    ALOGV("converter %d/%#x -> %d/%#x%s%s", conv->src_format, src_mask,
+          conv->dst_format, dst_mask, conv->identity_mix ? "" : " mix",
+          conv->dither ? " dither" : "");
+    return conv;
+}
+
+void format_converter_destroy(struct format_converter *converter)
+{
+    free(converter);
+}
+
+void format_converter_process(struct format_converter *conv, void *dst,
+                              const void *src, size_t frames)
+{
+    const uint8_t *in = src;
+    uint8_t *out = dst;
+
+    if (conv->identity_mix && !conv->dither &&
+            convert_direct(dst, conv->dst_format, src, conv->src_format,
+                           frames * conv->src_channels))
+        return;
+
+    while (frames) {
+        size_t n = frames < CHUNK_FRAMES ? frames : CHUNK_FRAMES;
+        float *mixed = conv->in;
+
+        to_float(conv->in, in, conv->src_format, n * conv->src_channels);
+        if (!conv->identity_mix) {
+            mix(conv, conv->out, conv->in, n);
+            mixed = conv->out;
+        }
+        if (conv->dither)
+            add_tpdf_dither(conv, mixed, n * conv->dst_channels);
+        from_float(out, conv->dst_format, mixed, n * conv->dst_channels);
+
+        in += n * conv->src_frame_size;
+        out += n * conv->dst_frame_size;
+        frames -= n;
+    }
+}
+
+size_t format_converter_src_frame_size(const struct format_converter *converter)
+{
+    return converter->src_frame_size;
+}
+
+size_t format_converter_dst_frame_size(const struct format_converter *converter)
+{
+    return converter->dst_frame_size;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ALSA_UTILS_FORMAT_CONVERT_H
+#define ANDROID_ALSA_UTILS_FORMAT_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+#include <system/audio.h>
+#include <tinyalsa/asoundlib.h>
+
+__BEGIN_DECLS
+
+/*
+ * Sample format conversion and channel mixing between the framework's
+ * audio_format_t / audio_channel_mask_t and what a tinyalsa PCM accepts.
+ * The common pairs have NEON and SSE2 kernels; everything else goes through
+ * a float intermediate with a scalar fallback.
+ */
+
+/*
+ * In-memory sample layouts.  audio_format_t has no float PCM in this tree, so
+ * the converter uses its own enum and maps both audio_format_t and
+ * pcm_format onto it.
+ */
+enum sample_format {
+    SAMPLE_FORMAT_INVALID = -1,
+    SAMPLE_FORMAT_S16,      /* int16_t: AUDIO_FORMAT_PCM_16_BIT, PCM_FORMAT_S16_LE */
+    SAMPLE_FORMAT_Q8_23,    /* int32_t holding 24 bits: AUDIO_FORMAT_PCM_8_24_BIT,
+                               PCM_FORMAT_S24_LE */
+    SAMPLE_FORMAT_S32,      /* int32_t: AUDIO_FORMAT_PCM_32_BIT, PCM_FORMAT_S32_LE */
+    SAMPLE_FORMAT_FLOAT,    /* float in [-1.0, 1.0) */
+    SAMPLE_FORMAT_S8,       /* int8_t: PCM_FORMAT_S8 */
+    SAMPLE_FORMAT_U8,       /* uint8_t offset binary: AUDIO_FORMAT_PCM_8_BIT */
+    SAMPLE_FORMAT_CNT,
+};
+
+enum format_dither {
+    FORMAT_DITHER_NONE,
+    /* triangular noise of +/-1 LSB, added when narrowing to 8 or 16 bits */
+    FORMAT_DITHER_TPDF,
+};
+
+/* SAMPLE_FORMAT_INVALID if the format is not linear PCM. */
+enum sample_format sample_format_from_audio_format(audio_format_t format);
+enum sample_format sample_format_from_pcm_format(enum pcm_format format);
+
+/* Bytes per sample, 0 for SAMPLE_FORMAT_INVALID. */
+size_t sample_format_bytes(enum sample_format format);
+
+/*
+ * Convert samples without mixing or dither.  dst may equal src when the
+ * destination sample is no larger than the source sample.
+ */
+void format_convert_samples(void *dst, enum sample_format dst_format,
+                            const void *src, enum sample_format src_format,
+                            size_t samples);
+
+struct format_converter;
+
+struct format_converter_config {
+    enum sample_format src_format;
+    enum sample_format dst_format;
+    /* input masks are treated as mono or stereo by channel count */
+    audio_channel_mask_t src_channel_mask;
+    audio_channel_mask_t dst_channel_mask;
+    enum format_dither dither;
+};
+
+/*
+ * Returns NULL if a format is invalid or a mask has no channels or more than
+ * FORMAT_CONVERT_MAX_CHANNELS channels.
+ *
+ * Channels present on both sides are copied.  A missing front centre is
+ * split between left and right, missing back/side channels fold into the
+ * matching side or front channel, LFE is dropped and a mono source feeds
+ * both front channels.  Each output row is normalized so that a full-scale
+ * input cannot clip.
+ */
+#define FORMAT_CONVERT_MAX_CHANNELS 8
+struct format_converter *format_converter_create(
+        const struct format_converter_config *config);
+
+void format_converter_destroy(struct format_converter *converter);
+
+/*
+ * Convert frames frames.  dst may equal src when the destination frame is no
+ * larger than the source frame.  Not thread safe; use one converter per
+ * stream.
+ */
+void format_converter_process(struct format_converter *converter, void *dst,
+                              const void *src, size_t frames);
+
+size_t format_converter_src_frame_size(const struct format_converter *converter);
+size_t format_converter_dst_frame_size(const struct format_converter *converter);
+
+__END_DECLS
+
+#endif // ANDROID_ALSA_UTILS_FORMAT_CONVERT_H
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ALSA_UTILS_LISTEN_SESSION_H
+#define ANDROID_ALSA_UTILS_LISTEN_SESSION_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <tinyalsa/asoundlib.h>
+#include <alsa_utils/spsc_ring.h>
+
+__BEGIN_DECLS
+
+/*
+ * Always-on capture for voice wakeup, backing the open_listen_session,
+ * close_listen_session, set_mad_observer and listen_set_parameters hooks.
+ *
+ * A single capture thread reads one PCM period per wakeup, so the period size
+ * sets the duty cycle.  Each period lands directly in a ring that keeps the
+ * last preroll_ms of audio.  A keyword is either found by the software
+ * detector on each period, or reported by the DSP through
+ * listen_session_trigger().  When a keyword fires, the ring is trimmed to the
+ * pre-roll and handed to the reader: from then on the capture thread only
+ * produces and the audio_stream_in reads the pre-roll and the live audio
+ * behind it from the same memory.  listen_session_rearm() takes the ring back.
+ */
+
+struct listen_session;
+
+enum listen_event_type {
+    LISTEN_EVENT_DETECTED,      /* keyword fired, the ring is handed off */
+    LISTEN_EVENT_OVERRUN,       /* the reader fell behind, audio was dropped */
+    LISTEN_EVENT_ERROR,         /* capture failed repeatedly */
+};
+
+struct listen_event {
+    enum listen_event_type type;
+    int keyword;                /* detector or trigger value, 0 otherwise */
+    uint64_t position;          /* frames captured up to the event */
+    unsigned int preroll_frames; /* frames readable before live audio */
+    struct timespec timestamp;  /* CLOCK_MONOTONIC */
+};
+
+/* Called from the capture thread; must not block. */
+typedef void (*listen_event_callback_t)(void *cookie,
+                                        const struct listen_event *event);
+
+/*
+ * Software detector, run on every captured period while listening.  Returns
+ * a positive keyword id to fire, 0 otherwise.  May be called twice per
+ * period when the period wraps around the ring.
+ */
+typedef int (*listen_detect_t)(void *cookie, const void *frames,
+                               unsigned int count);
+
+struct listen_session_config {
+    unsigned int card;
+    unsigned int device;
+    /* period_size is the capture batch: one wakeup per period */
+    struct pcm_config pcm;
+    unsigned int pcm_flags;
+    unsigned int preroll_ms;
+    listen_detect_t detect;     /* NULL when the DSP detects */
+    listen_event_callback_t callback;
+    void *cookie;
+};
+
+struct listen_session_stats {
+    uint32_t wakeups;           /* periods captured */
+    uint32_t detections;
+    uint32_t overruns;          /* periods dropped while handed off */
+    uint32_t errors;            /* failed pcm_read() calls */
+};
+
+/* Open the PCM and start the capture thread, initially stopped. */
+struct listen_session *listen_session_open(
+        const struct listen_session_config *config);
+
+void listen_session_close(struct listen_session *session);
+
+/* Start or stop capture.  Stopping drops any pre-roll. */
+int listen_session_start(struct listen_session *session);
+int listen_session_stop(struct listen_session *session);
+
+/*
+ * Report a keyword detected outside the library, e.g. from the MAD observer.
+ * Takes effect at the end of the period being captured, so it costs no extra
+ * wakeup.  Safe to call from any thread.
+ */
+int listen_session_trigger(struct listen_session *session, int keyword);
+
+/*
+ * Backing for listen_set_parameters.  Understands listen_preroll_ms=<ms>,
+ * which is clamped to the capacity chosen at open.
+ */
+int listen_session_set_parameters(struct listen_session *session,
+                                  const char *kv_pairs);
+
+/*
+ * Reader side, valid between LISTEN_EVENT_DETECTED and listen_session_rearm()
+ * and always from the same thread.
+ *
+ * listen_session_acquire() maps up to frames queued frames in place, waiting
+ * for at least one if wait is set, and returns the frame count;
+ * listen_session_release() consumes them.  listen_session_read() is the
+ * copying convenience for audio_stream_in::read.
+ */
+uint32_t listen_session_acquire(struct listen_session *session, uint32_t frames,
+                                struct spsc_ring_region regions[2], int wait);
+void listen_session_release(struct listen_session *session, uint32_t frames);
+ssize_t listen_session_read(struct listen_session *session, void *buffer,
+                            size_t bytes);
+
+/* Hand the ring back to the capture thread and resume listening. */
+void listen_session_rearm(struct listen_session *session);
+
+void listen_session_get_stats(const struct listen_session *session,
+                              struct listen_session_stats *stats);
+
+size_t listen_session_frame_size(const struct listen_session *session);
+
+__END_DECLS
+
+#endif // ANDROID_ALSA_UTILS_LISTEN_SESSION_H
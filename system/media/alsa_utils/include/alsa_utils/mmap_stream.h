@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ALSA_UTILS_MMAP_STREAM_H
+#define ANDROID_ALSA_UTILS_MMAP_STREAM_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <tinyalsa/asoundlib.h>
+
+__BEGIN_DECLS
+
+/*
+ * Low-latency playback engine on top of the tinyalsa mmap API.
+ *
+ * audio_stream_out::write() copies into a lock-free ring and returns; a
+ * SCHED_FIFO pump thread moves frames from the ring straight into the
+ * kernel's mmap buffer with pcm_mmap_begin()/pcm_mmap_commit().  The pump
+ * transfers one "period" per wakeup.  The period starts at
+ * config.pcm.period_size, is doubled (up to max_period_size) after every
+ * xrun and is halved again (down to min_period_size) once the stream has
+ * run cleanly for a second.
+ */
+
+struct mmap_stream;
+
+struct mmap_stream_config {
+    unsigned int card;
+    unsigned int device;
+    /* period_size is the initial pump period; flags PCM_MMAP|PCM_MONOTONIC
+     * are always added to pcm_flags. */
+    struct pcm_config pcm;
+    unsigned int pcm_flags;
+    /* bounds for the adaptive period, 0 means pcm.period_size */
+    unsigned int min_period_size;
+    unsigned int max_period_size;
+    /* ring capacity in frames, rounded up to a power of two; 0 means twice
+     * the kernel buffer */
+    unsigned int ring_frames;
+    /* SCHED_FIFO priority of the pump thread, 0 keeps SCHED_NORMAL */
+    int fifo_priority;
+};
+
+struct mmap_stream_stats {
+    uint64_t frames_written;    /* frames accepted by mmap_stream_write() */
+    uint64_t frames_committed;  /* frames committed to the kernel, incl. silence */
+    uint64_t silence_frames;    /* silence inserted when the ring ran dry */
+    uint32_t xruns;             /* kernel underruns (EPIPE) */
+    uint32_t ring_underruns;    /* pump wakeups that found the ring empty */
+    uint32_t period_size;       /* current adaptive period in frames */
+};
+
+/* Open the PCM and start the pump thread.  Returns NULL on failure. */
+struct mmap_stream *mmap_stream_open(const struct mmap_stream_config *config);
+
+/* Stop the pump thread, close the PCM and free the stream. */
+void mmap_stream_close(struct mmap_stream *stream);
+
+/*
+ * Queue bytes of audio.  Blocks only while the ring is full, and returns the
+ * number of bytes queued or a negative errno.  Must always be called from the
+ * same thread.
+ */
+ssize_t mmap_stream_write(struct mmap_stream *stream, const void *buffer,
+                          size_t bytes);
+
+/*
+ * Stop the PCM and drop queued audio; the next write restarts the stream.
+ * Presentation position keeps counting across standby.
+ */
+int mmap_stream_standby(struct mmap_stream *stream);
+
+/*
+ * Backing for audio_stream_out::get_presentation_position: frames of written
+ * audio that have reached the DAC, and the CLOCK_MONOTONIC time at which that
+ * count was sampled.  Returns -ENODATA until the PCM has started.
+ */
+int mmap_stream_get_presentation_position(const struct mmap_stream *stream,
+                                          uint64_t *frames,
+                                          struct timespec *timestamp);
+
+void mmap_stream_get_stats(const struct mmap_stream *stream,
+                           struct mmap_stream_stats *stats);
+
+/* Frame size in bytes of the underlying PCM. */
+size_t mmap_stream_frame_size(const struct mmap_stream *stream);
+
+__END_DECLS
+
+#endif // ANDROID_ALSA_UTILS_MMAP_STREAM_H
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ALSA_UTILS_OFFLOAD_BUFFERS_H
+#define ANDROID_ALSA_UTILS_OFFLOAD_BUFFERS_H
+
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <tinyalsa/asoundlib.h>
+#ifdef QCOM_DIRECTTRACK
+#include <hardware/audio.h>
+#endif
+
+__BEGIN_DECLS
+
+/*
+ * Buffer manager for tunnel (LPA) and offload output streams.
+ *
+ * The PCM's mmap area is split into period_count buffers of period_size
+ * frames each.  Those buffers are handed to the framework as-is through
+ * get_buffer_info(), so a client that fills the buffer returned by
+ * offload_buffers_dequeue() is played without any copy.  A completion thread
+ * sleeps in pcm_wait() only while buffers are queued and reports every buffer
+ * the DSP has consumed through the callback, which is what the HAL forwards
+ * to the observer registered with set_observer().
+ */
+
+struct offload_buffers;
+
+enum offload_event {
+    OFFLOAD_EVENT_BUFFER_AVAILABLE, /* arg is the index of the freed buffer */
+    OFFLOAD_EVENT_DRAINED,          /* every queued frame has been played */
+    OFFLOAD_EVENT_UNDERRUN,         /* the DSP ran dry before a drain */
+};
+
+/* Called from the completion thread without any lock held. */
+typedef void (*offload_callback_t)(void *cookie, enum offload_event event,
+                                   int arg);
+
+struct offload_buffers_config {
+    /* opened with PCM_MMAP | PCM_MONOTONIC, period_size must divide the
+     * buffer evenly */
+    struct pcm *pcm;
+    /* buffers queued before the PCM starts, 0 means two */
+    unsigned int start_buffers;
+    offload_callback_t callback;
+    void *cookie;
+};
+
+/* Map the PCM buffer and start the completion thread.  NULL on failure. */
+struct offload_buffers *offload_buffers_open(
+        const struct offload_buffers_config *config);
+
+/* Stop the PCM and the completion thread.  Does not close the PCM. */
+void offload_buffers_close(struct offload_buffers *ob);
+
+unsigned int offload_buffers_count(const struct offload_buffers *ob);
+size_t offload_buffers_size(const struct offload_buffers *ob);
+
+/* Address of buffer index inside the PCM mmap area. */
+void *offload_buffers_get(const struct offload_buffers *ob, unsigned int index);
+
+#ifdef QCOM_DIRECTTRACK
+/*
+ * Backing for audio_stream_out::get_buffer_info.  The returned structure is
+ * owned by ob and stays valid until offload_buffers_close().
+ */
+int offload_buffers_get_info(struct offload_buffers *ob, struct buf_info **info);
+#endif
+
+/*
+ * Backing for audio_stream_out::is_buffer_available: set *available to 1 if
+ * the next buffer is free.  With wait set, block until it is (or until the
+ * stream is flushed) instead of returning 0.
+ */
+int offload_buffers_is_available(struct offload_buffers *ob, int *available,
+                                 int wait);
+
+/*
+ * Return the index of the next buffer to fill, blocking while the DSP still
+ * owns it.  Returns -EINTR if the stream was flushed meanwhile.
+ */
+int offload_buffers_dequeue(struct offload_buffers *ob);
+
+/*
+ * Hand bytes of data to the DSP.  If data is the buffer returned by the last
+ * offload_buffers_dequeue() it is committed in place; otherwise up to one
+ * buffer is copied into it.  A short buffer is padded with silence, so only
+ * the last buffer before a drain should be short.  Returns the number of
+ * bytes consumed or a negative errno.
+ */
+ssize_t offload_buffers_queue(struct offload_buffers *ob, const void *data,
+                              size_t bytes);
+
+/*
+ * Start the PCM if it has not started yet and report OFFLOAD_EVENT_DRAINED
+ * once the last queued buffer has been played.
+ */
+int offload_buffers_drain(struct offload_buffers *ob);
+
+/* Stop the PCM and return every buffer to the client. */
+int offload_buffers_flush(struct offload_buffers *ob);
+
+/*
+ * Backing for audio_stream_out::get_time_stamp: microseconds of audio played
+ * since open, extrapolated from the last pcm_get_htimestamp() sample while
+ * the PCM is running.
+ */
+int offload_buffers_get_time_stamp(struct offload_buffers *ob,
+                                   uint64_t *time_us);
+
+/* Frames played since open and the CLOCK_MONOTONIC time of that count. */
+int offload_buffers_get_presentation_position(struct offload_buffers *ob,
+                                              uint64_t *frames,
+                                              struct timespec *timestamp);
+
+__END_DECLS
+
+#endif // ANDROID_ALSA_UTILS_OFFLOAD_BUFFERS_H
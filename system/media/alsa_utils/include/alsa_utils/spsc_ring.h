@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ALSA_UTILS_SPSC_RING_H
+#define ANDROID_ALSA_UTILS_SPSC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+__BEGIN_DECLS
+
+/*
+ * Fixed-size, single-producer single-consumer ring of audio frames.
+ *
+ * Exactly one thread may call the producer functions (spsc_ring_write,
+ * spsc_ring_write_regions, spsc_ring_write_advance) and exactly one thread
+ * may call the consumer functions (spsc_ring_read, spsc_ring_read_regions,
+ * spsc_ring_read_advance).  Neither side ever takes a lock, so the ring is
+ * safe to use from a SCHED_FIFO thread.
+ *
+ * The indices are free-running frame counters; the capacity must be a power
+ * of two so that wrap-around is a mask rather than a division.
+ */
+struct spsc_ring {
+    volatile int32_t front;     /* frames consumed, written by the consumer */
+    volatile int32_t rear;      /* frames produced, written by the producer */
+    uint32_t frame_count;       /* capacity in frames, power of two */
+    uint32_t frame_size;        /* bytes per frame */
+    void *buffer;               /* frame_count * frame_size bytes */
+};
+
+/* A contiguous part of the ring, as returned by the *_regions functions. */
+struct spsc_ring_region {
+    void *data;
+    uint32_t frames;
+};
+
+/*
+ * Initialize the ring over caller-provided storage of frame_count * frame_size
+ * bytes.  Returns 0 on success or -EINVAL if frame_count is not a power of two.
+ */
+int spsc_ring_init(struct spsc_ring *ring, uint32_t frame_count,
+                   uint32_t frame_size, void *buffer);
+
+/* Drop all queued frames.  Only safe while neither side is running. */
+void spsc_ring_reset(struct spsc_ring *ring);
+
+/* Number of frames the consumer can read right now. */
+uint32_t spsc_ring_readable(const struct spsc_ring *ring);
+
+/* Number of frames the producer can write right now. */
+uint32_t spsc_ring_writable(const struct spsc_ring *ring);
+
+/* Copy up to frames frames in; returns the number of frames copied. */
+uint32_t spsc_ring_write(struct spsc_ring *ring, const void *data,
+                         uint32_t frames);
+
+/* Copy up to frames frames out; returns the number of frames copied. */
+uint32_t spsc_ring_read(struct spsc_ring *ring, void *data, uint32_t frames);
+
+/*
+ * Zero-copy access.  Fill regions[0..1] with at most frames frames of free
+ * (write) or queued (read) space and return the total frame count.  The
+ * second region is empty unless the span wraps.  Call the matching *_advance
+ * function with the number of frames actually produced or consumed.
+ */
+uint32_t spsc_ring_write_regions(struct spsc_ring *ring, uint32_t frames,
+                                 struct spsc_ring_region regions[2]);
+void spsc_ring_write_advance(struct spsc_ring *ring, uint32_t frames);
+
+uint32_t spsc_ring_read_regions(struct spsc_ring *ring, uint32_t frames,
+                                struct spsc_ring_region regions[2]);
+void spsc_ring_read_advance(struct spsc_ring *ring, uint32_t frames);
+
+__END_DECLS
+
+#endif // ANDROID_ALSA_UTILS_SPSC_RING_H
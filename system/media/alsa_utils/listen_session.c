@@ -0,0 +1,466 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "listen_session"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <cutils/str_parms.h>
+
+#include <alsa_utils/listen_session.h>
+
+#define LISTEN_PARAM_PREROLL_MS "listen_preroll_ms"
+
+/* periods of slack the reader gets behind the pre-roll after a handoff */
+#define READER_SLACK_PERIODS 4
+
+/* report LISTEN_EVENT_ERROR and stop after this many failed reads in a row */
+#define MAX_READ_ERRORS 8
+
+enum {
+    MODE_LISTENING,             /* capture thread owns both ends of the ring */
+    MODE_HANDED_OFF,            /* the reader consumes the ring */
+};
+
+struct listen_session {
+    struct pcm *pcm;
+    unsigned int rate;
+    unsigned int period;
+    size_t frame_size;
+    listen_detect_t detect;
+    listen_event_callback_t callback;
+    void *cookie;
+
+    struct spsc_ring ring;
+    void *ring_buffer;
+    void *scratch;                  /* one period, for audio dropped on overrun */
+
+    pthread_t thread;
+    sem_t start_sem;
+    sem_t data_sem;
+    volatile int32_t exiting;
+    volatile int32_t active;
+    volatile int32_t mode;
+    volatile int32_t rearm_request;
+    volatile int32_t trigger;
+    volatile int32_t reader_waiting;
+    volatile int32_t preroll_frames;
+
+    /* owned by the capture thread */
+    int capturing;
+    int overrun_reported;
+    unsigned int read_errors;
+    uint64_t position;
+
+    volatile int32_t wakeups;
+    volatile int32_t detections;
+    volatile int32_t overruns;
+    volatile int32_t errors;
+};
+
+static unsigned int round_up_pow2(unsigned int v)
+{
+    unsigned int r = 1;
+
+    while (r < v)
+        r <<= 1;
+    return r;
+}
+
+static void wake_reader(struct listen_session *session)
+{
+    if (android_atomic_cmpxchg(1, 0, &session->reader_waiting) == 0)
+        sem_post(&session->data_sem);
+}
+
+static void send_event(struct listen_session *session,
+                       enum listen_event_type type, int keyword,
+                       unsigned int preroll)
+{
+    struct listen_event event;
+
+    if (!session->callback)
+        return;
+
+    event.type = type;
+    event.keyword = keyword;
+    event.position = session->position;
+    event.preroll_frames = preroll;
+    clock_gettime(CLOCK_MONOTONIC, &event.timestamp);
+    session->callback(session->cookie, &event);
+}
+
+static int take_trigger(struct listen_session *session)
+{
+    int32_t keyword;
+
+    do {
+        keyword = android_atomic_acquire_load(&session->trigger);
+        if (keyword == 0)
+            return 0;
+    } while (android_atomic_cmpxchg(keyword, 0, &session->trigger) != 0);
+    return keyword;
+}
+
+static void hand_off(struct listen_session *session, int keyword)
+{
+    uint32_t preroll = android_atomic_acquire_load(&session->preroll_frames);
+    uint32_t readable = spsc_ring_readable(&session->ring);
+
+    if (readable > preroll) {
+        spsc_ring_read_advance(&session->ring, readable - preroll);
+        readable = preroll;
+    }
+    session->overrun_reported = 0;
+    android_atomic_inc(&session->detections);
+    /* publish the trimmed ring before the reader can learn about it */
+    android_atomic_release_store(MODE_HANDED_OFF, &session->mode);
+
+    ALOGV("keyword %d at frame %llu, %u frames of pre-roll", keyword,
+          (unsigned long long)session->position, readable);
+    send_event(session, LISTEN_EVENT_DETECTED, keyword, readable);
+}
+
+static int read_pcm(struct listen_session *session, void *data,
+                    unsigned int frames)
+{
+    if (pcm_read(session->pcm, data, frames * session->frame_size) == 0) {
+        session->capturing = 1;
+        session->read_errors = 0;
+        return 0;
+    }
+    /* listen_session_stop() or close() aborted the read */
+    if (!android_atomic_acquire_load(&session->active))
+        return -EIO;
+
+    android_atomic_inc(&session->errors);
+    ALOGW("pcm_read failed: %s", pcm_get_error(session->pcm));
+    if (++session->read_errors >= MAX_READ_ERRORS) {
+        ALOGE("capture keeps failing, stopping");
+        android_atomic_release_store(0, &session->active);
+        send_event(session, LISTEN_EVENT_ERROR, 0, 0);
+    }
+    return -EIO;
+}
+
+/* Capture one period: the only wakeup per period while listening. */
+static void capture_period(struct listen_session *session)
+{
+    struct spsc_ring_region regions[2];
+    int handed_off = android_atomic_acquire_load(&session->mode) == MODE_HANDED_OFF;
+    uint32_t got;
+    int keyword = 0;
+    int i;
+
+    got = spsc_ring_write_regions(&session->ring, session->period, regions);
+    if (got < session->period) {
+        if (handed_off) {
+            /* keep what the reader has not seen yet, drop the new audio */
+            if (read_pcm(session, session->scratch, session->period) == 0) {
+                session->position += session->period;
+                android_atomic_inc(&session->wakeups);
+                android_atomic_inc(&session->overruns);
+                if (!session->overrun_reported) {
+                    session->overrun_reported = 1;
+                    send_event(session, LISTEN_EVENT_OVERRUN, 0, 0);
+                }
+            }
+            wake_reader(session);
+            return;
+        }
+        /* listening: the oldest pre-roll makes room */
+        spsc_ring_read_advance(&session->ring, session->period - got);
+        spsc_ring_write_regions(&session->ring, session->period, regions);
+    }
+
+    for (i = 0; i < 2; i++) {
+        if (regions[i].frames &&
+                read_pcm(session, regions[i].data, regions[i].frames) < 0)
+            return;
+    }
+    spsc_ring_write_advance(&session->ring, session->period);
+    session->position += session->period;
+    android_atomic_inc(&session->wakeups);
+
+    if (handed_off) {
+        wake_reader(session);
+        return;
+    }
+
+    for (i = 0; i < 2 && session->detect && keyword <= 0; i++) {
+        if (regions[i].frames)
+            keyword = session->detect(session->cookie, regions[i].data,
+                                      regions[i].frames);
+    }
+    if (keyword <= 0)
+        keyword = take_trigger(session);
+    if (keyword > 0)
+        hand_off(session, keyword);
+}
+
+static void *capture_thread(void *context)
+{
+    struct listen_session *session = context;
+
+    while (!android_atomic_acquire_load(&session->exiting)) {
+        if (!android_atomic_acquire_load(&session->active)) {
+            if (session->capturing) {
+                pcm_stop(session->pcm);
+                session->capturing = 0;
+            }
+            if (android_atomic_acquire_load(&session->mode) == MODE_LISTENING)
+                spsc_ring_read_advance(&session->ring,
+                                       spsc_ring_readable(&session->ring));
+            wake_reader(session);
+            sem_wait(&session->start_sem);
+            continue;
+        }
+
+        if (android_atomic_cmpxchg(1, 0, &session->rearm_request) == 0) {
+            /* the reader is done: take over the consumer side again */
+            android_atomic_release_store(MODE_LISTENING, &session->mode);
+        }
+        capture_period(session);
+    }
+
+    if (session->capturing)
+        pcm_stop(session->pcm);
+    return NULL;
+}
+
+struct listen_session *listen_session_open(
+        const struct listen_session_config *config)
+{
+    struct listen_session *session;
+    struct pcm_config pcm_config = config->pcm;
+    unsigned int preroll, ring_frames;
+
+    if (pcm_config.period_size == 0 || pcm_config.rate == 0)
+        return NULL;
+
+    session = calloc(1, sizeof(*session));
+    if (!session)
+        return NULL;
+
+    session->pcm = pcm_open(config->card, config->device,
+                            config->pcm_flags | PCM_IN, &pcm_config);
+    if (!session->pcm || !pcm_is_ready(session->pcm)) {
+        ALOGE("cannot open pcm %u,%u: %s", config->card, config->device,
+              session->pcm ? pcm_get_error(session->pcm) : "no memory");
+        goto err_pcm;
+    }
+
+    session->rate = pcm_config.rate;
+    session->period = pcm_config.period_size;
+    session->frame_size = pcm_frames_to_bytes(session->pcm, 1);
+    session->detect = config->detect;
+    session->callback = config->callback;
+    session->cookie = config->cookie;
+
+    preroll = (uint64_t)config->preroll_ms * session->rate / 1000;
+    ring_frames = round_up_pow2(preroll + READER_SLACK_PERIODS * session->period);
+    session->preroll_frames = preroll;
+    session->ring_buffer = malloc(ring_frames * session->frame_size);
+    session->scratch = malloc(session->period * session->frame_size);
+    if (!session->ring_buffer || !session->scratch)
+        goto err_buffers;
+    spsc_ring_init(&session->ring, ring_frames, session->frame_size,
+                   session->ring_buffer);
+
+    sem_init(&session->start_sem, 0, 0);
+    sem_init(&session->data_sem, 0, 0);
+    if (pthread_create(&session->thread, NULL, capture_thread, session) != 0) {
+        ALOGE("cannot create capture thread");
+        goto err_thread;
+    }
+
+    ALOGV("opened pcm %u,%u: period %u frames, pre-roll %u of %u frames",
+          config->card, config->device, session->period, preroll, ring_frames);
+    return session;
+
+err_thread:
+    sem_destroy(&session->data_sem);
+    sem_destroy(&session->start_sem);
+err_buffers:
+    free(session->scratch);
+    free(session->ring_buffer);
+    pcm_close(session->pcm);
+err_pcm:
+    free(session);
+    return NULL;
+}
+
+void listen_session_close(struct listen_session *session)
+{
+    if (!session)
+        return;
+
+    android_atomic_release_store(1, &session->exiting);
+    android_atomic_release_store(0, &session->active);
+    /* unblock a pcm_read() in progress */
+    pcm_stop(session->pcm);
+    sem_post(&session->start_sem);
+    pthread_join(session->thread, NULL);
+
+    sem_destroy(&session->data_sem);
+    sem_destroy(&session->start_sem);
+    pcm_close(session->pcm);
+    free(session->scratch);
+    free(session->ring_buffer);
+    free(session);
+}
+
+int listen_session_start(struct listen_session *session)
+{
+    if (android_atomic_cmpxchg(0, 1, &session->active) == 0)
+        sem_post(&session->start_sem);
+    return 0;
+}
+
+int listen_session_stop(struct listen_session *session)
+{
+    if (android_atomic_cmpxchg(1, 0, &session->active) == 0) {
+        pcm_stop(session->pcm);
+        wake_reader(session);
+    }
+    return 0;
+}
+
+int listen_session_trigger(struct listen_session *session, int keyword)
+{
+    if (keyword <= 0)
+        return -EINVAL;
+    android_atomic_release_store(keyword, &session->trigger);
+    return 0;
+}
+
+int listen_session_set_parameters(struct listen_session *session,
+                                  const char *kv_pairs)
+{
+    struct str_parms *parms;
+    int preroll_ms;
+    int ret = 0;
+
+    parms = str_parms_create_str(kv_pairs);
+    if (!parms)
+        return -ENOMEM;
+
+    if (str_parms_get_int(parms, LISTEN_PARAM_PREROLL_MS, &preroll_ms) >= 0) {
+        uint32_t max = session->ring.frame_count -
+                       READER_SLACK_PERIODS * session->period;
+        uint64_t frames = (uint64_t)preroll_ms * session->rate / 1000;
+
+        if (preroll_ms < 0) {
+            ret = -EINVAL;
+        } else {
+            if (frames > max)
+                frames = max;
+            android_atomic_release_store(frames, &session->preroll_frames);
+        }
+    }
+
+    str_parms_destroy(parms);
+    return ret;
+}
+
+uint32_t listen_session_acquire(struct listen_session *session, uint32_t frames,
+                                struct spsc_ring_region regions[2], int wait)
+{
+    uint32_t got;
+
+    for (;;) {
+        got = spsc_ring_read_regions(&session->ring, frames, regions);
+        if (got || !wait || !android_atomic_acquire_load(&session->active))
+            return got;
+
+        /* empty: sleep until the capture thread has written a period */
+        android_atomic_release_store(1, &session->reader_waiting);
+        if (spsc_ring_readable(&session->ring) == 0 &&
+                android_atomic_acquire_load(&session->active)) {
+            sem_wait(&session->data_sem);
+        } else if (android_atomic_cmpxchg(1, 0, &session->reader_waiting) != 0) {
+            /* the capture thread already cleared the flag and posted */
+            sem_wait(&session->data_sem);
+        }
+    }
+}
+
+void listen_session_release(struct listen_session *session, uint32_t frames)
+{
+    spsc_ring_read_advance(&session->ring, frames);
+}
+
+ssize_t listen_session_read(struct listen_session *session, void *buffer,
+                            size_t bytes)
+{
+    struct spsc_ring_region regions[2];
+    uint8_t *data = buffer;
+    uint32_t frames = bytes / session->frame_size;
+    uint32_t done = 0;
+
+    if (android_atomic_acquire_load(&session->mode) != MODE_HANDED_OFF)
+        return -EAGAIN;
+
+    while (done < frames) {
+        uint32_t got = listen_session_acquire(session, frames - done, regions, 1);
+        size_t first;
+
+        if (got == 0)
+            break;
+        first = regions[0].frames * session->frame_size;
+        memcpy(data + done * session->frame_size, regions[0].data, first);
+        if (regions[1].frames)
+            memcpy(data + done * session->frame_size + first, regions[1].data,
+                   regions[1].frames * session->frame_size);
+        listen_session_release(session, got);
+        done += got;
+    }
+
+    if (done == 0 && frames)
+        return -ENODEV;
+    return done * session->frame_size;
+}
+
+void listen_session_rearm(struct listen_session *session)
+{
+    /*
+     * Drop a trigger that came in while handed off, but not one that comes
+     * after this call and before the capture thread sees the request.
+     */
+    android_atomic_release_store(0, &session->trigger);
+    android_atomic_release_store(1, &session->rearm_request);
+}
+
+void listen_session_get_stats(const struct listen_session *session,
+                              struct listen_session_stats *stats)
+{
+    stats->wakeups = android_atomic_acquire_load(&session->wakeups);
+    stats->detections = android_atomic_acquire_load(&session->detections);
+    stats->overruns = android_atomic_acquire_load(&session->overruns);
+    stats->errors = android_atomic_acquire_load(&session->errors);
+}
+
+size_t listen_session_frame_size(const struct listen_session *session)
+{
+    return session->frame_size;
+}
@@ -0,0 +1,599 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "mmap_stream"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <cutils/atomic.h>
+#include <cutils/atomic-inline.h>
+#include <cutils/log.h>
+#include <sound/asound.h>
+
+#include <alsa_utils/mmap_stream.h>
+#include <alsa_utils/spsc_ring.h>
+
+/* give up waiting for the PCM after this many periods without an interrupt */
+#define WAIT_TIMEOUT_PERIODS 4
+
+/*
+ * underrun fills tracked while queued in the kernel; each pump transfer
+ * adds at most one, and the buffer holds only a few transfers
+ */
+#define MAX_SILENCE_RUNS 16
+
+struct mmap_stream {
+    struct pcm *pcm;
+    struct pcm_config config;
+    size_t frame_size;
+    unsigned int buffer_size;       /* kernel buffer, frames */
+    unsigned int min_period;
+    unsigned int max_period;
+    int fifo_priority;
+
+    struct spsc_ring ring;
+    void *ring_buffer;
+
+    pthread_t thread;
+    volatile int32_t exiting;
+    volatile int32_t standby_request;
+    volatile int32_t pump_idle;     /* pump is (about to be) blocked on data_sem */
+    volatile int32_t writer_waiting; /* writer is (about to be) blocked on space_sem */
+    sem_t data_sem;
+    sem_t space_sem;
+    sem_t standby_sem;
+
+    /*
+     * Owned by the writer thread, which has a sequence count of its own: the
+     * pump, running SCHED_FIFO, must never wait for the writer to finish.
+     */
+    volatile int32_t written_seq;
+    uint64_t frames_written;
+
+    /* owned by the pump thread */
+    int running;
+    unsigned int period;
+    unsigned int clean_frames;
+    uint64_t committed;
+    uint64_t silence;
+    uint64_t silence_played;
+    uint64_t discarded;
+    /* silence still in the kernel buffer, by committed position */
+    struct {
+        uint64_t start;
+        unsigned int count;
+    } silence_runs[MAX_SILENCE_RUNS];
+    unsigned int silence_head;
+    unsigned int silence_count;
+    uint32_t xruns;
+    uint32_t ring_underruns;
+
+    /*
+     * Snapshot of the pump state for readers on other threads, guarded by a
+     * sequence count: odd while the pump is updating it.
+     */
+    volatile int32_t snapshot_seq;
+    struct {
+        int valid;
+        uint64_t presented;
+        struct timespec timestamp;
+        struct mmap_stream_stats stats;
+    } snapshot;
+};
+
+static unsigned int round_up_pow2(unsigned int v)
+{
+    unsigned int r = 1;
+
+    while (r < v)
+        r <<= 1;
+    return r;
+}
+
+/* Note count frames of silence committed at position start. */
+static void silence_add(struct mmap_stream *stream, uint64_t start,
+                        unsigned int count)
+{
+    unsigned int i;
+
+    if (stream->silence_count) {
+        i = (stream->silence_head + stream->silence_count - 1) %
+            MAX_SILENCE_RUNS;
+        if (stream->silence_runs[i].start + stream->silence_runs[i].count ==
+                start) {
+            stream->silence_runs[i].count += count;
+            return;
+        }
+    }
+    if (stream->silence_count == MAX_SILENCE_RUNS) {
+        /* count the oldest as played a little early rather than lose it */
+        stream->silence_played +=
+            stream->silence_runs[stream->silence_head].count;
+        stream->silence_head = (stream->silence_head + 1) % MAX_SILENCE_RUNS;
+        stream->silence_count--;
+    }
+    i = (stream->silence_head + stream->silence_count) % MAX_SILENCE_RUNS;
+    stream->silence_runs[i].start = start;
+    stream->silence_runs[i].count = count;
+    stream->silence_count++;
+}
+
+/*
+ * Silence among the first position frames committed, retiring the runs
+ * the DSP has played through.
+ */
+static uint64_t silence_played_by(struct mmap_stream *stream,
+                                  uint64_t position)
+{
+    while (stream->silence_count) {
+        unsigned int i = stream->silence_head;
+
+        if (stream->silence_runs[i].start + stream->silence_runs[i].count >
+                position) {
+            if (stream->silence_runs[i].start < position)
+                return stream->silence_played + position -
+                       stream->silence_runs[i].start;
+            break;
+        }
+        stream->silence_played += stream->silence_runs[i].count;
+        stream->silence_head = (i + 1) % MAX_SILENCE_RUNS;
+        stream->silence_count--;
+    }
+    return stream->silence_played;
+}
+
+static void publish_snapshot(struct mmap_stream *stream, unsigned int avail,
+                             const struct timespec *ts)
+{
+    int32_t seq = stream->snapshot_seq;
+    uint64_t queued = stream->running ? stream->buffer_size - avail : 0;
+    uint64_t played = stream->committed - queued;
+    uint64_t presented = played - stream->discarded;
+    uint64_t silence = silence_played_by(stream, played);
+
+    presented = presented > silence ? presented - silence : 0;
+
+    android_atomic_release_store(seq + 1, &stream->snapshot_seq);
+    /* the release store only orders what came before it */
+    android_memory_barrier();
+    if (ts != NULL) {
+        /* never let the reported position go backwards */
+        if (!stream->snapshot.valid || presented > stream->snapshot.presented)
+            stream->snapshot.presented = presented;
+        stream->snapshot.timestamp = *ts;
+        stream->snapshot.valid = 1;
+    }
+    stream->snapshot.stats.frames_committed = stream->committed;
+    stream->snapshot.stats.silence_frames = stream->silence;
+    stream->snapshot.stats.xruns = stream->xruns;
+    stream->snapshot.stats.ring_underruns = stream->ring_underruns;
+    stream->snapshot.stats.period_size = stream->period;
+    android_atomic_release_store(seq + 2, &stream->snapshot_seq);
+}
+
+static void wake_writer(struct mmap_stream *stream)
+{
+    if (android_atomic_cmpxchg(1, 0, &stream->writer_waiting) == 0)
+        sem_post(&stream->space_sem);
+}
+
+static void wake_pump(struct mmap_stream *stream)
+{
+    if (android_atomic_cmpxchg(1, 0, &stream->pump_idle) == 0)
+        sem_post(&stream->data_sem);
+}
+
+/*
+ * Move up to frames frames from the ring into the kernel buffer, padding with
+ * silence if the ring runs dry.  Returns 0 or a negative errno from tinyalsa.
+ */
+static int transfer(struct mmap_stream *stream, unsigned int frames, int pad)
+{
+    int underrun = 0;
+
+    while (frames > 0) {
+        void *areas;
+        unsigned int offset;
+        unsigned int count = frames;
+        unsigned int got;
+        uint8_t *dst;
+        int ret;
+
+        ret = pcm_mmap_begin(stream->pcm, &areas, &offset, &count);
+        if (ret < 0)
+            return ret;
+        if (count == 0)
+            break;
+
+        dst = (uint8_t *)areas + offset * stream->frame_size;
+        got = spsc_ring_read(&stream->ring, dst, count);
+        if (got < count) {
+            if (!pad) {
+                count = got;
+                if (count == 0)
+                    break;
+            } else {
+                memset(dst + got * stream->frame_size, 0,
+                       (count - got) * stream->frame_size);
+                silence_add(stream, stream->committed + got, count - got);
+                stream->silence += count - got;
+                underrun = 1;
+            }
+        }
+
+        ret = pcm_mmap_commit(stream->pcm, offset, count);
+        if (ret < 0)
+            return ret;
+        stream->committed += count;
+        frames -= count;
+    }
+
+    if (underrun)
+        stream->ring_underruns++;
+    wake_writer(stream);
+    return 0;
+}
+
+static void adapt_period(struct mmap_stream *stream, int xrun,
+                         unsigned int frames)
+{
+    if (xrun) {
+        stream->clean_frames = 0;
+        if (stream->period < stream->max_period) {
+            stream->period *= 2;
+            if (stream->period > stream->max_period)
+                stream->period = stream->max_period;
+            ALOGV("xrun, period grows to %u frames", stream->period);
+        }
+    } else {
+        stream->clean_frames += frames;
+        if (stream->clean_frames >= stream->config.rate &&
+                stream->period > stream->min_period) {
+            stream->period /= 2;
+            if (stream->period < stream->min_period)
+                stream->period = stream->min_period;
+            stream->clean_frames = 0;
+            ALOGV("stable, period shrinks to %u frames", stream->period);
+        }
+    }
+    /* only honoured by tinyalsa for PCM_MMAP|PCM_NOIRQ streams */
+    pcm_set_avail_min(stream->pcm, stream->period);
+}
+
+static void stop_pcm(struct mmap_stream *stream, int xrun)
+{
+    unsigned int avail = 0;
+    uint64_t played = stream->committed;
+    struct timespec ts;
+
+    if (!stream->running)
+        return;
+
+    /* whatever was still queued in the kernel will never be heard */
+    if (!xrun && pcm_get_htimestamp(stream->pcm, &avail, &ts) == 0 &&
+            avail < stream->buffer_size) {
+        played -= stream->buffer_size - avail;
+        stream->discarded += stream->buffer_size - avail;
+    }
+    /* silence past that point is part of what was discarded */
+    stream->silence_played = silence_played_by(stream, played);
+    stream->silence_count = 0;
+    pcm_stop(stream->pcm);
+    stream->running = 0;
+    publish_snapshot(stream, stream->buffer_size, NULL);
+}
+
+static void handle_standby(struct mmap_stream *stream)
+{
+    stop_pcm(stream, 0);
+    spsc_ring_read_advance(&stream->ring, spsc_ring_readable(&stream->ring));
+    android_atomic_release_store(0, &stream->standby_request);
+    sem_post(&stream->standby_sem);
+}
+
+static int start_pcm(struct mmap_stream *stream)
+{
+    int ret;
+
+    /*
+     * pcm_stop() and an xrun both leave the pcm needing a prepare before it
+     * takes data again, and a prepare of an already prepared pcm is harmless.
+     */
+    if (pcm_ioctl(stream->pcm, SNDRV_PCM_IOCTL_PREPARE) < 0) {
+        ALOGE("cannot prepare pcm: %s", strerror(errno));
+        return -errno;
+    }
+
+    /* prime the kernel buffer with whatever is queued, then start */
+    ret = transfer(stream, stream->buffer_size, 0);
+    if (ret == 0)
+        ret = pcm_start(stream->pcm);
+    if (ret < 0) {
+        ALOGE("cannot start pcm: %s", pcm_get_error(stream->pcm));
+        return ret;
+    }
+    stream->running = 1;
+    return 0;
+}
+
+static void *pump_thread(void *arg)
+{
+    struct mmap_stream *stream = arg;
+    unsigned int period_ms;
+
+    if (stream->fifo_priority > 0) {
+        struct sched_param param;
+
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = stream->fifo_priority;
+        if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0)
+            ALOGW("cannot set SCHED_FIFO priority %d", stream->fifo_priority);
+    }
+
+    while (!android_atomic_acquire_load(&stream->exiting)) {
+        unsigned int avail;
+        unsigned int queued;
+        unsigned int target;
+        struct timespec ts;
+        int ret;
+
+        if (android_atomic_acquire_load(&stream->standby_request)) {
+            handle_standby(stream);
+            continue;
+        }
+
+        if (!stream->running) {
+            if (spsc_ring_readable(&stream->ring) < stream->min_period) {
+                android_atomic_release_store(1, &stream->pump_idle);
+                /* recheck to close the race with a writer that just queued */
+                if (spsc_ring_readable(&stream->ring) < stream->min_period &&
+                        !android_atomic_acquire_load(&stream->exiting) &&
+                        !android_atomic_acquire_load(&stream->standby_request)) {
+                    sem_wait(&stream->data_sem);
+                } else if (android_atomic_cmpxchg(1, 0, &stream->pump_idle) != 0) {
+                    /* a writer already cleared the flag and posted */
+                    sem_wait(&stream->data_sem);
+                }
+                continue;
+            }
+            if (start_pcm(stream) < 0)
+                usleep(stream->period * 1000000LL / stream->config.rate);
+            continue;
+        }
+
+        period_ms = stream->period * 1000 / stream->config.rate + 1;
+        ret = pcm_wait(stream->pcm, period_ms * WAIT_TIMEOUT_PERIODS);
+        if (ret == 0) {
+            ALOGW("pcm_wait timed out after %u ms", period_ms * WAIT_TIMEOUT_PERIODS);
+            continue;
+        }
+        if (ret < 0 ||
+                pcm_get_htimestamp(stream->pcm, &avail, &ts) < 0) {
+            stream->xruns++;
+            adapt_period(stream, 1, 0);
+            stop_pcm(stream, 1);
+            continue;
+        }
+
+        /* keep two pump periods queued in the kernel */
+        queued = stream->buffer_size - avail;
+        target = 2 * stream->period;
+        if (target > stream->buffer_size)
+            target = stream->buffer_size;
+        if (queued >= target) {
+            usleep((queued - target + stream->period / 2) * 1000000LL /
+                   stream->config.rate);
+            continue;
+        }
+
+        ret = transfer(stream, target - queued, 1);
+        if (ret < 0) {
+            stream->xruns++;
+            adapt_period(stream, 1, 0);
+            stop_pcm(stream, 1);
+            continue;
+        }
+        adapt_period(stream, 0, target - queued);
+        publish_snapshot(stream, avail - (target - queued), &ts);
+    }
+
+    stop_pcm(stream, 0);
+    return NULL;
+}
+
+struct mmap_stream *mmap_stream_open(const struct mmap_stream_config *config)
+{
+    struct mmap_stream *stream;
+    unsigned int ring_frames;
+
+    if (config->pcm.period_size == 0 || config->pcm.rate == 0)
+        return NULL;
+
+    stream = calloc(1, sizeof(*stream));
+    if (!stream)
+        return NULL;
+
+    stream->config = config->pcm;
+    stream->config.avail_min = config->pcm.period_size;
+    stream->period = config->pcm.period_size;
+    stream->min_period = config->min_period_size ?: config->pcm.period_size;
+    stream->max_period = config->max_period_size ?: config->pcm.period_size;
+    stream->fifo_priority = config->fifo_priority;
+
+    stream->pcm = pcm_open(config->card, config->device,
+                           config->pcm_flags | PCM_OUT | PCM_MMAP | PCM_MONOTONIC,
+                           &stream->config);
+    if (!stream->pcm || !pcm_is_ready(stream->pcm)) {
+        ALOGE("cannot open pcm %u,%u: %s", config->card, config->device,
+              stream->pcm ? pcm_get_error(stream->pcm) : "no memory");
+        goto err_pcm;
+    }
+
+    stream->frame_size = pcm_frames_to_bytes(stream->pcm, 1);
+    stream->buffer_size = pcm_get_buffer_size(stream->pcm);
+    if (stream->max_period > stream->buffer_size / 2)
+        stream->max_period = stream->buffer_size / 2;
+    if (stream->min_period > stream->max_period)
+        stream->min_period = stream->max_period;
+    if (stream->period > stream->max_period)
+        stream->period = stream->max_period;
+
+    ring_frames = round_up_pow2(config->ring_frames ?: 2 * stream->buffer_size);
+    stream->ring_buffer = malloc(ring_frames * stream->frame_size);
+    if (!stream->ring_buffer)
+        goto err_ring;
+    spsc_ring_init(&stream->ring, ring_frames, stream->frame_size,
+                   stream->ring_buffer);
+
+    sem_init(&stream->data_sem, 0, 0);
+    sem_init(&stream->space_sem, 0, 0);
+    sem_init(&stream->standby_sem, 0, 0);
+    publish_snapshot(stream, stream->buffer_size, NULL);
+
+    if (pthread_create(&stream->thread, NULL, pump_thread, stream) != 0) {
+        ALOGE("cannot create pump thread");
+        goto err_thread;
+    }
+
+    ALOGV("opened pcm %u,%u: buffer %u frames, period %u..%u frames, ring %u frames",
+          config->card, config->device, stream->buffer_size, stream->min_period,
+          stream->max_period, ring_frames);
+    return stream;
+
+err_thread:
+    sem_destroy(&stream->standby_sem);
+    sem_destroy(&stream->space_sem);
+    sem_destroy(&stream->data_sem);
+    free(stream->ring_buffer);
+err_ring:
+    pcm_close(stream->pcm);
+err_pcm:
+    free(stream);
+    return NULL;
+}
+
+void mmap_stream_close(struct mmap_stream *stream)
+{
+    if (!stream)
+        return;
+
+    android_atomic_release_store(1, &stream->exiting);
+    wake_pump(stream);
+    pthread_join(stream->thread, NULL);
+
+    sem_destroy(&stream->standby_sem);
+    sem_destroy(&stream->space_sem);
+    sem_destroy(&stream->data_sem);
+    pcm_close(stream->pcm);
+    free(stream->ring_buffer);
+    free(stream);
+}
+
+ssize_t mmap_stream_write(struct mmap_stream *stream, const void *buffer,
+                          size_t bytes)
+{
+    const uint8_t *data = buffer;
+    uint32_t frames = bytes / stream->frame_size;
+    uint32_t done = 0;
+    int32_t seq;
+
+    while (done < frames) {
+        done += spsc_ring_write(&stream->ring, data + done * stream->frame_size,
+                                frames - done);
+        if (spsc_ring_readable(&stream->ring) >= stream->min_period)
+            wake_pump(stream);
+        if (done == frames)
+            break;
+
+        /* ring is full: sleep until the pump has consumed a period */
+        android_atomic_release_store(1, &stream->writer_waiting);
+        if (spsc_ring_writable(&stream->ring) == 0) {
+            wake_pump(stream);
+            sem_wait(&stream->space_sem);
+        } else if (android_atomic_cmpxchg(1, 0, &stream->writer_waiting) != 0) {
+            /* the pump already cleared the flag and posted */
+            sem_wait(&stream->space_sem);
+        }
+    }
+
+    seq = stream->written_seq;
+    android_atomic_release_store(seq + 1, &stream->written_seq);
+    android_memory_barrier();
+    stream->frames_written += frames;
+    android_atomic_release_store(seq + 2, &stream->written_seq);
+    return frames * stream->frame_size;
+}
+
+int mmap_stream_standby(struct mmap_stream *stream)
+{
+    android_atomic_release_store(1, &stream->standby_request);
+    wake_pump(stream);
+    sem_wait(&stream->standby_sem);
+    return 0;
+}
+
+int mmap_stream_get_presentation_position(const struct mmap_stream *stream,
+                                          uint64_t *frames,
+                                          struct timespec *timestamp)
+{
+    int32_t seq;
+    int valid;
+
+    do {
+        seq = android_atomic_acquire_load(&stream->snapshot_seq);
+        valid = stream->snapshot.valid;
+        *frames = stream->snapshot.presented;
+        *timestamp = stream->snapshot.timestamp;
+        /* keep the reads above from moving past the re-check */
+        android_memory_barrier();
+    } while ((seq & 1) ||
+             seq != android_atomic_acquire_load(&stream->snapshot_seq));
+
+    return valid ? 0 : -ENODATA;
+}
+
+void mmap_stream_get_stats(const struct mmap_stream *stream,
+                           struct mmap_stream_stats *stats)
+{
+    int32_t seq;
+
+    do {
+        seq = android_atomic_acquire_load(&stream->snapshot_seq);
+        *stats = stream->snapshot.stats;
+        android_memory_barrier();
+    } while ((seq & 1) ||
+             seq != android_atomic_acquire_load(&stream->snapshot_seq));
+
+    do {
+        seq = android_atomic_acquire_load(&stream->written_seq);
+        stats->frames_written = stream->frames_written;
+        android_memory_barrier();
+    } while ((seq & 1) ||
+             seq != android_atomic_acquire_load(&stream->written_seq));
+}
+
+size_t mmap_stream_frame_size(const struct mmap_stream *stream)
+{
+    return stream->frame_size;
+}
@@ -0,0 +1,543 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "offload_buffers"
+/*#define LOG_NDEBUG 0*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include <alsa_utils/offload_buffers.h>
+
+/* give up waiting for the DSP after this many buffer durations */
+#define WAIT_TIMEOUT_BUFFERS 2
+
+/* shortest sleep while the DSP is late to move its pointer */
+#define MIN_SLEEP_NS 1000000LL
+
+struct offload_buffers {
+    struct pcm *pcm;
+    unsigned int rate;
+    unsigned int period;            /* frames per buffer */
+    unsigned int count;             /* number of buffers */
+    unsigned int buffer_size;       /* kernel buffer, frames */
+    unsigned int start_buffers;
+    size_t frame_size;
+    size_t buffer_bytes;
+    uint8_t *base;                  /* start of the mmap area */
+    offload_callback_t callback;
+    void *cookie;
+#ifdef QCOM_DIRECTTRACK
+    struct buf_info info;
+#endif
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;            /* queued, released, flushed or exiting */
+
+    /* guarded by lock */
+    int exiting;
+    int running;
+    int draining;
+    uint32_t generation;            /* bumped by every flush */
+    uint32_t committed;             /* buffers handed to the DSP */
+    uint32_t released;              /* buffers returned to the client */
+    unsigned int *slots;            /* slot of buffer n at slots[n % count] */
+    uint64_t committed_frames;
+    uint64_t silence;               /* padding of short buffers */
+    uint64_t discarded;             /* frames dropped by flush */
+    uint64_t presented;
+    unsigned int in_flight;
+    struct timespec timestamp;
+    int timestamp_valid;
+
+    /* owned by the client thread */
+    int dequeued;                   /* slot returned by dequeue, or -1 */
+};
+
+static unsigned int pending(const struct offload_buffers *ob)
+{
+    return ob->committed - ob->released;
+}
+
+static void update_presented(struct offload_buffers *ob, unsigned int in_flight,
+                             const struct timespec *ts)
+{
+    uint64_t presented = ob->committed_frames - ob->silence - ob->discarded;
+
+    presented = presented > in_flight ? presented - in_flight : 0;
+    /* never let the reported position go backwards */
+    if (presented > ob->presented)
+        ob->presented = presented;
+    ob->in_flight = in_flight;
+    if (ts) {
+        ob->timestamp = *ts;
+        ob->timestamp_valid = 1;
+    }
+}
+
+/* Stop the PCM and give every queued buffer back.  Called with lock held. */
+static void stop_locked(struct offload_buffers *ob, int discard)
+{
+    unsigned int avail;
+    struct timespec ts;
+
+    if (discard && ob->running &&
+            pcm_get_htimestamp(ob->pcm, &avail, &ts) == 0 &&
+            avail < ob->buffer_size)
+        ob->discarded += ob->buffer_size - avail;
+    pcm_stop(ob->pcm);
+    ob->running = 0;
+    ob->draining = 0;
+    ob->released = ob->committed;
+    update_presented(ob, 0, NULL);
+}
+
+static int start_locked(struct offload_buffers *ob)
+{
+    if (ob->running || pending(ob) == 0)
+        return 0;
+    if (pcm_start(ob->pcm) < 0) {
+        ALOGE("cannot start pcm: %s", pcm_get_error(ob->pcm));
+        return -EIO;
+    }
+    ob->running = 1;
+    pthread_cond_broadcast(&ob->cond);
+    return 0;
+}
+
+/*
+ * pcm_wait() returns whenever a buffer is free, not when the oldest queued
+ * one has been played, so it returns at once for as long as the client has
+ * not refilled.  Sleep until the DSP, at its pointer as of ts, plays frames
+ * more frames, or until a flush.  Called with lock held.
+ */
+static void sleep_frames_locked(struct offload_buffers *ob, unsigned int frames,
+                                const struct timespec *ts)
+{
+    uint32_t generation = ob->generation;
+    struct timespec now, deadline;
+    int64_t ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = (int64_t)frames * 1000000000 / ob->rate -
+         ((int64_t)(now.tv_sec - ts->tv_sec) * 1000000000 +
+          (now.tv_nsec - ts->tv_nsec));
+    if (ns < MIN_SLEEP_NS)
+        ns = MIN_SLEEP_NS;
+
+    /* the condition waits on CLOCK_REALTIME */
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec += ns % 1000000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (!ob->exiting && ob->running && generation == ob->generation)
+        if (pthread_cond_timedwait(&ob->cond, &ob->lock, &deadline) == ETIMEDOUT)
+            break;
+}
+
+static void notify(struct offload_buffers *ob, enum offload_event event, int arg)
+{
+    if (ob->callback)
+        ob->callback(ob->cookie, event, arg);
+}
+
+static void *completion_thread(void *context)
+{
+    struct offload_buffers *ob = context;
+    int timeout_ms = (ob->period * 1000 / ob->rate ?: 1) * WAIT_TIMEOUT_BUFFERS;
+
+    pthread_mutex_lock(&ob->lock);
+    while (!ob->exiting) {
+        uint32_t generation, first, done;
+        enum offload_event end = OFFLOAD_EVENT_BUFFER_AVAILABLE;
+        unsigned int avail, left = 0;
+        struct timespec ts;
+        int ret;
+
+        /* sleep without a timeout until there is something to complete */
+        if (!ob->running || pending(ob) == 0) {
+            pthread_cond_wait(&ob->cond, &ob->lock);
+            continue;
+        }
+
+        generation = ob->generation;
+        pthread_mutex_unlock(&ob->lock);
+        ret = pcm_wait(ob->pcm, timeout_ms);
+        pthread_mutex_lock(&ob->lock);
+
+        if (ob->exiting || generation != ob->generation || !ob->running)
+            continue;
+        if (ret == 0) {
+            ALOGW("pcm_wait timed out after %d ms", timeout_ms);
+            continue;
+        }
+
+        first = ob->released;
+        if (ret < 0 || pcm_get_htimestamp(ob->pcm, &avail, &ts) < 0) {
+            /* the DSP ran dry: everything queued has been played */
+            end = ob->draining ? OFFLOAD_EVENT_DRAINED : OFFLOAD_EVENT_UNDERRUN;
+            stop_locked(ob, 0);
+        } else {
+            unsigned int in_flight = ob->buffer_size - avail;
+            unsigned int queued = pending(ob) * ob->period;
+            unsigned int consumed = queued > in_flight ? queued - in_flight : 0;
+
+            ob->released += consumed / ob->period;
+            update_presented(ob, in_flight, &ts);
+            if (ob->draining && pending(ob) == 0) {
+                end = OFFLOAD_EVENT_DRAINED;
+                stop_locked(ob, 0);
+            } else if (pending(ob)) {
+                /* what is left of the oldest buffer */
+                left = in_flight - (pending(ob) - 1) * ob->period;
+            }
+        }
+        done = ob->released;
+        if (done == first && end == OFFLOAD_EVENT_BUFFER_AVAILABLE) {
+            if (left)
+                sleep_frames_locked(ob, left, &ts);
+            continue;
+        }
+        pthread_cond_broadcast(&ob->cond);
+
+        pthread_mutex_unlock(&ob->lock);
+        for (; first != done; first++)
+            notify(ob, OFFLOAD_EVENT_BUFFER_AVAILABLE,
+                   ob->slots[first % ob->count]);
+        if (end != OFFLOAD_EVENT_BUFFER_AVAILABLE) {
+            ALOGV("%s after %llu frames",
+                  end == OFFLOAD_EVENT_DRAINED ? "drained" : "underrun",
+                  (unsigned long long)ob->presented);
+            notify(ob, end, 0);
+        }
+        pthread_mutex_lock(&ob->lock);
+    }
+    pthread_mutex_unlock(&ob->lock);
+    return NULL;
+}
+
+struct offload_buffers *offload_buffers_open(
+        const struct offload_buffers_config *config)
+{
+    struct offload_buffers *ob;
+    struct pcm_config pcm_config;
+    void *areas;
+    unsigned int offset, frames;
+
+    if (!config->pcm || pcm_get_config(config->pcm, &pcm_config) < 0 ||
+            pcm_config.period_size == 0 || pcm_config.period_count == 0 ||
+            pcm_config.rate == 0)
+        return NULL;
+
+    ob = calloc(1, sizeof(*ob));
+    if (!ob)
+        return NULL;
+
+    ob->pcm = config->pcm;
+    ob->rate = pcm_config.rate;
+    ob->period = pcm_config.period_size;
+    ob->buffer_size = pcm_get_buffer_size(ob->pcm);
+    ob->count = ob->buffer_size / ob->period;
+    ob->frame_size = pcm_frames_to_bytes(ob->pcm, 1);
+    ob->buffer_bytes = ob->period * ob->frame_size;
+    ob->start_buffers = config->start_buffers ?: 2;
+    if (ob->start_buffers > ob->count)
+        ob->start_buffers = ob->count;
+    ob->callback = config->callback;
+    ob->cookie = config->cookie;
+    ob->dequeued = -1;
+
+    if (ob->count == 0 || ob->buffer_size % ob->period != 0) {
+        ALOGE("buffer of %u frames is not a multiple of the %u frame period",
+              ob->buffer_size, ob->period);
+        goto err_free;
+    }
+
+    /* nothing is queued yet, so this only maps the area */
+    frames = ob->buffer_size;
+    if (pcm_mmap_begin(ob->pcm, &areas, &offset, &frames) < 0) {
+        ALOGE("cannot map pcm buffer: %s", pcm_get_error(ob->pcm));
+        goto err_free;
+    }
+    ob->base = areas;
+
+    ob->slots = calloc(ob->count, sizeof(*ob->slots));
+    if (!ob->slots)
+        goto err_free;
+
+#ifdef QCOM_DIRECTTRACK
+    ob->info.buffers = calloc(ob->count, sizeof(*ob->info.buffers));
+    if (!ob->info.buffers)
+        goto err_slots;
+    for (offset = 0; offset < ob->count; offset++)
+        ob->info.buffers[offset] = offload_buffers_get(ob, offset);
+    ob->info.bufsize = ob->buffer_bytes;
+    ob->info.nBufs = ob->count;
+#endif
+
+    pthread_mutex_init(&ob->lock, NULL);
+    pthread_cond_init(&ob->cond, NULL);
+    if (pthread_create(&ob->thread, NULL, completion_thread, ob) != 0) {
+        ALOGE("cannot create completion thread");
+        goto err_thread;
+    }
+
+    ALOGV("%u buffers of %u frames, start after %u", ob->count, ob->period,
+          ob->start_buffers);
+    return ob;
+
+err_thread:
+    pthread_cond_destroy(&ob->cond);
+    pthread_mutex_destroy(&ob->lock);
+#ifdef QCOM_DIRECTTRACK
+    free(ob->info.buffers);
+err_slots:
+#endif
+    free(ob->slots);
+err_free:
+    free(ob);
+    return NULL;
+}
+
+void offload_buffers_close(struct offload_buffers *ob)
+{
+    if (!ob)
+        return;
+
+    pthread_mutex_lock(&ob->lock);
+    ob->exiting = 1;
+    stop_locked(ob, 1);
+    pthread_cond_broadcast(&ob->cond);
+    pthread_mutex_unlock(&ob->lock);
+    pthread_join(ob->thread, NULL);
+
+    pthread_cond_destroy(&ob->cond);
+    pthread_mutex_destroy(&ob->lock);
+#ifdef QCOM_DIRECTTRACK
+    free(ob->info.buffers);
+#endif
+    free(ob->slots);
+    free(ob);
+}
+
+unsigned int offload_buffers_count(const struct offload_buffers *ob)
+{
+    return ob->count;
+}
+
+size_t offload_buffers_size(const struct offload_buffers *ob)
+{
+    return ob->buffer_bytes;
+}
+
+void *offload_buffers_get(const struct offload_buffers *ob, unsigned int index)
+{
+    if (index >= ob->count)
+        return NULL;
+    return ob->base + index * ob->buffer_bytes;
+}
+
+#ifdef QCOM_DIRECTTRACK
+int offload_buffers_get_info(struct offload_buffers *ob, struct buf_info **info)
+{
+    *info = &ob->info;
+    return 0;
+}
+#endif
+
+int offload_buffers_is_available(struct offload_buffers *ob, int *available,
+                                 int wait)
+{
+    uint32_t generation;
+
+    pthread_mutex_lock(&ob->lock);
+    generation = ob->generation;
+    while (wait && pending(ob) >= ob->count && !ob->exiting &&
+            generation == ob->generation)
+        pthread_cond_wait(&ob->cond, &ob->lock);
+    *available = pending(ob) < ob->count;
+    pthread_mutex_unlock(&ob->lock);
+    return 0;
+}
+
+int offload_buffers_dequeue(struct offload_buffers *ob)
+{
+    uint32_t generation;
+    void *areas;
+    unsigned int offset, frames;
+    int ret = 0;
+
+    if (ob->dequeued >= 0)
+        return ob->dequeued;
+
+    pthread_mutex_lock(&ob->lock);
+    generation = ob->generation;
+    while (pending(ob) >= ob->count) {
+        if (ob->exiting || generation != ob->generation) {
+            ret = -EINTR;
+            goto out;
+        }
+        pthread_cond_wait(&ob->cond, &ob->lock);
+    }
+
+    /* frames is in and out: the most we want, then what we got */
+    frames = ob->period;
+    ret = pcm_mmap_begin(ob->pcm, &areas, &offset, &frames);
+    if (ret < 0) {
+        ALOGE("pcm_mmap_begin failed: %s", pcm_get_error(ob->pcm));
+        goto out;
+    }
+    if (offset % ob->period != 0 || frames < ob->period) {
+        ALOGE("pcm offset %u (%u frames) is not on a buffer boundary",
+              offset, frames);
+        ret = -EIO;
+        goto out;
+    }
+    ret = ob->dequeued = offset / ob->period;
+out:
+    pthread_mutex_unlock(&ob->lock);
+    return ret;
+}
+
+ssize_t offload_buffers_queue(struct offload_buffers *ob, const void *data,
+                              size_t bytes)
+{
+    uint8_t *buffer;
+    size_t used;
+    int slot;
+    int ret;
+
+    slot = offload_buffers_dequeue(ob);
+    if (slot < 0)
+        return slot;
+
+    buffer = offload_buffers_get(ob, slot);
+    used = bytes < ob->buffer_bytes ? bytes : ob->buffer_bytes;
+    used -= used % ob->frame_size;
+    if (data != buffer)
+        memcpy(buffer, data, used);
+    if (used < ob->buffer_bytes)
+        memset(buffer + used, 0, ob->buffer_bytes - used);
+
+    pthread_mutex_lock(&ob->lock);
+    ob->dequeued = -1;
+    ret = pcm_mmap_commit(ob->pcm, slot * ob->period, ob->period);
+    if (ret < 0) {
+        ALOGE("pcm_mmap_commit failed: %s", pcm_get_error(ob->pcm));
+        pthread_mutex_unlock(&ob->lock);
+        return ret;
+    }
+    ob->slots[ob->committed % ob->count] = slot;
+    ob->committed++;
+    ob->committed_frames += ob->period;
+    ob->silence += (ob->buffer_bytes - used) / ob->frame_size;
+    if (pending(ob) >= ob->start_buffers)
+        ret = start_locked(ob);
+    /* only a running, empty queue leaves the completion thread waiting for this */
+    if (pending(ob) == 1)
+        pthread_cond_broadcast(&ob->cond);
+    pthread_mutex_unlock(&ob->lock);
+
+    return ret < 0 ? ret : (ssize_t)used;
+}
+
+int offload_buffers_drain(struct offload_buffers *ob)
+{
+    int ret = 0;
+    int drained;
+
+    pthread_mutex_lock(&ob->lock);
+    drained = pending(ob) == 0;
+    if (!drained) {
+        ob->draining = 1;
+        ret = start_locked(ob);
+    }
+    pthread_mutex_unlock(&ob->lock);
+
+    if (drained)
+        notify(ob, OFFLOAD_EVENT_DRAINED, 0);
+    return ret;
+}
+
+int offload_buffers_flush(struct offload_buffers *ob)
+{
+    pthread_mutex_lock(&ob->lock);
+    ob->generation++;
+    stop_locked(ob, 1);
+    pthread_cond_broadcast(&ob->cond);
+    pthread_mutex_unlock(&ob->lock);
+    return 0;
+}
+
+int offload_buffers_get_presentation_position(struct offload_buffers *ob,
+                                              uint64_t *frames,
+                                              struct timespec *timestamp)
+{
+    unsigned int avail;
+    struct timespec ts;
+    int ret = -ENODATA;
+
+    pthread_mutex_lock(&ob->lock);
+    if (ob->running && pcm_get_htimestamp(ob->pcm, &avail, &ts) == 0)
+        update_presented(ob, ob->buffer_size - avail, &ts);
+    if (ob->timestamp_valid) {
+        *frames = ob->presented;
+        *timestamp = ob->timestamp;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&ob->lock);
+    return ret;
+}
+
+int offload_buffers_get_time_stamp(struct offload_buffers *ob,
+                                   uint64_t *time_us)
+{
+    uint64_t frames;
+    struct timespec ts, now;
+    int64_t elapsed_us, in_flight_us;
+    int running;
+
+    if (offload_buffers_get_presentation_position(ob, &frames, &ts) < 0) {
+        *time_us = 0;
+        return 0;
+    }
+
+    pthread_mutex_lock(&ob->lock);
+    running = ob->running;
+    in_flight_us = (int64_t)ob->in_flight * 1000000 / ob->rate;
+    pthread_mutex_unlock(&ob->lock);
+
+    *time_us = frames * 1000000 / ob->rate;
+    if (running) {
+        /* the DSP kept playing since the hardware pointer was sampled */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        elapsed_us = (int64_t)(now.tv_sec - ts.tv_sec) * 1000000 +
+                     (now.tv_nsec - ts.tv_nsec) / 1000;
+        if (elapsed_us > in_flight_us)
+            elapsed_us = in_flight_us;
+        if (elapsed_us > 0)
+            *time_us += elapsed_us;
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <cutils/atomic.h>
+
+#include <alsa_utils/spsc_ring.h>
+
+int spsc_ring_init(struct spsc_ring *ring, uint32_t frame_count,
+                   uint32_t frame_size, void *buffer)
+{
+    if (frame_count == 0 || (frame_count & (frame_count - 1)) != 0 ||
+            frame_size == 0 || buffer == NULL)
+        return -EINVAL;
+
+    ring->front = 0;
+    ring->rear = 0;
+    ring->frame_count = frame_count;
+    ring->frame_size = frame_size;
+    ring->buffer = buffer;
+    return 0;
+}
+
+void spsc_ring_reset(struct spsc_ring *ring)
+{
+    android_atomic_release_store(0, &ring->front);
+    android_atomic_release_store(0, &ring->rear);
+}
+
+uint32_t spsc_ring_readable(const struct spsc_ring *ring)
+{
+    uint32_t rear = (uint32_t)android_atomic_acquire_load(&ring->rear);
+    uint32_t front = (uint32_t)android_atomic_acquire_load(&ring->front);
+
+    return rear - front;
+}
+
+uint32_t spsc_ring_writable(const struct spsc_ring *ring)
+{
+    return ring->frame_count - spsc_ring_readable(ring);
+}
+
+static uint32_t get_regions(const struct spsc_ring *ring, uint32_t index,
+                            uint32_t frames, struct spsc_ring_region regions[2])
+{
+    uint32_t offset = index & (ring->frame_count - 1);
+    uint32_t first = ring->frame_count - offset;
+
+    if (first > frames)
+        first = frames;
+    regions[0].data = (uint8_t *)ring->buffer + offset * ring->frame_size;
+    regions[0].frames = first;
+    regions[1].data = ring->buffer;
+    regions[1].frames = frames - first;
+    return frames;
+}
+
+uint32_t spsc_ring_write_regions(struct spsc_ring *ring, uint32_t frames,
+                                 struct spsc_ring_region regions[2])
+{
+    uint32_t avail = spsc_ring_writable(ring);
+
+    if (frames > avail)
+        frames = avail;
+    /* only the producer writes rear, so a plain read is enough here */
+    return get_regions(ring, (uint32_t)ring->rear, frames, regions);
+}
+
+void spsc_ring_write_advance(struct spsc_ring *ring, uint32_t frames)
+{
+    android_atomic_release_store((int32_t)((uint32_t)ring->rear + frames),
+                                 &ring->rear);
+}
+
+uint32_t spsc_ring_read_regions(struct spsc_ring *ring, uint32_t frames,
+                                struct spsc_ring_region regions[2])
+{
+    uint32_t avail = spsc_ring_readable(ring);
+
+    if (frames > avail)
+        frames = avail;
+    /* only the consumer writes front, so a plain read is enough here */
+    return get_regions(ring, (uint32_t)ring->front, frames, regions);
+}
+
+void spsc_ring_read_advance(struct spsc_ring *ring, uint32_t frames)
+{
+    android_atomic_release_store((int32_t)((uint32_t)ring->front + frames),
+                                 &ring->front);
+}
+
+uint32_t spsc_ring_write(struct spsc_ring *ring, const void *data,
+                         uint32_t frames)
+{
+    struct spsc_ring_region regions[2];
+    size_t first_bytes;
+
+    frames = spsc_ring_write_regions(ring, frames, regions);
+    if (frames == 0)
+        return 0;
+
+    first_bytes = regions[0].frames * ring->frame_size;
+    memcpy(regions[0].data, data, first_bytes);
+    if (regions[1].frames)
+        memcpy(regions[1].data, (const uint8_t *)data + first_bytes,
+               regions[1].frames * ring->frame_size);
+    spsc_ring_write_advance(ring, frames);
+    return frames;
+}
+
+uint32_t spsc_ring_read(struct spsc_ring *ring, void *data, uint32_t frames)
+{
+    struct spsc_ring_region regions[2];
+    size_t first_bytes;
+
+    frames = spsc_ring_read_regions(ring, frames, regions);
+    if (frames == 0)
+        return 0;
+
+    first_bytes = regions[0].frames * ring->frame_size;
+    memcpy(data, regions[0].data, first_bytes);
+    if (regions[1].frames)
+        memcpy((uint8_t *)data + first_bytes, regions[1].data,
+               regions[1].frames * ring->frame_size);
+    spsc_ring_read_advance(ring, frames);
+    return frames;
+}
@@ -0,0 +1,69 @@
+# Copyright 2014 The Android Open Source Project
+#
+# Host tests and benchmarks for libalsautils.  The ones that need a pcm run
+# against fake_pcm.c, a simulated DSP, instead of libtinyalsa.
+
+LOCAL_PATH := $(call my-dir)
+
+alsa_utils_test_includes := \
+	$(LOCAL_PATH)/../include \
+	external/tinyalsa/include
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := spsc_ring_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	spsc_ring_test.c \
+	../spsc_ring.c
+LOCAL_C_INCLUDES := $(alsa_utils_test_includes)
+LOCAL_STATIC_LIBRARIES := libcutils
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := mmap_stream_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	mmap_stream_bench.c \
+	fake_pcm.c \
+	../mmap_stream.c \
+	../spsc_ring.c
+LOCAL_C_INCLUDES := $(alsa_utils_test_includes)
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := format_convert_bench
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	format_convert_bench.c \
+	../format_convert.c
+LOCAL_C_INCLUDES := $(alsa_utils_test_includes)
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := offload_buffers_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	offload_buffers_test.c \
+	fake_pcm.c \
+	../offload_buffers.c
+LOCAL_C_INCLUDES := $(alsa_utils_test_includes)
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := listen_session_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_SRC_FILES := \
+	listen_session_test.c \
+	fake_pcm.c \
+	../listen_session.c \
+	../spsc_ring.c
+LOCAL_C_INCLUDES := $(alsa_utils_test_includes)
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+include $(BUILD_HOST_EXECUTABLE)
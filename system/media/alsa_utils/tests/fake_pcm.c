@@ -0,0 +1,445 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <sys/ioctl.h>
+#include <sound/asound.h>
+
+#include "fake_pcm.h"
+
+#define NSEC_PER_SEC 1000000000LL
+
+struct pcm {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        /* signalled on commit, start and stop */
+    struct pcm_config config;
+    unsigned int flags;
+    unsigned int buffer_size;
+    unsigned int frame_size;
+    unsigned int avail_min;
+    void *buffer;
+
+    int running;
+    int xrun;
+    uint32_t generation;        /* bumped by pcm_stop() */
+    int64_t start_ns;
+    uint64_t hw_base;           /* hw at the last start */
+    uint64_t hw;                /* frames played or captured */
+    uint64_t appl;              /* frames committed or read */
+
+    fake_pcm_source_t source;
+    void *cookie;
+    struct fake_pcm_stats stats;
+};
+
+static pthread_mutex_t last_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct pcm *last_pcm;
+static fake_pcm_source_t next_source;
+static void *next_cookie;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+static int64_t frames_to_ns(const struct pcm *pcm, uint64_t frames)
+{
+    return frames * NSEC_PER_SEC / pcm->config.rate;
+}
+
+static int is_capture(const struct pcm *pcm)
+{
+    return pcm->flags & PCM_IN;
+}
+
+/* Move hw to where the DSP is now.  Called with lock held. */
+static void update_locked(struct pcm *pcm)
+{
+    uint64_t hw;
+
+    if (!pcm->running)
+        return;
+
+    hw = pcm->hw_base +
+         (uint64_t)(now_ns() - pcm->start_ns) * pcm->config.rate / NSEC_PER_SEC;
+    if (!is_capture(pcm)) {
+        if (hw >= pcm->appl) {
+            /* ran dry */
+            hw = pcm->appl;
+            pcm->running = 0;
+            pcm->xrun = 1;
+            pcm->stats.xruns++;
+        }
+    } else if (hw - pcm->appl > pcm->buffer_size) {
+        /* not read in time: the oldest audio is overwritten */
+        pcm->appl = hw - pcm->buffer_size;
+        pcm->stats.xruns++;
+    }
+    pcm->hw = hw;
+    pcm->stats.frames = hw;
+}
+
+static unsigned int avail_locked(const struct pcm *pcm)
+{
+    if (is_capture(pcm))
+        return pcm->hw - pcm->appl;
+    return pcm->buffer_size - (pcm->appl - pcm->hw);
+}
+
+/* Sleep until deadline_ns or a signal.  Called with lock held. */
+static void wait_locked(struct pcm *pcm, int64_t deadline_ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = deadline_ns / NSEC_PER_SEC;
+    ts.tv_nsec = deadline_ns % NSEC_PER_SEC;
+    pthread_cond_timedwait(&pcm->cond, &pcm->lock, &ts);
+}
+
+void fake_pcm_set_source(fake_pcm_source_t source, void *cookie)
+{
+    next_source = source;
+    next_cookie = cookie;
+}
+
+void fake_pcm_get_stats(struct fake_pcm_stats *stats)
+{
+    pthread_mutex_lock(&last_lock);
+    pthread_mutex_lock(&last_pcm->lock);
+    update_locked(last_pcm);
+    *stats = last_pcm->stats;
+    pthread_mutex_unlock(&last_pcm->lock);
+    pthread_mutex_unlock(&last_lock);
+}
+
+uint64_t fake_pcm_thread_wakeups(void)
+{
+    long self = syscall(SYS_gettid);
+    uint64_t total = 0;
+    struct dirent *de;
+    DIR *dir;
+
+    dir = opendir("/proc/self/task");
+    if (!dir)
+        return 0;
+    while ((de = readdir(dir)) != NULL) {
+        char path[300], line[128];
+        unsigned long long n;
+        FILE *f;
+
+        if (de->d_name[0] == '.' || atol(de->d_name) == self)
+            continue;
+        snprintf(path, sizeof(path), "/proc/self/task/%s/status", de->d_name);
+        f = fopen(path, "r");
+        if (!f)
+            continue;
+        while (fgets(line, sizeof(line), f))
+            if (sscanf(line, "voluntary_ctxt_switches: %llu", &n) == 1)
+                total += n;
+        fclose(f);
+    }
+    closedir(dir);
+    return total;
+}
+
+uint64_t fake_pcm_thread_cpu_ns(void)
+{
+    struct timespec process, thread;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &process);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &thread);
+    return (process.tv_sec - thread.tv_sec) * NSEC_PER_SEC +
+           (process.tv_nsec - thread.tv_nsec);
+}
+
+struct pcm *pcm_open(unsigned int card, unsigned int device,
+                     unsigned int flags, struct pcm_config *config)
+{
+    static const unsigned int sample_bytes[PCM_FORMAT_MAX] = {
+        [PCM_FORMAT_S16_LE] = 2,
+        [PCM_FORMAT_S32_LE] = 4,
+        [PCM_FORMAT_S8] = 1,
+        [PCM_FORMAT_S24_LE] = 4,
+    };
+    pthread_condattr_t attr;
+    struct pcm *pcm;
+
+    if (config->format >= PCM_FORMAT_MAX || config->rate == 0 ||
+            config->period_size == 0)
+        return NULL;
+
+    pcm = calloc(1, sizeof(*pcm));
+    if (!pcm)
+        return NULL;
+    pcm->config = *config;
+    if (pcm->config.period_count == 0)
+        pcm->config.period_count = 4;
+    pcm->flags = flags;
+    pcm->buffer_size = pcm->config.period_size * pcm->config.period_count;
+    pcm->frame_size = pcm->config.channels * sample_bytes[config->format];
+    pcm->avail_min = config->avail_min > 0 ? (unsigned int)config->avail_min
+                                           : config->period_size;
+    pcm->buffer = calloc(pcm->buffer_size, pcm->frame_size);
+    if (!pcm->buffer) {
+        free(pcm);
+        return NULL;
+    }
+    pcm->source = next_source;
+    pcm->cookie = next_cookie;
+
+    pthread_mutex_init(&pcm->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&pcm->cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    pthread_mutex_lock(&last_lock);
+    last_pcm = pcm;
+    pthread_mutex_unlock(&last_lock);
+    return pcm;
+}
+
+int pcm_close(struct pcm *pcm)
+{
+    pthread_mutex_lock(&last_lock);
+    if (last_pcm == pcm)
+        last_pcm = NULL;
+    pthread_mutex_unlock(&last_lock);
+
+    pthread_cond_destroy(&pcm->cond);
+    pthread_mutex_destroy(&pcm->lock);
+    free(pcm->buffer);
+    free(pcm);
+    return 0;
+}
+
+int pcm_is_ready(struct pcm *pcm)
+{
+    return pcm != NULL;
+}
+
+const char *pcm_get_error(struct pcm *pcm)
+{
+    return "fake pcm error";
+}
+
+int pcm_get_config(struct pcm *pcm, struct pcm_config *config)
+{
+    *config = pcm->config;
+    return 0;
+}
+
+unsigned int pcm_get_buffer_size(struct pcm *pcm)
+{
+    return pcm->buffer_size;
+}
+
+unsigned int pcm_frames_to_bytes(struct pcm *pcm, unsigned int frames)
+{
+    return frames * pcm->frame_size;
+}
+
+int pcm_set_avail_min(struct pcm *pcm, int avail_min)
+{
+    pthread_mutex_lock(&pcm->lock);
+    pcm->avail_min = avail_min;
+    pthread_cond_broadcast(&pcm->cond);
+    pthread_mutex_unlock(&pcm->lock);
+    return 0;
+}
+
+int pcm_ioctl(struct pcm *pcm, int request, ...)
+{
+    if (request != (int)SNDRV_PCM_IOCTL_PREPARE) {
+        errno = EINVAL;
+        return -1;
+    }
+    pthread_mutex_lock(&pcm->lock);
+    pcm->xrun = 0;
+    pthread_mutex_unlock(&pcm->lock);
+    return 0;
+}
+
+/* Like tinyalsa's, this prepares the pcm first, so it also recovers an xrun. */
+int pcm_start(struct pcm *pcm)
+{
+    pthread_mutex_lock(&pcm->lock);
+    pcm->xrun = 0;
+    pcm->running = 1;
+    pcm->start_ns = now_ns();
+    pcm->hw_base = pcm->hw;
+    pthread_cond_broadcast(&pcm->cond);
+    pthread_mutex_unlock(&pcm->lock);
+    return 0;
+}
+
+int pcm_stop(struct pcm *pcm)
+{
+    pthread_mutex_lock(&pcm->lock);
+    update_locked(pcm);
+    /* whatever was queued is dropped */
+    if (is_capture(pcm))
+        pcm->appl = pcm->hw;
+    else
+        pcm->hw = pcm->appl;
+    pcm->running = 0;
+    pcm->xrun = 0;
+    pcm->generation++;
+    pthread_cond_broadcast(&pcm->cond);
+    pthread_mutex_unlock(&pcm->lock);
+    return 0;
+}
+
+int pcm_mmap_begin(struct pcm *pcm, void **areas, unsigned int *offset,
+                   unsigned int *frames)
+{
+    unsigned int avail, off;
+
+    pthread_mutex_lock(&pcm->lock);
+    update_locked(pcm);
+    avail = avail_locked(pcm);
+    off = pcm->appl % pcm->buffer_size;
+    if (*frames > avail)
+        *frames = avail;
+    if (*frames > pcm->buffer_size - off)
+        *frames = pcm->buffer_size - off;
+    *areas = pcm->buffer;
+    *offset = off;
+    pthread_mutex_unlock(&pcm->lock);
+    return 0;
+}
+
+int pcm_mmap_commit(struct pcm *pcm, unsigned int offset, unsigned int frames)
+{
+    pthread_mutex_lock(&pcm->lock);
+    pcm->appl += frames;
+    pthread_cond_broadcast(&pcm->cond);
+    pthread_mutex_unlock(&pcm->lock);
+    return frames;
+}
+
+int pcm_wait(struct pcm *pcm, int timeout)
+{
+    int64_t timeout_ns = now_ns() + timeout * 1000000LL;
+    int ret;
+
+    pthread_mutex_lock(&pcm->lock);
+    for (;;) {
+        int64_t deadline_ns = timeout_ns;
+        unsigned int avail;
+
+        update_locked(pcm);
+        if (pcm->xrun) {
+            ret = -EPIPE;
+            break;
+        }
+        avail = avail_locked(pcm);
+        if (avail >= pcm->avail_min) {
+            ret = 1;
+            break;
+        }
+        if (now_ns() >= timeout_ns) {
+            ret = 0;
+            break;
+        }
+        if (pcm->running) {
+            /* when the DSP will have made room, or run dry */
+            uint64_t need = pcm->avail_min - avail;
+            int64_t when;
+
+            if (!is_capture(pcm) && pcm->appl - pcm->hw < need)
+                need = pcm->appl - pcm->hw;
+            when = pcm->start_ns +
+                   frames_to_ns(pcm, pcm->hw + need - pcm->hw_base) + 1;
+            if (when < deadline_ns)
+                deadline_ns = when;
+        }
+        wait_locked(pcm, deadline_ns);
+    }
+    pthread_mutex_unlock(&pcm->lock);
+    return ret;
+}
+
+int pcm_get_htimestamp(struct pcm *pcm, unsigned int *avail,
+                       struct timespec *tstamp)
+{
+    int64_t ns;
+
+    pthread_mutex_lock(&pcm->lock);
+    update_locked(pcm);
+    if (pcm->xrun) {
+        pthread_mutex_unlock(&pcm->lock);
+        return -1;
+    }
+    *avail = avail_locked(pcm);
+    /* the time at which the DSP reached hw */
+    ns = pcm->running ? pcm->start_ns + frames_to_ns(pcm, pcm->hw - pcm->hw_base)
+                      : now_ns();
+    tstamp->tv_sec = ns / NSEC_PER_SEC;
+    tstamp->tv_nsec = ns % NSEC_PER_SEC;
+    pthread_mutex_unlock(&pcm->lock);
+    return 0;
+}
+
+int pcm_read(struct pcm *pcm, void *data, unsigned int count)
+{
+    unsigned int frames = count / pcm->frame_size;
+    uint32_t generation;
+
+    pthread_mutex_lock(&pcm->lock);
+    if (!pcm->running) {
+        pcm->running = 1;
+        pcm->start_ns = now_ns();
+        pcm->hw_base = pcm->hw;
+    }
+    generation = pcm->generation;
+    for (;;) {
+        unsigned int avail;
+
+        update_locked(pcm);
+        avail = avail_locked(pcm);
+        if (avail >= frames)
+            break;
+        if (pcm->generation != generation || !pcm->running) {
+            /* stopped under us, as by another thread's pcm_stop() */
+            pthread_mutex_unlock(&pcm->lock);
+            errno = EBADFD;
+            return -1;
+        }
+        wait_locked(pcm, pcm->start_ns +
+                    frames_to_ns(pcm, pcm->appl + frames - pcm->hw_base) + 1);
+    }
+    if (pcm->source)
+        pcm->source(pcm->cookie, data, frames, pcm->appl);
+    else
+        memset(data, 0, count);
+    pcm->appl += frames;
+    pthread_mutex_unlock(&pcm->lock);
+    return 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ALSA_UTILS_FAKE_PCM_H
+#define ANDROID_ALSA_UTILS_FAKE_PCM_H
+
+#include <stdint.h>
+
+#include <tinyalsa/asoundlib.h>
+
+/*
+ * A stand-in for the tinyalsa pcm functions the library uses, for the host
+ * tests.  Each pcm is a simulated DSP that plays or captures config.rate
+ * frames per second of CLOCK_MONOTONIC time once started.  A playback pcm
+ * whose buffer runs dry stops with an xrun, like one whose stop_threshold is
+ * the buffer size; a capture pcm that is not read in time drops the oldest
+ * audio and counts an overrun.
+ */
+
+/* Fills frames frames of capture data, starting at frame position. */
+typedef void (*fake_pcm_source_t)(void *cookie, void *data,
+                                  unsigned int frames, uint64_t position);
+
+struct fake_pcm_stats {
+    uint64_t frames;            /* frames played or captured */
+    uint32_t xruns;             /* underruns or overruns */
+};
+
+/* Source for capture pcms opened from now on; silence by default. */
+void fake_pcm_set_source(fake_pcm_source_t source, void *cookie);
+
+/* Stats of the most recently opened pcm, which must still be open. */
+void fake_pcm_get_stats(struct fake_pcm_stats *stats);
+
+/*
+ * Times the threads of the process other than the caller have gone to
+ * sleep, from /proc: with the test in one thread, the wakeups of the
+ * library's own threads.
+ */
+uint64_t fake_pcm_thread_wakeups(void);
+
+/* CPU time of the threads of the process other than the caller, in ns. */
+uint64_t fake_pcm_thread_cpu_ns(void);
+
+#endif // ANDROID_ALSA_UTILS_FAKE_PCM_H
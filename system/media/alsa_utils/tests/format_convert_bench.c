@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * format_convert_bench: frames per second for each conversion pair the
+ * HALs use, converting BENCH_FRAMES frames per call.
+ *
+ * Each pair is also checked against itself one frame at a time.  A single
+ * frame is shorter than any vector, so that run only uses the scalar tails
+ * and the NEON/SSE2 kernels must give the same output bit for bit.  Exits
+ * with 1 if they do not.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <alsa_utils/format_convert.h>
+
+#define BENCH_FRAMES    1024
+#define BENCH_SECONDS   0.2
+
+struct pair {
+    const char *name;
+    enum sample_format src;
+    enum sample_format dst;
+    audio_channel_mask_t src_mask;
+    audio_channel_mask_t dst_mask;
+};
+
+#define STEREO  AUDIO_CHANNEL_OUT_STEREO
+#define MONO    AUDIO_CHANNEL_OUT_MONO
+#define SURROUND AUDIO_CHANNEL_OUT_5POINT1
+
+static const struct pair pairs[] = {
+    { "s16 -> 8_24",            SAMPLE_FORMAT_S16,   SAMPLE_FORMAT_Q8_23, STEREO, STEREO },
+    { "8_24 -> s16",            SAMPLE_FORMAT_Q8_23, SAMPLE_FORMAT_S16,   STEREO, STEREO },
+    { "s16 -> s32",             SAMPLE_FORMAT_S16,   SAMPLE_FORMAT_S32,   STEREO, STEREO },
+    { "s32 -> s16",             SAMPLE_FORMAT_S32,   SAMPLE_FORMAT_S16,   STEREO, STEREO },
+    { "8_24 -> s32",            SAMPLE_FORMAT_Q8_23, SAMPLE_FORMAT_S32,   STEREO, STEREO },
+    { "s32 -> 8_24",            SAMPLE_FORMAT_S32,   SAMPLE_FORMAT_Q8_23, STEREO, STEREO },
+    { "s16 -> float",           SAMPLE_FORMAT_S16,   SAMPLE_FORMAT_FLOAT, STEREO, STEREO },
+    { "float -> s16",           SAMPLE_FORMAT_FLOAT, SAMPLE_FORMAT_S16,   STEREO, STEREO },
+    { "s32 -> float",           SAMPLE_FORMAT_S32,   SAMPLE_FORMAT_FLOAT, STEREO, STEREO },
+    { "float -> s32",           SAMPLE_FORMAT_FLOAT, SAMPLE_FORMAT_S32,   STEREO, STEREO },
+    { "u8 -> s16",              SAMPLE_FORMAT_U8,    SAMPLE_FORMAT_S16,   STEREO, STEREO },
+    { "s16 stereo -> mono",     SAMPLE_FORMAT_S16,   SAMPLE_FORMAT_S16,   STEREO, MONO },
+    { "s16 mono -> stereo",     SAMPLE_FORMAT_S16,   SAMPLE_FORMAT_S16,   MONO,   STEREO },
+    { "s16 5.1 -> stereo",      SAMPLE_FORMAT_S16,   SAMPLE_FORMAT_S16,   SURROUND, STEREO },
+    { "float 5.1 -> s16 stereo", SAMPLE_FORMAT_FLOAT, SAMPLE_FORMAT_S16,  SURROUND, STEREO },
+    { "8_24 stereo -> s16 mono", SAMPLE_FORMAT_Q8_23, SAMPLE_FORMAT_S16,  STEREO, MONO },
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Full-scale noise, with the extremes included to exercise saturation. */
+static void fill_source(void *buffer, enum sample_format format, size_t samples)
+{
+    size_t i;
+
+    srand(1);
+    for (i = 0; i < samples; i++) {
+        int32_t r = (int32_t)((uint32_t)rand() << 16 ^ (uint32_t)rand());
+
+        if (i % 97 == 0)
+            r = INT32_MAX;
+        else if (i % 89 == 0)
+            r = INT32_MIN;
+        switch (format) {
+        case SAMPLE_FORMAT_S16:
+            ((int16_t *)buffer)[i] = r >> 16;
+            break;
+        case SAMPLE_FORMAT_Q8_23:
+            ((int32_t *)buffer)[i] = r >> 8;
+            break;
+        case SAMPLE_FORMAT_S32:
+            ((int32_t *)buffer)[i] = r;
+            break;
+        case SAMPLE_FORMAT_FLOAT:
+            /* a little past full scale too */
+            ((float *)buffer)[i] = r / 2147483648.0f * 1.01f;
+            break;
+        case SAMPLE_FORMAT_S8:
+            ((int8_t *)buffer)[i] = r >> 24;
+            break;
+        case SAMPLE_FORMAT_U8:
+            ((uint8_t *)buffer)[i] = (r >> 24) + 128;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static int run_pair(const struct pair *pair)
+{
+    struct format_converter_config config;
+    struct format_converter *converter;
+    size_t src_frame, dst_frame, i;
+    uint8_t *src, *dst, *ref;
+    double start, elapsed;
+    unsigned long calls = 0;
+    int ret = 0;
+
+    memset(&config, 0, sizeof(config));
+    config.src_format = pair->src;
+    config.dst_format = pair->dst;
+    config.src_channel_mask = pair->src_mask;
+    config.dst_channel_mask = pair->dst_mask;
+    config.dither = FORMAT_DITHER_NONE;
+    converter = format_converter_create(&config);
+    if (!converter) {
+        printf("%-26s cannot create\n", pair->name);
+        return 1;
+    }
+    src_frame = format_converter_src_frame_size(converter);
+    dst_frame = format_converter_dst_frame_size(converter);
+    src = malloc(BENCH_FRAMES * src_frame);
+    dst = malloc(BENCH_FRAMES * dst_frame);
+    ref = malloc(BENCH_FRAMES * dst_frame);
+    fill_source(src, pair->src,
+                BENCH_FRAMES * src_frame / sample_format_bytes(pair->src));
+
+    /* vector kernels against the scalar tails */
+    format_converter_process(converter, dst, src, BENCH_FRAMES);
+    for (i = 0; i < BENCH_FRAMES; i++)
+        format_converter_process(converter, ref + i * dst_frame,
+                                 src + i * src_frame, 1);
+    if (memcmp(dst, ref, BENCH_FRAMES * dst_frame)) {
+        for (i = 0; i < BENCH_FRAMES * dst_frame; i++)
+            if (dst[i] != ref[i])
+                break;
+        printf("%-26s MISMATCH at frame %zu\n", pair->name, i / dst_frame);
+        ret = 1;
+    }
+
+    start = now();
+    do {
+        format_converter_process(converter, dst, src, BENCH_FRAMES);
+        calls++;
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+    printf("%-26s %8.1f Mframes/s\n", pair->name,
+           calls * BENCH_FRAMES / elapsed / 1e6);
+
+    free(ref);
+    free(dst);
+    free(src);
+    format_converter_destroy(converter);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    size_t i;
+    int failed = 0;
+
+#if defined(__ARM_NEON__)
+    printf("kernels: NEON\n");
+#elif defined(__SSE2__)
+    printf("kernels: SSE2\n");
+#else
+    printf("kernels: scalar\n");
+#endif
+    for (i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++)
+        failed |= run_pair(&pairs[i]);
+    if (failed)
+        printf("FAIL\n");
+    return failed;
+}
@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * listen_session_test: listen on a simulated capture pcm (see fake_pcm.h)
+ * whose left channel counts frames and whose right channel marks the
+ * keyword, with a software detector that looks for the mark.  Checks that:
+ *
+ *   - the capture thread wakes about once per period and otherwise sleeps
+ *   - the keyword is reported within a period or so of being captured
+ *   - the reader gets exactly the pre-roll, then the live audio behind it
+ *     with no frame lost or repeated
+ *   - after a rearm, listen_session_trigger() fires at the next period
+ *
+ * and reports the wakeups per second and CPU time while listening.
+ */
+
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <alsa_utils/listen_session.h>
+
+#include "fake_pcm.h"
+
+#define RATE            16000
+#define CHANNELS        2
+#define PERIOD          320
+#define PREROLL_MS      500
+#define KEYWORD         1
+#define KEYWORD_FRAME   (RATE * 3 / 2)
+#define TRIGGER_KEYWORD 7
+#define LIVE_MS         500
+
+#define PREROLL_FRAMES  (RATE * PREROLL_MS / 1000)
+#define PERIOD_MS       (PERIOD * 1000 / RATE)
+
+/*
+ * Limits before the test fails.  Scheduling delays on a loaded host can add
+ * tens of ms to a wakeup, but the capture thread should never need more than
+ * the one wakeup per period the period size buys.
+ */
+#define MAX_WAKEUPS_PER_PERIOD  1.5
+#define MAX_DETECT_LATE_MS      (2 * PERIOD_MS + 30)
+#define MAX_CPU_PERCENT         2
+
+static sem_t event_sem;
+static struct listen_event last_event;
+static uint64_t frames_at_event;
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+static void source(void *cookie, void *data, unsigned int frames,
+                   uint64_t position)
+{
+    int16_t *samples = data;
+    unsigned int i;
+
+    for (i = 0; i < frames; i++, position++) {
+        samples[i * CHANNELS] = (int16_t)position;
+        samples[i * CHANNELS + 1] = position == KEYWORD_FRAME;
+    }
+}
+
+static int detect(void *cookie, const void *frames, unsigned int count)
+{
+    const int16_t *samples = frames;
+    unsigned int i;
+
+    for (i = 0; i < count; i++)
+        if (samples[i * CHANNELS + 1])
+            return KEYWORD;
+    return 0;
+}
+
+static void callback(void *cookie, const struct listen_event *event)
+{
+    struct fake_pcm_stats stats;
+
+    if (event->type == LISTEN_EVENT_ERROR)
+        fail("capture error");
+    if (event->type != LISTEN_EVENT_DETECTED)
+        return;
+    fake_pcm_get_stats(&stats);
+    frames_at_event = stats.frames;
+    last_event = *event;
+    sem_post(&event_sem);
+}
+
+static int wait_event(int seconds)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += seconds;
+    return sem_timedwait(&event_sem, &ts);
+}
+
+static double ms_since(const struct timespec *start)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec - start->tv_sec) * 1000.0 +
+           (ts.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/* Read frames frames and check that they count up from first. */
+static void read_and_check(struct listen_session *session, uint64_t first,
+                           unsigned int frames)
+{
+    int16_t buffer[PERIOD * CHANNELS];
+    uint64_t expected = first;
+
+    while (frames) {
+        unsigned int want = frames < PERIOD ? frames : PERIOD;
+        ssize_t got = listen_session_read(session, buffer,
+                                          want * CHANNELS * sizeof(int16_t));
+        unsigned int i, n;
+
+        if (got <= 0) {
+            fail("read");
+            return;
+        }
+        n = got / (CHANNELS * sizeof(int16_t));
+        for (i = 0; i < n; i++, expected++) {
+            if (buffer[i * CHANNELS] != (int16_t)expected) {
+                printf("frame %llu reads as %d\n", (unsigned long long)expected,
+                       buffer[i * CHANNELS]);
+                fail("the reader lost or repeated audio");
+                return;
+            }
+        }
+        frames -= n;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct listen_session_config config;
+    struct listen_session_stats stats;
+    struct listen_session *session;
+    struct timespec start, trigger_time;
+    double listen_ms, wakeups, cpu, late_ms, trigger_ms;
+    uint64_t wakeups_before, cpu_before;
+
+    memset(&config, 0, sizeof(config));
+    config.pcm.channels = CHANNELS;
+    config.pcm.rate = RATE;
+    config.pcm.period_size = PERIOD;
+    config.pcm.period_count = 4;
+    config.pcm.format = PCM_FORMAT_S16_LE;
+    config.preroll_ms = PREROLL_MS;
+    config.detect = detect;
+    config.callback = callback;
+    sem_init(&event_sem, 0, 0);
+    fake_pcm_set_source(source, NULL);
+
+    session = listen_session_open(&config);
+    if (!session) {
+        printf("FAIL: cannot open\n");
+        return 1;
+    }
+
+    wakeups_before = fake_pcm_thread_wakeups();
+    cpu_before = fake_pcm_thread_cpu_ns();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    listen_session_start(session);
+    if (wait_event(5) < 0) {
+        fail("no detection");
+        listen_session_close(session);
+        return 1;
+    }
+    listen_ms = ms_since(&start);
+    wakeups = (fake_pcm_thread_wakeups() - wakeups_before) * 1000.0 / listen_ms;
+    cpu = (fake_pcm_thread_cpu_ns() - cpu_before) / 1e4 / listen_ms;
+    late_ms = ((double)frames_at_event - KEYWORD_FRAME) * 1000 / RATE;
+
+    printf("listening:        %.0f ms, %.1f wakeups/s for %.1f periods/s\n",
+           listen_ms, wakeups, (double)RATE / PERIOD);
+    printf("thread CPU:       %.2f%%\n", cpu);
+    printf("detected:         %.1f ms after the keyword, %u frames of pre-roll\n",
+           late_ms, last_event.preroll_frames);
+
+    if (wakeups > MAX_WAKEUPS_PER_PERIOD * RATE / PERIOD)
+        fail("the capture thread wakes more than once per period");
+    if (cpu > MAX_CPU_PERCENT)
+        fail("the capture thread spins");
+    if (last_event.keyword != KEYWORD)
+        fail("wrong keyword");
+    if (late_ms < 0 || late_ms > MAX_DETECT_LATE_MS)
+        fail("detection late");
+    if (last_event.preroll_frames != PREROLL_FRAMES)
+        fail("wrong pre-roll");
+
+    /* the pre-roll, then live audio up to LIVE_MS past the keyword */
+    read_and_check(session, last_event.position - last_event.preroll_frames,
+                   last_event.preroll_frames + RATE * LIVE_MS / 1000);
+
+    /* hand the ring back, then fire from outside as the DSP would */
+    listen_session_rearm(session);
+    clock_gettime(CLOCK_MONOTONIC, &trigger_time);
+    listen_session_trigger(session, TRIGGER_KEYWORD);
+    if (wait_event(1) < 0) {
+        fail("trigger ignored");
+    } else {
+        trigger_ms = ms_since(&trigger_time);
+        printf("triggered:        %.1f ms after listen_session_trigger()\n",
+               trigger_ms);
+        if (last_event.keyword != TRIGGER_KEYWORD)
+            fail("wrong trigger keyword");
+        if (trigger_ms > MAX_DETECT_LATE_MS)
+            fail("trigger late");
+        read_and_check(session, last_event.position - last_event.preroll_frames,
+                       last_event.preroll_frames + PERIOD);
+    }
+
+    listen_session_stop(session);
+    listen_session_get_stats(session, &stats);
+    printf("stats:            %u wakeups, %u detections, %u overruns, "
+           "%u errors\n", stats.wakeups, stats.detections, stats.overruns,
+           stats.errors);
+    if (stats.detections != 2)
+        fail("detection count");
+    if (stats.overruns || stats.errors)
+        fail("overruns or errors while the reader kept up");
+    listen_session_close(session);
+
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * mmap_stream_bench: play through mmap_stream into a simulated pcm (see
+ * fake_pcm.h) the way AudioFlinger writes to a HAL, and report how long
+ * write() blocks, the latency from write() to presentation, the pump's
+ * wakeups and the xruns.  With -s the writer stalls every second, which
+ * should cost ring underruns but no xruns once the period has grown.
+ * On a host the pump is not SCHED_FIFO, so scheduling delays alone cause
+ * the odd xrun at the smallest periods; each one should double the period.
+ *
+ * Fails if the presentation position ever goes backwards or gets ahead of
+ * the frames written, or if it does not reach the frames written once they
+ * have all played out, with the pump filling in silence behind them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <alsa_utils/mmap_stream.h>
+
+#include "fake_pcm.h"
+
+/* how long past the worst latency seen to wait for the writes to play out */
+#define DRAIN_MARGIN_MS 200
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: mmap_stream_bench [-d <seconds>] [-p <period frames>]"
+            " [-s <stall ms>]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    struct mmap_stream_config config;
+    struct mmap_stream_stats stats;
+    struct mmap_stream *stream;
+    unsigned int seconds = 5, period = 240, stall_ms = 0;
+    unsigned int burst, writes = 0;
+    int64_t start, max_block = 0, total_block = 0;
+    uint64_t last_presented = 0, wakeups;
+    double latency_sum = 0, latency_max = 0;
+    unsigned int latency_samples = 0;
+    struct timespec drained_ts;
+    int16_t *buffer;
+    int opt, errors = 0;
+
+    while ((opt = getopt(argc, argv, "d:p:s:")) != -1) {
+        switch (opt) {
+        case 'd': seconds = atoi(optarg); break;
+        case 'p': period = atoi(optarg); break;
+        case 's': stall_ms = atoi(optarg); break;
+        default: usage();
+        }
+    }
+
+    memset(&config, 0, sizeof(config));
+    config.pcm.channels = 2;
+    config.pcm.rate = 48000;
+    config.pcm.period_size = period;
+    config.pcm.period_count = 8;
+    config.pcm.format = PCM_FORMAT_S16_LE;
+    config.min_period_size = period;
+    config.max_period_size = period * 4;
+
+    stream = mmap_stream_open(&config);
+    if (!stream) {
+        fprintf(stderr, "cannot open the stream\n");
+        return 1;
+    }
+
+    /* AudioFlinger's normal mixer writes 20 ms at a time */
+    burst = config.pcm.rate / 50;
+    buffer = calloc(burst, mmap_stream_frame_size(stream));
+
+    start = now_ns();
+    while (now_ns() - start < seconds * 1000000000LL) {
+        uint64_t presented;
+        struct timespec ts;
+        int64_t t = now_ns();
+
+        mmap_stream_write(stream, buffer, burst * mmap_stream_frame_size(stream));
+        t = now_ns() - t;
+        total_block += t;
+        if (t > max_block)
+            max_block = t;
+        writes++;
+
+        if (mmap_stream_get_presentation_position(stream, &presented, &ts) == 0) {
+            /* frames written but not yet heard, at the time of ts */
+            uint64_t written = (uint64_t)writes * burst;
+            double ms;
+
+            if (presented < last_presented || presented > written) {
+                fprintf(stderr, "bad position %llu after %llu, %llu written\n",
+                        (unsigned long long)presented,
+                        (unsigned long long)last_presented,
+                        (unsigned long long)written);
+                errors++;
+            }
+            last_presented = presented;
+            ms = (written - presented) * 1000.0 / config.pcm.rate;
+            latency_sum += ms;
+            if (ms > latency_max)
+                latency_max = ms;
+            latency_samples++;
+        }
+
+        if (stall_ms && writes % 50 == 0)
+            usleep(stall_ms * 1000);
+    }
+
+    wakeups = fake_pcm_thread_wakeups();
+
+    /* the silence queued behind the last write is not presented audio */
+    usleep((unsigned int)(latency_max + DRAIN_MARGIN_MS) * 1000);
+    if (mmap_stream_get_presentation_position(stream, &last_presented,
+                                              &drained_ts) == 0 &&
+            last_presented != (uint64_t)writes * burst) {
+        fprintf(stderr, "position %llu after draining %llu frames\n",
+                (unsigned long long)last_presented,
+                (unsigned long long)writes * burst);
+        errors++;
+    }
+    mmap_stream_get_stats(stream, &stats);
+
+    printf("writes:          %u of %u frames\n", writes, burst);
+    printf("write() blocked: avg %.2f ms, max %.2f ms\n",
+           total_block / 1e6 / writes, max_block / 1e6);
+    if (latency_samples)
+        printf("latency:         avg %.2f ms, max %.2f ms\n",
+               latency_sum / latency_samples, latency_max);
+    printf("pump wakeups:    %.1f/s\n", wakeups / (double)seconds);
+    printf("xruns:           %u, ring underruns %u, %llu frames of silence\n",
+           stats.xruns, stats.ring_underruns,
+           (unsigned long long)stats.silence_frames);
+    printf("period:          %u frames\n", stats.period_size);
+
+    mmap_stream_close(stream);
+    free(buffer);
+    if (errors) {
+        printf("FAIL\n");
+        return 1;
+    }
+    return 0;
+}
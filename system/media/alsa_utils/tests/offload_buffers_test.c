@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * offload_buffers_test: feed offload_buffers the way the framework feeds a
+ * tunnel stream, filling each buffer in place from the callbacks, against a
+ * simulated DSP (see fake_pcm.h).  Checks that:
+ *
+ *   - every queued buffer comes back through the callback exactly once and
+ *     in order, and no underrun is reported while the client keeps up
+ *   - the callback comes soon after the DSP has played the buffer
+ *   - get_time_stamp() stays close to what the DSP has really played
+ *   - drain reports OFFLOAD_EVENT_DRAINED with every frame presented
+ *   - flush returns every buffer to the client
+ *
+ * and that the completion thread wakes about once per buffer played and
+ * does not spin in between.
+ */
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <alsa_utils/offload_buffers.h>
+
+#include "fake_pcm.h"
+
+#define RATE            44100
+#define PERIOD          4096
+#define PERIODS         4
+#define SECONDS         4
+
+/*
+ * Limits before the test fails.  A callback may be late by scheduling delays,
+ * but not by anything near a buffer, and the completion thread should wake
+ * about once per buffer and otherwise sleep.
+ */
+#define MAX_CALLBACK_LATE_MS    (PERIOD * 1000 / RATE / 2)
+#define MAX_TIMESTAMP_ERROR_MS  5
+#define MAX_WAKEUPS_PER_BUFFER  2
+#define MAX_CPU_PERCENT         5
+
+static struct offload_buffers *ob;
+static sem_t available_sem;
+static sem_t drained_sem;
+static unsigned int expected_slot[PERIODS];
+static uint32_t queued, returned;
+static uint32_t underruns;
+static double worst_late_ms;
+static int errors;
+
+static void fail(const char *what)
+{
+    printf("FAIL: %s\n", what);
+    errors++;
+}
+
+static void callback(void *cookie, enum offload_event event, int arg)
+{
+    struct fake_pcm_stats stats;
+    double late_ms;
+
+    switch (event) {
+    case OFFLOAD_EVENT_BUFFER_AVAILABLE:
+        if ((unsigned int)arg != expected_slot[returned % PERIODS])
+            fail("buffers returned out of order");
+        returned++;
+        /* the DSP should have played it just now */
+        fake_pcm_get_stats(&stats);
+        late_ms = ((double)stats.frames - (double)returned * PERIOD) * 1000 / RATE;
+        if (late_ms > worst_late_ms)
+            worst_late_ms = late_ms;
+        sem_post(&available_sem);
+        break;
+    case OFFLOAD_EVENT_DRAINED:
+        sem_post(&drained_sem);
+        break;
+    case OFFLOAD_EVENT_UNDERRUN:
+        underruns++;
+        break;
+    }
+}
+
+static int queue_one(void)
+{
+    int slot = offload_buffers_dequeue(ob);
+    int16_t *buffer;
+
+    if (slot < 0)
+        return slot;
+    /* fill it in place, as a client of get_buffer_info() would */
+    buffer = offload_buffers_get(ob, slot);
+    memset(buffer, 0, offload_buffers_size(ob));
+    expected_slot[queued % PERIODS] = slot;
+    queued++;
+    return offload_buffers_queue(ob, buffer, offload_buffers_size(ob));
+}
+
+static double timestamp_error_ms(void)
+{
+    struct fake_pcm_stats stats;
+    uint64_t time_us;
+
+    offload_buffers_get_time_stamp(ob, &time_us);
+    fake_pcm_get_stats(&stats);
+    return time_us / 1000.0 - stats.frames * 1000.0 / RATE;
+}
+
+int main(int argc, char **argv)
+{
+    struct pcm_config pcm_config;
+    struct offload_buffers_config config;
+    struct fake_pcm_stats stats;
+    struct timespec ts;
+    struct pcm *pcm;
+    double err, worst_err = 0, wakeups, cpu;
+    int64_t start;
+    uint64_t frames;
+    int available, i;
+
+    memset(&pcm_config, 0, sizeof(pcm_config));
+    pcm_config.channels = 2;
+    pcm_config.rate = RATE;
+    pcm_config.period_size = PERIOD;
+    pcm_config.period_count = PERIODS;
+    pcm_config.format = PCM_FORMAT_S16_LE;
+    pcm = pcm_open(0, 0, PCM_OUT | PCM_MMAP | PCM_MONOTONIC, &pcm_config);
+
+    memset(&config, 0, sizeof(config));
+    config.pcm = pcm;
+    config.callback = callback;
+    sem_init(&available_sem, 0, 0);
+    sem_init(&drained_sem, 0, 0);
+    ob = offload_buffers_open(&config);
+    if (!ob) {
+        printf("FAIL: cannot open\n");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    start = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+
+    /* fill every buffer, then one more each time the DSP frees one */
+    for (i = 0; i < PERIODS; i++)
+        if (queue_one() < 0)
+            fail("queue");
+    while (queued < (uint32_t)(SECONDS * RATE / PERIOD)) {
+        sem_wait(&available_sem);
+        err = timestamp_error_ms();
+        if (err < 0)
+            err = -err;
+        if (err > worst_err)
+            worst_err = err;
+        /* take a while to decode the next buffer, leaving one free meanwhile */
+        usleep(PERIOD * 1000000LL / RATE / 4);
+        if (queue_one() < 0)
+            fail("queue");
+    }
+
+    fake_pcm_get_stats(&stats);
+    wakeups = fake_pcm_thread_wakeups() * (double)RATE / stats.frames;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    cpu = fake_pcm_thread_cpu_ns() * 100.0 /
+          (ts.tv_sec * 1000000000LL + ts.tv_nsec - start);
+    printf("buffers:          %u of %u frames, %u returned\n", queued, PERIOD,
+           returned);
+    printf("wakeups:          %.1f/s for %.1f buffers/s\n", wakeups,
+           (double)RATE / PERIOD);
+    printf("thread CPU:       %.2f%%\n", cpu);
+    printf("callback late:    %.2f ms at worst\n", worst_late_ms);
+    printf("timestamp error:  %.2f ms at worst\n", worst_err);
+
+    offload_buffers_drain(ob);
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 2;
+    if (sem_timedwait(&drained_sem, &ts) < 0)
+        fail("no drained event");
+    if (returned != queued)
+        fail("not every buffer came back");
+    if (underruns)
+        fail("underrun while the client kept up");
+    if (worst_late_ms > MAX_CALLBACK_LATE_MS)
+        fail("callbacks late");
+    if (worst_err > MAX_TIMESTAMP_ERROR_MS)
+        fail("timestamps off");
+    if (wakeups > MAX_WAKEUPS_PER_BUFFER * (double)RATE / PERIOD)
+        fail("the completion thread polls");
+    if (cpu > MAX_CPU_PERCENT)
+        fail("the completion thread spins");
+    if (offload_buffers_get_presentation_position(ob, &frames, &ts) < 0 ||
+            frames != (uint64_t)queued * PERIOD)
+        fail("drain did not present every frame");
+
+    /* a flush hands every buffer back at once */
+    for (i = 0; i < PERIODS; i++)
+        if (queue_one() < 0)
+            fail("queue after drain");
+    offload_buffers_is_available(ob, &available, 0);
+    if (available)
+        fail("available with every buffer queued");
+    offload_buffers_flush(ob);
+    offload_buffers_is_available(ob, &available, 0);
+    if (!available)
+        fail("flush kept buffers");
+
+    offload_buffers_close(ob);
+    pcm_close(pcm);
+    if (errors)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * spsc_ring_test: run a producer and a consumer thread through one ring and
+ * check that every frame comes out once and in order, whichever mix of
+ * copying and zero-copy calls moved it.  Reports frames per second.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <alsa_utils/spsc_ring.h>
+
+#define RING_FRAMES     1024
+#define MAX_CHUNK       300
+
+static struct spsc_ring ring;
+static uint32_t total_frames = 50 * 1000 * 1000;
+
+/* xorshift, so each thread gets its own chunk sizes */
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void *producer(void *arg)
+{
+    uint32_t chunk[MAX_CHUNK];
+    uint32_t seed = 1, next = 0;
+
+    while (next < total_frames) {
+        uint32_t want = next_random(&seed) % MAX_CHUNK + 1;
+        uint32_t i, done;
+
+        if (want > total_frames - next)
+            want = total_frames - next;
+        if (want & 1) {
+            for (i = 0; i < want; i++)
+                chunk[i] = next + i;
+            done = spsc_ring_write(&ring, chunk, want);
+        } else {
+            struct spsc_ring_region regions[2];
+            uint32_t r, n = 0;
+
+            done = spsc_ring_write_regions(&ring, want, regions);
+            for (r = 0; r < 2; r++)
+                for (i = 0; i < regions[r].frames; i++)
+                    ((uint32_t *)regions[r].data)[i] = next + n++;
+            spsc_ring_write_advance(&ring, done);
+        }
+        next += done;
+        if (done == 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+static void *consumer(void *arg)
+{
+    uint32_t chunk[MAX_CHUNK];
+    uint32_t seed = 2, next = 0;
+    int errors = 0;
+
+    while (next < total_frames) {
+        uint32_t want = next_random(&seed) % MAX_CHUNK + 1;
+        uint32_t i, done;
+
+        if (want & 1) {
+            done = spsc_ring_read(&ring, chunk, want);
+            for (i = 0; i < done; i++)
+                if (chunk[i] != next + i)
+                    errors++;
+        } else {
+            struct spsc_ring_region regions[2];
+            uint32_t r, n = 0;
+
+            done = spsc_ring_read_regions(&ring, want, regions);
+            for (r = 0; r < 2; r++)
+                for (i = 0; i < regions[r].frames; i++)
+                    if (((uint32_t *)regions[r].data)[i] != next + n++)
+                        errors++;
+            spsc_ring_read_advance(&ring, done);
+        }
+        if (errors) {
+            /* the producer may be stuck on a full ring, so do not join it */
+            printf("FAIL: frame %u out of order\n", next);
+            exit(1);
+        }
+        next += done;
+        if (done == 0)
+            sched_yield();
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    static uint32_t buffer[RING_FRAMES];
+    struct timespec start, end;
+    pthread_t p, c;
+    double secs;
+
+    if (argc > 1)
+        total_frames = strtoul(argv[1], NULL, 0);
+
+    spsc_ring_init(&ring, RING_FRAMES, sizeof(uint32_t), buffer);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_create(&c, NULL, consumer, NULL);
+    pthread_create(&p, NULL, producer, NULL);
+    pthread_join(p, NULL);
+    pthread_join(c, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%u frames in %.3f s, %.1f Mframes/s\n", total_frames, secs,
+           total_frames / secs / 1e6);
+    return 0;
+}